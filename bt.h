@@ -18,6 +18,24 @@ typedef enum
 	LEAF_NODE		
 } NodeType;
 
+// Node layout.  By default the keys of a node are kept in an array of
+// their own, ahead of the record ids or child page ids, so that a search
+// runs over contiguous keys (see keysearch.h).  Build with
+// BT_INTERLEAVED_KEYS to keep each key next to its record id instead.
+
+#if !defined(BT_INTERLEAVED_KEYS)
+#define BT_SEPARATE_KEYS
+#endif
+
+// Nodes of in-memory trees are aligned to cache lines of this size, and
+// lookups prefetch nodes a line at a time.
+const int CACHE_LINE_SIZE = 64;
+
+// An entry is a key followed by its value; BTNodePage relies on the
+// key being the first field.  count, the number of leaf entries under
+// pid, is only stored by the index nodes of a counted tree (see
+// BTNodePage::SetType()); other index nodes end their entries at pid.
+
 struct LeafEntry {
     	int key;
 	RecordID rid;
@@ -26,6 +44,31 @@ struct LeafEntry {
 struct IndexEntry {
     	int key;
 	PageID pid;
+	int count;
+};
+
+// A change not yet made to the leaves of a buffered tree, waiting in the
+// buffer of an index node (see BTIndexPage::AddMessage()).
+
+typedef enum
+{
+	INSERT_MESSAGE,
+	DELETE_MESSAGE
+} MessageType;
+
+struct BTMessage {
+    	int key;
+	RecordID rid;
+	int type;
+};
+
+// A message a scan merges in, with where it was found: messages deeper
+// in the tree are older, and so are those earlier in a buffer.
+
+struct BTScanMessage {
+	BTMessage msg;
+	int depth;
+	int seq;
 };
 
 // There macros might be useful to you.
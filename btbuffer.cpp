@@ -0,0 +1,318 @@
+#include <limits.h>
+#include <string.h>
+#include "minirel.h"
+#include "bufmgr.h"
+#include "new_error.h"
+#include "btfile.h"
+
+
+//-------------------------------------------------------------------
+// BTreeFile::BufferMessage
+//
+// Input   : msg - an insert or delete for a buffered tree
+// Output  : None
+// Return  : OK if the message is in the buffer of the root, DONE if the
+//           root is a leaf and the change has to be made there, an
+//           error status otherwise.
+// Purpose : Put a message in the root, flushing some of its messages
+//           down first if its buffer is full.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::BufferMessage(const BTMessage &msg)
+{
+	BTIndexPage *root;
+	Status s;
+
+	for (;;)
+	{
+		s = PinNode(rootPid, (Page *&)root);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+		if (root->GetType() != INDEX_NODE)
+		{
+			UnpinNode((Page *)root, CLEAN);
+			return DONE;
+		}
+		if (!root->BufferIsFull())
+		{
+			root->AddMessage(msg);
+			UnpinNode((Page *)root, DIRTY);
+			return OK;
+		}
+		UnpinNode((Page *)root, CLEAN);
+
+		// A flush through to the leaves can split the root
+		s = FlushBuffer(rootPid);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+	}
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::FlushBuffer
+//
+// Input   : pid - an index node of a buffered tree
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Make room in the buffer of a node by moving the messages
+//           for the child that has the most of them down in one batch.
+//           An index child takes them into its own buffer, after its
+//           own flush if it is short of room.  Messages for a leaf are
+//           made, oldest first, through the usual insert and delete;
+//           the node is let go of first, as that may split it.  At
+//           least one message leaves the node.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::FlushBuffer(PageID pid)
+{
+	BTIndexPage *page;
+	BTNodePage *child;
+	BTMessage *msgs;
+	PageID childPid;
+	int i, from, n, best = 0, bestFrom = 0, bestN = 0, room;
+	Status s;
+
+	s = PinNode(pid, (Page *&)page);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	for (i = 0; i <= page->GetNumOfRecords(); i++)
+	{
+		page->ChildMessages(i, from, n);
+		if (n > bestN)
+		{
+			best = i;
+			bestFrom = from;
+			bestN = n;
+		}
+	}
+	if (bestN == 0)
+	{
+		UnpinNode((Page *)page, CLEAN);
+		return OK;
+	}
+
+	childPid = page->GetChild(best);
+	s = PinChild(page, best, child);
+	if (s != OK)
+	{
+		UnpinNode((Page *)page, CLEAN);
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	}
+
+	if (child->GetType() == INDEX_NODE)
+	{
+		BTIndexPage *indexChild = (BTIndexPage *)child;
+
+		// Moving only a few at a time would write the child for little
+		room = indexChild->GetMessageCapacity() - indexChild->GetNumOfMessages();
+		if (room < bestN && room < indexChild->GetMessageCapacity() / 4)
+		{
+			UnpinNode((Page *)child, CLEAN);
+			UnpinNode((Page *)page, CLEAN);
+			return FlushBuffer(childPid);
+		}
+
+		// The oldest messages go first if not all fit, so those left
+		// behind are still the newer ones
+		if (bestN > room)
+			bestN = room;
+		msgs = new BTMessage[bestN];
+		page->TakeMessages(bestFrom, bestN, msgs);
+		s = indexChild->AddMessages(msgs, bestN);
+		delete [] msgs;
+		UnpinNode((Page *)child, DIRTY);
+		UnpinNode((Page *)page, DIRTY);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+		return OK;
+	}
+
+	msgs = new BTMessage[bestN];
+	page->TakeMessages(bestFrom, bestN, msgs);
+	UnpinNode((Page *)child, CLEAN);
+	UnpinNode((Page *)page, DIRTY);
+
+	for (i = 0; i < bestN && s == OK; i++)
+	{
+		LeafEntry entry;
+
+		entry.key = msgs[i].key;
+		entry.rid = msgs[i].rid;
+		if (msgs[i].type == INSERT_MESSAGE)
+			s = InsertEntry(entry);
+		else
+			s = DeleteFromLeaf(entry);
+	}
+	delete [] msgs;
+
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::DeleteFromLeaf
+//
+// Input   : entry - the entry to delete
+// Output  : None
+// Return  : OK if successful (whether or not the entry was there), an
+//           error status otherwise.
+// Purpose : Make a delete message of a buffered tree, or a delete in a
+//           packed tree.  The leaves of a buffered tree are never
+//           merged, since that would move the keys that route messages,
+//           nor are those of a packed tree, which might not fit on one;
+//           so this only takes the entry out of its leaf.  Entries with
+//           its key start on the leaf a scan from it starts on, and may
+//           go on over the next leaves.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::DeleteFromLeaf(const LeafEntry entry)
+{
+	BTNodePage *page, *child;
+	BTLeafPage *leaf;
+	RecordID tRid;
+	Status s;
+
+	s = PinNode(rootPid, (Page *&)page);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	while (page->GetType() == INDEX_NODE)
+	{
+		BTIndexPage *indexPage = (BTIndexPage *)page;
+
+		s = PinChild(indexPage, indexPage->LowerBound(entry.key), child);
+		UnpinNode((Page *)page, CLEAN);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+		page = child;
+	}
+
+	leaf = (BTLeafPage *)page;
+	for (;;)
+	{
+		LeafEntry last;
+		PageID nextPid;
+
+		if (leaf->Delete(entry.key, entry.rid, tRid) == OK)
+		{
+			UnpinNode((Page *)leaf, DIRTY);
+			return OK;
+		}
+
+		// Done unless the entries with the key go on to the next leaf
+		nextPid = leaf->GetNextPage();
+		if (!leaf->IsEmpty())
+			leaf->GetEntry(leaf->GetNumOfRecords() - 1, last);
+		if (nextPid == INVALID_PAGE || (!leaf->IsEmpty() && last.key > entry.key))
+		{
+			UnpinNode((Page *)leaf, CLEAN);
+			return OK;
+		}
+
+		UnpinNode((Page *)leaf, CLEAN);
+		s = PinNode(nextPid, (Page *&)leaf);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+	}
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::GetMessages
+//
+// Input   : pid     - an index node of a buffered tree
+//           depth   - index nodes above it
+//           height  - index nodes on a path from the root to a leaf
+//           lowKey, highKey - a range, as for OpenScan()
+//           snap    - a snapshot to read, or NULL
+//           msgs, n - an array of n messages with room for max
+// Output  : msgs, n, max - with the messages in the range from the
+//                          subtree of pid added, the array grown as
+//                          needed
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Collect the messages a scan of the range has to merge:
+//           those in the buffers of the node and of the index nodes
+//           under it whose children can hold keys of the range.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::GetMessages(PageID pid, int depth, int height,
+                       const int *lowKey, const int *highKey,
+                       const BTSnapshot *snap, BTScanMessage *&msgs,
+                       int &n, int &max)
+{
+	BTIndexPage *page;
+	BTMessage msg;
+	PageID node;
+	int i, first, last;
+	Status s = OK;
+
+	node = (snap != NULL) ? SnapshotNode(snap, pid) : pid;
+	s = PinNode(node, (Page *&)page);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	i = (lowKey != NULL) ? page->MessageLowerBound(*lowKey) : 0;
+	for (; i < page->GetNumOfMessages(); i++)
+	{
+		page->GetMessage(i, msg);
+		if (highKey != NULL && msg.key > *highKey)
+			break;
+		AddScanMessage(msgs, n, max, msg, depth, i);
+	}
+
+	// The children are leaves, with no messages
+	if (depth + 1 >= height)
+	{
+		UnpinNode((Page *)page, CLEAN);
+		return OK;
+	}
+
+	first = (lowKey != NULL) ? page->FindInsertPos(*lowKey) : 0;
+	last = page->GetNumOfRecords();
+	if (highKey != NULL && *highKey < INT_MAX)
+		last = page->FindInsertPos(*highKey);
+	for (i = first; i <= last && s == OK; i++)
+		s = GetMessages(page->GetChild(i), depth + 1, height,
+		                lowKey, highKey, snap, msgs, n, max);
+
+	UnpinNode((Page *)page, CLEAN);
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::AddScanMessage
+//
+// Input   : msgs, n, max - an array of n messages with room for max
+//           msg, depth, seq - a message for a scan and where it is
+// Output  : msgs, n, max - with the message added, the array doubled
+//                          if it was full
+//-------------------------------------------------------------------
+
+void
+BTreeFile::AddScanMessage(BTScanMessage *&msgs, int &n, int &max,
+                          const BTMessage &msg, int depth, int seq)
+{
+	if (n == max)
+	{
+		BTScanMessage *larger = new BTScanMessage[2 * max];
+
+		memcpy(larger, msgs, n * sizeof(BTScanMessage));
+		delete [] msgs;
+		msgs = larger;
+		max *= 2;
+	}
+	msgs[n].msg = msg;
+	msgs[n].depth = depth;
+	msgs[n].seq = seq;
+	n++;
+}
@@ -0,0 +1,627 @@
+#include <stdlib.h>
+#include <string.h>
+#include "minirel.h"
+#include "bufmgr.h"
+#include "db.h"
+#include "new_error.h"
+#include "threads.h"
+#include "btfile.h"
+
+
+// Fewest entries worth a thread of their own when sorting.
+const int BULK_MIN_RUN = 16384;
+
+const int BULK_MAX_THREADS = 64;
+
+// Keys sampled from each sorted run to choose where the merge is split.
+const int BULK_SAMPLES = 64;
+
+// Bits of the key sorted on per pass of the radix sort.
+const int RADIX_BITS = 8;
+
+
+// What the threads of a bulk load share.  Thread i sorts run i of the
+// input, merges part i of the runs, then fills its share of the leaves.
+
+struct BulkLoadState {
+	const int      *keys;
+	const RecordID *rids;
+	int             n;
+	int             numOfThreads;
+
+	LeafEntry      *a;		// the runs, sorted in place
+	LeafEntry      *b;		// scratch for the sort, then the merge
+	LeafEntry      *sorted;	// a or b, all n entries in key order
+
+	// Part j of the merge is cuts[j*numOfThreads + i] up to
+	// cuts[(j+1)*numOfThreads + i] of each run i, and goes to
+	// sorted + offsets[j].
+	int            *cuts;
+	int            *offsets;
+
+	BTMemStore     *mem;
+	int             nodeSize;
+	Bool            counted;
+	Bool            buffered;
+	Bool            packed;
+	PageID         *leaves;
+	int             numOfLeaves;
+	int            *bounds;	// leaf k holds sorted[bounds[k]..bounds[k+1])
+	Status         *status;	// of each thread filling leaves
+};
+
+
+// First entry of run i of n entries cut into numOfRuns.
+static int RunStart(int n, int numOfRuns, int i)
+{
+	return (int)((double)n * i / numOfRuns);
+}
+
+
+// Radix digit of key, with the sign bit flipped so that negative keys
+// sort first.
+static int Digit(int key, int shift)
+{
+	return (((unsigned)key ^ 0x80000000u) >> shift) & ((1 << RADIX_BITS) - 1);
+}
+
+
+//-------------------------------------------------------------------
+// RadixSort
+//
+// Input   : entries - n entries
+//           scratch - room for n entries
+// Output  : entries - the same entries sorted by key; entries with
+//                     equal keys keep their order
+// Purpose : Sort by key, RADIX_BITS of it per pass, least significant
+//           first.  An even number of passes ends up back in entries.
+//-------------------------------------------------------------------
+
+static void RadixSort(LeafEntry *entries, LeafEntry *scratch, int n)
+{
+	int counts[1 << RADIX_BITS];
+
+	for (int shift = 0; shift < 32; shift += RADIX_BITS)
+	{
+		int i, sum = 0;
+
+		memset(counts, 0, sizeof(counts));
+		for (i = 0; i < n; i++)
+			counts[Digit(entries[i].key, shift)]++;
+		for (i = 0; i < (1 << RADIX_BITS); i++)
+		{
+			int c = counts[i];
+
+			counts[i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < n; i++)
+			scratch[counts[Digit(entries[i].key, shift)]++] = entries[i];
+
+		LeafEntry *t = entries;
+		entries = scratch;
+		scratch = t;
+	}
+}
+
+
+//-------------------------------------------------------------------
+// SortRun
+//
+// Input   : arg - the BulkLoadState
+//           i   - the run
+// Output  : None
+// Purpose : Copy run i of the input into a and sort it there.
+//-------------------------------------------------------------------
+
+static void SortRun(void *arg, int i)
+{
+	BulkLoadState *st = (BulkLoadState *)arg;
+	int lo = RunStart(st->n, st->numOfThreads, i);
+	int hi = RunStart(st->n, st->numOfThreads, i + 1);
+
+	for (int j = lo; j < hi; j++)
+	{
+		st->a[j].key = st->keys[j];
+		st->a[j].rid = st->rids[j];
+	}
+	RadixSort(st->a + lo, st->b + lo, hi - lo);
+}
+
+
+// Lowest position in sorted entries[lo..hi) whose key is not below key.
+static int LowerBound(const LeafEntry *entries, int lo, int hi, int key)
+{
+	while (lo < hi)
+	{
+		int mid = lo + (hi - lo) / 2;
+
+		if (entries[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+static int CompareInts(const void *x, const void *y)
+{
+	int a = *(const int *)x, b = *(const int *)y;
+
+	return (a < b) ? -1 : (a > b);
+}
+
+
+//-------------------------------------------------------------------
+// SplitRuns
+//
+// Input   : st - a BulkLoadState with its runs sorted
+// Output  : st->cuts, st->offsets
+// Return  : OK if successful, FAIL if out of memory.
+// Purpose : Cut the key range into one part per thread at keys sampled
+//           evenly from all runs, so that the parts come out about the
+//           same size, and find where each part starts in each run and
+//           in the merged output.  Equal keys all go to one part.
+//-------------------------------------------------------------------
+
+static Status SplitRuns(BulkLoadState *st)
+{
+	int t = st->numOfThreads;
+	int *samples = new int[t * BULK_SAMPLES];
+	int i, j;
+
+	if (samples == NULL)
+		return FAIL;
+
+	for (i = 0; i < t; i++)
+	{
+		int lo = RunStart(st->n, t, i);
+		int hi = RunStart(st->n, t, i + 1);
+
+		for (j = 0; j < BULK_SAMPLES; j++)
+			samples[i*BULK_SAMPLES + j] =
+			    st->a[lo + (int)((double)(hi - lo) * j / BULK_SAMPLES)].key;
+	}
+	qsort(samples, t * BULK_SAMPLES, sizeof(int), CompareInts);
+
+	for (i = 0; i < t; i++)
+	{
+		int lo = RunStart(st->n, t, i);
+		int hi = RunStart(st->n, t, i + 1);
+
+		st->cuts[i] = lo;
+		for (j = 1; j < t; j++)
+			st->cuts[j*t + i] = LowerBound(st->a, lo, hi,
+			                               samples[j*BULK_SAMPLES]);
+		st->cuts[t*t + i] = hi;
+	}
+
+	st->offsets[0] = 0;
+	for (j = 0; j < t; j++)
+	{
+		st->offsets[j + 1] = st->offsets[j];
+		for (i = 0; i < t; i++)
+			st->offsets[j + 1] += st->cuts[(j + 1)*t + i] - st->cuts[j*t + i];
+	}
+
+	delete [] samples;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// MergePart
+//
+// Input   : arg - the BulkLoadState
+//           j   - the part
+// Output  : None
+// Purpose : Merge part j of the sorted runs into b, with a heap of the
+//           runs ordered by their next key (and run, to keep equal
+//           keys in input order).
+//-------------------------------------------------------------------
+
+static void MergePart(void *arg, int j)
+{
+	BulkLoadState *st = (BulkLoadState *)arg;
+	int t = st->numOfThreads;
+	int *pos = new int[t];
+	int *end = new int[t];
+	int *heap = new int[t];
+	int size = 0;
+	LeafEntry *out = st->b + st->offsets[j];
+
+#define RUN_BEFORE(x, y) \
+	(st->a[pos[x]].key < st->a[pos[y]].key || \
+	 (st->a[pos[x]].key == st->a[pos[y]].key && (x) < (y)))
+
+	for (int i = 0; i < t; i++)
+	{
+		pos[i] = st->cuts[j*t + i];
+		end[i] = st->cuts[(j + 1)*t + i];
+		if (pos[i] == end[i])
+			continue;
+
+		// Sift up
+		int k = size++;
+		while (k > 0 && RUN_BEFORE(i, heap[(k - 1) / 2]))
+		{
+			heap[k] = heap[(k - 1) / 2];
+			k = (k - 1) / 2;
+		}
+		heap[k] = i;
+	}
+
+	while (size > 0)
+	{
+		int r = heap[0];
+
+		*out++ = st->a[pos[r]++];
+		if (pos[r] == end[r])
+			r = heap[--size];
+
+		// Sift r down from the top
+		int k = 0;
+		for (;;)
+		{
+			int c = 2*k + 1;
+
+			if (c >= size)
+				break;
+			if (c + 1 < size && RUN_BEFORE(heap[c + 1], heap[c]))
+				c++;
+			if (!RUN_BEFORE(heap[c], r))
+				break;
+			heap[k] = heap[c];
+			k = c;
+		}
+		if (size > 0)
+			heap[k] = r;
+	}
+
+#undef RUN_BEFORE
+
+	delete [] heap;
+	delete [] end;
+	delete [] pos;
+}
+
+
+//-------------------------------------------------------------------
+// FillLeaves
+//
+// Input   : arg - the BulkLoadState
+//           i   - the thread
+// Output  : None
+// Purpose : Write thread i's share of the leaves: leaf k holds sorted
+//           entries from bounds[k] on, and is linked to leaves k-1 and
+//           k+1.
+//-------------------------------------------------------------------
+
+static void FillLeaves(void *arg, int i)
+{
+	BulkLoadState *st = (BulkLoadState *)arg;
+	int first = RunStart(st->numOfLeaves, st->numOfThreads, i);
+	int last = RunStart(st->numOfLeaves, st->numOfThreads, i + 1);
+	Status s = OK;
+
+	for (int k = first; k < last && s == OK; k++)
+	{
+		PageID pid = st->leaves[k];
+		int lo = st->bounds[k];
+		int hi = st->bounds[k + 1];
+		BTLeafPage *leaf;
+
+		if (st->mem != NULL)
+			s = st->mem->GetNode(pid, (Page *&)leaf);
+		else
+			s = MINIBASE_BM->PinPage(pid, (Page *&)leaf, TRUE);
+		if (s != OK)
+			break;
+
+		leaf->Init(pid, st->nodeSize);
+		leaf->SetType(LEAF_NODE, st->counted, st->buffered, st->packed);
+		s = leaf->Append(st->sorted + lo, hi - lo);
+		if (k > 0)
+			leaf->SetPrevPage(st->leaves[k - 1]);
+		if (k + 1 < st->numOfLeaves)
+			leaf->SetNextPage(st->leaves[k + 1]);
+
+		if (st->mem == NULL)
+		{
+			Status u = MINIBASE_BM->UnpinPage(pid, DIRTY);
+			if (s == OK)
+				s = u;
+		}
+	}
+	st->status[i] = s;
+}
+
+
+//-------------------------------------------------------------------
+// PackLeaves
+//
+// Input   : sorted - n entries in key order
+//           size   - bytes per node
+// Output  : bounds - unless NULL, where each leaf starts, then n
+// Return  : How many packed leaves the entries fill, each taking as
+//           many of them in turn as fit.
+//-------------------------------------------------------------------
+
+static int PackLeaves(const LeafEntry *sorted, int n, int size, int *bounds)
+{
+	BTPackedRange range, wider;
+	int i = 0, k = 0, first;
+
+	while (i < n)
+	{
+		if (bounds != NULL)
+			bounds[k] = i;
+		first = i;
+		range.Start(sorted[i++]);
+		while (i < n)
+		{
+			wider = range;
+			wider.Add(sorted[i]);
+			if (i - first + 1 > BTNodePage::PackedCapacity(size, wider.Width()))
+				break;
+			range = wider;
+			i++;
+		}
+		k++;
+	}
+	if (bounds != NULL)
+		bounds[k] = n;
+	return k;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::BulkLoad
+//
+// Input   : keys, rids     - n entries, in any order
+//           numOfThreads   - threads to use, 0 for one per processor
+// Output  : None
+// Return  : OK if successful, FAIL if the tree is not empty, an error
+//           status otherwise.
+// Purpose : Build the tree from scratch out of n entries, much faster
+//           than inserting them one by one:
+//
+//           1. Each thread copies a run of the input and radix sorts
+//              it.
+//           2. The runs are cut at sampled keys into one part per
+//              thread, and each thread merges its part of all runs.
+//           3. The leaves, full, are allocated as one contiguous run of
+//              pages where the DB has one, and each thread writes and
+//              links its share of them.  Packed leaves hold different
+//              numbers of entries, found going through them in order.
+//           4. The index levels are built bottom up from the first key
+//              of each child.  The top node goes into the old root's
+//              page, which stays the root.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::BulkLoad(const int *keys, const RecordID *rids, int n,
+                    int numOfThreads)
+{
+	BulkLoadState st;
+	BTNodePage *root;
+	PageID *pids;
+	int *firstKeys, *counts;
+	int i, j, c, leafCapacity, indexCapacity;
+	Status s;
+
+	// A memory-mapped database is read-only
+	if (mem == NULL && MINIBASE_DB->IsMapped())
+		return FAIL;
+
+	// The tree is only empty if the delta buffer adds nothing to it
+	s = MergeDelta();
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	s = PinNode(rootPid, (Page *&)root);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	leafCapacity = root->GetCapacity();
+	if (root->GetType() != LEAF_NODE || !root->IsEmpty())
+	{
+		UnpinNode(rootPid, CLEAN);
+		return FAIL;
+	}
+	UnpinNode(rootPid, CLEAN);
+	if (n <= 0)
+		return OK;
+
+	if (numOfThreads <= 0)
+		numOfThreads = NumOfProcessors();
+	if (numOfThreads > n / BULK_MIN_RUN + 1)
+		numOfThreads = n / BULK_MIN_RUN + 1;
+	if (numOfThreads > BULK_MAX_THREADS)
+		numOfThreads = BULK_MAX_THREADS;
+
+	st.keys = keys;
+	st.rids = rids;
+	st.n = n;
+	st.numOfThreads = numOfThreads;
+	st.a = new LeafEntry[n];
+	st.b = new LeafEntry[n];
+	st.cuts = new int[(numOfThreads + 1) * numOfThreads];
+	st.offsets = new int[numOfThreads + 1];
+	st.mem = mem;
+	st.nodeSize = nodeSize;
+	st.counted = counted;
+	st.buffered = buffered;
+	st.packed = packed;
+	st.leaves = NULL;
+	st.bounds = NULL;
+	st.status = new Status[numOfThreads];
+	pids = firstKeys = counts = NULL;
+	if (st.a == NULL || st.b == NULL || st.cuts == NULL ||
+	    st.offsets == NULL || st.status == NULL)
+	{
+		s = FAIL;
+		goto done;
+	}
+
+	// Sort, and merge the sorted runs
+	RunThreads(numOfThreads, SortRun, &st);
+	if (numOfThreads == 1)
+		st.sorted = st.a;
+	else
+	{
+		s = SplitRuns(&st);
+		if (s != OK)
+			goto done;
+		RunThreads(numOfThreads, MergePart, &st);
+		st.sorted = st.b;
+	}
+
+	if (packed)
+		st.numOfLeaves = PackLeaves(st.sorted, n, nodeSize, NULL);
+	else
+		st.numOfLeaves = (n + leafCapacity - 1) / leafCapacity;
+	st.leaves = new PageID[st.numOfLeaves];
+	st.bounds = new int[st.numOfLeaves + 1];
+	if (st.leaves == NULL || st.bounds == NULL)
+	{
+		s = FAIL;
+		goto done;
+	}
+	if (packed)
+		PackLeaves(st.sorted, n, nodeSize, st.bounds);
+	else
+	{
+		for (i = 0; i <= st.numOfLeaves; i++)
+			st.bounds[i] = RunStart(n, st.numOfLeaves, i);
+	}
+
+	// Snapshots keep what they saw of the root before it is overwritten
+	writing = TRUE;
+	s = PinNode(rootPid, (Page *&)root);
+	writing = FALSE;
+	if (s != OK)
+		goto done;
+	UnpinNode(rootPid, CLEAN);
+
+	// A single leaf is the root itself; otherwise the leaves are new
+	if (st.numOfLeaves == 1)
+		st.leaves[0] = rootPid;
+	else if (mem != NULL)
+	{
+		for (i = 0; i < st.numOfLeaves && s == OK; i++)
+		{
+			Page *page;
+			s = mem->NewNode(st.leaves[i], page);
+		}
+	}
+	else if (MINIBASE_DB->AllocatePage(st.leaves[0], st.numOfLeaves) == OK)
+	{
+		for (i = 1; i < st.numOfLeaves; i++)
+			st.leaves[i] = st.leaves[0] + i;
+	}
+	else
+	{
+		for (i = 0; i < st.numOfLeaves && s == OK; i++)
+			s = MINIBASE_DB->AllocatePage(st.leaves[i]);
+	}
+	for (i = 0; i < st.numOfLeaves && s == OK; i++)
+		if (st.leaves[i] != rootPid)
+			s = NoCopyNeeded(st.leaves[i]);
+	if (s != OK)
+		goto done;
+
+	if (st.numOfLeaves < numOfThreads)
+		numOfThreads = st.numOfLeaves;
+	st.numOfThreads = numOfThreads;
+	RunThreads(numOfThreads, FillLeaves, &st);
+	for (i = 0; i < numOfThreads && s == OK; i++)
+		s = st.status[i];
+	if (s != OK)
+		goto done;
+
+	// The index levels, bottom up
+	c = st.numOfLeaves;
+	pids = new PageID[c];
+	firstKeys = new int[c];
+	counts = new int[c];
+	if (pids == NULL || firstKeys == NULL || counts == NULL)
+	{
+		s = FAIL;
+		goto done;
+	}
+	for (i = 0; i < c; i++)
+	{
+		pids[i] = st.leaves[i];
+		firstKeys[i] = st.sorted[st.bounds[i]].key;
+		counts[i] = st.bounds[i + 1] - st.bounds[i];
+	}
+
+	indexCapacity = BTNodePage::Capacity(INDEX_NODE, counted, nodeSize, buffered);
+	while (c > 1)
+	{
+		int m = (c + indexCapacity) / (indexCapacity + 1);
+
+		for (j = 0; j < m; j++)
+		{
+			BTIndexPage *node;
+			PageID pid;
+			RecordID tRid;
+			int lo = RunStart(c, m, j);
+			int hi = RunStart(c, m, j + 1);
+			int sum = counts[lo];
+
+			if (m == 1)
+			{
+				pid = rootPid;
+				s = PinNode(pid, (Page *&)node);
+			}
+			else
+				s = NewNode(pid, (Page *&)node);
+			if (s != OK)
+				goto done;
+
+			node->Init(pid, nodeSize);
+			node->SetType(INDEX_NODE, counted, buffered, packed);
+			node->SetLeftLink(pids[lo]);
+			if (counted)
+				node->SetChildCount(0, counts[lo]);
+			for (i = lo + 1; i < hi; i++)
+			{
+				IndexEntry entry;
+
+				entry.key = firstKeys[i];
+				entry.pid = pids[i];
+				entry.count = counts[i];
+				node->Insert(entry, tRid);
+				sum += counts[i];
+			}
+			UnpinNode(pid, DIRTY);
+
+			// Children lo.. are not needed any more
+			pids[j] = pid;
+			firstKeys[j] = firstKeys[lo];
+			counts[j] = sum;
+		}
+		c = m;
+	}
+
+	// The path to the rightmost leaf is not known
+	lastLeaf = INVALID_PAGE;
+	appends = 0;
+
+done:
+	delete [] counts;
+	delete [] firstKeys;
+	delete [] pids;
+	delete [] st.status;
+	delete [] st.bounds;
+	delete [] st.leaves;
+	delete [] st.offsets;
+	delete [] st.cuts;
+	delete [] st.b;
+	delete [] st.a;
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	return OK;
+}
@@ -0,0 +1,417 @@
+#include <limits.h>
+#include "minirel.h"
+#include "bufmgr.h"
+#include "new_error.h"
+#include "btfile.h"
+#include "btdelta.h"
+
+
+//-------------------------------------------------------------------
+// BTDeltaBuffer::BTDeltaBuffer
+//
+// Input   : None
+// Output  : None
+// Purpose : Make an empty buffer.
+//-------------------------------------------------------------------
+
+BTDeltaBuffer::BTDeltaBuffer()
+{
+	head = NewNode(DELTA_MAX_LEVEL);
+	level = 1;
+	count = 0;
+	seed = 2463534242u;
+}
+
+
+//-------------------------------------------------------------------
+// BTDeltaBuffer::~BTDeltaBuffer
+//
+// Input   : None
+// Output  : None
+// Purpose : Free the messages, which are lost.
+//-------------------------------------------------------------------
+
+BTDeltaBuffer::~BTDeltaBuffer()
+{
+	Clear();
+	delete [] (char *)head;
+}
+
+
+//-------------------------------------------------------------------
+// BTDeltaBuffer::NewNode
+//
+// Input   : level - number of levels the node is on
+// Output  : None
+// Return  : A node with room for level links, all NULL, or NULL if out
+//           of memory.
+//-------------------------------------------------------------------
+
+BTDeltaNode *BTDeltaBuffer::NewNode(int level)
+{
+	char *mem = new char[sizeof(BTDeltaNode) + (level - 1) * sizeof(BTDeltaNode *)];
+	BTDeltaNode *node = (BTDeltaNode *)mem;
+
+	if (node == NULL)
+		return NULL;
+	node->level = level;
+	for (int i = 0; i < level; i++)
+		node->next[i] = NULL;
+	return node;
+}
+
+
+//-------------------------------------------------------------------
+// BTDeltaBuffer::RandomLevel
+//
+// Input   : None
+// Output  : None
+// Return  : The number of levels for a new node: 1, and one more with
+//           probability 1/DELTA_BRANCHING each time.
+//-------------------------------------------------------------------
+
+int BTDeltaBuffer::RandomLevel()
+{
+	int l = 1;
+
+	// xorshift, so as not to disturb the caller's rand()
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	for (unsigned r = seed; l < DELTA_MAX_LEVEL && r % DELTA_BRANCHING == 0;
+	     r /= DELTA_BRANCHING)
+		l++;
+	return l;
+}
+
+
+//-------------------------------------------------------------------
+// BTDeltaBuffer::Add
+//
+// Input   : msg - an insert or delete
+// Output  : None
+// Purpose : Link a new node in after the last message with a key not
+//           larger than msg.key, on each of its levels.
+// Return  : OK if successful, FAIL if out of memory.
+//-------------------------------------------------------------------
+
+Status BTDeltaBuffer::Add(const BTMessage &msg)
+{
+	BTDeltaNode *update[DELTA_MAX_LEVEL];
+	BTDeltaNode *x = head, *node;
+	int i, l;
+
+	for (i = level - 1; i >= 0; i--)
+	{
+		while (x->next[i] != NULL && x->next[i]->msg.key <= msg.key)
+			x = x->next[i];
+		update[i] = x;
+	}
+
+	l = RandomLevel();
+	node = NewNode(l);
+	if (node == NULL)
+		return FAIL;
+	for (; level < l; level++)
+		update[level] = head;
+
+	node->msg = msg;
+	for (i = 0; i < l; i++)
+	{
+		node->next[i] = update[i]->next[i];
+		update[i]->next[i] = node;
+	}
+	count++;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTDeltaBuffer::Find
+//
+// Input   : key - a key
+// Output  : None
+// Return  : The first message whose key is not smaller than key, NULL
+//           if there is none.
+//-------------------------------------------------------------------
+
+BTDeltaNode *BTDeltaBuffer::Find(int key)
+{
+	BTDeltaNode *x = head;
+
+	for (int i = level - 1; i >= 0; i--)
+		while (x->next[i] != NULL && x->next[i]->msg.key < key)
+			x = x->next[i];
+	return x->next[0];
+}
+
+
+//-------------------------------------------------------------------
+// BTDeltaBuffer::Contains
+//
+// Input   : key - a key
+// Output  : None
+// Return  : TRUE if there is a message with key.
+//-------------------------------------------------------------------
+
+Bool BTDeltaBuffer::Contains(int key)
+{
+	BTDeltaNode *node = Find(key);
+
+	return node != NULL && node->msg.key == key;
+}
+
+
+//-------------------------------------------------------------------
+// BTDeltaBuffer::Clear
+//
+// Input   : None
+// Output  : None
+// Purpose : Throw all messages away.
+//-------------------------------------------------------------------
+
+void BTDeltaBuffer::Clear()
+{
+	BTDeltaNode *node = head->next[0], *next;
+
+	while (node != NULL)
+	{
+		next = node->next[0];
+		delete [] (char *)node;
+		node = next;
+	}
+	for (int i = 0; i < DELTA_MAX_LEVEL; i++)
+		head->next[i] = NULL;
+	level = 1;
+	count = 0;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::SetDeltaBuffer
+//
+// Input   : maxEntries - how many inserts and deletes the buffer holds
+//                        before they are merged into the tree, 0 for
+//                        no buffer
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Put a delta buffer in front of the tree, resize it, or take
+//           it away.  A buffer that is too full for its new size, or
+//           that is taken away, is merged first.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::SetDeltaBuffer(int maxEntries)
+{
+	Status s = OK;
+
+	if (maxEntries <= 0)
+	{
+		s = MergeDelta();
+		delete delta;
+		delta = NULL;
+		deltaCapacity = 0;
+	}
+	else
+	{
+		if (delta == NULL)
+			delta = new BTDeltaBuffer;
+		if (delta == NULL)
+			return FAIL;
+		deltaCapacity = maxEntries;
+		if (delta->GetNumOfMessages() >= deltaCapacity)
+			s = MergeDelta();
+	}
+
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::AddToDelta
+//
+// Input   : msg - an insert or delete
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Keep an insert or delete in the delta buffer, merging the
+//           buffer once it is full.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::AddToDelta(const BTMessage &msg)
+{
+	Status s;
+
+	s = delta->Add(msg);
+	if (s == OK && delta->GetNumOfMessages() >= deltaCapacity)
+		s = MergeDelta();
+
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::MergeDelta
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Make the inserts and deletes waiting in the delta buffer,
+//           in key order, and empty it.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::MergeDelta()
+{
+	BTMessage *msgs;
+	BTDeltaNode *node;
+	int i, n;
+	Status s;
+
+	if (delta == NULL || delta->GetNumOfMessages() == 0)
+		return OK;
+
+	n = delta->GetNumOfMessages();
+	msgs = new BTMessage[n];
+	if (msgs == NULL)
+		return FAIL;
+	for (i = 0, node = delta->First(); node != NULL; node = BTDeltaBuffer::Next(node))
+		msgs[i++] = node->msg;
+	delta->Clear();
+
+	writing = TRUE;
+	s = ApplySorted(msgs, n);
+	writing = FALSE;
+	delete [] msgs;
+
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::ApplySorted
+//
+// Input   : msgs - n inserts and deletes in key order, and for equal
+//                  keys in the order they were made
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Make a sorted batch of changes a leaf at a time.  Going
+//           down to the leaf of the next change also gives the key
+//           where that leaf's range ends, and the following changes
+//           up to that key are made on the leaf while it is pinned,
+//           and counted once in the nodes above in a counted tree.
+//           A change that would split the leaf or leave it less than
+//           half full (which a packed leaf may be) is left to Apply().  A buffered tree takes the
+//           changes one by one into the buffer of its root.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::ApplySorted(const BTMessage *msgs, int n)
+{
+	PageID path[BT_MAX_HEIGHT];
+	int pos[BT_MAX_HEIGHT];
+	BTNodePage *page, *child;
+	BTLeafPage *leaf;
+	RecordID tRid;
+	int i = 0, j, d, depth, high = 0, change;
+	Bool bounded;
+	Status s = OK;
+
+	while (i < n && s == OK)
+	{
+		if (buffered)
+		{
+			s = Apply(msgs[i++]);
+			continue;
+		}
+
+		s = PinNode(rootPid, (Page *&)page);
+		if (s != OK)
+			break;
+
+		// Down to the leaf, as do_insert() goes
+		depth = 0;
+		bounded = FALSE;
+		while (page->GetType() == INDEX_NODE && s == OK)
+		{
+			BTIndexPage *indexPage = (BTIndexPage *)page;
+			int p = indexPage->FindInsertPos(msgs[i].key);
+
+			if (p < indexPage->GetNumOfRecords())
+			{
+				IndexEntry entry;
+
+				indexPage->GetEntry(p, entry);
+				high = entry.key;
+				bounded = TRUE;
+			}
+			if (depth < BT_MAX_HEIGHT)
+			{
+				path[depth] = page->PageNo();
+				pos[depth] = p;
+			}
+			depth++;
+
+			s = PinChild(indexPage, p, child);
+			UnpinNode((Page *)page, CLEAN);
+			page = child;
+		}
+		if (s != OK)
+			break;
+		leaf = (BTLeafPage *)page;
+
+		// The changes for this leaf that it can take in place.  The
+		// counts of a tree too tall to remember the path are kept by
+		// Apply().
+		change = 0;
+		for (j = i; j < n && !(counted && depth > BT_MAX_HEIGHT); j++)
+		{
+			if (bounded && msgs[j].key >= high)
+				break;
+			if (msgs[j].type == INSERT_MESSAGE)
+			{
+				if (leaf->Insert(msgs[j].key, msgs[j].rid, tRid, packScratch) != OK)
+					break;
+				change++;
+			}
+			else
+			{
+				if (depth > 0 && !packed &&
+				    !(leaf->GetNumOfRecords() > leaf->MinEntries()))
+					break;
+				// An entry that is not here is looked for by Apply()
+				if (leaf->Delete(msgs[j].key, msgs[j].rid, tRid) != OK)
+					break;
+				change--;
+			}
+		}
+		UnpinNode((Page *)leaf, (j > i) ? DIRTY : CLEAN);
+
+		if (counted && change != 0)
+		{
+			for (d = 0; d < depth && s == OK; d++)
+			{
+				s = PinNode(path[d], (Page *&)page);
+				if (s != OK)
+					break;
+				((BTIndexPage *)page)->AddChildCount(pos[d], change);
+				UnpinNode((Page *)page, DIRTY);
+			}
+		}
+
+		// A change the leaf could not take splits or merges it
+		if (j == i && s == OK)
+			s = Apply(msgs[j++]);
+		i = j;
+	}
+
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	return OK;
+}
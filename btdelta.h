@@ -0,0 +1,55 @@
+#ifndef BTDELTA_H
+#define BTDELTA_H
+
+#include "minirel.h"
+#include "bt.h"
+
+
+// The write buffer of a BTreeFile (see BTreeFile::SetDeltaBuffer()): a
+// skiplist of inserts and deletes not yet made to the tree, in key order
+// and, for equal keys, oldest first.  A node has a random number of
+// levels, each one more with probability 1/DELTA_BRANCHING, and is
+// linked into the list of each of its levels.
+
+const int DELTA_MAX_LEVEL = 16;
+const int DELTA_BRANCHING = 4;
+
+struct BTDeltaNode {
+	BTMessage    msg;
+	int          level;
+	BTDeltaNode *next[1];	// level of them, allocated with the node
+};
+
+
+class BTDeltaBuffer {
+
+public:
+
+	BTDeltaBuffer();
+	~BTDeltaBuffer();
+
+	// Add a message after those with the same key.
+	Status Add(const BTMessage &msg);
+
+	// The first message with a key not smaller than key, NULL if none.
+	BTDeltaNode *Find(int key);
+	Bool         Contains(int key);
+
+	BTDeltaNode *First() { return head->next[0]; }
+	static BTDeltaNode *Next(BTDeltaNode *node) { return node->next[0]; }
+
+	int    GetNumOfMessages() { return count; }
+	void   Clear();
+
+private:
+
+	BTDeltaNode *head;	// DELTA_MAX_LEVEL links, no message
+	int          level;	// highest level in use
+	int          count;
+	unsigned     seed;
+
+	int    RandomLevel();
+	static BTDeltaNode *NewNode(int level);
+};
+
+#endif
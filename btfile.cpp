@@ -1,3 +1,6 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 #include "minirel.h"
 #include "bufmgr.h"
 #include "db.h"
@@ -9,35 +12,145 @@
 //-------------------------------------------------------------------
 // BTreeFile::BTreeFile
 //
-// Input   : filename - filename of an index.  
+// Input   : filename    - filename of an index.  
+//           withCounts  - for a new index, whether its index entries
+//                         keep subtree counts (see Rank()).
+//           withBuffers - for a new index, whether its index nodes
+//                         buffer inserts and deletes (see Insert()).
+//           withPacking - for a new index, whether its leaves are
+//                         bit-packed.
 // Output  : returnStatus - status of execution of constructor. 
 //           OK if successful, FAIL otherwise.
 // Purpose : If the B+ tree exists, open it.  Otherwise create a
 //           new B+ tree index.
 //-------------------------------------------------------------------
 
-BTreeFile::BTreeFile (Status& returnStatus, const char *filename) 
+BTreeFile::BTreeFile (Status& returnStatus, const char *filename,
+                      Bool withCounts, Bool withBuffers, Bool withPacking) 
 {
 	Page *rootPage;
 
+	leafExtent = INVALID_PAGE;
+	leafExtentUsed = 0;
+	counted = withCounts;
+	buffered = withBuffers;
+	packed = withPacking;
+	packScratch = NULL;
+	delta = NULL;
+	deltaCapacity = 0;
+	lastLeaf = INVALID_PAGE;
+	lastDepth = 0;
+	appends = 0;
+	mem = NULL;
+	nodeSize = MINIBASE_PAGESIZE;
+	snapshots = NULL;
+	epoch = 0;
+	writing = FALSE;
+	fileName[0] = '\0';
+	if (strlen(filename) >= (size_t)MAX_NAME)
+	{
+		returnStatus = FAIL;
+		return;
+	}
+	strcpy(fileName, filename);
+
 	// filename contains the name of the BTreeFile to be opened
 	if (MINIBASE_DB->GetFileEntry(filename, rootPid) == OK)
 	{
-		MINIBASE_BM->PinPage(rootPid, rootPage);
+		PinNode(rootPid, rootPage);
+		counted = ((BTNodePage *)rootPage)->IsCounted();
+		buffered = ((BTNodePage *)rootPage)->IsBuffered();
+		packed = ((BTNodePage *)rootPage)->IsPacked();
 	}
 	// create a new B+ tree index, add a new file entry into database
 	else
 	{
+		if (counted && (buffered || packed))
+		{
+			returnStatus = FAIL;
+			return;
+		}
 		std::cout << "create a new B+ Tree" << std::endl;
-		MINIBASE_BM->NewPage(rootPid, rootPage);
+		Status s = NewLeafPage(INVALID_PAGE, rootPid, rootPage);
+		if (s != OK) {
+			returnStatus = MINIBASE_CHAIN_ERROR(BTREE, s);
+			return;
+		}
 		if (MINIBASE_DB->AddFileEntry(filename, rootPid) != OK) {
 			std::cout << "error in AddFileEntry()" << std::endl;
 		}
-		((SortedPage *)rootPage)->Init(rootPid);
+		((BTNodePage *)rootPage)->Init(rootPid, nodeSize);
 
 		// initialize the type of the page
-		((SortedPage *)rootPage)->SetType(LEAF_NODE);
+		((BTNodePage *)rootPage)->SetType(LEAF_NODE, counted, buffered, packed);
+	}
+	if (packed)
+		packScratch = new LeafEntry[BTNodePage::PackedScratchSize()];
+	returnStatus = OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::BTreeFile
+//
+// Input   : size        - bytes per node, rounded up to whole cache
+//                         lines; a few hundred bytes to a few KB
+//           withCounts  - whether index entries keep subtree counts
+//           withBuffers - whether index nodes buffer inserts and
+//                         deletes
+//           withPacking - whether leaves are bit-packed
+// Output  : returnStatus - OK if successful, FAIL if size is too small
+//           to hold four entries (and four messages), or if withCounts
+//           is given with withBuffers or withPacking.
+// Purpose : Create a B+ tree that lives in memory only, outside the DB
+//           and the buffer pool.  It works like any other BTreeFile
+//           and goes away with the object.
+//-------------------------------------------------------------------
+
+BTreeFile::BTreeFile (Status& returnStatus, int size, Bool withCounts,
+                      Bool withBuffers, Bool withPacking) 
+{
+	Page *rootPage;
+	Status s;
+
+	leafExtent = INVALID_PAGE;
+	leafExtentUsed = 0;
+	counted = withCounts;
+	buffered = withBuffers;
+	packed = withPacking;
+	packScratch = NULL;
+	delta = NULL;
+	deltaCapacity = 0;
+	lastLeaf = INVALID_PAGE;
+	lastDepth = 0;
+	appends = 0;
+	mem = new BTMemStore(size);
+	nodeSize = mem->NodeSize();
+	snapshots = NULL;
+	epoch = 0;
+	writing = FALSE;
+	rootPid = INVALID_PAGE;
+	fileName[0] = '\0';
+
+	if (nodeSize < BTNODE_HEADER_SIZE + 4 * (int)sizeof(IndexEntry) ||
+	    (buffered && nodeSize < BTNODE_HEADER_SIZE +
+	                 2 * (int)(sizeof(int) + 4 * sizeof(BTMessage))) ||
+	    (counted && (buffered || packed)))
+	{
+		returnStatus = FAIL;
+		return;
 	}
+
+	s = NewLeafPage(INVALID_PAGE, rootPid, rootPage);
+	if (s != OK)
+	{
+		returnStatus = MINIBASE_CHAIN_ERROR(BTREE, s);
+		return;
+	}
+	((BTNodePage *)rootPage)->Init(rootPid, nodeSize);
+	((BTNodePage *)rootPage)->SetType(LEAF_NODE, counted, buffered, packed);
+	if (packed)
+		packScratch = new LeafEntry[BTNodePage::PackedScratchSize()];
 	returnStatus = OK;
 }
 
@@ -47,12 +160,233 @@ BTreeFile::BTreeFile (Status& returnStatus, const char *filename)
 //
 // Input   : None 
 // Output  : None
-// Purpose : Clean Up
+// Purpose : Clean Up.  What the delta buffer holds goes into the tree
+//           first.
 //-------------------------------------------------------------------
 
 BTreeFile::~BTreeFile()
 {
+	SetDeltaBuffer(0);
+	while (snapshots != NULL)
+		ReleaseSnapshot(snapshots);
+	ReleaseLeafExtent();
+	delete mem;
+	delete [] packScratch;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::SetRoot
+//
+// Input   : pid - the new root
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Make pid the root, and for a tree in the DB record it in
+//           the file entry, so that the index opens at it again.
+//-------------------------------------------------------------------
+
+Status BTreeFile::SetRoot(PageID pid)
+{
+	Status s;
 
+	rootPid = pid;
+	if (mem != NULL)
+		return OK;
+	s = MINIBASE_DB->UpdateFileEntry(fileName, pid);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::NewNode
+//
+// Input   : None
+// Output  : pid  - page id of the new node
+//           page - the node, pinned
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Allocate a node, in the DB or in memory.
+//-------------------------------------------------------------------
+
+Status BTreeFile::NewNode(PageID &pid, Page *&page)
+{
+	Status s;
+
+	if (mem != NULL)
+		s = mem->NewNode(pid, page);
+	else
+		s = MINIBASE_BM->NewPage(pid, page);
+	if (s == OK)
+		s = NoCopyNeeded(pid);
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::FreeNode
+//
+// Input   : pid - a node that is pinned once, or not at all
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Give a node back, to the DB or to memory.
+//-------------------------------------------------------------------
+
+Status BTreeFile::FreeNode(PageID pid)
+{
+	if (mem != NULL)
+		return mem->FreeNode(pid);
+	return MINIBASE_BM->FreePage(pid);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::DropNode
+//
+// Input   : pid - a node taken out of the tree, not pinned
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Free a node the tree no longer uses.  While snapshots are
+//           in use, one of them may still read it, or a scan of one
+//           have it pinned, so it is only held in the copy table, and
+//           freed by ReleaseSnapshot() once none of them is left.
+//-------------------------------------------------------------------
+
+Status BTreeFile::DropNode(PageID pid)
+{
+	Status s;
+
+	if (snapshots == NULL)
+		return FreeNode(pid);
+
+	s = copies.Hold(pid, snapshots->epoch);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::NewLeafPage
+//
+// Input   : leftPid - the leaf the new page goes to the right of, or
+//                     INVALID_PAGE for a first leaf.
+// Output  : pid  - page id of the new leaf.
+//           page - the new page, pinned.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Allocate a page for a leaf so that the leaf chain stays
+//           physically sequential: the page right after leftPid if it
+//           is free, otherwise the next page of the reserved extent.
+//           A new extent of LEAF_EXTENT pages is reserved when the
+//           current one is used up, falling back to a single page
+//           when the DB has no such run left.  Neither miss leaves an
+//           error behind.
+//-------------------------------------------------------------------
+
+Status BTreeFile::NewLeafPage(PageID leftPid, PageID &pid, Page *&page)
+{
+	Status s;
+	Bool noErrors;
+	int i;
+
+	pid = INVALID_PAGE;
+
+	// Memory has no pages to keep together
+	if (mem != NULL)
+		return mem->NewNode(pid, page);
+
+	// Right next to the left neighbour
+	if (leftPid != INVALID_PAGE)
+	{
+		i = leftPid + 1 - leafExtent;
+		if (leafExtent != INVALID_PAGE && i >= 0 && i < LEAF_EXTENT)
+		{
+			if (!(leafExtentUsed & (1u << i)))
+			{
+				leafExtentUsed |= 1u << i;
+				pid = leftPid + 1;
+			}
+		}
+		else if (leftPid + 1 < MINIBASE_DB->GetNumOfPages() &&
+		         MINIBASE_DB->AllocatePageAt(leftPid + 1) == OK)
+		{
+			pid = leftPid + 1;
+		}
+	}
+
+	// Next free page of the extent
+	if (pid == INVALID_PAGE && leafExtent != INVALID_PAGE)
+	{
+		for (i = 0; i < LEAF_EXTENT; i++)
+		{
+			if (!(leafExtentUsed & (1u << i)))
+			{
+				leafExtentUsed |= 1u << i;
+				pid = leafExtent + i;
+				break;
+			}
+		}
+	}
+
+	// A new extent
+	if (pid == INVALID_PAGE)
+	{
+		s = ReleaseLeafExtent();
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+		noErrors = (minibase_errors.error() == NULL);
+		if (MINIBASE_DB->AllocatePage(leafExtent, LEAF_EXTENT) == OK)
+		{
+			leafExtentUsed = 1;
+			pid = leafExtent;
+		}
+		else
+		{
+			leafExtent = INVALID_PAGE;
+			s = MINIBASE_DB->AllocatePage(pid);
+			if (s != OK)
+				return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+			// The DB reported that it had no run free
+			if (noErrors)
+				minibase_errors.clear_errors();
+		}
+	}
+
+	return MINIBASE_BM->PinNewPage(pid, page);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::ReleaseLeafExtent
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Give the pages of the reserved extent that did not become
+//           leaves back to the DB.
+//-------------------------------------------------------------------
+
+Status BTreeFile::ReleaseLeafExtent()
+{
+	Status s;
+
+	if (leafExtent == INVALID_PAGE)
+		return OK;
+
+	for (int i = 0; i < LEAF_EXTENT; i++)
+	{
+		if (!(leafExtentUsed & (1u << i)))
+		{
+			s = MINIBASE_DB->DeallocatePage(leafExtent + i);
+			if (s != OK)
+				return MINIBASE_CHAIN_ERROR(BTREE, s);
+		}
+	}
+	leafExtent = INVALID_PAGE;
+	leafExtentUsed = 0;
+	return OK;
 }
 
 
@@ -80,7 +414,9 @@ BTreeFile::DestroyFile()
 //           rid - RecordID of the record to be inserted.
 // Output  : None
 // Return  : OK if successful, FAIL otherwise.
-// Purpose : Insert an index entry with this rid and key.  
+// Purpose : Insert an index entry with this rid and key.  With a delta
+//           buffer, the insert waits there; in a buffered tree with
+//           index nodes, it is a message put in the buffer of the root.
 // Note    : If the root didn't exist, create it.
 //-------------------------------------------------------------------
 
@@ -88,159 +424,316 @@ BTreeFile::DestroyFile()
 Status 
 BTreeFile::Insert (const int key, const RecordID rid)
 {
-	LeafEntry leafEntry;
-	IndexEntry *new_index_entry = NULL;
+	BTMessage msg;
+	Status s;
+
+	// A memory-mapped database is read-only
+	if (mem == NULL && MINIBASE_DB->IsMapped())
+		return FAIL;
+
+	msg.key = key;
+	msg.rid = rid;
+	msg.type = INSERT_MESSAGE;
+	if (delta != NULL)
+		return AddToDelta(msg);
+
+	writing = TRUE;
+	s = Apply(msg);
+	writing = FALSE;
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::Apply
+//
+// Input   : msg - an insert or a delete
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Make an insert or delete that does not go through the delta
+//           buffer: through the buffers of a buffered tree, or to the
+//           leaves.
+//-------------------------------------------------------------------
+
+Status 
+BTreeFile::Apply (const BTMessage &msg)
+{
+	LeafEntry entry;
+	IndexEntry oldchildentry;
+	Status s = DONE;
+
+	if (buffered)
+		s = BufferMessage(msg);
+	if (s != DONE)
+		return s;
+
+	entry.key = msg.key;
+	entry.rid = msg.rid;
+	if (msg.type == INSERT_MESSAGE)
+		return InsertEntry(entry);
+
+	// Packed leaves are not merged, as the two might not fit on one
+	if (packed)
+		return DeleteFromLeaf(entry);
+
+	// Nodes on the right edge may be merged away
+	lastLeaf = INVALID_PAGE;
+	appends = 0;
+
+	// An entry that is not there is not an error
+	oldchildentry.pid = INVALID_PAGE;
+	s = do_delete(-1, rootPid, entry, oldchildentry);
+	return (s == DONE) ? OK : s;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::InsertEntry
+//
+// Input   : leafEntry - the entry to insert
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Put an entry into its leaf, splitting nodes as needed and
+//           growing a new root if the old one splits.  A packed leaf
+//           may have to split before it can take the entry, which then
+//           goes down the tree again.
+//-------------------------------------------------------------------
+
+Status 
+BTreeFile::InsertEntry (const LeafEntry leafEntry)
+{
+	IndexEntry new_index_entry;
 	Status s;
 
-	leafEntry.key = key;
-	leafEntry.rid = rid;
-	s = do_insert(rootPid, leafEntry, new_index_entry);
+	// Keys that come in order go straight to the rightmost leaf
+	s = Append(leafEntry);
+	if (s != DONE)
+		return s;
 
-	// root node was just split
-	if (new_index_entry != NULL)
+	do
 	{
-		PageID Rpid;
-		RecordID tRid;
-		SortedPage *Rpage;
-		BTIndexPage *R;
-
-		// Create a new root-node page
-		MINIBASE_BM->NewPage(Rpid, (Page *&)Rpage);
-		MINIBASE_BM->PinPage(Rpid, (Page *&)Rpage);
-		R = (BTIndexPage *)Rpage;
-		R->Init(Rpid);
-		R->SetType(INDEX_NODE);
-		R->Insert(new_index_entry->key, new_index_entry->pid, tRid);
-		R->SetLeftLink(rootPid);
-
-		// Change the root node
-		rootPid = Rpid;
-
-		MINIBASE_BM->UnpinPage(Rpid, DIRTY);
-		delete new_index_entry;
-	}
+		new_index_entry.pid = INVALID_PAGE;
+		s = do_insert(rootPid, leafEntry, new_index_entry, TRUE, 0);
+
+		// root node was just split
+		if (new_index_entry.pid != INVALID_PAGE)
+		{
+			PageID Rpid;
+			RecordID tRid;
+			BTNodePage *Rpage;
+			BTIndexPage *R;
+
+			// Create a new root-node page
+			NewNode(Rpid, (Page *&)Rpage);
+			PinNode(Rpid, (Page *&)Rpage);
+			R = (BTIndexPage *)Rpage;
+			R->Init(Rpid, nodeSize);
+			R->SetType(INDEX_NODE, counted, buffered, packed);
+			R->Insert(new_index_entry, tRid);
+			R->SetLeftLink(rootPid);
+
+			if (counted)
+			{
+				BTNodePage *oldRoot;
+
+				PinNode(rootPid, (Page *&)oldRoot);
+				R->SetChildCount(0, oldRoot->SubtreeCount());
+				UnpinNode(rootPid, CLEAN);
+			}
+
+			// Change the root node
+			UnpinNode(Rpid, DIRTY);
+			Status rs = SetRoot(Rpid);
+			if (rs != OK)
+				return rs;
+		}
+	} while (s == DONE);
 	return s;
 }
 
-Status BTreeFile::do_insert(PageID pid, const LeafEntry leafEntry, IndexEntry * &new_index_entry)
+
+//-------------------------------------------------------------------
+// BTreeFile::Append
+//
+// Input   : entry - the entry to insert
+// Output  : None
+// Return  : OK if the entry was inserted, DONE if it has to go through
+//           do_insert(), an error status otherwise.
+// Purpose : Insert an entry without going down the tree if it goes at
+//           the end of the rightmost leaf and that leaf has room.  In a
+//           counted tree the nodes on the remembered path each get one
+//           more entry under their last child.
+//-------------------------------------------------------------------
+
+Status BTreeFile::Append(const LeafEntry entry)
 {
-	SortedPage *page;
+	BTLeafPage *leaf;
+	BTIndexPage *indexPage;
+	LeafEntry last;
 	RecordID tRid;
+	Status s;
 
-	MINIBASE_BM->PinPage(pid, (Page *&)page);
+	if (lastLeaf == INVALID_PAGE)
+		return DONE;
+
+	s = PinNode(lastLeaf, (Page *&)leaf);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	// An empty leaf below the root, which deletes leave in a packed
+	// tree, takes only keys from its separator on, which is not known
+	// here
+	if (!leaf->IsEmpty())
+		leaf->GetEntry(leaf->GetNumOfRecords() - 1, last);
+	if ((leaf->IsEmpty() ? lastDepth > 0 : entry.key < last.key) ||
+	    leaf->Insert(entry.key, entry.rid, tRid, packScratch) != OK)
+	{
+		UnpinNode(lastLeaf, CLEAN);
+		return DONE;
+	}
+	UnpinNode(lastLeaf, DIRTY);
+	appends++;
+
+	if (counted)
+	{
+		for (int d = 0; d < lastDepth; d++)
+		{
+			s = PinNode(lastPath[d], (Page *&)indexPage);
+			if (s != OK)
+				return MINIBASE_CHAIN_ERROR(BTREE, s);
+			indexPage->AddChildCount(indexPage->GetNumOfRecords(), 1);
+			UnpinNode(lastPath[d], DIRTY);
+		}
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::do_insert
+//
+// Input   : pid       - root of the subtree to insert into
+//           leafEntry - the entry to insert
+//           rightmost - TRUE if pid is on the right edge of the tree
+//           depth     - number of index nodes above pid
+// Output  : new_index_entry - the entry for a new sibling of pid if pid
+//                             was split, pid INVALID_PAGE otherwise
+// Return  : OK if successful, DONE if a packed leaf had to be split
+//           without the entry, which is left to the caller to insert
+//           again, an error status otherwise.
+// Purpose : Insert an entry into a subtree, splitting nodes on the way
+//           back up as needed.  Going down the right edge it records
+//           the path for Append().
+//-------------------------------------------------------------------
+
+Status BTreeFile::do_insert(PageID pid, const LeafEntry leafEntry, IndexEntry &new_index_entry,
+                            Bool rightmost, int depth)
+{
+	BTNodePage *page;
+	RecordID tRid;
+	Status s;
+
+	s = PinNode(pid, (Page *&)page);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
 
 	if (page->GetType() == INDEX_NODE)
 	{
 		BTIndexPage *indexPage = (BTIndexPage *)page;	// non-leaf node
 		PageID childPid;
-		IndexEntry index, indexSaved;
+		int childPos;
 
 		// Choose a subtree
-		indexPage->GetFirst(index.key, index.pid, tRid);
+		childPos = indexPage->FindInsertPos(leafEntry.key);
+		childPid = indexPage->GetChild(childPos);
 
-		if (index.key > leafEntry.key) {
-			childPid = indexPage->GetLeftLink();
-		}
-		else {
-			indexSaved = index;
-			while (index.key < leafEntry.key) { // we don't support duplicate numbers!!!!1
-				indexSaved = index;
-				if (indexPage->GetNext(index.key, index.pid, tRid) == DONE)
-					break;
-			}
-			childPid = indexSaved.pid;
-		}
+		if (rightmost && depth < BT_MAX_HEIGHT)
+			lastPath[depth] = pid;
+		rightmost = rightmost && childPos == indexPage->GetNumOfRecords();
 
-		MINIBASE_BM->UnpinPage(pid, CLEAN);
+		UnpinNode(pid, CLEAN);
 
 		// Recursively, insert entry
-		do_insert(childPid, leafEntry, new_index_entry);
+		s = do_insert(childPid, leafEntry, new_index_entry, rightmost, depth + 1);
 
 		// after the Recursion return, we will go to here!
-		if (new_index_entry == NULL)
+		if (s != OK && s != DONE)
 		{
-			return OK;
+			return s;
 		}
-		// We split child, must insert *new_index_entry into N
+		if (new_index_entry.pid == INVALID_PAGE)
+		{
+			if (counted && s == OK)
+			{
+				s = PinNode(pid, (Page *&)page);
+				if (s != OK)
+					return MINIBASE_CHAIN_ERROR(BTREE, s);
+				((BTIndexPage *)page)->AddChildCount(childPos, 1);
+				UnpinNode(pid, DIRTY);
+			}
+			return s;
+		}
+		// We split child, must insert new_index_entry into N
 		else
 		{
-			MINIBASE_BM->PinPage(pid, (Page *&)page);
+			Status ps = PinNode(pid, (Page *&)page);
+			if (ps != OK)
+			{
+				new_index_entry.pid = INVALID_PAGE;
+				return MINIBASE_CHAIN_ERROR(BTREE, ps);
+			}
 			indexPage = (BTIndexPage *)page;
 
+			// The child got the new leaf entry and lost what moved to
+			// its new sibling
+			indexPage->AddChildCount(childPos, (s == OK) - new_index_entry.count);
+
 			// Usual case ; there exists enough space
-			if (indexPage->GetNumOfRecords() < 2 * treeOrder)
+			if (!indexPage->IsFull())
 			{
-				// Insert new child into N
-				indexPage->Insert(new_index_entry->key, new_index_entry->pid, tRid);
-				MINIBASE_BM->UnpinPage(pid, DIRTY);
+				// Insert new child into N, next to the one it was split
+				// from: other entries may have the same key
+				indexPage->InsertEntry(childPos, new_index_entry);
+				UnpinNode(pid, DIRTY);
 				// Set newchildentry to NULL
-				delete new_index_entry;
-				new_index_entry = NULL;
-				return OK;
+				new_index_entry.pid = INVALID_PAGE;
+				return s;
 			}
 			// Split node ; no enough space
 			else
 			{
 				PageID pid2;
-				SortedPage *page2;
+				BTNodePage *page2;
 				BTIndexPage *newIndexPage;
-				IndexEntry tEntry, *temp = new IndexEntry[2 * treeOrder + 1];
-				int i = 0, j = 0;
-				bool insertFlag = true;
-
-				// Allocate a new nonleaf-node page
-				MINIBASE_BM->NewPage(pid2, (Page *&)page2);
-				MINIBASE_BM->PinPage(pid2, (Page *&)page2);
-				newIndexPage = (BTIndexPage *)page2;
-				newIndexPage->Init(pid2);
-				newIndexPage->SetType(INDEX_NODE);
+				int splitKey;
+				Status ns;
 
-				while (!indexPage->IsEmpty())
+				// Allocate a new nonleaf-node page; s may be DONE and
+				// must reach the caller as it is
+				ns = NewNode(pid2, (Page *&)page2);
+				if (ns != OK)
 				{
-					indexPage->GetFirst(tEntry.key, tEntry.pid, tRid);
-					if (insertFlag && tEntry.key > new_index_entry->key)
-					{
-						temp[i] = *new_index_entry;
-						i = i + 1;
-						insertFlag = false;
-					}
-					temp[i] = tEntry;
-					i = i + 1;
-					indexPage->Delete(tEntry.key, tRid);
+					UnpinNode(pid, CLEAN);
+					new_index_entry.pid = INVALID_PAGE;
+					return MINIBASE_CHAIN_ERROR(BTREE, ns);
 				}
+				newIndexPage = (BTIndexPage *)page2;
+				newIndexPage->Init(pid2, nodeSize);
+				newIndexPage->SetType(INDEX_NODE, counted, buffered, packed);
 
-				if (insertFlag)
-				{
-					temp[i] = *new_index_entry;
-					i = i + 1;
-				}
-
-				for (; j < treeOrder; j++)
-				{
-					indexPage->Insert(temp[j].key, temp[j].pid, tRid);
-				}
-
-				newIndexPage->SetLeftLink(temp[j].pid);
-
-				// because of the property of B+ Tree, No dumplicate number in Index Node
-				// so, jump j
-				int splited_new_entry = j;
-				j++;
-				for (; j < i; j++)
-				{
-					newIndexPage->Insert(temp[j].key, temp[j].pid, tRid);
-				}
+				// Move the upper half to it; the middle entry moves up
+				indexPage->Split(new_index_entry, childPos, newIndexPage,
+				                 splitKey, appends >= APPEND_RUN);
 
 				// *newchildentry set to guide searches btwn N and N2
-				delete new_index_entry;
-				new_index_entry = new IndexEntry;
-				new_index_entry->key = temp[treeOrder].key;
-				new_index_entry->pid = pid2;
+				new_index_entry.key = splitKey;
+				new_index_entry.pid = pid2;
+				new_index_entry.count = newIndexPage->SubtreeCount();
 
-				MINIBASE_BM->UnpinPage(pid, DIRTY);
-				MINIBASE_BM->UnpinPage(pid2, DIRTY);
+				UnpinNode(pid, DIRTY);
+				UnpinNode(pid2, DIRTY);
 
-				return OK;
+				return s;
 			}
 		}
 	}
@@ -248,84 +741,86 @@ Status BTreeFile::do_insert(PageID pid, const LeafEntry leafEntry, IndexEntry *
 	{
 		BTLeafPage *leafPage = (BTLeafPage *)page;	// leaf node
 
-		// Usual case
-		if (leafPage->GetNumOfRecords() < 2 * treeOrder)
+		s = OK;
+
+		// Count the inserts in a row at the end of the rightmost leaf
+		if (rightmost && leafPage->FindInsertPos(leafEntry.key) == leafPage->GetNumOfRecords())
+			appends++;
+		else
+			appends = 0;
+
+		// Usual case.  A leaf that is not full takes the entry, except
+		// that a packed leaf may not have the bits for it.
+		if (leafPage->Insert(leafEntry.key, leafEntry.rid, tRid,
+		                     packScratch) == OK)
 		{
-			leafPage->Insert(leafEntry.key, leafEntry.rid, tRid);
-			MINIBASE_BM->UnpinPage(pid, DIRTY);
+			UnpinNode(pid, DIRTY);
+
+			if (rightmost && depth <= BT_MAX_HEIGHT)
+			{
+				lastLeaf = pid;
+				lastDepth = depth;
+			}
 			return OK;
 		}
 		// In the case that the leaf is full
 		else
 		{
 			PageID pidNew, Spid;
-			SortedPage *page2, *Spage;
+			BTNodePage *page2, *Spage;
 			BTLeafPage *L2, *S;
-			LeafEntry tEntry, *temp = new LeafEntry[2 * treeOrder + 1];
-			int i = 0, j = 0;
-			bool insertFlag = true;
-
-			// Allocate a new leaf-node page
-			MINIBASE_BM->NewPage(pidNew, (Page *&)page2);
-			MINIBASE_BM->PinPage(pidNew, (Page *&)page2);
-			L2 = (BTLeafPage *)page2;
-			L2->Init(pidNew);
-			L2->SetType(LEAF_NODE);
+			int splitKey;
 
-			// Split the old leafPage
-			while (!leafPage->IsEmpty())
+			// Allocate a new leaf-node page, next to this one if possible
+			if (NewLeafPage(pid, pidNew, (Page *&)page2) != OK)
 			{
-				leafPage->GetFirst(tEntry.key, tEntry.rid, tRid);
-				if (insertFlag && tEntry.key > leafEntry.key)
-				{
-					temp[i] = leafEntry;
-					i = i + 1;
-					insertFlag = false;
-				}
-				temp[i] = tEntry;
-				i = i + 1;
-				leafPage->Delete(tEntry.key, tEntry.rid, tRid);
+				UnpinNode(pid, CLEAN);
+				return FAIL;
 			}
+			NoCopyNeeded(pidNew);
+			L2 = (BTLeafPage *)page2;
+			L2->Init(pidNew, nodeSize);
+			L2->SetType(LEAF_NODE, counted, buffered, packed);
 
-			if (insertFlag)
-			{
-				temp[i] = leafEntry;
-				i = i + 1;
-			}
+			// Split the old leafPage, moving the upper half to L2
+			if (leafPage->Split(leafEntry.key, leafEntry.rid, L2, splitKey,
+			                    appends >= APPEND_RUN, packScratch) == DONE)
+				s = DONE;
 
-			for (j = 0; j < treeOrder; j++)
-			{
-				leafPage->Insert(temp[j].key, temp[j].rid, tRid);
-			}
-
-			for (; j < i; j++)
-			{
-				L2->Insert(temp[j].key, temp[j].rid, tRid);
-			}
+			// The path to the rightmost leaf is found again by the
+			// next insert that goes there
+			lastLeaf = INVALID_PAGE;
 
 			// Set *newchildentry
-			delete new_index_entry;
-			new_index_entry = new IndexEntry;
-			new_index_entry->key = temp[treeOrder].key;
-			new_index_entry->pid = pidNew;
+			new_index_entry.key = splitKey;
+			new_index_entry.pid = pidNew;
+			new_index_entry.count = L2->GetNumOfRecords();
 
 			// Set sibling pointers
 			Spid = leafPage->GetNextPage();
 
 			if (Spid != -1)
 			{
-				MINIBASE_BM->PinPage(Spid, (Page *&)Spage);
+				Status ps = PinNode(Spid, (Page *&)Spage);
+				if (ps != OK)
+				{
+					UnpinNode(pid, DIRTY);
+					UnpinNode(pidNew, DIRTY);
+					new_index_entry.pid = INVALID_PAGE;
+					return MINIBASE_CHAIN_ERROR(BTREE, ps);
+				}
 				S = (BTLeafPage *)Spage;
 				S->SetPrevPage(pidNew);
-				MINIBASE_BM->UnpinPage(Spid, DIRTY);
+				UnpinNode(Spid, DIRTY);
 			}
 
 			leafPage->SetNextPage(pidNew);
 			L2->SetPrevPage(pid);
 			L2->SetNextPage(Spid);
 
-			MINIBASE_BM->UnpinPage(pid, DIRTY);
-			MINIBASE_BM->UnpinPage(pidNew, DIRTY);
+			UnpinNode(pid, DIRTY);
+			UnpinNode(pidNew, DIRTY);
+			return s;
 		}
 	}
 
@@ -339,125 +834,163 @@ Status BTreeFile::do_insert(PageID pid, const LeafEntry leafEntry, IndexEntry *
 //           rid - RecordID of the record to be deleted.
 // Output  : None
 // Return  : OK if successful, FAIL otherwise. 
-// Purpose : Delete an index entry with this rid and key.  
+// Purpose : Delete an index entry with this rid and key.  With a delta
+//           buffer, the delete waits there; in a buffered tree with
+//           index nodes, it is a message put in the buffer of the root.
 // Note    : If the root becomes empty, delete it.
 //-------------------------------------------------------------------
 
 Status 
 BTreeFile::Delete (const int key, const RecordID rid)
 {
-	// To do
-	LeafEntry entry;
-	IndexEntry *oldchildentry = NULL;
+	BTMessage msg;
+	Status s;
 
-	entry.key = key;
-	entry.rid = rid;
+	// A memory-mapped database is read-only
+	if (mem == NULL && MINIBASE_DB->IsMapped())
+		return FAIL;
 
-	return do_delete(-1, rootPid, entry, oldchildentry);
+	msg.key = key;
+	msg.rid = rid;
+	msg.type = DELETE_MESSAGE;
+	if (delta != NULL)
+		return AddToDelta(msg);
+
+	writing = TRUE;
+	s = Apply(msg);
+	writing = FALSE;
+	return s;
 }
 
+//-------------------------------------------------------------------
+// BTreeFile::do_delete
+//
+// Input   : Ppid  - parent of pid, -1 for the root
+//           pid   - root of the subtree to delete from
+//           entry - the entry to delete
+// Output  : oldchildentry - the entry of a child of Ppid to take out if
+//                           pid was merged with a sibling, pid
+//                           INVALID_PAGE otherwise
+// Return  : OK if successful, DONE if the entry is not in the subtree,
+//           which is then unchanged, an error status otherwise.
+// Purpose : Delete an entry from a subtree, merging or redistributing
+//           nodes that fall below half full on the way back up.
+//-------------------------------------------------------------------
+
 Status 
-BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry *&oldchildentry)
+BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry &oldchildentry)
 {
-	SortedPage *page;
+	BTNodePage *page;
 	RecordID tRid;
+	Status s;
 
-	MINIBASE_BM->PinPage(pid, (Page *&)page);
+	s = PinNode(pid, (Page *&)page);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
 
 	// Index node
 	if (page->GetType() == INDEX_NODE)
 	{
 		BTIndexPage *N = (BTIndexPage *)page;	// non-leaf node
 		PageID Pi;
-		IndexEntry Ki, Ki1;
-		int i = 0;
-
-		// Choose a subtree
-
-		N->GetFirst(Ki1.key, Ki1.pid, tRid);
-
-		while (Ki1.key <= entry.key)
+		int i, last;
+
+		// Choose a subtree.  With duplicates, entries with the key may
+		// be under any child from the first one that can hold it to the
+		// one an insert of it goes to: try each in turn.
+		i = N->LowerBound(entry.key);
+		last = N->FindInsertPos(entry.key);
+		for (;;)
 		{
-			i++;
-			Ki = Ki1;
+			Pi = N->GetChild(i);
+			UnpinNode(pid, CLEAN);
 
-			if (N->GetNext(Ki1.key, Ki1.pid, tRid) == DONE)
-			{
-				//No more entires
+			// Recursively, delete entry
+			oldchildentry.pid = INVALID_PAGE;
+			s = do_delete(pid, Pi, entry, oldchildentry);
+			if (s != DONE || i == last)
 				break;
-			}
-		}
-
-		std::cout << "Ki = " << Ki.key << "  ki1 = " << Ki1.key << std::endl;
-		std::cout << "i = " << i << std::endl;
 
-		///////////////////
-		if (i == 0)
-		{
-			Pi = N->GetLeftLink();
-			std::cout << "get left link = " << Pi << std::endl;
-		}
-		else
-		{
-			Pi = Ki.pid;
+			i++;
+			s = PinNode(pid, (Page *&)page);
+			if (s != OK)
+				return MINIBASE_CHAIN_ERROR(BTREE, s);
+			N = (BTIndexPage *)page;
 		}
-
-		MINIBASE_BM->UnpinPage(pid, CLEAN);
-
-		// Recursively, delete entry
-		do_delete(pid, Pi, entry, oldchildentry);
+		if (s != OK)
+			return s;
 
 		// Usual case : Do not delete child node
-		if (oldchildentry == NULL)
+		if (oldchildentry.pid == INVALID_PAGE)
 		{
+			// The child may also have traded entries with a sibling
+			if (counted)
+			{
+				s = PinNode(pid, (Page *&)page);
+				if (s != OK)
+					return MINIBASE_CHAIN_ERROR(BTREE, s);
+				RecountChildren((BTIndexPage *)page, i - 1, i + 1);
+				UnpinNode(pid, DIRTY);
+			}
 			return OK;
 		}
 		// Discard child node
 		else
 		{
-			MINIBASE_BM->PinPage(pid, (Page *&)page);
+			s = PinNode(pid, (Page *&)page);
+			if (s != OK)
+			{
+				oldchildentry.pid = INVALID_PAGE;
+				return MINIBASE_CHAIN_ERROR(BTREE, s);
+			}
 			N = (BTIndexPage *)page;
-			std::cout << "we will delete this key in parent node : " << oldchildentry->key << std::endl;
-			N->Delete(oldchildentry->key, tRid);
+			std::cout << "we will delete this key in parent node : " << oldchildentry.key << std::endl;
+			N->DeleteEntry(N->FindChildPos(oldchildentry.pid) - 1);
 			std::cout << "after delete, the number of records = " << N->GetNumOfRecords() << std::endl;
 
+			// The child was merged into its left or right neighbour
+			if (counted)
+				RecountChildren(N, i - 1, i);
+
 			// Change root
 			if (pid == rootPid && N->GetNumOfRecords() <= 0)
 			{
 				std::cout << "Change root" << std::endl;
-				rootPid = N->GetLeftLink();
+				s = SetRoot(N->GetLeftLink());
 				std::cout << "new rootpid = " << rootPid << std::endl;
 				// reset to the LEAF_NODE
 				/*BTIndexPage *new_root_page;
-				MINIBASE_BM->PinPage(rootPid, (Page *&)new_root_page);
+				PinNode(rootPid, (Page *&)new_root_page);
 				new_root_page->SetType(LEAF_NODE);
-				MINIBASE_BM->UnpinPage(rootPid);
+				UnpinNode(rootPid);
 				*/
 
-				if (oldchildentry != NULL) {
-					delete oldchildentry;
-				}
-				oldchildentry = NULL;
-				MINIBASE_BM->UnpinPage(pid, DIRTY);
-				MINIBASE_BM->FreePage(pid);
-				return OK;
+				oldchildentry.pid = INVALID_PAGE;
+				UnpinNode(pid, DIRTY);
+				DropNode(pid);
+				return s;
 			}
 			// Check for underflow
-			else if (N->GetNumOfRecords() >= treeOrder || pid == rootPid)
+			else if (N->IsAtLeastHalfFull() || pid == rootPid)
 			{
-				delete oldchildentry;
-				oldchildentry = NULL;
-				MINIBASE_BM->UnpinPage(pid, DIRTY);
+				oldchildentry.pid = INVALID_PAGE;
+				UnpinNode(pid, DIRTY);
 				return OK;
 			}
 			else
 			{
 				//Get a sibling S of N
-				SortedPage *Spage, *Ppage;
+				BTNodePage *Spage, *Ppage;
 				BTIndexPage *S, *P;
 				IndexEntry left, right, tEntry;
 
-				MINIBASE_BM->PinPage(Ppid, (Page *&)Ppage);
+				s = PinNode(Ppid, (Page *&)Ppage);
+				if (s != OK)
+				{
+					oldchildentry.pid = INVALID_PAGE;
+					UnpinNode(pid, DIRTY);
+					return MINIBASE_CHAIN_ERROR(BTREE, s);
+				}
 				P = (BTIndexPage *)Ppage;
 
 				// Bring element from the right sibling
@@ -465,126 +998,140 @@ BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry
 				{
 					P->GetFirst(right.key, right.pid, tRid);
 
-					MINIBASE_BM->PinPage(right.pid, (Page *&)Spage);
+					s = PinNode(right.pid, (Page *&)Spage);
+					if (s != OK)
+					{
+						oldchildentry.pid = INVALID_PAGE;
+						UnpinNode(pid, DIRTY);
+						UnpinNode(Ppid, DIRTY);
+						return MINIBASE_CHAIN_ERROR(BTREE, s);
+					}
 					S = (BTIndexPage *)Spage;
 
 					// S has extra entries
-					if (S->GetNumOfRecords() > treeOrder)
+					if (S->GetNumOfRecords() > S->MinEntries())
 					{
-						PageID tPid;
+						IndexEntry moved;
 
 						// Redistribution
-						tPid = S->GetLeftLink();
+						moved.key = right.key;
+						moved.pid = S->GetLeftLink();
+						moved.count = S->GetChildCount(0);
 
-						S->GetFirst(tEntry.key, tEntry.pid, tRid);
-						S->Delete(tEntry.key, tRid);
+						S->GetEntry(0, tEntry);
+						S->DeleteEntry(0);
 						S->SetLeftLink(tEntry.pid);
+						S->SetChildCount(0, tEntry.count);
 
-						P->Delete(right.key, tRid);
-						P->Insert(tEntry.key, right.pid, tRid);
+						P->SetKey(0, tEntry.key);
 
-						N->Insert(right.key, tPid, tRid);
+						N->InsertEntry(N->GetNumOfRecords(), moved);
 
 						// Set oldchildentry to null
-						oldchildentry = NULL;
+						oldchildentry.pid = INVALID_PAGE;
 
-						MINIBASE_BM->UnpinPage(pid, DIRTY);
-						MINIBASE_BM->UnpinPage(Ppid, DIRTY);
-						MINIBASE_BM->UnpinPage(right.pid, DIRTY);
+						UnpinNode(pid, DIRTY);
+						UnpinNode(Ppid, DIRTY);
+						UnpinNode(right.pid, DIRTY);
 						return OK;
 					}
 					//Merge N and S (M = S)
 					else
 					{
 						// Set oldchildentry
-						delete oldchildentry;
-						oldchildentry = new IndexEntry;
-						*oldchildentry = right;
+						oldchildentry = right;
 
 						// Pull splitting key from parent
-						N->Insert(right.key, S->GetLeftLink(), tRid);
+						tEntry.key = right.key;
+						tEntry.pid = S->GetLeftLink();
+						tEntry.count = S->GetChildCount(0);
+						N->InsertEntry(N->GetNumOfRecords(), tEntry);
 
 						// Move all entries from M
 						while (!S->IsEmpty())
 						{
-							S->GetFirst(tEntry.key, tEntry.pid, tRid);
-							N->Insert(tEntry.key, tEntry.pid, tRid);
-							S->Delete(tEntry.key, tRid);
+							S->GetEntry(0, tEntry);
+							N->InsertEntry(N->GetNumOfRecords(), tEntry);
+							S->DeleteEntry(0);
 						}
 
-						MINIBASE_BM->UnpinPage(pid, DIRTY);
-						MINIBASE_BM->UnpinPage(Ppid, DIRTY);
-						MINIBASE_BM->UnpinPage(right.pid, DIRTY);
+						UnpinNode(pid, DIRTY);
+						UnpinNode(Ppid, DIRTY);
+						UnpinNode(right.pid, DIRTY);
 
 						// Discard empty node M
-						MINIBASE_BM->FreePage(right.pid);
+						DropNode(right.pid);
 						return OK;
 					}
 				}
 				// Bring element from the left sibling
 				else
 				{
-					P->GetFirst(right.key, right.pid, tRid);
-					left.pid = P->GetLeftLink();
-					while (right.pid != pid)
+					int pos = P->FindChildPos(pid) - 1;
+
+					P->GetEntry(pos, right);
+					left.pid = P->GetChild(pos);
+
+					s = PinNode(left.pid, (Page *&)Spage);
+					if (s != OK)
 					{
-						left = right;
-						P->GetNext(right.key, right.pid, tRid);
+						oldchildentry.pid = INVALID_PAGE;
+						UnpinNode(pid, DIRTY);
+						UnpinNode(Ppid, DIRTY);
+						return MINIBASE_CHAIN_ERROR(BTREE, s);
 					}
-
-					MINIBASE_BM->PinPage(left.pid, (Page *&)Spage);
 					S = (BTIndexPage *)Spage;
 
 					// S has extra entries
-					if (S->GetNumOfRecords() > treeOrder)
+					if (S->GetNumOfRecords() > S->MinEntries())
 					{
 						// Redistribution
 						IndexEntry  tEntrySaved;
-						S->GetFirst(tEntry.key, tEntry.pid, tRid);
-						tEntrySaved = tEntry;
-						while (S->GetNext(tEntry.key, tEntry.pid, tRid) != DONE) {
-							tEntrySaved = tEntry;
-						}
-						S->Delete(tEntrySaved.key, tRid);
+						S->GetEntry(S->GetNumOfRecords() - 1, tEntrySaved);
+						S->DeleteEntry(S->GetNumOfRecords() - 1);
 
-						P->Delete(right.key, tRid);
-						P->Insert(tEntrySaved.key, right.pid, tRid);
+						P->SetKey(pos, tEntrySaved.key);
 
-						N->Insert(right.key, N->GetLeftLink(), tRid);
+						tEntry.key = right.key;
+						tEntry.pid = N->GetLeftLink();
+						tEntry.count = N->GetChildCount(0);
+						N->InsertEntry(0, tEntry);
 						N->SetLeftLink(tEntrySaved.pid);
+						N->SetChildCount(0, tEntrySaved.count);
 
 						// Set oldchildentry to null
-						oldchildentry = NULL;
+						oldchildentry.pid = INVALID_PAGE;
 
-						MINIBASE_BM->UnpinPage(pid, DIRTY);
-						MINIBASE_BM->UnpinPage(Ppid, DIRTY);
-						MINIBASE_BM->UnpinPage(left.pid, DIRTY);
+						UnpinNode(pid, DIRTY);
+						UnpinNode(Ppid, DIRTY);
+						UnpinNode(left.pid, DIRTY);
 						return OK;
 					}
 					// Merge S and N  (M = N)
 					else
 					{
 						// Set oldchildentry
-						delete oldchildentry;
-						oldchildentry = new IndexEntry;
-						*oldchildentry = right;
+						oldchildentry = right;
 
 						// Pull splitting key from parent
-						S->Insert(right.key, N->GetLeftLink(), tRid);
+						tEntry.key = right.key;
+						tEntry.pid = N->GetLeftLink();
+						tEntry.count = N->GetChildCount(0);
+						S->InsertEntry(S->GetNumOfRecords(), tEntry);
 
 						// Move all entries from M
 						while (!N->IsEmpty())
 						{
-							N->GetFirst(tEntry.key, tEntry.pid, tRid);
-							S->Insert(tEntry.key, tEntry.pid, tRid);
-							N->Delete(tEntry.key, tRid);
+							N->GetEntry(0, tEntry);
+							S->InsertEntry(S->GetNumOfRecords(), tEntry);
+							N->DeleteEntry(0);
 						}
 						// Discard empty node M
-						MINIBASE_BM->UnpinPage(pid, DIRTY);
-						MINIBASE_BM->UnpinPage(Ppid, DIRTY);
-						MINIBASE_BM->UnpinPage(left.pid, DIRTY);
+						UnpinNode(pid, DIRTY);
+						UnpinNode(Ppid, DIRTY);
+						UnpinNode(left.pid, DIRTY);
 
-						MINIBASE_BM->FreePage(pid);
+						DropNode(pid);
 						return OK;
 					}
 				}
@@ -597,29 +1144,37 @@ BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry
 	{
 		BTLeafPage *L = (BTLeafPage *)page;	// leaf node
 
-		L->Delete(entry.key, entry.rid, tRid);
+		if (L->Delete(entry.key, entry.rid, tRid) != OK)
+		{
+			oldchildentry.pid = INVALID_PAGE;
+			UnpinNode(pid, CLEAN);
+			return DONE;
+		}
 
-		if (L->GetNumOfRecords() >= treeOrder || pid == rootPid)
+		if (L->IsAtLeastHalfFull() || pid == rootPid)
 		{
 			std::cout << "delete leaf / root page element" << std::endl;
-			if (oldchildentry != NULL) {
-				delete oldchildentry;
-			}
-			oldchildentry = NULL;
-			MINIBASE_BM->UnpinPage(pid, DIRTY);
+			oldchildentry.pid = INVALID_PAGE;
+			UnpinNode(pid, DIRTY);
 			std::cout << "ok ???" << std::endl;
 			return OK;
 		}
 		else
 		{
 			//Get a sibling S of N
-			SortedPage *Spage, *Ppage;
+			BTNodePage *Spage, *Ppage;
 			BTLeafPage *S;
 			BTIndexPage *P;
 			IndexEntry left, right;
 			LeafEntry tEntry;
 
-			MINIBASE_BM->PinPage(Ppid, (Page *&)Ppage);
+			s = PinNode(Ppid, (Page *&)Ppage);
+			if (s != OK)
+			{
+				oldchildentry.pid = INVALID_PAGE;
+				UnpinNode(pid, DIRTY);
+				return MINIBASE_CHAIN_ERROR(BTREE, s);
+			}
 			P = (BTIndexPage *)Ppage;
 
 			//std::cout << "pid = " << pid << ", left.pid = " << left.pid << "  right.pid = " << right.pid << std::endl;
@@ -629,29 +1184,35 @@ BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry
 			{
 				P->GetFirst(right.key, right.pid, tRid);
 
-				MINIBASE_BM->PinPage(right.pid, (Page *&)Spage);
+				s = PinNode(right.pid, (Page *&)Spage);
+				if (s != OK)
+				{
+					oldchildentry.pid = INVALID_PAGE;
+					UnpinNode(pid, DIRTY);
+					UnpinNode(Ppid, DIRTY);
+					return MINIBASE_CHAIN_ERROR(BTREE, s);
+				}
 				S = (BTLeafPage *)Spage;
 
 				// S has extra entries
-				if (S->GetNumOfRecords() > treeOrder)
+				if (S->GetNumOfRecords() > S->MinEntries())
 				{
 					// Redistribution
 					S->GetFirst(tEntry.key, tEntry.rid, tRid);
 					S->Delete(tEntry.key, tEntry.rid, tRid);
 
-					L->Insert(tEntry.key, tEntry.rid, tRid);
+					L->Insert(tEntry.key, tEntry.rid, tRid, packScratch);
 
 					S->GetFirst(tEntry.key, tEntry.rid, tRid);
 
-					P->Delete(right.key, tRid);
-					P->Insert(tEntry.key, right.pid, tRid);
+					P->SetKey(0, tEntry.key);
 
 					// Set oldchildentry to null
-					oldchildentry = NULL;
+					oldchildentry.pid = INVALID_PAGE;
 
-					MINIBASE_BM->UnpinPage(pid, DIRTY);
-					MINIBASE_BM->UnpinPage(Ppid, DIRTY);
-					MINIBASE_BM->UnpinPage(right.pid, DIRTY);
+					UnpinNode(pid, DIRTY);
+					UnpinNode(Ppid, DIRTY);
+					UnpinNode(right.pid, DIRTY);
 					return OK;
 				}
 				//Merge N and S (M = S)
@@ -660,15 +1221,13 @@ BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry
 					PageID tPid;
 
 					// Set oldchildentry
-					delete oldchildentry;
-					oldchildentry = new IndexEntry;
-					*oldchildentry = right;
+					oldchildentry = right;
 
 					// Move all entries from M
 					while (!S->IsEmpty())
 					{
 						S->GetFirst(tEntry.key, tEntry.rid, tRid);
-						L->Insert(tEntry.key, tEntry.rid, tRid);
+						L->Insert(tEntry.key, tEntry.rid, tRid, packScratch);
 						S->Delete(tEntry.key, tEntry.rid, tRid);
 					}
 
@@ -677,43 +1236,55 @@ BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry
 
 					if (tPid != -1)
 					{
-						SortedPage *tPage;
+						BTNodePage *tPage;
 						BTLeafPage *tS;
-						MINIBASE_BM->PinPage(tPid, (Page *&)tPage);
+						s = PinNode(tPid, (Page *&)tPage);
+						if (s != OK)
+						{
+							oldchildentry.pid = INVALID_PAGE;
+							UnpinNode(pid, DIRTY);
+							UnpinNode(Ppid, DIRTY);
+							UnpinNode(right.pid, DIRTY);
+							return MINIBASE_CHAIN_ERROR(BTREE, s);
+						}
 						tS = (BTLeafPage *)tPage;
 						tS->SetPrevPage(pid);
-						MINIBASE_BM->UnpinPage(tPid, DIRTY);
+						UnpinNode(tPid, DIRTY);
 					}
 
 					L->SetNextPage(tPid);
 
-					MINIBASE_BM->UnpinPage(pid, DIRTY);
-					MINIBASE_BM->UnpinPage(Ppid, DIRTY);
-					MINIBASE_BM->UnpinPage(right.pid, DIRTY);
+					UnpinNode(pid, DIRTY);
+					UnpinNode(Ppid, DIRTY);
+					UnpinNode(right.pid, DIRTY);
 
 					// Discard empty node M
-					MINIBASE_BM->FreePage(right.pid);
+					DropNode(right.pid);
 					return OK;
 				}
 			}
 			// Bring left sibling
 			else
 			{
-				P->GetFirst(right.key, right.pid, tRid);
-				left.pid = P->GetLeftLink();
-				while (right.pid != pid)
-				{
-					left = right;
-					P->GetNext(right.key, right.pid, tRid);
-				}
+				int pos = P->FindChildPos(pid) - 1;
+
+				P->GetEntry(pos, right);
+				left.pid = P->GetChild(pos);
 
 				std::cout << "left.pid = " << left.pid << " right = " << right.pid << std::endl;
 
-				MINIBASE_BM->PinPage(left.pid, (Page *&)Spage);
+				s = PinNode(left.pid, (Page *&)Spage);
+				if (s != OK)
+				{
+					oldchildentry.pid = INVALID_PAGE;
+					UnpinNode(pid, DIRTY);
+					UnpinNode(Ppid, DIRTY);
+					return MINIBASE_CHAIN_ERROR(BTREE, s);
+				}
 				S = (BTLeafPage *)Spage;
 
 				// S has extra entries
-				if (S->GetNumOfRecords() > treeOrder)
+				if (S->GetNumOfRecords() > S->MinEntries())
 				{
 					// Redistribution
 					LeafEntry tEntrySaved;
@@ -726,19 +1297,18 @@ BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry
 						std::cout << "delete key = " << tEntrySaved.key << "FAIL!!" << std::endl;
 					}
 
-					L->Insert(tEntrySaved.key, tEntrySaved.rid, tRid);
+					L->Insert(tEntrySaved.key, tEntrySaved.rid, tRid, packScratch);
 
 					L->GetFirst(tEntry.key, tEntry.rid, tRid);
 
-					P->Delete(right.key, tRid);
-					P->Insert(tEntry.key, right.pid, tRid);
+					P->SetKey(pos, tEntry.key);
 
 					// Set oldchildentry to null
-					oldchildentry = NULL;
+					oldchildentry.pid = INVALID_PAGE;
 
-					MINIBASE_BM->UnpinPage(pid, DIRTY);
-					MINIBASE_BM->UnpinPage(Ppid, DIRTY);
-					MINIBASE_BM->UnpinPage(left.pid, DIRTY);
+					UnpinNode(pid, DIRTY);
+					UnpinNode(Ppid, DIRTY);
+					UnpinNode(left.pid, DIRTY);
 					return OK;
 				}
 				// Merge S and N  (M = N)
@@ -747,15 +1317,13 @@ BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry
 					PageID tPid;
 
 					// Set oldchildentry
-					delete oldchildentry;
-					oldchildentry = new IndexEntry;
-					*oldchildentry = right;
+					oldchildentry = right;
 
 					// Move all entries from M
 					while (!L->IsEmpty())
 					{
 						L->GetFirst(tEntry.key, tEntry.rid, tRid);
-						S->Insert(tEntry.key, tEntry.rid, tRid);
+						S->Insert(tEntry.key, tEntry.rid, tRid, packScratch);
 						L->Delete(tEntry.key, tEntry.rid, tRid);
 					}
 
@@ -765,22 +1333,30 @@ BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry
 
 					if (tPid != -1)
 					{
-						SortedPage *tPage;
+						BTNodePage *tPage;
 						BTLeafPage *tS;
-						MINIBASE_BM->PinPage(tPid, (Page *&)tPage);
+						s = PinNode(tPid, (Page *&)tPage);
+						if (s != OK)
+						{
+							oldchildentry.pid = INVALID_PAGE;
+							UnpinNode(pid, DIRTY);
+							UnpinNode(Ppid, DIRTY);
+							UnpinNode(left.pid, DIRTY);
+							return MINIBASE_CHAIN_ERROR(BTREE, s);
+						}
 						tS = (BTLeafPage *)tPage;
 						tS->SetPrevPage(left.pid);
-						MINIBASE_BM->UnpinPage(tPid, DIRTY);
+						UnpinNode(tPid, DIRTY);
 					}
 
 					S->SetNextPage(tPid);
 
-					MINIBASE_BM->UnpinPage(pid, DIRTY);
-					MINIBASE_BM->UnpinPage(Ppid, DIRTY);
-					MINIBASE_BM->UnpinPage(left.pid, DIRTY);
+					UnpinNode(pid, DIRTY);
+					UnpinNode(Ppid, DIRTY);
+					UnpinNode(left.pid, DIRTY);
 
 					// Discard empty node M
-					MINIBASE_BM->FreePage(pid);
+					DropNode(pid);
 					return OK;
 				}
 			}
@@ -790,11 +1366,52 @@ BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry
 }
 
 
+//-------------------------------------------------------------------
+// BTreeFile::RecountChildren
+//
+// Input   : page     - an index node of a counted tree, pinned
+//           from, to - range of child positions, clipped to the node
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Set the counts of these children from the children
+//           themselves.  A delete calls it on the way back up for the
+//           child it went into and the siblings that child may have
+//           traded entries with or been merged into; the redistribution
+//           and merge code then need not keep the counts themselves.
+//-------------------------------------------------------------------
+
+Status BTreeFile::RecountChildren(BTIndexPage *page, int from, int to)
+{
+	BTNodePage *child;
+	PageID childPid;
+	Status s;
+
+	if (from < 0)
+		from = 0;
+	if (to > page->GetNumOfRecords())
+		to = page->GetNumOfRecords();
+
+	for (int i = from; i <= to; i++)
+	{
+		childPid = page->GetChild(i);
+		s = PinNode(childPid, (Page *&)child);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+		page->SetChildCount(i, child->SubtreeCount());
+		UnpinNode(childPid, CLEAN);
+	}
+	return OK;
+}
+
+
 //-------------------------------------------------------------------
 // BTreeFile::OpenScan
 //
 // Input   : lowKey, highKey - pointer to keys, indicate the range
 //                             to scan.
+//           order - Ascending, or Descending to return the records from
+//                   highKey down to lowKey
+//           snap  - a snapshot to scan, NULL for the tree as it is
 // Output  : None
 // Return  : A pointer to IndexFileScan class.
 // Purpose : Initialize a scan.  
@@ -811,85 +1428,717 @@ BTreeFile::do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry
 //-------------------------------------------------------------------
 
 IndexFileScan *
-BTreeFile::OpenScan(const int *lowKey, const int *highKey)
+BTreeFile::OpenScan(const int *lowKey, const int *highKey, TupleOrder order,
+                    const BTSnapshot *snap)
 {
 	BTreeFileScan* bTFileScan = new BTreeFileScan;
-	PageID pid;
-	Status s;
 
-	bTFileScan->highKey = highKey;
-	bTFileScan->lowKey = lowKey;
-	bTFileScan->tree = this;
-	bTFileScan->firstTime = true;
+	if (OpenScan(lowKey, highKey, *bTFileScan, order, snap) != OK)
+	{
+		delete bTFileScan;
+		return NULL;
+	}
+	return bTFileScan;
+}
 
-	IndexEntry index_entry, t_entry;
-	RecordID t_rid;
 
-	int temp = 0;
-	SortedPage *page;
+//-------------------------------------------------------------------
+// BTreeFile::OpenScan
+//
+// Input   : lowKey, highKey, order, snap - as above
+//           scan - a scan object owned by the caller
+// Output  : scan - positioned before the first entry of the range
+// Purpose : Open a scan without allocating it.  If scan was still open
+//           on some tree, it is closed first.
+// Return  : OK if successful, an error status otherwise.
+//-------------------------------------------------------------------
 
-	if (lowKey != NULL)
+Status
+BTreeFile::OpenScan(const int *lowKey, const int *highKey, BTreeFileScan &scan,
+                    TupleOrder order, const BTSnapshot *snap)
+{
+	Status s;
+	BTNodePage *page, *child;
+	BTIndexPage *indexPage;
+	PageID node, end = INVALID_PAGE;
+	int pos, endPos, height = 0, endHeight = 0;
+	Bool advise;
+
+	scan.Close();
+	scan.highKey = highKey;
+	scan.lowKey = lowKey;
+	scan.tree = this;
+	scan.firstTime = true;
+	scan.readAheadTo = INVALID_PAGE;
+	scan.order = (order == Descending) ? Descending : Ascending;
+	scan.snap = snap;
+	scan.merging = buffered ||
+	               (snap == NULL && delta != NULL && delta->GetNumOfMessages() > 0);
+
+	// Let a memory-mapped database know that the leaves of a range will
+	// be read in order.  A lookup of one key reads too little for it to
+	// matter.
+	advise = (mem == NULL && snap == NULL && MINIBASE_DB->IsMapped() &&
+	          !(lowKey != NULL && highKey != NULL && *lowKey == *highKey));
+
+	// Go down to the first leaf that can hold lowKey, or the leftmost
+	// one.  A descending scan goes down to the last leaf that can hold
+	// highKey, or the rightmost one.  Children are pinned through
+	// their references, so that a descent through pages already in the
+	// buffer pool does not look them up by page id.  A snapshot is
+	// read through the copies made for it.  For the advice, the node
+	// where the other end of the range leaves the path is noted.
+	node = (snap != NULL) ? SnapshotNode(snap, snap->rootPid) : rootPid;
+	s = PinNode(node, (Page *&)page);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	while (page->GetType() == INDEX_NODE)
 	{
-		pid = rootPid;
+		indexPage = (BTIndexPage *)page;
 
-		MINIBASE_BM->PinPage(rootPid, (Page *&)page);
-		while (page->GetType() == INDEX_NODE)
+		if (scan.order == Descending)
+			pos = indexPage->FindInsertPos(highKey != NULL ? *highKey : INT_MAX);
+		else if (lowKey != NULL)
+			pos = indexPage->LowerBound(*lowKey);
+		else
+			pos = 0;
+		if (advise && end == INVALID_PAGE)
 		{
-			((BTIndexPage *)page)->GetFirst(index_entry.key, index_entry.pid, t_rid);
-			MINIBASE_BM->UnpinPage(pid, CLEAN);
-			////////////////
-			temp = 0;
-			while (index_entry.key < *lowKey)
+			if (scan.order != Descending)
+				endPos = indexPage->FindInsertPos(highKey != NULL ? *highKey : INT_MAX);
+			else if (lowKey != NULL)
+				endPos = indexPage->LowerBound(*lowKey);
+			else
+				endPos = 0;
+			if (endPos != pos)
 			{
-				temp++;
-				t_entry = index_entry;
-
-				if (((BTIndexPage *)page)->GetNext(index_entry.key, index_entry.pid, t_rid) == DONE)
-				{
-					break;
-				}
+				end = indexPage->GetChild(endPos);
+				endHeight = height + 1;
 			}
+		}
+		if (snap != NULL)
+		{
+			node = SnapshotNode(snap, indexPage->GetChild(pos));
+			s = PinNode(node, (Page *&)child);
+		}
+		else
+		{
+			s = PinChild(indexPage, pos, child);
+		}
+		UnpinNode((Page *)page, CLEAN);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+		page = child;
+		height++;
+	}
+
+	// The leaf stays pinned while the scan is on it.  A copy keeps the
+	// page id of the node it was made from.
+	scan.curLeaf = (BTLeafPage *)page;
+	scan.cur_pid = page->PageNo();
+	scan.curNode = (snap != NULL) ? node : scan.cur_pid;
+
+	if (advise)
+		AdviseScan(lowKey, highKey, scan.order, scan.cur_pid,
+		           (end != INVALID_PAGE) ? end : scan.cur_pid,
+		           (end != INVALID_PAGE) ? height - endHeight : 0);
+
+	// What the buffers hold for the range is merged in as the scan goes.
+	// The delta buffer is newer than the tree; a snapshot is taken with
+	// it merged in.
+	if ((buffered && height > 0) || scan.merging)
+	{
+		BTScanMessage *msgs;
+		BTDeltaNode *d;
+		int n = 0, max = 64, seq = 0;
+
+		msgs = new BTScanMessage[max];
+		s = OK;
+		if (buffered && height > 0)
+			s = GetMessages((snap != NULL) ? snap->rootPid : rootPid, 0, height,
+			                lowKey, highKey, snap, msgs, n, max);
+		if (snap == NULL && delta != NULL)
+		{
+			d = delta->Find(lowKey != NULL ? *lowKey : INT_MIN);
+			for (; d != NULL && (highKey == NULL || d->msg.key <= *highKey);
+			     d = BTDeltaBuffer::Next(d))
+				AddScanMessage(msgs, n, max, d->msg, -1, seq++);
+		}
+		if (s == OK)
+			s = scan.SetMessages(msgs, n);
+		delete [] msgs;
+		if (s != OK)
+		{
+			scan.Close();
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+		}
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::AdviseScan
+//
+// Input   : lowKey, highKey, order - a scan, as for OpenScan()
+//           leaf   - the leaf the scan starts on
+//           end    - the node where the other end of the range left
+//                    the descent of OpenScan()
+//           levels - index levels from end down to the leaves, 0 if
+//                    end is a leaf
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Advise sequential access to the pages of a memory-mapped
+//           database from the leaf the scan starts on to the one it
+//           ends on.  Only the index nodes below where the two ends of
+//           the range part are read to find it.  The leaves of a tree
+//           that was bulk loaded, or grew a run of pages at a time, lie
+//           in that span in order, and the pages outside it keep the
+//           advice they had.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::AdviseScan(const int *lowKey, const int *highKey, TupleOrder order,
+                      PageID leaf, PageID end, int levels)
+{
+	BTIndexPage *indexPage;
+	int pos;
+	Status s;
+
+	// Go down from end to the leaf at the other end of the range
+	for (; levels > 0; levels--)
+	{
+		s = PinNode(end, (Page *&)indexPage);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+		if (order != Descending)
+			pos = indexPage->FindInsertPos(highKey != NULL ? *highKey : INT_MAX);
+		else if (lowKey != NULL)
+			pos = indexPage->LowerBound(*lowKey);
+		else
+			pos = 0;
+		end = indexPage->GetChild(pos);
+		UnpinNode((Page *)indexPage, CLEAN);
+	}
+
+	if (end < leaf)
+	{
+		PageID t = end;
+		end = leaf;
+		leaf = t;
+	}
+	MINIBASE_DB->AdviseAccess(DB_ACCESS_SEQUENTIAL, leaf, end - leaf + 1);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// AddKey / CompareKeys
+//
+// Purpose : Append x to the array a of n elements, which has room for
+//           max, doubling it when full; order keys for qsort().
+//-------------------------------------------------------------------
+
+static void AddKey(int *&a, int &n, int &max, int x)
+{
+	if (n == max)
+	{
+		int *larger = new int[2 * max];
+
+		memcpy(larger, a, n * sizeof(int));
+		delete [] a;
+		a = larger;
+		max *= 2;
+	}
+	a[n++] = x;
+}
 
-			///////////////////
-			if (!temp)
+static int CompareKeys(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::OpenParallelScan
+//
+// Input   : lowKey, highKey - the range to scan, as for OpenScan()
+//           nparts - how many scans to open at most
+//           scans  - an array of nparts scan objects
+//           snap   - a snapshot to scan, NULL for the tree as it is
+// Output  : scans - scans[0..n) opened on consecutive parts of the
+//                   range, in key order
+//           n     - the number of scans opened, 1 to nparts
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Go down the tree a level at a time through the nodes that
+//           overlap the range, collecting the separator keys inside it,
+//           until there are at least nparts - 1 of them or the next
+//           level is the leaves.  The keys collected split the range
+//           into subtrees of the same height, so keys picked evenly
+//           from them give parts of about the same size.  A tree too
+//           small to have the separators gets fewer parts.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::OpenParallelScan(const int *lowKey, const int *highKey, int nparts,
+                            BTreeFileScan *scans, int &n,
+                            const BTSnapshot *snap)
+{
+	int *level, *next, *keys, *swap;
+	int numOfNodes, numOfNext, numOfKeys, maxNodes, maxNext, maxKeys;
+	int i, j, first, last, m;
+	BTNodePage *page;
+	BTIndexPage *indexPage;
+	IndexEntry entry;
+	Status s = OK;
+
+	n = 0;
+	maxNodes = maxNext = maxKeys = 16;
+	level = new int[maxNodes];
+	next = new int[maxNext];
+	keys = new int[maxKeys];
+	numOfNodes = 1;
+	numOfKeys = 0;
+	level[0] = (snap != NULL) ? snap->rootPid : rootPid;
+
+	while (s == OK && numOfKeys < nparts - 1)
+	{
+		numOfNext = 0;
+		for (j = 0; j < numOfNodes; j++)
+		{
+			s = PinNode((snap != NULL) ? SnapshotNode(snap, level[j]) : level[j],
+			            (Page *&)page);
+			if (s != OK)
+				break;
+			if (page->GetType() != INDEX_NODE)
 			{
-				pid = ((BTIndexPage *)page)->GetLeftLink();
+				UnpinNode((Page *)page, CLEAN);
+				break;
 			}
-			else
+
+			// The children that overlap the range, and the keys
+			// between them
+			indexPage = (BTIndexPage *)page;
+			first = (lowKey != NULL) ? indexPage->LowerBound(*lowKey) : 0;
+			last = (highKey != NULL) ? indexPage->FindInsertPos(*highKey)
+			                         : indexPage->GetNumOfRecords();
+			for (i = first; i <= last; i++)
 			{
-				index_entry = t_entry;
-				pid = index_entry.pid;
+				if (i > first)
+				{
+					indexPage->GetEntry(i - 1, entry);
+					if ((lowKey == NULL || entry.key > *lowKey) &&
+					    (highKey == NULL || entry.key <= *highKey))
+						AddKey(keys, numOfKeys, maxKeys, entry.key);
+				}
+				AddKey(next, numOfNext, maxNext, indexPage->GetChild(i));
 			}
-
-			MINIBASE_BM->PinPage(pid, (Page *&)page);
+			UnpinNode((Page *)page, CLEAN);
 		}
-		//bTFileScan->curLeaf = (BTLeafPage *&)page;
-		MINIBASE_BM->UnpinPage(pid, CLEAN);
-		s = MINIBASE_BM->PinPage(pid, (Page *&)bTFileScan->curLeaf);
-		bTFileScan->cur_pid = pid;
-		if (s != OK) return NULL;
+
+		// Down at the leaves
+		if (j < numOfNodes)
+			break;
+
+		swap = level;
+		level = next;
+		next = swap;
+		numOfNodes = numOfNext;
+		m = maxNodes;
+		maxNodes = maxNext;
+		maxNext = m;
 	}
-	else
+	delete [] level;
+	delete [] next;
+
+	if (s != OK)
+	{
+		delete [] keys;
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	}
+
+	// Sorted without duplicates, each key splits the range in two.  No
+	// key is below INT_MIN, so it splits off nothing and the part
+	// before it would have no upper bound to end at.
+	qsort(keys, numOfKeys, sizeof(int), CompareKeys);
+	for (i = 0, m = 0; i < numOfKeys; i++)
+		if (keys[i] != INT_MIN && (m == 0 || keys[i] != keys[m - 1]))
+			keys[m++] = keys[i];
+
+	if (nparts > m + 1)
+		nparts = m + 1;
+	if (nparts < 1)
+		nparts = 1;
+
+	// Part i runs from the key picked for it to just before the next
+	for (i = 0; i < nparts; i++)
 	{
-		PageID nextPid = rootPid;
-		MINIBASE_BM->PinPage(nextPid, (Page *&)page);
+		const int *low = lowKey, *high = highKey;
+
+		if (i > 0)
+		{
+			scans[i].partLow = keys[(long long)i * m / nparts];
+			low = &scans[i].partLow;
+		}
+		if (i < nparts - 1)
+		{
+			scans[i].partHigh = keys[(long long)(i + 1) * m / nparts] - 1;
+			high = &scans[i].partHigh;
+		}
 
-		while (page->GetType() == INDEX_NODE)
+		s = OpenScan(low, high, scans[i], Ascending, snap);
+		if (s != OK)
 		{
-			MINIBASE_BM->UnpinPage(nextPid, CLEAN);
-			nextPid = ((BTIndexPage*&)page)->GetLeftLink();
-			MINIBASE_BM->PinPage(nextPid, (Page *&)page);
+			while (--i >= 0)
+				scans[i].Close();
+			delete [] keys;
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
 		}
-		MINIBASE_BM->UnpinPage(nextPid, CLEAN);
+	}
+
+	delete [] keys;
+	n = nparts;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::Snapshot
+//
+// Input   : None
+// Output  : None
+// Return  : The new snapshot, to be released with ReleaseSnapshot().
+// Purpose : Take a snapshot of the tree as it is now.  Nothing is
+//           copied until a node it sees is about to change.  The delta
+//           buffer is merged in first.
+//-------------------------------------------------------------------
 
+BTSnapshot *
+BTreeFile::Snapshot()
+{
+	BTSnapshot *snap;
+
+	// What the delta buffer holds is part of what the snapshot sees
+	if (MergeDelta() != OK)
+		return NULL;
+
+	snap = new BTSnapshot;
+	if (snap == NULL)
+		return NULL;
+	snap->rootPid = rootPid;
+	snap->epoch = epoch++;
+	snap->next = snapshots;
+	snapshots = snap;
+	return snap;
+}
 
-		s = MINIBASE_BM->PinPage(nextPid, (Page *&)bTFileScan->curLeaf);
-		bTFileScan->cur_pid = nextPid;
-		if (s != OK) return NULL;
 
+//-------------------------------------------------------------------
+// BTreeFile::ReleaseSnapshot
+//
+// Input   : snap - a snapshot of this tree, with no scans open on it
+// Output  : None
+// Return  : OK if successful, FAIL if snap is not a snapshot of this
+//           tree, an error status otherwise.
+// Purpose : Drop a snapshot, and free the copies, and the nodes held
+//           for snapshots (see DropNode()), that no snapshot in use
+//           sees any more.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::ReleaseSnapshot(BTSnapshot *snap)
+{
+	BTSnapshot **link = &snapshots;
+	BTNodeCopy *c, *next;
+	Status s, result = OK;
+
+	while (*link != NULL && *link != snap)
+		link = &(*link)->next;
+	if (*link == NULL)
+		return FAIL;
+	*link = snap->next;
+	delete snap;
+
+	for (c = copies.Prune(snapshots); c != NULL; c = next)
+	{
+		next = c->next;
+		if (c->copy != INVALID_PAGE)
+		{
+			s = FreeNode(c->copy);
+			if (s != OK)
+				result = MINIBASE_CHAIN_ERROR(BTREE, s);
+		}
+		delete c;
 	}
+	return result;
+}
 
-	return bTFileScan;
+
+//-------------------------------------------------------------------
+// BTreeFile::CopyForSnapshots
+//
+// Input   : pid  - a node about to be written
+//           page - the node, pinned
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Copy the node for the snapshots that see it as it is, if
+//           there are any and it was not copied for them already.  The
+//           child references of the copy are unswizzled, since only
+//           page ids mean anything outside the node itself.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::CopyForSnapshots(PageID pid, Page *page)
+{
+	int from = copies.LastEpoch(pid) + 1;
+	PageID copyPid;
+	Page *copy;
+	Status s;
+
+	// Snapshots before from have a copy, those after the newest one
+	// will see the change.
+	if (snapshots->epoch < from)
+		return OK;
+
+	if (mem != NULL)
+		s = mem->NewNode(copyPid, copy);
+	else
+		s = MINIBASE_BM->NewPage(copyPid, copy);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	memcpy((char *)copy, (char *)page, nodeSize);
+	if (((BTNodePage *)page)->GetType() == INDEX_NODE)
+	{
+		BTIndexPage *node = (BTIndexPage *)page;
+		BTIndexPage *nodeCopy = (BTIndexPage *)copy;
+
+		for (int i = 0; i <= node->GetNumOfRecords(); i++)
+			*nodeCopy->ChildRef(i) = node->GetChild(i);
+	}
+	UnpinNode(copyPid, DIRTY);
+
+	s = copies.Insert(pid, copyPid, from, snapshots->epoch);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::NoCopyNeeded
+//
+// Input   : pid - a node just added to the tree
+// Output  : None
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Note that the snapshots in use do not see pid, so that it
+//           is not copied for them when it is written.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::NoCopyNeeded(PageID pid)
+{
+	int from;
+
+	if (snapshots == NULL)
+		return OK;
+
+	from = copies.LastEpoch(pid) + 1;
+	if (snapshots->epoch < from)
+		return OK;
+	return copies.Insert(pid, INVALID_PAGE, from, snapshots->epoch);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::SnapshotNode
+//
+// Input   : snap - a snapshot
+//           pid  - a node it sees
+// Output  : None
+// Return  : The node to read for snap: pid, or a copy of it.
+//-------------------------------------------------------------------
+
+PageID
+BTreeFile::SnapshotNode(const BTSnapshot *snap, PageID pid)
+{
+	PageID copy = copies.Find(pid, snap->epoch);
+
+	return (copy != INVALID_PAGE) ? copy : pid;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::Rank
+//
+// Input   : key - a key value
+// Output  : rank - number of entries with a key smaller than key, which
+//                  is also the position of the first entry with key
+// Return  : OK if successful, FAIL if the tree keeps no counts, an
+//           error status otherwise.
+// Purpose : Go down to the leaf where key would be, adding up the
+//           counts of the children left of the path on the way.  The
+//           counts only cover the delta buffer once it is merged in.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::Rank(const int key, int &rank)
+{
+	BTNodePage *page, *child;
+	BTIndexPage *indexPage;
+	Status s;
+	int pos;
+
+	rank = 0;
+	if (!counted)
+		return FAIL;
+	s = MergeDelta();
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	s = PinNode(rootPid, (Page *&)page);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	while (page->GetType() == INDEX_NODE)
+	{
+		indexPage = (BTIndexPage *)page;
+
+		// The same child a scan from key starts at
+		pos = indexPage->LowerBound(key);
+		for (int i = 0; i < pos; i++)
+			rank += indexPage->GetChildCount(i);
+		s = PinChild(indexPage, pos, child);
+		UnpinNode((Page *)page, CLEAN);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+		page = child;
+	}
+
+	rank += page->LowerBound(key);
+	UnpinNode((Page *)page, CLEAN);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::CountRange
+//
+// Input   : lowKey, highKey - the range, as for OpenScan()
+// Output  : n - number of entries in the range
+// Return  : OK if successful, FAIL if the tree keeps no counts, an
+//           error status otherwise.
+// Purpose : Count a range without scanning it: the difference of the
+//           ranks of its ends.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::CountRange(const int *lowKey, const int *highKey, int &n)
+{
+	BTNodePage *root;
+	int low = 0, high;
+	Status s;
+
+	n = 0;
+	if (!counted)
+		return FAIL;
+	s = MergeDelta();
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	if (lowKey != NULL)
+	{
+		s = Rank(*lowKey, low);
+		if (s != OK)
+			return s;
+	}
+
+	if (highKey != NULL && *highKey != INT_MAX)
+	{
+		s = Rank(*highKey + 1, high);
+		if (s != OK)
+			return s;
+	}
+	else
+	{
+		s = PinNode(rootPid, (Page *&)root);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+		high = root->SubtreeCount();
+		UnpinNode(rootPid, CLEAN);
+	}
+
+	if (high > low)
+		n = high - low;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::Select
+//
+// Input   : i - a position in key order, from 0
+// Output  : key, rid - the entry at that position
+// Return  : OK if successful, DONE if the tree has no more than i
+//           entries, FAIL if it keeps no counts, an error status
+//           otherwise.
+// Purpose : Go down to the i-th entry, skipping over the children
+//           whose counts add up to less than i, after merging in the
+//           delta buffer.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::Select(int i, int &key, RecordID &rid)
+{
+	BTNodePage *page, *child;
+	BTIndexPage *indexPage;
+	LeafEntry entry;
+	Status s;
+	int c;
+
+	if (!counted)
+		return FAIL;
+	if (i < 0)
+		return DONE;
+	s = MergeDelta();
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	s = PinNode(rootPid, (Page *&)page);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+
+	while (page->GetType() == INDEX_NODE)
+	{
+		indexPage = (BTIndexPage *)page;
+
+		for (c = 0; c < indexPage->GetNumOfRecords(); c++)
+		{
+			if (i < indexPage->GetChildCount(c))
+				break;
+			i -= indexPage->GetChildCount(c);
+		}
+		s = PinChild(indexPage, c, child);
+		UnpinNode((Page *)page, CLEAN);
+		if (s != OK)
+			return MINIBASE_CHAIN_ERROR(BTREE, s);
+		page = child;
+	}
+
+	if (i >= page->GetNumOfRecords())
+	{
+		UnpinNode((Page *)page, CLEAN);
+		return DONE;
+	}
+
+	((BTLeafPage *)page)->GetEntry(i, entry);
+	key = entry.key;
+	rid = entry.rid;
+	UnpinNode((Page *)page, CLEAN);
+	return OK;
 }
 
 
@@ -905,14 +2154,15 @@ BTreeFile::OpenScan(const int *lowKey, const int *highKey)
 Status 
 BTreeFile::PrintTree (PageID pageID)
 { 
-	SortedPage *page;
+	BTNodePage *page;
 	BTIndexPage *index;
 	Status s;
 	PageID curPageID;
 	RecordID curRid;
 	int  key;
 
-	PIN (pageID, page);
+	if (PinNode(pageID, (Page *&)page) != OK)
+		return FAIL;
 	NodeType type = (NodeType) page->GetType ();
 	
 	if (type == INDEX_NODE) 
@@ -927,12 +2177,12 @@ BTreeFile::PrintTree (PageID pageID)
 			PrintTree(curPageID);
 			s = index->GetNext(key, curPageID, curRid);
 		}
-		UNPIN(pageID, CLEAN);
+		UnpinNode(pageID, CLEAN);
 		PrintNode(pageID);
 	} 
 	else {
 		std::cout << "Page ID = " << pageID << " is a LEAF_NODE" << std::endl;
-		UNPIN(pageID, CLEAN);
+		UnpinNode(pageID, CLEAN);
 		PrintNode(pageID);
 	}
 	return OK;
@@ -952,7 +2202,7 @@ BTreeFile::PrintNode (PageID pageID)
 {
 	
 	char filename[50]="c:\\temp\\BTREENODES.TXT";
-	SortedPage *page;
+	BTNodePage *page;
 	BTIndexPage *index;
 	BTLeafPage *leaf;
 	int i;
@@ -964,7 +2214,8 @@ BTreeFile::PrintNode (PageID pageID)
 
 	std::ofstream os(filename, std::ios::app);
 	
-	PIN (pageID, page);
+	if (PinNode(pageID, (Page *&)page) != OK)
+		return FAIL;
 	NodeType type = (NodeType) page->GetType ();
 	i = 0;
 	switch (type) 
@@ -997,7 +2248,7 @@ BTreeFile::PrintNode (PageID pageID)
 			os << "\n This page contains  " << i <<"  entries." << std::endl;
 			break;
 	}
-	UNPIN(pageID, CLEAN);
+	UnpinNode(pageID, CLEAN);
 	os.close();
 
 	return OK;	
@@ -1,13 +1,27 @@
 #ifndef _BTFILE_H
 #define _BTFILE_H
 
+#include "bufmgr.h"
 #include "btindex.h"
 #include "btleaf.h"
+#include "btmem.h"
+#include "btsnap.h"
+#include "btdelta.h"
 #include "index.h"
 #include "btfilescan.h"
 #include "bt.h"
 
-const int treeOrder = 4;
+// Leaf pages are taken from runs of this many pages reserved in the DB at
+// once (at most 32, one bit each in leafExtentUsed).
+const int LEAF_EXTENT = 16;
+
+// The path down to the rightmost leaf is remembered for trees up to this
+// height, so that keys appended in order can go straight to the leaf.
+const int BT_MAX_HEIGHT = 16;
+
+// Appends in a row after which nodes on the right edge are split so that
+// they stay full (see BTNodePage::SplitInsert()).
+const int APPEND_RUN = 4;
 
 class BTreeFile: public IndexFile {
 	
@@ -15,29 +29,196 @@ public:
 	
 	friend class BTreeFileScan;
 
-	BTreeFile(Status& status, const char *filename);
+	// withBuffers makes a buffered tree (see Insert()); a tree cannot
+	// both keep counts and buffers.  withPacking makes a packed tree,
+	// whose leaves store each entry in as few bits as the entries
+	// around it allow (see btnode.h), at some cost in decoding them.
+	// Its leaves are not merged when entries are deleted, so it cannot
+	// keep counts either.
+	BTreeFile(Status& status, const char *filename, Bool withCounts = FALSE,
+	          Bool withBuffers = FALSE, Bool withPacking = FALSE);
+	BTreeFile(Status& status, int nodeSize, Bool withCounts = FALSE,
+	          Bool withBuffers = FALSE, Bool withPacking = FALSE);
 	~BTreeFile();
 	
 	Status DestroyFile();
 	
+	// In a buffered tree, inserts and deletes are messages put in the
+	// buffer of the root and flushed down a level at a time, a batch
+	// for one child when a buffer fills, so that a leaf is written once
+	// per batch instead of once per entry.  Scans and lookups merge the
+	// messages still on the way.  A buffered tree is meant for indexes
+	// with each (key, rid) at most once: a message replaces whatever
+	// the leaves hold for its (key, rid).
 	Status Insert(const int key, const RecordID rid); 
 	Status Delete(const int key, const RecordID rid);
+
+	// A write buffer in front of the tree, in memory: inserts and
+	// deletes wait in it, in key order, and scans and lookups see
+	// them.  When it holds maxEntries, they are merged into the tree in
+	// key order, each leaf taking all of its own at once.  0 (the
+	// default) removes the buffer, merging what it holds first.
+	Status SetDeltaBuffer(int maxEntries);
+	Status MergeDelta();
     
-	IndexFileScan *OpenScan(const int *lowKey, const int *highKey);
+	IndexFileScan *OpenScan(const int *lowKey, const int *highKey,
+	                        TupleOrder order = Ascending,
+	                        const BTSnapshot *snap = NULL);
+	Status OpenScan(const int *lowKey, const int *highKey, BTreeFileScan &scan,
+	                TupleOrder order = Ascending, const BTSnapshot *snap = NULL);
+
+	// Split [lowKey, highKey] at separator keys of the upper levels into
+	// at most nparts ranges of about the same number of entries, and
+	// open an ascending scan on each.  The n scans are independent, so
+	// different threads can read them at the same time.
+	Status OpenParallelScan(const int *lowKey, const int *highKey, int nparts,
+	                        BTreeFileScan *scans, int &n,
+	                        const BTSnapshot *snap = NULL);
+
+	// Point lookups: the record id of the first entry with key, DONE if
+	// there is none.  A batch of keys is looked up interleaved, which is
+	// much faster than one at a time when the tree is in memory.
+	Status Lookup(const int key, RecordID &rid);
+	Status Lookup(const int *keys, int n, RecordID *rids, Bool *found);
+
+	// Fill an empty tree with n entries given in any order, sorting them
+	// on numOfThreads threads (0 for one per processor) and writing the
+	// leaves full and in key order, without going through Insert().
+	Status BulkLoad(const int *keys, const RecordID *rids, int n,
+	                int numOfThreads = 0);
+
+	// A read-only view of the tree as it is now, which scans opened on
+	// it keep seeing while the tree changes.  Each snapshot must be
+	// released, after the scans on it are closed.
+	BTSnapshot *Snapshot();
+	Status ReleaseSnapshot(BTSnapshot *snap);
 	
 	Status Print();
 	Status DumpStatistics();
 
+	// Order statistics, for trees created with counts.  Positions are
+	// 0-based in key order.
+	Status CountRange(const int *lowKey, const int *highKey, int &n);
+	Status Rank(const int key, int &rank);
+	Status Select(int i, int &key, RecordID &rid);
+
 private:
 	
 	// You may add members and methods here.
 
 	PageID      rootPid;
+	char        fileName[MAX_NAME];	// its file entry, "" in memory
+	Bool        counted;	// index entries carry subtree counts
+	Bool        buffered;	// index nodes buffer inserts and deletes
+	Bool        packed;		// leaves are bit-packed
+
+	// Room to unpack a leaf into when a packed leaf is repacked or
+	// split, NULL if the tree is not packed.
+	LeafEntry  *packScratch;
+
+	// Inserts and deletes waiting to be merged in, NULL if they are
+	// made right away (see SetDeltaBuffer()).
+	BTDeltaBuffer *delta;
+	int         deltaCapacity;
+
+	// The nodes of an in-memory tree are in mem, those of a tree in the
+	// DB go through the buffer manager.  The methods below hide which.
+	BTMemStore *mem;
+	int         nodeSize;
+
+	Status PinNode(PageID pid, Page *&page)
+	{
+		Status s;
+
+		if (mem != NULL)
+			s = mem->GetNode(pid, page);
+		else
+			s = MINIBASE_BM->PinPage(pid, page);
+		if (s == OK && writing && snapshots != NULL)
+			s = CopyForSnapshots(pid, page);
+		return s;
+	}
+
+	Status UnpinNode(PageID pid, Bool dirty = FALSE)
+	{
+		if (mem != NULL)
+			return OK;
+		return MINIBASE_BM->UnpinPage(pid, dirty);
+	}
+
+	Status UnpinNode(Page *page, Bool dirty = FALSE)
+	{
+		if (mem != NULL)
+			return OK;
+		return MINIBASE_BM->UnpinPage(page, dirty);
+	}
+
+	Status PinChild(BTIndexPage *page, int i, BTNodePage *&child)
+	{
+		Status s;
+
+		if (mem != NULL)
+			s = mem->GetNode(page->GetChild(i), (Page *&)child);
+		else
+			s = page->PinChild(i, child);
+		if (s == OK && writing && snapshots != NULL)
+			s = CopyForSnapshots(page->GetChild(i), (Page *)child);
+		return s;
+	}
+
+	Status SetRoot(PageID pid);
+	Status NewNode(PageID &pid, Page *&page);
+	Status FreeNode(PageID pid);
+	Status DropNode(PageID pid);
+
+	// Snapshots in use, newest first, and the copies of nodes they see.
+	// While Insert() or Delete() is writing, every node they pin is
+	// copied first if a snapshot can still see it (see btsnap.h).
+	BTSnapshot *snapshots;
+	int         epoch;		// of the next snapshot
+	Bool        writing;
+	BTCopyTable copies;
+
+	Status CopyForSnapshots(PageID pid, Page *page);
+	Status NoCopyNeeded(PageID pid);
+	PageID SnapshotNode(const BTSnapshot *snap, PageID pid);
+
+	// The run of pages currently reserved for new leaves.
+	PageID      leafExtent;
+	unsigned    leafExtentUsed;	// bit i set: leafExtent+i is in use
+
+	// The rightmost leaf and the index nodes above it, root first, as
+	// the last insert that went there found them.  INVALID_PAGE when
+	// a split or a delete may have changed them.
+	PageID      lastLeaf;
+	PageID      lastPath[BT_MAX_HEIGHT];
+	int         lastDepth;		// index nodes in lastPath
+	int         appends;		// inserts in a row at the right end
 	
+	Status NewLeafPage(PageID leftPid, PageID &pid, Page *&page);
+	Status ReleaseLeafExtent();
+	Status AdviseScan(const int *lowKey, const int *highKey, TupleOrder order,
+	                  PageID leaf, PageID end, int levels);
 	Status PrintTree(PageID pid);
 	Status PrintNode(PageID pid);
-	Status do_insert(PageID pid, const LeafEntry entry, IndexEntry * &new_index);
-	Status do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry *&oldchildentry);
+	Status Append(const LeafEntry entry);
+	Status Apply(const BTMessage &msg);
+	Status AddToDelta(const BTMessage &msg);
+	Status ApplySorted(const BTMessage *msgs, int n);
+	Status InsertEntry(const LeafEntry entry);
+	Status DeleteFromLeaf(const LeafEntry entry);
+	Status BufferMessage(const BTMessage &msg);
+	Status FlushBuffer(PageID pid);
+	Status GetMessages(PageID node, int depth, int height,
+	                   const int *lowKey, const int *highKey,
+	                   const BTSnapshot *snap, BTScanMessage *&msgs,
+	                   int &n, int &max);
+	static void AddScanMessage(BTScanMessage *&msgs, int &n, int &max,
+	                           const BTMessage &msg, int depth, int seq);
+	Status do_insert(PageID pid, const LeafEntry entry, IndexEntry &new_index,
+	                 Bool rightmost, int depth);
+	Status do_delete(PageID Ppid, PageID pid, const LeafEntry entry, IndexEntry &oldchildentry);
+	Status RecountChildren(BTIndexPage *page, int from, int to);
 };
 
 
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include "minirel.h"
 #include "bufmgr.h"
 #include "db.h"
@@ -5,6 +6,36 @@
 #include "btfile.h"
 #include "btfilescan.h"
 
+//-------------------------------------------------------------------
+// BTreeFileScan::BTreeFileScan
+//
+// Input   : None
+// Output  : None
+// Purpose : Make a closed scan.  BTreeFile::OpenScan() opens it; a
+//           scan can be opened again after it is done, so one object
+//           (on the stack, say) serves any number of scans.
+//-------------------------------------------------------------------
+
+BTreeFileScan::BTreeFileScan ()
+{
+	tree = NULL;
+	curLeaf = NULL;
+	cur_pid = INVALID_PAGE;
+	lowKey = NULL;
+	highKey = NULL;
+	firstTime = true;
+	order = Ascending;
+	readAheadTo = INVALID_PAGE;
+	snap = NULL;
+	curNode = INVALID_PAGE;
+	merging = false;
+	messages = NULL;
+	numOfMessages = 0;
+	curMessage = 0;
+	peeked = false;
+}
+
+
 //-------------------------------------------------------------------
 // BTreeFileScan::~BTreeFileScan
 //
@@ -15,7 +46,45 @@
 
 BTreeFileScan::~BTreeFileScan ()
 {
-	MINIBASE_BM->UnpinPage(curLeaf->PageNo());
+	Close();
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFileScan::Close
+//
+// Input   : None
+// Output  : None
+// Purpose : End the scan, unpinning the leaf it is on.  GetNext()
+//           returns DONE until the scan is opened again.
+//-------------------------------------------------------------------
+
+void BTreeFileScan::Close ()
+{
+	ReleaseLeaf();
+	delete [] messages;
+	messages = NULL;
+	numOfMessages = 0;
+	curMessage = 0;
+	peeked = false;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFileScan::ReleaseLeaf
+//
+// Input   : None
+// Output  : None
+// Purpose : Unpin the leaf the scan is on, once there are no more
+//           entries to read from the leaves.
+//-------------------------------------------------------------------
+
+void BTreeFileScan::ReleaseLeaf ()
+{
+	// The last leaf is already unpinned if the scan ran off the end.
+	if (curLeaf != NULL)
+		tree->UnpinNode((Page *)curLeaf);
+	curLeaf = NULL;
 }
 
 
@@ -32,145 +101,511 @@ BTreeFileScan::~BTreeFileScan ()
 Status 
 BTreeFileScan::GetNext (RecordID &rid, int &key)
 {
+	int n;
 
-	PageID nextPid;
-	Page tpage;
+	if (merging)
+		return NextMerged(&rid, &key, 1, n);
+	return NextEntries(&rid, &key, 1, n);
+}
 
-	status = OK;
 
+//-------------------------------------------------------------------
+// BTreeFileScan::GetNextBatch
+//
+// Input   : rids, keys - arrays of max elements
+//           max  - how many records to return at most
+// Output  : rids, keys - the next n records of the scan
+//           n    - the number of records returned
+// Purpose : Return the next records from the B+-tree index a run of a
+//           leaf at a time.  Where the run ends is worked out once per
+//           leaf: with a binary search for highKey, if there is one.
+//           Calls can be mixed with GetNext().
+// Return  : OK if n > 0, DONE if no more records to read.
+//-------------------------------------------------------------------
 
-	if (highKey == NULL)
-	{
-		if (firstTime)
-		{
-			curLeaf->GetFirst(curKey, cur_rid, t_rid);
+Status 
+BTreeFileScan::GetNextBatch (RecordID *rids, int *keys, int max, int &n)
+{
+	if (merging)
+		return NextMerged(rids, keys, max, n);
+	return NextEntries(rids, keys, max, n);
+}
 
-			if (lowKey != NULL)
-			{
-				while (curKey < *lowKey)
-				{
-					status = curLeaf->GetNext(curKey, cur_rid, t_rid);
-					if (status == DONE)
-					{
-						nextPid = curLeaf->GetNextPage();
-						MINIBASE_BM->UnpinPage(cur_pid, CLEAN);
-						if (nextPid == INVALID_PAGE)
-							return DONE;
 
-						MINIBASE_BM->PinPage(nextPid, (Page *&)curLeaf);
-						cur_pid = nextPid;
+//-------------------------------------------------------------------
+// BTreeFileScan::NextEntries
+//
+// Input   : rids, keys, max - as for GetNextBatch()
+// Output  : rids, keys, n - the next entries of the leaves
+// Purpose : GetNextBatch() without the messages of a buffered tree.
+// Return  : OK if n > 0, DONE if no more records to read.
+//-------------------------------------------------------------------
+
+Status 
+BTreeFileScan::NextEntries (RecordID *rids, int *keys, int max, int &n)
+{
+	int slot, end, take;
+	bool seek = false;
 
-						curLeaf->GetFirst(curKey, cur_rid, t_rid);
-						status = OK;
+	if (order == Descending)
+		return GetPrevBatch(rids, keys, max, n);
 
-					}
-				}
-			}
-			rid = cur_rid;
-			key = curKey;
-			firstTime = false;
+	n = 0;
+	if (curLeaf == NULL)
+		return DONE;
+	FollowCopy();
 
-			return status;
+	// Position of the next entry on the current leaf
+	if (firstTime)
+	{
+		seek = (lowKey != NULL);
+		slot = seek ? curLeaf->LowerBound(*lowKey) : 0;
+		firstTime = false;
+	}
+	else
+	{
+		slot = t_rid.slotNo + 1;
+	}
 
-		}//end firsttime
+	while (n < max)
+	{
+		if (slot >= curLeaf->GetNumOfRecords())
+		{
+			if (NextLeaf() != OK)
+				break;
+			slot = seek ? curLeaf->LowerBound(*lowKey) : 0;
+			continue;
+		}
+		seek = false;
+
+		// Entries slot..end-1 are in the range
+		end = curLeaf->GetNumOfRecords();
+		if (highKey != NULL)
+			end = curLeaf->FindInsertPos(*highKey);
+		if (end < slot)
+			end = slot;
+
+		take = end - slot;
+		if (take > max - n)
+			take = max - n;
+		curLeaf->GetEntries(slot, take, keys + n, rids + n);
+		n += take;
+		slot += take;
+
+		// Past highKey: nothing more to read
+		if (slot == end && end < curLeaf->GetNumOfRecords())
+		{
+			ReleaseLeaf();
+			break;
+		}
+	}
 
-		if (DONE == curLeaf->GetNext(curKey, cur_rid, t_rid))
+	// Leave GetNext() where this batch stopped
+	if (curLeaf != NULL)
+	{
+		t_rid.pageNo = cur_pid;
+		t_rid.slotNo = slot - 1;
+		if (n > 0)
 		{
+			curKey = keys[n - 1];
+			cur_rid = rids[n - 1];
+		}
+	}
+
+	return n > 0 ? OK : DONE;
+}
+
 
-			nextPid = curLeaf->GetNextPage();
-			MINIBASE_BM->UnpinPage(cur_pid, CLEAN);
-			if (nextPid == INVALID_PAGE)
-				return DONE;
+//-------------------------------------------------------------------
+// CompareMessages
+//
+// Purpose : Order messages for qsort() by key and record id, and for
+//           the same (key, rid) oldest first.
+//-------------------------------------------------------------------
 
-			MINIBASE_BM->PinPage(nextPid, (Page *&)curLeaf);
-			cur_pid = nextPid;
+static int CompareMessages(const void *a, const void *b)
+{
+	const BTScanMessage *x = (const BTScanMessage *)a;
+	const BTScanMessage *y = (const BTScanMessage *)b;
+
+	if (x->msg.key != y->msg.key)
+		return (x->msg.key < y->msg.key) ? -1 : 1;
+	if (x->msg.rid.pageNo != y->msg.rid.pageNo)
+		return (x->msg.rid.pageNo < y->msg.rid.pageNo) ? -1 : 1;
+	if (x->msg.rid.slotNo != y->msg.rid.slotNo)
+		return (x->msg.rid.slotNo < y->msg.rid.slotNo) ? -1 : 1;
+	if (x->depth != y->depth)
+		return (x->depth > y->depth) ? -1 : 1;
+	return (x->seq < y->seq) ? -1 : (x->seq > y->seq);
+}
 
-			curLeaf->GetFirst(curKey, cur_rid, t_rid);
 
-		}
+//-------------------------------------------------------------------
+// BTreeFileScan::SetMessages
+//
+// Input   : msgs - n messages for the range of the scan, from the
+//                  buffers of a buffered tree, in any order
+// Output  : None
+// Purpose : Keep the last message for each (key, rid), which decides
+//           whether the scan returns that entry, in scan order.  msgs
+//           is sorted in place.
+// Return  : OK if successful, FAIL if out of memory.
+//-------------------------------------------------------------------
 
+Status
+BTreeFileScan::SetMessages (BTScanMessage *msgs, int n)
+{
+	int i, m = 0;
 
+	if (n == 0)
+		return OK;
 
-		rid = cur_rid;
-		key = curKey;
+	messages = new BTMessage[n];
+	if (messages == NULL)
+		return FAIL;
 
+	qsort(msgs, n, sizeof(BTScanMessage), CompareMessages);
+	for (i = 0; i < n; i++)
+	{
+		if (i + 1 < n && msgs[i + 1].msg.key == msgs[i].msg.key &&
+		    msgs[i + 1].msg.rid == msgs[i].msg.rid)
+			continue;
+		messages[m++] = msgs[i].msg;
+	}
 
-	}//end high_key is NULL
-	else
+	if (order == Descending)
 	{
-		if (firstTime)
+		for (i = 0; i < m / 2; i++)
 		{
+			BTMessage t = messages[i];
+
+			messages[i] = messages[m - 1 - i];
+			messages[m - 1 - i] = t;
+		}
+	}
+	numOfMessages = m;
+	curMessage = 0;
+	return OK;
+}
+
 
-			curLeaf->GetFirst(curKey, cur_rid, t_rid);
+//-------------------------------------------------------------------
+// BTreeFileScan::NextMerged
+//
+// Input   : rids, keys, max - as for GetNextBatch()
+// Output  : rids, keys, n - the next entries of a buffered tree
+// Purpose : GetNextBatch() for a buffered tree: merge the entries of
+//           the leaves, read one ahead, with the messages.  An insert
+//           message whose key comes before the next leaf entry is
+//           returned first.  A leaf entry is left out if there is a
+//           message for it; such messages have its key, so they are
+//           the next ones.
+// Return  : OK if n > 0, DONE if no more records to read.
+//-------------------------------------------------------------------
 
-			if (lowKey != NULL)
+Status
+BTreeFileScan::NextMerged (RecordID *rids, int *keys, int max, int &n)
+{
+	int got, i;
+
+	n = 0;
+	while (n < max)
+	{
+		if (!peeked && NextEntries(&peekRid, &peekKey, 1, got) == OK)
+			peeked = true;
+
+		if (curMessage < numOfMessages)
+		{
+			BTMessage &msg = messages[curMessage];
+
+			if (!peeked || (order == Descending ? msg.key > peekKey
+			                                    : msg.key < peekKey))
 			{
-				while (curKey < *lowKey)
+				curMessage++;
+				if (msg.type == INSERT_MESSAGE)
 				{
-					status = curLeaf->GetNext(curKey, cur_rid, t_rid);
+					rids[n] = msg.rid;
+					keys[n] = msg.key;
+					n++;
+				}
+				continue;
+			}
+		}
+		if (!peeked)
+			break;
+
+		peeked = false;
+		for (i = curMessage; i < numOfMessages; i++)
+			if (messages[i].key != peekKey || messages[i].rid == peekRid)
+				break;
+		if (i < numOfMessages && messages[i].key == peekKey)
+			continue;
+		rids[n] = peekRid;
+		keys[n] = peekKey;
+		n++;
+	}
+
+	return n > 0 ? OK : DONE;
+}
 
-					if (status == DONE)
-					{
-						nextPid = curLeaf->GetNextPage();
-						MINIBASE_BM->UnpinPage(cur_pid, CLEAN);
-						if (nextPid == INVALID_PAGE)
-							return DONE;
 
-						MINIBASE_BM->PinPage(nextPid, (Page *&)curLeaf);
-						cur_pid = nextPid;
+//-------------------------------------------------------------------
+// BTreeFileScan::NextLeaf
+//
+// Input   : None
+// Output  : None
+// Purpose : Move the scan to the next leaf, unpinning the current one.
+// Return  : OK if there is a next leaf, DONE otherwise, in which case
+//           the scan is closed.
+//-------------------------------------------------------------------
+
+Status
+BTreeFileScan::NextLeaf()
+{
+	PageID nextPid = curLeaf->GetNextPage();
 
-						curLeaf->GetFirst(curKey, cur_rid, t_rid);
+	tree->UnpinNode((Page *)curLeaf, CLEAN);
+	curLeaf = NULL;
+	if (nextPid == INVALID_PAGE)
+		return DONE;
 
-						if (key > *highKey)
-							return DONE;
+	ReadAhead(nextPid);
+	if (PinLeaf(nextPid) != OK)
+	{
+		curLeaf = NULL;
+		return DONE;
+	}
+	cur_pid = nextPid;
+	return OK;
+}
 
-						status = OK;
-					}
 
-				}
-			}
+//-------------------------------------------------------------------
+// BTreeFileScan::GetPrevBatch
+//
+// Input   : rids, keys - arrays of max elements
+//           max  - how many records to return at most
+// Output  : rids, keys - the next n records of a descending scan
+//           n    - the number of records returned
+// Purpose : GetNextBatch() for a descending scan: starting from the
+//           last entry not larger than highKey, return runs of each
+//           leaf in reverse and go on to the previous leaf, until a key
+//           smaller than lowKey is met.
+// Return  : OK if n > 0, DONE if no more records to read.
+//-------------------------------------------------------------------
 
-			firstTime = false;
-			rid = cur_rid;
-			key = curKey;
+Status 
+BTreeFileScan::GetPrevBatch (RecordID *rids, int *keys, int max, int &n)
+{
+	int slot, begin, take, i, j;
 
-			if (key > *highKey)
-				return DONE;
-			return status;
+	n = 0;
+	if (curLeaf == NULL)
+		return DONE;
+	FollowCopy();
 
-		}
+	// Position of the next entry on the current leaf
+	if (firstTime)
+	{
+		if (highKey != NULL)
+			slot = curLeaf->FindInsertPos(*highKey) - 1;
+		else
+			slot = curLeaf->GetNumOfRecords() - 1;
+		firstTime = false;
+	}
+	else
+	{
+		slot = t_rid.slotNo - 1;
+	}
 
-		if (DONE == curLeaf->GetNext(curKey, cur_rid, t_rid))
+	while (n < max)
+	{
+		if (slot < 0)
 		{
+			if (PrevLeaf() != OK)
+				break;
+			slot = curLeaf->GetNumOfRecords() - 1;
+			continue;
+		}
 
-			nextPid = curLeaf->GetNextPage();
-			MINIBASE_BM->UnpinPage(cur_pid, CLEAN);
-			if (nextPid == INVALID_PAGE)
-				return DONE;
+		// Entries begin..slot are in the range
+		begin = 0;
+		if (lowKey != NULL)
+			begin = curLeaf->LowerBound(*lowKey);
+		if (begin > slot + 1)
+			begin = slot + 1;
 
-			MINIBASE_BM->PinPage(nextPid, (Page *&)curLeaf);
-			cur_pid = nextPid;
+		take = slot + 1 - begin;
+		if (take > max - n)
+			take = max - n;
+		curLeaf->GetEntries(slot + 1 - take, take, keys + n, rids + n);
 
-			curLeaf->GetFirst(curKey, cur_rid, t_rid);
+		// The run was copied in ascending order; turn it around
+		for (i = n, j = n + take - 1; i < j; i++, j--)
+		{
+			int k = keys[i];
+			RecordID r = rids[i];
+			keys[i] = keys[j];
+			rids[i] = rids[j];
+			keys[j] = k;
+			rids[j] = r;
+		}
+		n += take;
+		slot -= take;
 
+		// Below lowKey: nothing more to read
+		if (slot < begin && begin > 0)
+		{
+			ReleaseLeaf();
+			break;
 		}
+	}
 
+	// Leave GetNext() where this batch stopped
+	if (curLeaf != NULL)
+	{
+		t_rid.pageNo = cur_pid;
+		t_rid.slotNo = slot + 1;
+		if (n > 0)
+		{
+			curKey = keys[n - 1];
+			cur_rid = rids[n - 1];
+		}
+	}
 
-		rid = cur_rid;
-		key = curKey;
+	return n > 0 ? OK : DONE;
+}
 
-		if (key > *highKey)
-			return DONE;
 
+//-------------------------------------------------------------------
+// BTreeFileScan::PrevLeaf
+//
+// Input   : None
+// Output  : None
+// Purpose : Move the scan to the previous leaf, unpinning the current
+//           one.
+// Return  : OK if there is a previous leaf, DONE otherwise, in which
+//           case the scan is closed.
+//-------------------------------------------------------------------
 
-	}//end high_key is value
+Status
+BTreeFileScan::PrevLeaf()
+{
+	PageID prevPid = curLeaf->GetPrevPage();
 
-	if (cur_rid.pageNo == -1 && t_rid.pageNo == -1)
+	tree->UnpinNode((Page *)curLeaf, CLEAN);
+	curLeaf = NULL;
+	if (prevPid == INVALID_PAGE)
 		return DONE;
 
-	return status;
+	ReadAhead(prevPid);
+	if (PinLeaf(prevPid) != OK)
+	{
+		curLeaf = NULL;
+		return DONE;
+	}
+	cur_pid = prevPid;
+	return OK;
 }
 
+
+//-------------------------------------------------------------------
+// BTreeFileScan::PinLeaf
+//
+// Input   : pid - a leaf
+// Output  : None
+// Purpose : Pin the leaf, or for a scan of a snapshot the copy of it
+//           the snapshot sees, as the current leaf.
+// Return  : OK if successful, an error status otherwise.
+//-------------------------------------------------------------------
+
+Status
+BTreeFileScan::PinLeaf(PageID pid)
+{
+	curNode = (snap != NULL) ? tree->SnapshotNode(snap, pid) : pid;
+	return tree->PinNode(curNode, (Page *&)curLeaf);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFileScan::FollowCopy
+//
+// Input   : None
+// Output  : None
+// Purpose : A scan of a snapshot reads the leaf it is on in place until
+//           a writer changes it.  The writer copies it first, and the
+//           scan moves over to the copy, which holds what it has been
+//           reading.
+//-------------------------------------------------------------------
+
+void
+BTreeFileScan::FollowCopy()
+{
+	BTLeafPage *copy;
+	PageID node;
+
+	if (snap == NULL)
+		return;
+
+	node = tree->SnapshotNode(snap, cur_pid);
+	if (node == curNode || tree->PinNode(node, (Page *&)copy) != OK)
+		return;
+	tree->UnpinNode((Page *)curLeaf, CLEAN);
+	curLeaf = copy;
+	curNode = node;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFileScan::ReadAhead
+//
+// Input   : nextPid - the leaf the scan is about to move to.
+// Output  : None
+// Purpose : If the scan is walking through consecutive pages, read the
+//           following LEAF_READ_AHEAD pages into the buffer pool so the
+//           leaves come off the disk in one sequential sweep.  For a
+//           descending scan, the pages are the LEAF_READ_AHEAD before
+//           nextPid.
+//-------------------------------------------------------------------
+
+void
+BTreeFileScan::ReadAhead(PageID nextPid)
+{
+	// Nodes of an in-memory tree need no reading
+	if (tree->mem != NULL)
+		return;
+
+	if (order == Descending)
+	{
+		if (nextPid != cur_pid - 1)
+			return;
+
+		if (readAheadTo != INVALID_PAGE && nextPid - LEAF_READ_AHEAD / 2 > readAheadTo)
+			return;
+
+		PageID to = (readAheadTo != INVALID_PAGE && readAheadTo < nextPid) ? readAheadTo : nextPid;
+		PageID from = nextPid - LEAF_READ_AHEAD;
+		if (from < 0)
+			from = 0;
+		if (from < to)
+			MINIBASE_BM->PrefetchPages(from, to - from);
+		readAheadTo = from;
+		return;
+	}
+
+	if (nextPid != cur_pid + 1)
+		return;
+
+	// Keep at least half a window ahead of the scan.
+	if (readAheadTo != INVALID_PAGE && nextPid + LEAF_READ_AHEAD / 2 < readAheadTo)
+		return;
+
+	PageID from = (readAheadTo > nextPid) ? readAheadTo : nextPid + 1;
+	MINIBASE_BM->PrefetchPages(from, nextPid + 1 + LEAF_READ_AHEAD - from);
+	readAheadTo = nextPid + 1 + LEAF_READ_AHEAD;
+}
+
+
 //-------------------------------------------------------------------
 // BTreeFileScan::DeleteCurrent
 //
@@ -5,16 +5,23 @@
 
 class BTreeFile;
 
+// Number of pages read ahead when the leaf chain runs through
+// consecutive pages.
+const int LEAF_READ_AHEAD = 8;
+
 class BTreeFileScan : public IndexFileScan {
 	
 public:
 	
 	friend class BTreeFile;
 
+	BTreeFileScan();
+	~BTreeFileScan();
+
 	Status GetNext (RecordID &rid,  int &key);
+	Status GetNextBatch (RecordID *rids, int *keys, int max, int &n);
 	Status DeleteCurrent ();
-
-	~BTreeFileScan();
+	void Close ();
 	
 private:
 	BTreeFile *tree;
@@ -28,7 +35,38 @@ private:
 	RecordID cur_rid;
 	RecordID t_rid;
 	Status status;
+	TupleOrder order;	// Ascending or Descending
+	PageID readAheadTo;	// pages up to here (down to here if
+				// descending) have been read ahead
+	const BTSnapshot *snap;	// the snapshot scanned, or NULL
+	PageID curNode;		// what is pinned for cur_pid: the leaf
+				// itself or a copy of it
+	int partLow, partHigh;	// range of a scan opened by
+				// BTreeFile::OpenParallelScan()
+
+	// A scan of a buffered tree merges the leaf entries with the
+	// messages in the buffers for its range, as of when it was opened:
+	// the last message for each (key, rid), in scan order.  A leaf
+	// entry with a message is left out; an insert message is returned
+	// where its key goes.
+	bool merging;
+	BTMessage *messages;
+	int numOfMessages;
+	int curMessage;		// next message to merge
+	bool peeked;		// peekKey, peekRid: the next leaf entry
+	int peekKey;
+	RecordID peekRid;
 
+	void ReadAhead(PageID nextPid);
+	void ReleaseLeaf();
+	Status NextEntries (RecordID *rids, int *keys, int max, int &n);
+	Status NextMerged (RecordID *rids, int *keys, int max, int &n);
+	Status SetMessages (BTScanMessage *msgs, int n);
+	Status PinLeaf(PageID pid);
+	void FollowCopy();
+	Status NextLeaf();
+	Status PrevLeaf();
+	Status GetPrevBatch (RecordID *rids, int *keys, int max, int &n);
 };
 
 #endif
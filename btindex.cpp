@@ -1,4 +1,5 @@
 #include <string.h>
+#include "bufmgr.h"
 #include "btindex.h"
 
 
@@ -16,18 +17,42 @@ Status
 BTIndexPage::Insert (const int key, const PageID pageID, RecordID &rid)
 {
 	IndexEntry entry;
-	Status s;
 	
 	entry.key = key;
 	entry.pid = pageID;
+	entry.count = 0;
+
+	return Insert(entry, rid);
+}
 
-	s = SortedPage::InsertRecord((char *)&entry, sizeof(IndexEntry), rid);
+
+//-------------------------------------------------------------------
+// BTIndexPage::Insert
+//
+// Input   : entry - the entry to insert, with the count of its child
+//                   if this is a node of a counted tree.
+// Output  : rid - record id of the entry inserted.
+// Purpose : Insert an entry into this index node.
+// Return  : OK if insertion is succesfull, FAIL otherwise.
+//-------------------------------------------------------------------
+
+Status 
+BTIndexPage::Insert (const IndexEntry &entry, RecordID &rid)
+{
+	Status s;
+	int pos;
+
+	UnswizzleChildren();
+	pos = FindInsertPos(entry.key);
+	s = InsertAt(pos, &entry);
 	if (s != OK)
 	{
-		std::cerr << "Fail to insert record into SortedPage\n";
+		std::cerr << "Fail to insert entry into index node\n";
 		return FAIL;
 	}
 	
+	rid.pageNo = this->pid;
+	rid.slotNo = pos;
 	return OK;
 }
 
@@ -46,32 +71,69 @@ Status
 BTIndexPage::Delete (const int key, RecordID &rid)
 {
 	int i;
-	IndexEntry *entry;
 	
-	// Scan through all the records in this page and find the
-	// matching pair (key, dataRid).
+	UnswizzleChildren();
 
-	for (i = numOfSlots - 1; i >= 0; i--)
+	// Find the first entry with this key.
+
+	i = LowerBound(key);
+	if (i < count && KeyAt(i) == key)
 	{
-		entry = (IndexEntry *)(data + slots[i].offset);
-		if (entry->key == key)
-		{
-			// We delete it here.
-
-			Status s;
-			
-			rid.pageNo = PageNo();
-			rid.slotNo = i;
-			s = SortedPage::DeleteRecord(rid);
-
-			return s;
-		}
+		// We delete it here.
+
+		rid.pageNo = PageNo();
+		rid.slotNo = i;
+		return DeleteAt(i);
 	}
 	
 	return FAIL;
 }
 
 
+//-------------------------------------------------------------------
+// BTIndexPage::Split
+//
+// Input   : entry  - the entry to insert
+//           slotNo - where it goes, among the entries with its key
+//           right  - a new, empty index node of the same kind
+//           append - TRUE if keys are being appended in order, see
+//                    BTNodePage::SplitInsert()
+// Output  : splitKey - the key that separates this node from right
+// Purpose : Insert entry into this full index node by splitting it.
+//           The upper half of the entries is moved to right, and the
+//           middle one is taken out: its key is returned to go into the
+//           parent, its page (and count) becomes the left link of right.
+//           Buffered messages for the children of right move with them.
+// Return  : OK if successful, FAIL otherwise.
+//-------------------------------------------------------------------
+
+Status 
+BTIndexPage::Split (const IndexEntry &entry, int slotNo, BTIndexPage *right,
+                    int &splitKey, Bool append)
+{
+	IndexEntry middle;
+
+	UnswizzleChildren();
+	if (SplitInsert(slotNo, &entry, right, &middle, append) != OK)
+		return FAIL;
+
+	right->SetLeftLink(middle.pid);
+	right->SetChildCount(0, middle.count);
+	splitKey = middle.key;
+
+	// Messages go with the children they are for
+	if (IsBuffered())
+	{
+		int from = MessageLowerBound(splitKey);
+
+		if (right->AddMessages(Messages() + from, MessageCount() - from) != OK)
+			return FAIL;
+		MessageCount() = from;
+	}
+	return OK;
+}
+
+
 //-------------------------------------------------------------------
 // BTIndexPage::GetFirst
 //
@@ -88,30 +150,26 @@ BTIndexPage::Delete (const int key, RecordID &rid)
 Status 
 BTIndexPage::GetFirst (int &firstKey, PageID &firstPid, RecordID &rid)
 {
-	// Initialize the record id of the first (key, dataRid) pair.  The
-	// first record is always at slot position 0, since SortedPage always
-	// compact it's records.  We can also use HeapPage::FirstRecord here
-	// but it is not neccessary.
+	// Initialize the record id of the first (key, pageID) pair.  The
+	// first entry is always at position 0.
 
 	rid.pageNo = this->pid;
 	rid.slotNo = 0;
 
 	// If there are no record in this page, just return DONE.
 	
-	if (numOfSlots == 0)
+	if (count == 0)
 	{
 		rid.pageNo = INVALID_PAGE;
 		rid.slotNo = INVALID_SLOT;
 		return DONE;
 	}
 	
-	// Otherwise, we just copy the record into key and dataRid,
-	// and returned.  The record is located at offset slots[0].offset
-	// from the beginning of data area (pointed to by member data in 
-	// HeapPage)
+	// Otherwise, we just copy the entry into key and pageID,
+	// and returned.
 
 	IndexEntry entry;
-	memcpy(&entry, (IndexEntry *)(data + slots[0].offset), sizeof(IndexEntry));
+	GetEntry(0, entry);
 	firstKey = entry.key;
 	firstPid = entry.pid;
 	
@@ -138,26 +196,23 @@ BTIndexPage::GetNext (int &nextKey, PageID &nextPid, RecordID &rid)
 {
 	// If we are at the end of records, return DONE.
 
-	if (rid.slotNo + 1 >= numOfSlots)
+	if (rid.slotNo + 1 >= count)
 	{
 		rid.pageNo = INVALID_PAGE;
 		rid.slotNo = INVALID_SLOT;
 		return DONE;
 	}
 
-	// Increment the slotNo in rid to point to the next record in this
-	// page.  We can do this for subclass of SorterPage since the records
-	// in a sorted page is always compact.  
+	// Increment the slotNo in rid to point to the next entry in this
+	// page.  The entries of a node are always dense.
 	
 	rid.slotNo ++;
 
-	// Otherwise, we just copy the record into key and dataRid,
-	// and returned.  The record is located at offset 
-	// slots[rid.slotNo].offset from the beginning of data area 
-	// (pointed to by member data in HeapPage)
+	// Otherwise, we just copy the entry into key and pageID,
+	// and returned.
 
 	IndexEntry entry;
-	memcpy(&entry, (IndexEntry *)(data + slots[rid.slotNo].offset), sizeof(IndexEntry));
+	GetEntry(rid.slotNo, entry);
 	nextKey = entry.key;
 	nextPid = entry.pid;
 	
@@ -165,6 +220,40 @@ BTIndexPage::GetNext (int &nextKey, PageID &nextPid, RecordID &rid)
 }
 
 
+//-------------------------------------------------------------------
+// BTIndexPage::FindChild
+//
+// Input   : key - a key value
+// Output  : None
+// Purpose : Find the child an entry with this key is inserted into:
+//           the child of the last entry whose key is smaller than or
+//           equal to key, or the left link if there is none.
+// Return  : The page id of the child.
+//-------------------------------------------------------------------
+
+PageID BTIndexPage::FindChild (const int key)
+{
+	return GetChild(FindInsertPos(key));
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::FindFirstChild
+//
+// Input   : key - a key value
+// Output  : None
+// Purpose : Find the leftmost child that can hold this key: the child
+//           of the last entry whose key is smaller than key, or the
+//           left link if there is none.  Scans start from there.
+// Return  : The page id of the child.
+//-------------------------------------------------------------------
+
+PageID BTIndexPage::FindFirstChild (const int key)
+{
+	return GetChild(LowerBound(key));
+}
+
+
 //-------------------------------------------------------------------
 // BTIndexPage::GetLeftLink
 //
@@ -176,7 +265,7 @@ BTIndexPage::GetNext (int &nextKey, PageID &nextPid, RecordID &rid)
 
 PageID BTIndexPage::GetLeftLink ()
 {
-	return GetPrevPage();
+	return GetChild(0);
 }
 
 
@@ -191,7 +280,411 @@ PageID BTIndexPage::GetLeftLink ()
 
 void BTIndexPage::SetLeftLink (PageID pageID)
 {
+	UnswizzleChildren();
 	SetPrevPage(pageID);
 }
 
 
+//-------------------------------------------------------------------
+// BTIndexPage::GetChild
+//
+// Input   : i - position of a child, 0 to GetNumOfRecords()
+// Output  : None
+// Purpose : Return the left link for position 0, otherwise the page id
+//           of entry i-1.
+// Return  : The page id of the child.
+//-------------------------------------------------------------------
+
+PageID BTIndexPage::GetChild (int i)
+{
+	PageID ref = *ChildRef(i);
+
+	// Only a page in the buffer pool can hold swizzled references
+	if (IsSwizzled(ref))
+		return MINIBASE_BM->PageOf(ref);
+	return ref;
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::PinChild
+//
+// Input   : i - position of a child, 0 to GetNumOfRecords()
+// Output  : child - the child, pinned
+// Purpose : Pin a child of this node, which must be pinned itself,
+//           through BufMgr::PinChild(): the reference to the child is
+//           swizzled, and later pins through it skip the hash table.
+//           Unpin the child with BufMgr::UnpinPage(Page *).
+// Return  : OK if successful, an error status otherwise.
+//-------------------------------------------------------------------
+
+Status BTIndexPage::PinChild (int i, BTNodePage *&child)
+{
+	return MINIBASE_BM->PinChild(ChildRef(i), (Page *)this, (Page *&)child);
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::ChildRef
+//
+// Input   : i - position of a child, 0 to GetNumOfRecords()
+// Output  : None
+// Purpose : Find where the reference to a child is kept: the left link
+//           for position 0, the value of entry i-1 otherwise.
+// Return  : A pointer to the reference, which may be swizzled.
+//-------------------------------------------------------------------
+
+PageID *BTIndexPage::ChildRef (int i)
+{
+	if (i == 0)
+		return &prevPage;
+	return (PageID *)ValueAt(i - 1);
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::UnswizzleChildren
+//
+// Input   : None
+// Output  : None
+// Purpose : Put back the page ids of the children whose references are
+//           swizzled, before entries are moved around.
+//-------------------------------------------------------------------
+
+void BTIndexPage::UnswizzleChildren ()
+{
+	PageID *ref;
+
+	for (int i = 0; i <= count; i++)
+	{
+		ref = ChildRef(i);
+		if (IsSwizzled(*ref))
+			*ref = MINIBASE_BM->Unswizzle(*ref);
+	}
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::GetEntry
+//
+// Input   : slotNo - position of the entry
+// Output  : entry - a copy of the entry, with the page id of its child
+// Purpose : Read an entry.
+//-------------------------------------------------------------------
+
+void BTIndexPage::GetEntry (int slotNo, IndexEntry &entry)
+{
+	ReadEntry(slotNo, &entry);
+	if (IsSwizzled(entry.pid))
+		entry.pid = MINIBASE_BM->PageOf(entry.pid);
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::FindChildPos
+//
+// Input   : pid - a page
+// Output  : None
+// Purpose : Find the position of a child, as for GetChild().
+// Return  : The position, -1 if pid is not a child of this node.
+//-------------------------------------------------------------------
+
+int BTIndexPage::FindChildPos (PageID pid)
+{
+	for (int i = 0; i <= count; i++)
+		if (GetChild(i) == pid)
+			return i;
+	return -1;
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::InsertEntry
+//
+// Input   : slotNo - position to insert at, 0 to GetNumOfRecords()
+//           entry  - the entry, whose key must keep the node in order
+//                    there
+// Output  : None
+// Purpose : Insert an entry at a given position: next to the entry of
+//           the child a new child was split from, say, where Insert()
+//           would put it after all entries with the same key.
+// Return  : OK if successful, FAIL if the node is full.
+//-------------------------------------------------------------------
+
+Status BTIndexPage::InsertEntry (int slotNo, const IndexEntry &entry)
+{
+	UnswizzleChildren();
+	return InsertAt(slotNo, &entry);
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::DeleteEntry
+//
+// Input   : slotNo - position of the entry
+// Output  : None
+// Purpose : Delete the entry at a given position.
+// Return  : OK if successful, FAIL if there is no such entry.
+//-------------------------------------------------------------------
+
+Status BTIndexPage::DeleteEntry (int slotNo)
+{
+	UnswizzleChildren();
+	return DeleteAt(slotNo);
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::SetKey
+//
+// Input   : slotNo - position of an entry
+//           key    - its new key, which must keep the node in order
+// Output  : None
+// Purpose : Change the key of an entry, keeping its child and count.
+//-------------------------------------------------------------------
+
+void BTIndexPage::SetKey (int slotNo, int key)
+{
+	SetKeyAt(slotNo, key);
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::GetChildCount
+//
+// Input   : i - position of a child, 0 to GetNumOfRecords()
+// Output  : None
+// Purpose : Return the number of leaf entries under the child.
+// Return  : The count, 0 if this node keeps no counts.
+//-------------------------------------------------------------------
+
+int BTIndexPage::GetChildCount (int i)
+{
+	if (!IsCounted())
+		return 0;
+	if (i == 0)
+		return leftCount;
+	return *(int *)(ValueAt(i - 1) + sizeof(PageID));
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::SetChildCount
+//
+// Input   : i - position of a child, 0 to GetNumOfRecords()
+//           n - number of leaf entries under it
+// Output  : None
+// Purpose : Record the count of a child.  Does nothing if this node
+//           keeps no counts.
+//-------------------------------------------------------------------
+
+void BTIndexPage::SetChildCount (int i, int n)
+{
+	if (!IsCounted())
+		return;
+	if (i == 0)
+		leftCount = n;
+	else
+		*(int *)(ValueAt(i - 1) + sizeof(PageID)) = n;
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::AddChildCount
+//
+// Input   : i     - position of a child, 0 to GetNumOfRecords()
+//           delta - change in the number of leaf entries under it
+// Output  : None
+// Purpose : Adjust the count of a child.  Does nothing if this node
+//           keeps no counts.
+//-------------------------------------------------------------------
+
+void BTIndexPage::AddChildCount (int i, int delta)
+{
+	SetChildCount(i, GetChildCount(i) + delta);
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::GetNumOfMessages
+//
+// Input   : None
+// Output  : None
+// Return  : The number of messages in the buffer, 0 for a node of a
+//           tree without buffers.
+//-------------------------------------------------------------------
+
+int BTIndexPage::GetNumOfMessages ()
+{
+	return IsBuffered() ? MessageCount() : 0;
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::GetMessageCapacity
+//
+// Input   : None
+// Output  : None
+// Return  : How many messages the buffer holds when full.
+//-------------------------------------------------------------------
+
+int BTIndexPage::GetMessageCapacity ()
+{
+	return IsBuffered() ? MessageCapacity() : 0;
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::BufferIsFull
+//
+// Input   : None
+// Output  : None
+// Return  : TRUE if no more messages fit in the buffer.
+//-------------------------------------------------------------------
+
+Bool BTIndexPage::BufferIsFull ()
+{
+	return GetNumOfMessages() >= GetMessageCapacity();
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::GetMessage
+//
+// Input   : i - position of a message, 0 to GetNumOfMessages()-1
+// Output  : msg - a copy of the message
+// Purpose : Read a message of the buffer.
+//-------------------------------------------------------------------
+
+void BTIndexPage::GetMessage (int i, BTMessage &msg)
+{
+	msg = Messages()[i];
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::MessageLowerBound
+//
+// Input   : key - a key value
+// Output  : None
+// Return  : The position of the first message whose key is not smaller
+//           than key, GetNumOfMessages() if there is none.
+//-------------------------------------------------------------------
+
+int BTIndexPage::MessageLowerBound (int key)
+{
+	BTMessage *msgs = Messages();
+	int lo = 0, hi = GetNumOfMessages();
+
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+
+		if (msgs[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::AddMessage
+//
+// Input   : msg - a message
+// Output  : None
+// Purpose : Put a message in the buffer, after those with the same key
+//           since it is newer.
+// Return  : OK if successful, FAIL if the buffer is full.
+//-------------------------------------------------------------------
+
+Status BTIndexPage::AddMessage (const BTMessage &msg)
+{
+	BTMessage *msgs = Messages();
+	int n = GetNumOfMessages();
+	int pos;
+
+	if (BufferIsFull())
+		return FAIL;
+
+	pos = MessageLowerBound(msg.key);
+	while (pos < n && msgs[pos].key == msg.key)
+		pos++;
+	memmove(msgs + pos + 1, msgs + pos, (n - pos) * sizeof(BTMessage));
+	msgs[pos] = msg;
+	MessageCount() = n + 1;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::AddMessages
+//
+// Input   : msgs - n messages in buffer order, newer than any here,
+//                  such as those a parent flushes down
+// Output  : None
+// Purpose : Merge a batch of messages into the buffer, from the back so
+//           that each message moves once.
+// Return  : OK if successful, FAIL if they do not fit.
+//-------------------------------------------------------------------
+
+Status BTIndexPage::AddMessages (const BTMessage *msgs, int n)
+{
+	BTMessage *buf = Messages();
+	int i = GetNumOfMessages() - 1;
+	int j = n - 1;
+	int k = GetNumOfMessages() + n - 1;
+
+	if (GetNumOfMessages() + n > GetMessageCapacity())
+		return FAIL;
+
+	while (j >= 0)
+	{
+		if (i >= 0 && buf[i].key > msgs[j].key)
+			buf[k--] = buf[i--];
+		else
+			buf[k--] = msgs[j--];
+	}
+	MessageCount() += n;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::TakeMessages
+//
+// Input   : from, n - a run of messages in the buffer
+// Output  : msgs - a copy of them, unless msgs is NULL
+// Purpose : Take a run of messages out of the buffer.
+//-------------------------------------------------------------------
+
+void BTIndexPage::TakeMessages (int from, int n, BTMessage *msgs)
+{
+	BTMessage *buf = Messages();
+	int left = GetNumOfMessages() - from - n;
+
+	if (msgs != NULL)
+		memcpy(msgs, buf + from, n * sizeof(BTMessage));
+	memmove(buf + from, buf + from + n, left * sizeof(BTMessage));
+	MessageCount() -= n;
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::ChildMessages
+//
+// Input   : i - position of a child, 0 to GetNumOfRecords()
+// Output  : from, n - the run of messages for that child: those whose
+//                     key is at least the key of entry i-1 and smaller
+//                     than that of entry i
+//-------------------------------------------------------------------
+
+void BTIndexPage::ChildMessages (int i, int &from, int &n)
+{
+	int to;
+
+	from = (i == 0) ? 0 : MessageLowerBound(KeyAt(i - 1));
+	to = (i == count) ? GetNumOfMessages() : MessageLowerBound(KeyAt(i));
+	n = to - from;
+}
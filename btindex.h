@@ -4,12 +4,12 @@
 
 #include "minirel.h"
 #include "page.h"
-#include "sortedpage.h"
+#include "btnode.h"
 #include "bt.h"
 
 
 
-class BTIndexPage : public SortedPage {
+class BTIndexPage : public BTNodePage {
 	
 private:
 
@@ -20,23 +20,57 @@ public:
     	// You may add public methods here.
 	
 	Status Insert (const int key, const PageID pid, RecordID &rid);
+	Status Insert (const IndexEntry &entry, RecordID &rid);
 	Status Delete (const int key, RecordID &rid);
+	Status Split (const IndexEntry &entry, int slotNo, BTIndexPage *right,
+	              int &splitKey, Bool append = FALSE);
 	Status GetSibling(const int key, PageID &pid, int &left);
 	Status GetFirst (int &key, PageID &pid, RecordID &rid);
 	Status GetNext (int &key, PageID &pid, RecordID &rid);
 	
+	PageID FindChild (const int key);
+	PageID FindFirstChild (const int key);
+
 	PageID GetLeftLink (void);
 	void   SetLeftLink (PageID left);
+
+	// Children by position: 0 is the left link, i > 0 the child of
+	// entry i-1.  The counts are 0 in a tree without counts.
+	PageID GetChild (int i);
+	Status PinChild (int i, BTNodePage *&child);
+	int    GetChildCount (int i);
+	void   SetChildCount (int i, int n);
+	void   AddChildCount (int i, int delta);
+
+	// The child references of a node in the buffer pool may be swizzled
+	// (see BufMgr::PinChild()); all methods return page ids, and those
+	// that change the node unswizzle it first.
+	PageID *ChildRef (int i);
+	void   UnswizzleChildren ();
 	    
-	IndexEntry *GetEntry(int slotNo) 
-	{
-	    	return (IndexEntry *)(data + slots[slotNo].offset);
-	}
-
-	Bool IsAtLeastHalfFull()
-	{
-		return (AvailableSpace() <= (HEAPPAGE_DATA_SIZE)/2);
-	}
+	void GetEntry(int slotNo, IndexEntry &entry);
+
+	// Entries by position.  Keys repeat in a tree with duplicates, in
+	// the index nodes too, so the entry for a child is found by its
+	// page rather than by its key.
+	int    FindChildPos (PageID pid);
+	Status InsertEntry (int slotNo, const IndexEntry &entry);
+	Status DeleteEntry (int slotNo);
+	void   SetKey (int slotNo, int key);
+
+	// The message buffer of a node of a buffered tree, in key order
+	// and, for equal keys, oldest first.  Child i is sent messages
+	// i..i+n-1 from ChildMessages(i); they route the way FindChild()
+	// does.  A node of a tree without buffers has no room for any.
+	int    GetNumOfMessages ();
+	int    GetMessageCapacity ();
+	Bool   BufferIsFull ();
+	void   GetMessage (int i, BTMessage &msg);
+	int    MessageLowerBound (int key);
+	Status AddMessage (const BTMessage &msg);
+	Status AddMessages (const BTMessage *msgs, int n);
+	void   TakeMessages (int from, int n, BTMessage *msgs);
+	void   ChildMessages (int i, int &from, int &n);
 };
 
 #endif
@@ -7,25 +7,31 @@
 //
 // Input   : key  - value of the key to be inserted.
 //           dataRid - record id of the record associated with key.
+//           scratch - for a packed leaf, room to unpack it into (see
+//                     BTNodePage::PackedScratchSize())
 // Output  : pairRid - record id of the inserted pair (key, dataRid)
 // Purpose : Insert the pair (key, dataRid) into this leaf node.
 // Return  : OK if insertion is successful.  FAIL otherwise.
 //-------------------------------------------------------------------
 
 Status 
-BTLeafPage::Insert(const int key, const RecordID dataRid, RecordID& pairRid)
+BTLeafPage::Insert(const int key, const RecordID dataRid, RecordID& pairRid,
+                   LeafEntry *scratch)
 {
 	LeafEntry entry;
+	int pos;
 	
 	entry.key = key;
 	entry.rid = dataRid;
 	
-	if (SortedPage::InsertRecord(
-		(char *)&entry, sizeof(LeafEntry), pairRid) != OK)
+	pos = FindInsertPos(key);
+	if (InsertAt(pos, &entry, scratch) != OK)
 	{
 		return FAIL;
 	}
 	
+	pairRid.pageNo = pid;
+	pairRid.slotNo = pos;
 	return OK;
 }
 
@@ -44,25 +50,23 @@ Status
 BTLeafPage::Delete (const int key, const RecordID dataRid, RecordID& rid)
 {
 	int i;
-	LeafEntry *entry;
+	LeafEntry entry;
 	
-	// Scan through all the records in this page and find the
+	// Scan through the entries with this key and find the
 	// matching pair (key, dataRid).
 
-	for (i = numOfSlots - 1; i >= 0; i--)
+	for (i = LowerBound(key); i < count; i++)
 	{
-		entry = GetEntry(i); 
-		if (entry->rid == dataRid && entry->key == key)
+		GetEntry(i, entry);
+		if (entry.key != key)
+			break;
+		if (entry.rid == dataRid)
 		{
 			// We delete it here.
 
-			Status s;
-			
 			rid.pageNo = PageNo();
 			rid.slotNo = i;
-			s = SortedPage::DeleteRecord(rid);
-
-			return s;
+			return DeleteAt(i);
 		}
 	}
 	
@@ -70,6 +74,43 @@ BTLeafPage::Delete (const int key, const RecordID dataRid, RecordID& rid)
 }
 
 
+//-------------------------------------------------------------------
+// BTLeafPage::Split
+//
+// Input   : key, dataRid - the pair to insert
+//           right - a new, empty leaf
+//           append - TRUE if keys are being appended in order, see
+//                    BTNodePage::SplitInsert()
+//           scratch - for a packed leaf, room to unpack it into
+// Output  : splitKey - the first key of right, to go into the parent
+// Purpose : Insert (key, dataRid) into this full leaf by splitting it:
+//           the upper half of the entries is moved to right.  The
+//           sibling links are left to the caller.
+// Return  : OK if successful, DONE if a packed leaf was split without
+//           taking the pair (see BTNodePage::PackedSplitInsert()),
+//           FAIL otherwise.
+//-------------------------------------------------------------------
+
+Status 
+BTLeafPage::Split (const int key, const RecordID dataRid, BTLeafPage *right,
+                   int &splitKey, Bool append, LeafEntry *scratch)
+{
+	LeafEntry entry;
+	Status s;
+	
+	entry.key = key;
+	entry.rid = dataRid;
+	
+	s = SplitInsert(FindInsertPos(key), &entry, right, NULL, append, scratch);
+	if (s != OK && s != DONE)
+		return FAIL;
+	
+	right->GetEntry(0, entry);
+	splitKey = entry.key;
+	return s;
+}
+
+
 //-------------------------------------------------------------------
 // BTLeafPage::GetFirst
 //
@@ -89,29 +130,25 @@ Status
 BTLeafPage::GetFirst (int &key, RecordID &dataRid, RecordID &rid)
 {
 	// Initialize the record id of the first (key, dataRid) pair.  The
-	// first record is always at slot position 0, since SortedPage always
-	// compact it's records.  We can also use HeapPage::FirstRecord here
-	// but it is not neccessary.
+	// first entry is always at position 0.
 
 	rid.pageNo = pid;
 	rid.slotNo = 0;
 
 	// If there are no record in this page, just return DONE.
 	
-	if (numOfSlots == 0)
+	if (count == 0)
 	{
 		dataRid.pageNo = INVALID_PAGE;
 		dataRid.slotNo = INVALID_SLOT;
 		return DONE;
 	}
 	
-	// Otherwise, we just copy the record into key and dataRid,
-	// and returned.  The record is located at offset slots[0].offset
-	// from the beginning of data area (pointed to by member data in 
-	// HeapPage)
+	// Otherwise, we just copy the entry into key and dataRid,
+	// and returned.
 
 	LeafEntry entry;
-	memcpy(&entry, GetEntry(0), sizeof(LeafEntry));
+	GetEntry(0, entry);
 	key = entry.key;
 	dataRid = entry.rid;
 	
@@ -138,26 +175,23 @@ BTLeafPage::GetNext (int &key, RecordID &dataRid, RecordID &rid)
 {
 	// If we are at the end of records, return DONE.
 
-	if (rid.slotNo + 1 >= numOfSlots)
+	if (rid.slotNo + 1 >= count)
 	{
 		dataRid.pageNo = INVALID_PAGE;
 		dataRid.slotNo = INVALID_SLOT;
 		return DONE;
 	}
 
-	// Increment the slotNo in rid to point to the next record in this
-	// page.  We can do this for subclass of SorterPage since the records
-	// in a sorted page is always compact.  
+	// Increment the slotNo in rid to point to the next entry in this
+	// page.  The entries of a node are always dense.
 	
 	rid.slotNo ++;
 
-	// Otherwise, we just copy the record into key and dataRid,
-	// and returned.  The record is located at offset 
-	// slots[rid.slotNo].offset from the beginning of data area 
-	// (pointed to by member data in HeapPage)
+	// Otherwise, we just copy the entry into key and dataRid,
+	// and returned.
 
 	LeafEntry entry;
-	memcpy(&entry, GetEntry(rid.slotNo), sizeof(LeafEntry));
+	GetEntry(rid.slotNo, entry);
 	key = entry.key;
 	dataRid = entry.rid;
 	
@@ -184,20 +218,18 @@ BTLeafPage::GetCurrent (int &key, RecordID &dataRid, RecordID rid)
 	// Check if the current record id is valid.  If not, return
 	// DONE.
 
-	if (rid.slotNo >= numOfSlots)
+	if (rid.slotNo >= count)
 	{
 		dataRid.pageNo = INVALID_PAGE;
 		dataRid.slotNo = INVALID_SLOT;
 		return DONE;
 	}
 
-	// If it's valid, we just copy the record into key and dataRid,
-	// and returned.  The record is located at offset 
-	// slots[rid.slotNo].offset from the beginning of data area 
-	// (pointed to by member data in HeapPage)
+	// If it's valid, we just copy the entry into key and dataRid,
+	// and returned.
 
 	LeafEntry entry;
-	memcpy(&entry, GetEntry(rid.slotNo), sizeof(LeafEntry));
+	GetEntry(rid.slotNo, entry);
 	key = entry.key;
 	dataRid = entry.rid;
 	
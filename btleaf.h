@@ -3,11 +3,11 @@
 
 #include "minirel.h"
 #include "page.h"
-#include "sortedpage.h"
+#include "btnode.h"
 #include "bt.h"
 #include "btindex.h"
 
-class BTLeafPage : public SortedPage {
+class BTLeafPage : public BTNodePage {
 	
 private:
 	
@@ -15,22 +15,32 @@ private:
 	
 public:
 		
-	Status Insert (const int key, const RecordID dataRid, RecordID& rid);
+	Status Insert (const int key, const RecordID dataRid, RecordID& rid,
+	               LeafEntry *scratch = NULL);
 	
 	Status GetFirst (int &key, RecordID &dataRid, RecordID &rid);
 	Status GetNext  (int &key, RecordID &dataRid, RecordID &rid);
 	Status GetCurrent (int &key, RecordID &dataRid, RecordID rid);
 	
 	Status Delete (const int key, const RecordID dataRid, RecordID& rid);
+	Status Split (const int key, const RecordID dataRid, BTLeafPage *right,
+	              int &splitKey, Bool append = FALSE, LeafEntry *scratch = NULL);
 
-	LeafEntry *GetEntry(int slotNo) 
+	void GetEntry(int slotNo, LeafEntry &entry)
 	{
-	    	return (LeafEntry *)(data + slots[slotNo].offset);
+	    	ReadEntry(slotNo, &entry);
 	}
 
-	Bool IsAtLeastHalfFull()
+	// Copy n entries from slotNo on into keys and dataRids.
+	void GetEntries(int slotNo, int n, int *keys, RecordID *dataRids)
 	{
-		return (AvailableSpace() <= (HEAPPAGE_DATA_SIZE)/2);
+	    	ReadEntries(slotNo, n, keys, dataRids);
+	}
+
+	// Add n entries, sorted, after the last one (see BTreeFile::BulkLoad()).
+	Status Append(const LeafEntry *entries, int n, LeafEntry *scratch = NULL)
+	{
+	    	return AppendEntries(n, entries, scratch);
 	}
 
 };
@@ -0,0 +1,273 @@
+#include "minirel.h"
+#include "bufmgr.h"
+#include "new_error.h"
+#include "btfile.h"
+#include "btfilescan.h"
+
+
+// Lookups a batch keeps going at once.  Each has at most one node on
+// its way into the cache, so this is about the number of misses a core
+// can have outstanding.
+const int LOOKUP_GROUP = 8;
+
+
+// Where one lookup of a batch is: at node, with its keys in the cache
+// once keysPrefetched, only its header so far otherwise.  node is NULL
+// for a slot with no lookup left to do.
+
+struct BTProbe {
+	int         i;		// position of the key in the batch
+	BTNodePage *node;
+	Bool        keysPrefetched;
+};
+
+
+// Start the next key of the batch, if any, on the probe that is done
+// with its key.
+static void NextProbe(BTProbe &p, int &next, int n, int &active,
+                      BTNodePage *root)
+{
+	p.node = NULL;
+	active--;
+	if (next < n)
+	{
+		p.i = next++;
+		p.node = root;
+		p.keysPrefetched = TRUE;
+		active++;
+	}
+}
+
+
+// Whether the buffer of an index node has a message for key.
+static Bool HasMessage(BTIndexPage *page, int key)
+{
+	BTMessage msg;
+	int pos = page->MessageLowerBound(key);
+
+	if (pos == page->GetNumOfMessages())
+		return FALSE;
+	page->GetMessage(pos, msg);
+	return msg.key == key;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::Lookup
+//
+// Input   : key - a key
+// Output  : rid - the record id of the first entry with key
+// Return  : OK if there is one, DONE if not, an error status
+//           otherwise.
+// Purpose : Point lookup; a batch of one.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::Lookup(const int key, RecordID &rid)
+{
+	Bool found;
+	Status s;
+
+	s = Lookup(&key, 1, &rid, &found);
+	if (s != OK)
+		return s;
+	return found ? OK : DONE;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::Lookup
+//
+// Input   : keys  - n keys, in any order
+// Output  : rids  - for each key found, the record id of its first
+//                   entry
+//           found - for each key, whether it is in the tree
+// Return  : OK if successful, an error status otherwise.
+// Purpose : Look up many keys at once, hiding the cache misses of one
+//           behind the work on the others.  Up to LOOKUP_GROUP lookups
+//           go down the tree side by side, taking turns.  On its turn a
+//           lookup whose node header was prefetched on its last turn
+//           prefetches the node's keys; one whose keys were prefetched
+//           searches them, moves on to the child and prefetches its
+//           header.  By the time a lookup comes round again, what it
+//           needs has had the other lookups' turns to arrive.  A
+//           lookup that reaches its leaf is done, and the next key
+//           starts at the root, which stays pinned for the batch.
+//           Fewer lookups go at once when the buffer pool is short of
+//           free frames.  A key with changes in the delta buffer, or
+//           in a buffered tree with messages on its way down, is looked
+//           up afterwards with a scan, which merges them.  A
+//           memory-mapped database is advised random access.
+//-------------------------------------------------------------------
+
+Status
+BTreeFile::Lookup(const int *keys, int n, RecordID *rids, Bool *found)
+{
+	BTProbe probes[LOOKUP_GROUP];
+	BTNodePage *root;
+	int group = LOOKUP_GROUP;
+	int next = 0, active = 0, g;
+	int *merge = NULL, numOfMerges = 0;
+	Status s;
+
+	// Each lookup holds a pin, and a small buffer pool has few to spare
+	if (mem == NULL && (int)MINIBASE_BM->GetNumOfUnpinnedBuffers() / 2 < group)
+		group = MINIBASE_BM->GetNumOfUnpinnedBuffers() / 2;
+	if (group < 1)
+		group = 1;
+
+	// Lookups read a page here and there: a memory-mapped database
+	// should not read ahead around them.  Scans advise their own spans.
+	if (mem == NULL && MINIBASE_DB->IsMapped())
+		MINIBASE_DB->AdviseAccess(DB_ACCESS_RANDOM);
+
+	s = PinNode(rootPid, (Page *&)root);
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	if (buffered || delta != NULL)
+		merge = new int[n];
+
+	for (g = 0; g < group; g++)
+	{
+		probes[g].node = NULL;
+		if (next < n)
+		{
+			probes[g].i = next++;
+			probes[g].node = root;
+			probes[g].keysPrefetched = TRUE;
+			active++;
+		}
+	}
+
+	while (active > 0 && s == OK)
+	{
+		for (g = 0; g < group && s == OK; g++)
+		{
+			BTProbe &p = probes[g];
+			int key;
+
+			if (p.node == NULL)
+				continue;
+			key = keys[p.i];
+
+			if (p.node == root && delta != NULL && delta->Contains(key))
+			{
+				merge[numOfMerges++] = p.i;
+				NextProbe(p, next, n, active, root);
+				continue;
+			}
+
+			if (!p.keysPrefetched)
+			{
+				p.node->PrefetchKeys();
+				p.keysPrefetched = TRUE;
+				continue;
+			}
+
+			if (p.node->GetType() == INDEX_NODE)
+			{
+				BTIndexPage *indexPage = (BTIndexPage *)p.node;
+				BTNodePage *child;
+				int pos = indexPage->LowerBound(key);
+
+				// Messages for key go down the path FindChild() takes,
+				// which is another one if key is in this node
+				if (buffered && (HasMessage(indexPage, key) ||
+				                 pos != indexPage->FindInsertPos(key)))
+				{
+					merge[numOfMerges++] = p.i;
+					if (p.node != root)
+						UnpinNode((Page *)p.node, CLEAN);
+					NextProbe(p, next, n, active, root);
+					continue;
+				}
+
+				// The same child a scan from key starts at
+				s = PinChild(indexPage, pos, child);
+				if (p.node != root)
+					UnpinNode((Page *)p.node, CLEAN);
+				p.node = NULL;
+				if (s != OK)
+				{
+					active--;
+					break;
+				}
+				child->PrefetchHeader();
+				p.node = child;
+				p.keysPrefetched = FALSE;
+				continue;
+			}
+
+			// At the leaf.  The first entry with key may be on one of
+			// the next leaves, if key separates this leaf from them.
+			BTLeafPage *leaf = (BTLeafPage *)p.node;
+			int pos = leaf->LowerBound(key);
+
+			while (pos == leaf->GetNumOfRecords() &&
+			       leaf->GetNextPage() != INVALID_PAGE)
+			{
+				PageID nextPid = leaf->GetNextPage();
+
+				if ((BTNodePage *)leaf != root)
+					UnpinNode((Page *)leaf, CLEAN);
+				leaf = NULL;
+				s = PinNode(nextPid, (Page *&)leaf);
+				if (s != OK)
+				{
+					leaf = NULL;
+					break;
+				}
+				pos = 0;
+			}
+
+			found[p.i] = FALSE;
+			if (s == OK && pos < leaf->GetNumOfRecords())
+			{
+				LeafEntry entry;
+
+				leaf->GetEntry(pos, entry);
+				if (entry.key == key)
+				{
+					rids[p.i] = entry.rid;
+					found[p.i] = TRUE;
+				}
+			}
+			if (leaf != NULL && (BTNodePage *)leaf != root)
+				UnpinNode((Page *)leaf, CLEAN);
+
+			if (s == OK)
+				NextProbe(p, next, n, active, root);
+			else
+			{
+				p.node = NULL;
+				active--;
+			}
+		}
+	}
+
+	// After an error, the lookups still under way let go of their nodes
+	for (g = 0; g < group; g++)
+		if (probes[g].node != NULL && probes[g].node != root)
+			UnpinNode((Page *)probes[g].node, CLEAN);
+	UnpinNode((Page *)root, CLEAN);
+
+	// The keys whose messages have to be merged in
+	if (numOfMerges > 0 && s == OK)
+	{
+		BTreeFileScan scan;
+
+		for (g = 0; g < numOfMerges && s == OK; g++)
+		{
+			int i = merge[g], key, got;
+
+			s = OpenScan(&keys[i], &keys[i], scan);
+			if (s == OK)
+				found[i] = (scan.GetNextBatch(&rids[i], &key, 1, got) == OK);
+		}
+	}
+	delete [] merge;
+
+	if (s != OK)
+		return MINIBASE_CHAIN_ERROR(BTREE, s);
+	return OK;
+}
@@ -0,0 +1,112 @@
+#include <string.h>
+#include "btmem.h"
+
+
+//-------------------------------------------------------------------
+// BTMemStore::BTMemStore
+//
+// Input   : size - bytes per node, at most MINIBASE_MAX_PAGESIZE
+// Output  : None
+// Purpose : Set up an empty store.  No memory is taken until the first
+//           node is.
+//-------------------------------------------------------------------
+
+BTMemStore::BTMemStore(int size)
+{
+	if (size > MINIBASE_MAX_PAGESIZE)
+		size = MINIBASE_MAX_PAGESIZE;
+	nodeSize = (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+	chunks = NULL;
+	numOfChunks = 0;
+	maxChunks = 0;
+	numOfNodes = 0;
+	freeList = INVALID_PAGE;
+}
+
+
+//-------------------------------------------------------------------
+// BTMemStore::~BTMemStore
+//
+// Input   : None
+// Output  : None
+// Purpose : Give all the nodes back.
+//-------------------------------------------------------------------
+
+BTMemStore::~BTMemStore()
+{
+	for (int i = 0; i < numOfChunks; i++)
+		AlignedFree(chunks[i]);
+	delete [] chunks;
+}
+
+
+//-------------------------------------------------------------------
+// BTMemStore::NewNode
+//
+// Input   : None
+// Output  : pid  - number of the new node
+//           page - its memory, nodeSize bytes, zeroed
+// Purpose : Take a node off the free list, or the next one of the last
+//           chunk, allocating a new chunk when it is used up.
+// Return  : OK if successful, FAIL if out of memory.
+//-------------------------------------------------------------------
+
+Status BTMemStore::NewNode(PageID &pid, Page *&page)
+{
+	if (freeList != INVALID_PAGE)
+	{
+		pid = freeList;
+		GetNode(pid, page);
+		freeList = *(PageID *)page;
+		memset((char *)page, 0, nodeSize);
+		return OK;
+	}
+
+	if (numOfNodes == numOfChunks * NODES_PER_CHUNK)
+	{
+		char *chunk;
+
+		if (numOfChunks == maxChunks)
+		{
+			int n = (maxChunks == 0) ? 16 : 2 * maxChunks;
+			char **larger = new char*[n];
+
+			if (numOfChunks > 0)
+				memcpy(larger, chunks, numOfChunks * sizeof(char *));
+			delete [] chunks;
+			chunks = larger;
+			maxChunks = n;
+		}
+
+		chunk = AlignedAlloc(NODES_PER_CHUNK * nodeSize);
+		if (chunk == NULL)
+			return FAIL;
+		chunks[numOfChunks++] = chunk;
+	}
+
+	pid = numOfNodes++;
+	GetNode(pid, page);
+	memset((char *)page, 0, nodeSize);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTMemStore::FreeNode
+//
+// Input   : pid - a node handed out by NewNode()
+// Output  : None
+// Purpose : Put the node on the free list.
+// Return  : OK if successful, FAIL if pid is not a node of this store.
+//-------------------------------------------------------------------
+
+Status BTMemStore::FreeNode(PageID pid)
+{
+	Page *page;
+
+	if (GetNode(pid, page) != OK)
+		return FAIL;
+	*(PageID *)page = freeList;
+	freeList = pid;
+	return OK;
+}
@@ -0,0 +1,50 @@
+#ifndef BTMEM_H
+#define BTMEM_H
+
+#include "minirel.h"
+#include "page.h"
+#include "bt.h"
+
+
+// Nodes of an in-memory B+ tree (see BTreeFile).  There is no DB and no
+// buffer pool behind them: the nodes are carved out of chunks of
+// NODES_PER_CHUNK, and the "page id" of a node is its number, which
+// leads to its address with a shift and a mask.  Node sizes are rounded
+// up to whole cache lines and every node starts on one, so small nodes
+// can be sized for the L1 or L2 cache rather than for disk pages.
+// Freed nodes are kept on a list for reuse.
+
+const int NODES_PER_CHUNK = 256;	// a power of 2
+
+class BTMemStore {
+
+public:
+
+	BTMemStore(int size);
+	~BTMemStore();
+
+	int    NodeSize() { return nodeSize; }
+
+	Status GetNode(PageID pid, Page *&page)
+	{
+		if (pid < 0 || pid >= numOfNodes)
+			return FAIL;
+		page = (Page *)(chunks[pid / NODES_PER_CHUNK] +
+		                (pid % NODES_PER_CHUNK) * nodeSize);
+		return OK;
+	}
+
+	Status NewNode(PageID &pid, Page *&page);
+	Status FreeNode(PageID pid);
+
+private:
+
+	int    nodeSize;
+	char **chunks;
+	int    numOfChunks;
+	int    maxChunks;	// size of the chunks array
+	int    numOfNodes;	// nodes handed out so far, freed or not
+	PageID freeList;	// freed nodes, linked through their first word
+};
+
+#endif
@@ -0,0 +1,952 @@
+#include <string.h>
+#include <limits.h>
+#include "btnode.h"
+#include "keysearch.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+// Keys left to compare with CountKeysLess() once binary search has
+// narrowed the range down; a few vector compares on one or two cache
+// lines are cheaper than the mispredicted branches of further halving.
+static const int KEY_SEARCH_WINDOW = 32;
+
+// Bytes left free after the entries of a packed leaf, so that any field
+// can be read or written with one unaligned 8-byte access.
+static const int PACKED_SLACK = sizeof(unsigned long long);
+
+// Fewest bits a packed entry is taken to need, so that even a 64KB leaf
+// of entries all alike holds no more than a ushort can count.
+static const int PACKED_MIN_WIDTH = 8;
+
+
+//-------------------------------------------------------------------
+// BTNodePage::Init
+//
+// Input   : pageNo - page id of this page
+//           size   - bytes the node spans, 0 for a whole page
+// Output  : None
+// Purpose : Initialize an empty node.  SetType() must be called
+//           before entries are inserted.
+//-------------------------------------------------------------------
+
+void BTNodePage::Init(PageID pageNo, int size)
+{
+	pid = pageNo;
+	nextPage = INVALID_PAGE;
+	prevPage = INVALID_PAGE;
+	type = LEAF_NODE;
+	count = 0;
+	entrySize = 0;
+	capacity = 0;
+	flags = 0;
+	nodeSize = (size != 0) ? size : MINIBASE_PAGESIZE;
+	leftCount = 0;
+}
+
+
+// Bytes per entry of a node of type t.  Index entries only take up room
+// for a subtree count in a counted tree.
+static int EntrySize(short t, Bool counted)
+{
+	if (t == LEAF_NODE)
+		return sizeof(LeafEntry);
+	else if (counted)
+		return sizeof(IndexEntry);
+	else
+		return sizeof(int) + sizeof(PageID);
+}
+
+
+// Entries that fit in a node of size bytes.  A buffered index node
+// keeps about the square root of that many, the rest of the page being
+// its buffer: the buffer then holds many messages for each child, so
+// that a flush moves large batches, while the tree is only about twice
+// as tall.
+static int EntryCapacity(short t, Bool counted, Bool buffered, int size)
+{
+	int n = (size - BTNODE_HEADER_SIZE) / EntrySize(t, counted);
+	int m = 4;
+
+	if (t != INDEX_NODE || !buffered)
+		return n;
+	while (m * m < n)
+		m++;
+	return m;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::SetType
+//
+// Input   : t        - LEAF_NODE or INDEX_NODE
+//           counted  - TRUE for a node of a counted tree
+//           buffered - TRUE for a node of a buffered tree
+//           packed   - TRUE for a node of a packed tree
+// Output  : None
+// Purpose : Set the type of the node, and with it the size of the
+//           entries and how many of them fit on a page.  The buffer of
+//           a buffered index node starts out empty; an empty packed
+//           leaf has no bits per field yet.
+//-------------------------------------------------------------------
+
+void BTNodePage::SetType(short t, Bool counted, Bool buffered, Bool packed)
+{
+	type = t;
+	flags = (counted ? BTNODE_COUNTED : 0) | (buffered ? BTNODE_BUFFERED : 0) |
+	        (packed ? BTNODE_PACKED : 0);
+	entrySize = EntrySize(t, counted);
+	// A 64KB page does not fit in nodeSize and wraps around to 0
+	int size = (nodeSize != 0) ? nodeSize : MINIBASE_MAX_PAGESIZE;
+	capacity = EntryCapacity(t, counted, buffered, size);
+	if (t == INDEX_NODE && buffered)
+		MessageCount() = 0;
+	if (IsPackedLeaf())
+		Pack(NULL, 0);
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::Capacity
+//
+// Input   : t        - LEAF_NODE or INDEX_NODE
+//           counted  - TRUE for a node of a counted tree
+//           size     - bytes per node, as given to Init()
+//           buffered - TRUE for a node of a buffered tree
+// Output  : None
+// Return  : How many entries such a node holds once SetType(t, counted,
+//           buffered) is done.
+//-------------------------------------------------------------------
+
+int BTNodePage::Capacity(short t, Bool counted, int size, Bool buffered)
+{
+	if (size == 0)
+		size = MINIBASE_PAGESIZE;
+	return EntryCapacity(t, counted, buffered, size);
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::MessageCapacity
+//
+// Input   : None
+// Output  : None
+// Return  : How many messages the buffer of this buffered index node
+//           has room for.
+//-------------------------------------------------------------------
+
+int BTNodePage::MessageCapacity()
+{
+	int size = (nodeSize != 0) ? nodeSize : MINIBASE_MAX_PAGESIZE;
+	int used = BTNODE_HEADER_SIZE + capacity*entrySize + sizeof(int);
+
+	return (size - used) / (int)sizeof(BTMessage);
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::SubtreeCount
+//
+// Input   : None
+// Output  : None
+// Purpose : Count the leaf entries under this node: its own entries for
+//           a leaf, the sum of the child counts for an index node.
+// Return  : The number of entries, 0 for an index node of a tree
+//           without counts.
+//-------------------------------------------------------------------
+
+int BTNodePage::SubtreeCount()
+{
+	int n;
+
+	if (type == LEAF_NODE)
+		return count;
+	if (!IsCounted())
+		return 0;
+
+	n = leftCount;
+	for (int i = 0; i < count; i++)
+		n += *(int *)(ValueAt(i) + sizeof(PageID));
+	return n;
+}
+
+
+// Start loading the cache line at p, without waiting for it.
+static inline void PrefetchLine(const void *p)
+{
+#if defined(__GNUC__)
+	__builtin_prefetch(p);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_prefetch((const char *)p, _MM_HINT_T0);
+#endif
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::PrefetchHeader / BTNodePage::PrefetchKeys
+//
+// Input   : None
+// Output  : None
+// Purpose : Prefetch the node for a search, in two steps, so that a
+//           caller with other work can do it in between (see
+//           BTreeFile::Lookup()).  The header gives the number of keys,
+//           and with it how many lines the keys span.
+//-------------------------------------------------------------------
+
+void BTNodePage::PrefetchHeader()
+{
+	PrefetchLine(this);
+}
+
+void BTNodePage::PrefetchKeys()
+{
+#ifdef BT_SEPARATE_KEYS
+	const char *end = (const char *)(Keys() + count);
+#else
+	const char *end = (const char *)EntryAt(count);
+#endif
+
+	if (IsPackedLeaf())
+		end = (const char *)PackedBits() + (count * PackedWidth() + 7) / 8;
+
+	// entries need not start on a line, so the last may be partly used
+	for (const char *p = entries; p < end; p += CACHE_LINE_SIZE)
+		PrefetchLine(p);
+	if (end > entries)
+		PrefetchLine(end - 1);
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::FindInsertPos
+//
+// Input   : key - key of an entry to be inserted
+// Output  : None
+// Purpose : Find the position an entry with this key goes to: after
+//           all entries with smaller or equal keys.
+// Return  : The position, between 0 and GetNumOfRecords().
+//-------------------------------------------------------------------
+
+int BTNodePage::FindInsertPos(int key)
+{
+	if (key == INT_MAX)
+		return count;
+	return LowerBound(key + 1);
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::LowerBound
+//
+// Input   : key - key to look for
+// Output  : None
+// Purpose : Find the first entry with a key not smaller than key.  With
+//           the keys stored apart, binary search only narrows the range
+//           down to KEY_SEARCH_WINDOW keys, which are then compared all
+//           at once by CountKeysLess().
+// Return  : Its position, GetNumOfRecords() if there is none.
+//-------------------------------------------------------------------
+
+int BTNodePage::LowerBound(int key)
+{
+	int low = 0, high = count;
+
+	if (IsPackedLeaf())
+		return PackedLowerBound(key);
+
+#ifdef BT_SEPARATE_KEYS
+	while (high - low > KEY_SEARCH_WINDOW)
+#else
+	while (low < high)
+#endif
+	{
+		int mid = (low + high) / 2;
+		if (KeyAt(mid) < key)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+#ifdef BT_SEPARATE_KEYS
+	low += CountKeysLess(Keys() + low, high - low, key);
+#endif
+	return low;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::ReadEntry
+//
+// Input   : i - position of the entry
+// Output  : entry - a copy of the entry, entrySize bytes
+// Purpose : Copy an entry out of the page, key first, then its value.
+//-------------------------------------------------------------------
+
+void BTNodePage::ReadEntry(int i, void *entry)
+{
+	if (IsPackedLeaf())
+	{
+		ReadPacked(i, *(LeafEntry *)entry);
+		return;
+	}
+	*(int *)entry = KeyAt(i);
+	memcpy((char *)entry + sizeof(int), ValueAt(i), ValueSize());
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::ReadEntries
+//
+// Input   : i - position of the first entry
+//           n - number of entries
+// Output  : keys   - the keys of entries i..i+n-1
+//           values - their values, ValueSize() bytes each
+// Purpose : Copy a run of entries out of the page, keys and values
+//           into separate arrays.
+//-------------------------------------------------------------------
+
+void BTNodePage::ReadEntries(int i, int n, int *keys, void *values)
+{
+	if (IsPackedLeaf())
+	{
+		LeafEntry entry;
+
+		for (int j = 0; j < n; j++)
+		{
+			ReadPacked(i + j, entry);
+			keys[j] = entry.key;
+			((RecordID *)values)[j] = entry.rid;
+		}
+		return;
+	}
+
+#ifdef BT_SEPARATE_KEYS
+	memcpy(keys, Keys() + i, n * sizeof(int));
+	memcpy(values, ValueAt(i), n * ValueSize());
+#else
+	for (int j = 0; j < n; j++)
+	{
+		keys[j] = KeyAt(i + j);
+		memcpy((char *)values + j * ValueSize(), ValueAt(i + j), ValueSize());
+	}
+#endif
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::AppendEntries
+//
+// Input   : n       - number of entries
+//           entries - n entries of entrySize bytes each, key first,
+//                     in key order and not smaller than the last key
+//                     on the page
+//           scratch - for a packed leaf that is not empty, room to
+//                     unpack it into (see PackedScratchSize())
+// Output  : None
+// Purpose : Add a run of entries at the end of the page, as when the
+//           page is filled from sorted input.  A packed leaf is packed
+//           again with them.
+// Return  : OK if successful, FAIL if they do not fit.
+//-------------------------------------------------------------------
+
+Status BTNodePage::AppendEntries(int n, const void *entries, LeafEntry *scratch)
+{
+	const char *entry = (const char *)entries;
+
+	if (n < 0)
+		return FAIL;
+	if (IsPackedLeaf())
+	{
+		if (count == 0)
+			return Pack((const LeafEntry *)entries, n);
+		if (scratch == NULL || count + n > PackedScratchSize())
+			return FAIL;
+		for (int j = 0; j < count; j++)
+			ReadPacked(j, scratch[j]);
+		memcpy(scratch + count, entries, n * sizeof(LeafEntry));
+		return Pack(scratch, count + n);
+	}
+	if (count + n > capacity)
+		return FAIL;
+
+#ifdef BT_SEPARATE_KEYS
+	for (int j = 0; j < n; j++, entry += entrySize)
+	{
+		Keys()[count + j] = *(const int *)entry;
+		memcpy(ValueAt(count + j), entry + sizeof(int), ValueSize());
+	}
+#else
+	memcpy(EntryAt(count), entry, n * entrySize);
+#endif
+	count += n;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::InsertAt
+//
+// Input   : pos     - position of the new entry
+//           entry   - the entry, entrySize bytes
+//           scratch - for a packed leaf, room to unpack it into (see
+//                     PackedScratchSize())
+// Output  : None
+// Purpose : Insert an entry, moving the entries from pos on up by one.
+// Return  : OK if successful, FAIL if the node is full or pos is out
+//           of range.
+//-------------------------------------------------------------------
+
+Status BTNodePage::InsertAt(int pos, const void *entry, LeafEntry *scratch)
+{
+	if (IsPackedLeaf() && pos >= 0 && pos <= count)
+		return PackedInsertAt(pos, *(const LeafEntry *)entry, scratch);
+	if (count >= capacity || pos < 0 || pos > count)
+		return FAIL;
+
+#ifdef BT_SEPARATE_KEYS
+	memmove(Keys() + pos + 1, Keys() + pos, (count - pos) * sizeof(int));
+	memmove(ValueAt(pos + 1), ValueAt(pos), (count - pos) * ValueSize());
+	Keys()[pos] = *(const int *)entry;
+	memcpy(ValueAt(pos), (const char *)entry + sizeof(int), ValueSize());
+#else
+	memmove(EntryAt(pos + 1), EntryAt(pos), (count - pos) * entrySize);
+	memcpy(EntryAt(pos), entry, entrySize);
+#endif
+	count++;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::DeleteAt
+//
+// Input   : pos - position of the entry to delete
+// Output  : None
+// Purpose : Delete an entry, moving the entries after it down by one.
+// Return  : OK if successful, FAIL if pos is out of range.
+//-------------------------------------------------------------------
+
+Status BTNodePage::DeleteAt(int pos)
+{
+	if (pos < 0 || pos >= count)
+		return FAIL;
+
+	if (IsPackedLeaf())
+	{
+		LeafEntry entry;
+
+		for (int j = pos; j < count - 1; j++)
+		{
+			ReadPacked(j + 1, entry);
+			WritePacked(j, entry);
+		}
+		count--;
+		return OK;
+	}
+
+#ifdef BT_SEPARATE_KEYS
+	memmove(Keys() + pos, Keys() + pos + 1, (count - pos - 1) * sizeof(int));
+	memmove(ValueAt(pos), ValueAt(pos + 1), (count - pos - 1) * ValueSize());
+#else
+	memmove(EntryAt(pos), EntryAt(pos + 1), (count - pos - 1) * entrySize);
+#endif
+	count--;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::MoveEntries
+//
+// Input   : from  - position of the first entry to move
+//           right - an empty node of the same type
+// Output  : None
+// Purpose : Move the entries from position from on to the start of
+//           right, in one copy (one for the keys and one for the
+//           values if they are kept apart).
+//-------------------------------------------------------------------
+
+void BTNodePage::MoveEntries(int from, BTNodePage *right)
+{
+	int n = count - from;
+
+#ifdef BT_SEPARATE_KEYS
+	memcpy(right->Keys(), Keys() + from, n * sizeof(int));
+	memcpy(right->ValueAt(0), ValueAt(from), n * ValueSize());
+#else
+	memcpy(right->EntryAt(0), EntryAt(from), n * entrySize);
+#endif
+	right->count = n;
+	count = from;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::SplitInsert
+//
+// Input   : pos    - position of the new entry, from FindInsertPos()
+//           entry  - the new entry, entrySize bytes
+//           right  - an empty node of the same type, the new sibling
+//           middle - NULL to split a leaf, where to put the middle
+//                    entry when splitting an index node
+//           append - TRUE if keys are being appended at the right end
+//                    of the tree
+//           scratch - for a packed leaf, room to unpack it into
+// Output  : middle - the entry that moves up, if middle is not NULL
+// Purpose : Split a full node while inserting entry into it.  Of the
+//           count + 1 entries, the lower half stays here and the upper
+//           half is moved to right with one copy.  For an index node
+//           the entry in the middle goes to neither page: its key is
+//           the separator and its child becomes right's left link, both
+//           up to the caller.
+//
+//           When appending and entry goes last, the node keeps all it
+//           has (but for the middle entry of an index node) and right
+//           starts with entry alone, so that a tree built in key order
+//           ends up with full nodes rather than half full ones.
+//
+//           A packed leaf is split by PackedSplitInsert().
+// Return  : OK if successful, DONE if a packed leaf was split without
+//           taking entry, FAIL if the node is not full or right is not
+//           empty.
+//-------------------------------------------------------------------
+
+Status BTNodePage::SplitInsert(int pos, const void *entry, BTNodePage *right,
+                               void *middle, Bool append, LeafEntry *scratch)
+{
+	int half = (count + 1) / 2;
+	int up = (middle != NULL);
+
+	if (IsPackedLeaf())
+		return PackedSplitInsert(pos, *(const LeafEntry *)entry, right, append,
+		                         scratch);
+
+	if (append && pos == count)
+		half = count - up;
+
+	if (count < capacity || right->count != 0 || pos < 0 || pos > count)
+		return FAIL;
+
+	if (pos < half)
+	{
+		// The new entry stays here, so one old entry less does.
+		if (up)
+		{
+			ReadEntry(half - 1, middle);
+			MoveEntries(half, right);
+			count = half - 1;
+		}
+		else
+		{
+			MoveEntries(half - 1, right);
+		}
+		return InsertAt(pos, entry);
+	}
+
+	if (pos == half && up)
+	{
+		// The new entry is the one that moves up.
+		memcpy(middle, entry, entrySize);
+		MoveEntries(half, right);
+		return OK;
+	}
+
+	if (up)
+	{
+		ReadEntry(half, middle);
+		MoveEntries(half + 1, right);
+		count = half;
+	}
+	else
+	{
+		MoveEntries(half, right);
+	}
+	return right->InsertAt(pos - half - up, entry);
+}
+
+
+// The width bits at bit pos of bits, and the same to write them.  Fields
+// are at most 32 bits and start within their first byte, so one 8-byte
+// word holds each.
+static inline unsigned GetBits(const uchar *bits, unsigned pos, int width)
+{
+	unsigned long long word;
+
+	memcpy(&word, bits + (pos >> 3), sizeof(word));
+	return (unsigned)((word >> (pos & 7)) & ((1ull << width) - 1));
+}
+
+static inline void SetBits(uchar *bits, unsigned pos, int width, unsigned value)
+{
+	unsigned long long word, mask = ((1ull << width) - 1) << (pos & 7);
+
+	memcpy(&word, bits + (pos >> 3), sizeof(word));
+	word = (word & ~mask) | (((unsigned long long)value << (pos & 7)) & mask);
+	memcpy(bits + (pos >> 3), &word, sizeof(word));
+}
+
+
+//-------------------------------------------------------------------
+// BTPackedRange::Start / BTPackedRange::Add / BTPackedRange::Bits
+//
+// Input   : entry     - a leaf entry
+//           high, low - the largest and smallest value of a field
+// Output  : None
+// Purpose : Start the ranges with one entry, and widen them to take in
+//           another.  Bits() is the number of bits the difference of
+//           high and low needs, 0 if they are equal.
+//-------------------------------------------------------------------
+
+void BTPackedRange::Start(const LeafEntry &entry)
+{
+	lowKey = highKey = entry.key;
+	lowPage = highPage = entry.rid.pageNo;
+	lowSlot = highSlot = entry.rid.slotNo;
+}
+
+void BTPackedRange::Add(const LeafEntry &entry)
+{
+	if (entry.key < lowKey)
+		lowKey = entry.key;
+	if (entry.key > highKey)
+		highKey = entry.key;
+	if (entry.rid.pageNo < lowPage)
+		lowPage = entry.rid.pageNo;
+	if (entry.rid.pageNo > highPage)
+		highPage = entry.rid.pageNo;
+	if (entry.rid.slotNo < lowSlot)
+		lowSlot = entry.rid.slotNo;
+	if (entry.rid.slotNo > highSlot)
+		highSlot = entry.rid.slotNo;
+}
+
+int BTPackedRange::Bits(int high, int low)
+{
+	unsigned diff = (unsigned)high - (unsigned)low;
+	int n = 0;
+
+	while (diff != 0)
+	{
+		n++;
+		diff >>= 1;
+	}
+	return n;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::PackedCapacity
+//
+// Input   : size  - bytes per node, as given to Init()
+//           width - bits per entry
+// Output  : None
+// Return  : How many entries of width bits a packed leaf holds.
+//-------------------------------------------------------------------
+
+int BTNodePage::PackedCapacity(int size, int width)
+{
+	int room;
+
+	if (size == 0)
+		size = MINIBASE_PAGESIZE;
+	room = size - BTNODE_HEADER_SIZE - (int)sizeof(BTPackedHeader) - PACKED_SLACK;
+	if (width < PACKED_MIN_WIDTH)
+		width = PACKED_MIN_WIDTH;
+	return room * 8 / width;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::PackedScratchSize
+//
+// Input   : None
+// Output  : None
+// Return  : How many entries a buffer must hold for any packed leaf
+//           to be unpacked into it along with one new entry.
+//-------------------------------------------------------------------
+
+int BTNodePage::PackedScratchSize()
+{
+	return PackedCapacity(MINIBASE_MAX_PAGESIZE, 0) + 1;
+}
+
+
+int BTNodePage::PackedWidth()
+{
+	BTPackedHeader *h = Packed();
+
+	return h->keyBits + h->pageBits + h->slotBits;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::ReadPacked / BTNodePage::WritePacked
+//
+// Input   : i     - position of an entry of a packed leaf
+//           entry - for WritePacked(), the entry, which PackedFits()
+// Output  : entry - for ReadPacked(), the entry decoded
+// Purpose : Decode or encode entry i: each field is its leaf's base
+//           plus the next keyBits, pageBits or slotBits bits.
+//-------------------------------------------------------------------
+
+void BTNodePage::ReadPacked(int i, LeafEntry &entry)
+{
+	BTPackedHeader *h = Packed();
+	unsigned pos = (unsigned)i * (h->keyBits + h->pageBits + h->slotBits);
+
+	entry.key = (int)((unsigned)h->keyBase + GetBits(PackedBits(), pos, h->keyBits));
+	pos += h->keyBits;
+	entry.rid.pageNo = (PageID)((unsigned)h->pageBase +
+	                            GetBits(PackedBits(), pos, h->pageBits));
+	pos += h->pageBits;
+	entry.rid.slotNo = (int)((unsigned)h->slotBase +
+	                         GetBits(PackedBits(), pos, h->slotBits));
+}
+
+void BTNodePage::WritePacked(int i, const LeafEntry &entry)
+{
+	BTPackedHeader *h = Packed();
+	unsigned pos = (unsigned)i * (h->keyBits + h->pageBits + h->slotBits);
+
+	SetBits(PackedBits(), pos, h->keyBits, (unsigned)entry.key - (unsigned)h->keyBase);
+	pos += h->keyBits;
+	SetBits(PackedBits(), pos, h->pageBits,
+	        (unsigned)entry.rid.pageNo - (unsigned)h->pageBase);
+	pos += h->pageBits;
+	SetBits(PackedBits(), pos, h->slotBits,
+	        (unsigned)entry.rid.slotNo - (unsigned)h->slotBase);
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::PackedFits
+//
+// Input   : entry - a leaf entry
+// Output  : None
+// Return  : TRUE if each field of entry can be encoded with the bases
+//           and widths the packed leaf has now.  Keys must not go below
+//           the base, so that the encoded keys keep their order.
+//-------------------------------------------------------------------
+
+Bool BTNodePage::PackedFits(const LeafEntry &entry)
+{
+	BTPackedHeader *h = Packed();
+
+	return entry.key >= h->keyBase && entry.rid.pageNo >= h->pageBase &&
+	       entry.rid.slotNo >= h->slotBase &&
+	       BTPackedRange::Bits(entry.key, h->keyBase) <= h->keyBits &&
+	       BTPackedRange::Bits(entry.rid.pageNo, h->pageBase) <= h->pageBits &&
+	       BTPackedRange::Bits(entry.rid.slotNo, h->slotBase) <= h->slotBits;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::UnpackWith
+//
+// Input   : pos   - a position, from 0 to GetNumOfRecords()
+//           entry - an entry to go there
+// Output  : all   - the entries of the packed leaf with entry at pos,
+//                   count + 1 of them
+//-------------------------------------------------------------------
+
+void BTNodePage::UnpackWith(int pos, const LeafEntry &entry, LeafEntry *all)
+{
+	int j;
+
+	for (j = 0; j < pos; j++)
+		ReadPacked(j, all[j]);
+	all[pos] = entry;
+	for (j = pos; j < count; j++)
+		ReadPacked(j, all[j + 1]);
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::Pack
+//
+// Input   : all - n entries in key order, NULL if n is 0
+// Output  : None
+// Purpose : Make a packed leaf hold just these entries, with the bases
+//           and widths they need.
+// Return  : OK if successful, FAIL if they do not fit, in which case
+//           the leaf is left as it was.
+//-------------------------------------------------------------------
+
+Status BTNodePage::Pack(const LeafEntry *all, int n)
+{
+	BTPackedHeader *h = Packed();
+	BTPackedRange range;
+	int size = (nodeSize != 0) ? nodeSize : MINIBASE_MAX_PAGESIZE;
+	int i, width = 0;
+
+	if (n > 0)
+	{
+		range.Start(all[0]);
+		for (i = 1; i < n; i++)
+			range.Add(all[i]);
+		width = range.Width();
+	}
+	if (n > PackedCapacity(size, width))
+		return FAIL;
+
+	memset(h, 0, sizeof(BTPackedHeader));
+	if (n > 0)
+	{
+		h->keyBase = range.lowKey;
+		h->pageBase = range.lowPage;
+		h->slotBase = range.lowSlot;
+		h->keyBits = range.KeyBits();
+		h->pageBits = range.PageBits();
+		h->slotBits = range.SlotBits();
+	}
+	capacity = PackedCapacity(size, width);
+	count = n;
+	for (i = 0; i < n; i++)
+		WritePacked(i, all[i]);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::PackedLowerBound
+//
+// Input   : key - key to look for
+// Output  : None
+// Purpose : LowerBound() for a packed leaf: binary search over the
+//           encoded keys, which keep the order of the keys.
+// Return  : The position of the first entry with a key not smaller than
+//           key, GetNumOfRecords() if there is none.
+//-------------------------------------------------------------------
+
+int BTNodePage::PackedLowerBound(int key)
+{
+	BTPackedHeader *h = Packed();
+	int width = PackedWidth(), low = 0, high = count;
+	unsigned target;
+
+	if (key <= h->keyBase)
+		return 0;
+	target = (unsigned)key - (unsigned)h->keyBase;
+
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+
+		if (GetBits(PackedBits(), (unsigned)mid * width, h->keyBits) < target)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::PackedInsertAt
+//
+// Input   : pos     - position of the new entry, from 0 to count
+//           entry   - the entry
+//           scratch - room for PackedScratchSize() entries
+// Output  : None
+// Purpose : InsertAt() for a packed leaf.  An entry within the bases
+//           and widths goes in after the entries from pos on move up
+//           by one; otherwise all are unpacked into scratch and packed
+//           again, with wider fields.
+// Return  : OK if successful, FAIL if the entries no longer fit or
+//           there is no scratch to repack them in.
+//-------------------------------------------------------------------
+
+Status BTNodePage::PackedInsertAt(int pos, const LeafEntry &entry,
+                                  LeafEntry *scratch)
+{
+	LeafEntry moved;
+
+	if (count < capacity && PackedFits(entry))
+	{
+		for (int j = count; j > pos; j--)
+		{
+			ReadPacked(j - 1, moved);
+			WritePacked(j, moved);
+		}
+		WritePacked(pos, entry);
+		count++;
+		return OK;
+	}
+
+	if (scratch == NULL)
+		return FAIL;
+	UnpackWith(pos, entry, scratch);
+	return Pack(scratch, count + 1);
+}
+
+
+//-------------------------------------------------------------------
+// BTNodePage::PackedSplitInsert
+//
+// Input   : pos    - position of the new entry, from FindInsertPos()
+//           entry  - the new entry
+//           right  - an empty packed leaf, the new sibling
+//           append - TRUE if keys are being appended at the right end
+//                    of the tree
+//           scratch - room for PackedScratchSize() entries
+// Output  : None
+// Purpose : SplitInsert() for a packed leaf that cannot take entry.  As
+//           many entries fit on a leaf as their ranges allow, so the
+//           split goes as near the middle (or, appending, the end) as
+//           it can with each half fitting.  An entry far off the range
+//           of its neighbours can leave no such split; then the leaf
+//           is split in half without it, and the caller inserts it
+//           again.
+// Return  : OK if successful, DONE if the leaf was split without entry,
+//           FAIL if right is not empty or there is no scratch.
+//-------------------------------------------------------------------
+
+Status BTNodePage::PackedSplitInsert(int pos, const LeafEntry &entry,
+                                     BTNodePage *right, Bool append,
+                                     LeafEntry *scratch)
+{
+	int size = (nodeSize != 0) ? nodeSize : MINIBASE_MAX_PAGESIZE;
+	int n = count + 1, k, kmin, kmax;
+	BTPackedRange range;
+	LeafEntry *all = scratch;
+	Status s = OK;
+
+	if (right->count != 0 || pos < 0 || pos > count || all == NULL)
+		return FAIL;
+	UnpackWith(pos, entry, all);
+
+	// The most entries from the left, and from the right, that fit
+	range.Start(all[0]);
+	for (kmax = 1; kmax < n; kmax++)
+	{
+		range.Add(all[kmax]);
+		if (kmax + 1 > PackedCapacity(size, range.Width()))
+			break;
+	}
+	range.Start(all[n - 1]);
+	for (kmin = n - 1; kmin > 0; kmin--)
+	{
+		range.Add(all[kmin - 1]);
+		if (n - kmin + 1 > PackedCapacity(size, range.Width()))
+			break;
+	}
+
+	// Entries 0..k-1 stay, k.. move to right
+	k = (append && pos == count) ? count : n / 2;
+	if (k < kmin)
+		k = kmin;
+	if (k > kmax)
+		k = kmax;
+	if (k < 1 || k > n - 1 || k < kmin)
+	{
+		memmove(all + pos, all + pos + 1, (count - pos) * sizeof(LeafEntry));
+		n = count;
+		k = n / 2;
+		s = DONE;
+	}
+
+	if (Pack(all, k) != OK || right->Pack(all + k, n - k) != OK)
+		s = FAIL;
+	return s;
+}
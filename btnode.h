@@ -0,0 +1,179 @@
+#ifndef BTNODE_PAGE_H
+#define BTNODE_PAGE_H
+
+#include "minirel.h"
+#include "page.h"
+#include "heappage.h"
+#include "bt.h"
+
+
+//
+// CHANGE this constant whenever you update the structure of BTNodePage.
+//
+const int BTNODE_HEADER_SIZE = 3*sizeof(PageID) + 6*sizeof(short) + sizeof(int);
+
+// Bits of BTNodePage::flags.
+const ushort BTNODE_COUNTED = 0x1;	// node of a counted tree
+const ushort BTNODE_BUFFERED = 0x2;	// node of a buffered tree
+const ushort BTNODE_PACKED = 0x4;	// node of a packed tree
+
+
+// The start of the entries of a packed leaf.  Each field of an entry is
+// stored as its difference from the smallest one on the leaf, in the
+// bits that the largest difference needs.
+
+struct BTPackedHeader {
+	int     keyBase;
+	PageID  pageBase;
+	int     slotBase;
+	uchar   keyBits;
+	uchar   pageBits;
+	uchar   slotBits;
+	uchar   unused;
+};
+
+// The smallest and largest of each field over some leaf entries, and
+// from them the bits each field takes on a packed leaf holding them.
+
+struct BTPackedRange {
+	int     lowKey, highKey;
+	PageID  lowPage, highPage;
+	int     lowSlot, highSlot;
+
+	void    Start(const LeafEntry &entry);
+	void    Add(const LeafEntry &entry);
+	int     KeyBits() { return Bits(highKey, lowKey); }
+	int     PageBits() { return Bits(highPage, lowPage); }
+	int     SlotBits() { return Bits(highSlot, lowSlot); }
+	int     Width() { return KeyBits() + PageBits() + SlotBits(); }
+	static int Bits(int high, int low);
+};
+
+
+// A B+ tree node.  The entries of a node all have the same size, so
+// instead of a slot directory the page holds a header and the entries
+// sorted by key.  With BT_SEPARATE_KEYS (bt.h) the capacity keys come
+// first and the values (record ids or child page ids) after them;
+// otherwise entry i is a key and its value at entries + i*entrySize.
+// Either way the "slotNo" of a RecordID on a node is simply the entry's
+// position.
+//
+// The index nodes of a counted tree also keep, next to each child, the
+// number of leaf entries under it: the entries carry IndexEntry::count
+// and leftCount holds the one of the leftmost child.
+//
+// The index nodes of a buffered tree give most of their space to a
+// buffer of messages (see BTIndexPage::AddMessage()), which follows the
+// capacity entries: the number of messages, then the messages.
+//
+// The leaves of a packed tree hold their entries bit-packed (see
+// BTNodePage::Pack()): a BTPackedHeader, then entry i at bit i*width,
+// its key, record id page and slot each in a fixed number of bits.
+// Entries are still read and searched by position, decoded on the fly,
+// but capacity is how many fit at the current widths and changes with
+// them.
+
+class BTNodePage {
+
+protected :
+
+	PageID  pid;         // Page ID of this page
+	PageID  nextPage;    // Next leaf, INVALID_PAGE for an index node.
+	PageID  prevPage;    // Previous leaf, or leftmost child of an index
+	                     // node.
+
+	short   type;        // LEAF_NODE or INDEX_NODE
+	ushort  count;       // Number of entries on the page.
+	ushort  entrySize;   // Size of one entry, set by SetType().
+	ushort  capacity;    // Number of entries that fit on the page.
+	ushort  flags;       // BTNODE_COUNTED, BTNODE_BUFFERED, BTNODE_PACKED
+	ushort  nodeSize;    // Bytes the node spans: the page size, or less
+	                     // for a node of an in-memory tree.  0 for 64KB.
+	int     leftCount;   // Leaf entries under the leftmost child of a
+	                     // counted index node.
+
+	char    entries[MAX_SPACE - BTNODE_HEADER_SIZE];
+
+	                     // Only capacity entries of this array are
+	                     // in the page.
+
+	int    ValueSize() { return entrySize - sizeof(int); }
+#ifdef BT_SEPARATE_KEYS
+	int   *Keys()         { return (int *)entries; }
+	int    KeyAt(int i)   { return Keys()[i]; }
+	void   SetKeyAt(int i, int key) { Keys()[i] = key; }
+	char  *ValueAt(int i) { return entries + capacity*sizeof(int) + i*ValueSize(); }
+#else
+	char  *EntryAt(int i) { return entries + i*entrySize; }
+	int    KeyAt(int i)   { return *(int *)EntryAt(i); }
+	void   SetKeyAt(int i, int key) { *(int *)EntryAt(i) = key; }
+	char  *ValueAt(int i) { return EntryAt(i) + sizeof(int); }
+#endif
+
+	int   &MessageCount() { return *(int *)(entries + capacity*entrySize); }
+	BTMessage *Messages() { return (BTMessage *)(entries + capacity*entrySize + sizeof(int)); }
+	int    MessageCapacity();
+
+	// Only the leaves of a packed tree are packed
+	Bool   IsPackedLeaf() { return type == LEAF_NODE && IsPacked(); }
+	BTPackedHeader *Packed() { return (BTPackedHeader *)entries; }
+	uchar *PackedBits() { return (uchar *)entries + sizeof(BTPackedHeader); }
+	int    PackedWidth();
+	void   ReadPacked(int i, LeafEntry &entry);
+	void   WritePacked(int i, const LeafEntry &entry);
+	Bool   PackedFits(const LeafEntry &entry);
+	void   UnpackWith(int pos, const LeafEntry &entry, LeafEntry *all);
+	Status Pack(const LeafEntry *all, int n);
+	int    PackedLowerBound(int key);
+	Status PackedInsertAt(int pos, const LeafEntry &entry, LeafEntry *scratch);
+	Status PackedSplitInsert(int pos, const LeafEntry &entry, BTNodePage *right,
+	                         Bool append, LeafEntry *scratch);
+
+	void   ReadEntry(int i, void *entry);
+	void   ReadEntries(int i, int n, int *keys, void *values);
+	Status AppendEntries(int n, const void *entries, LeafEntry *scratch = NULL);
+	void   MoveEntries(int from, BTNodePage *right);
+
+public:
+
+	void   Init(PageID pageNo, int size = 0);
+
+	PageID PageNo() { return pid; }
+	PageID GetNextPage() { return nextPage; }
+	PageID GetPrevPage() { return prevPage; }
+	void   SetNextPage(PageID pageNo) { nextPage = pageNo; }
+	void   SetPrevPage(PageID pageNo) { prevPage = pageNo; }
+
+	void   SetType(short t, Bool counted = FALSE, Bool buffered = FALSE,
+	               Bool packed = FALSE);
+	static int Capacity(short t, Bool counted, int size, Bool buffered = FALSE);
+	static int PackedCapacity(int size, int width);
+	static int PackedScratchSize();
+	short  GetType() { return type; }
+	Bool   IsCounted() { return (flags & BTNODE_COUNTED) != 0; }
+	Bool   IsBuffered() { return (flags & BTNODE_BUFFERED) != 0; }
+	Bool   IsPacked() { return (flags & BTNODE_PACKED) != 0; }
+	int    SubtreeCount();
+
+	int    GetNumOfRecords() { return count; }
+	int    GetCapacity() { return capacity; }
+	int    MinEntries() { return capacity / 2; }
+	Bool   IsEmpty() { return count == 0; }
+	Bool   IsFull() { return count == capacity; }
+	Bool   IsAtLeastHalfFull() { return count >= MinEntries(); }
+
+	// Ask for the node to be brought into the cache before it is
+	// searched: its header, then, once that is in, the keys in use.
+	void   PrefetchHeader();
+	void   PrefetchKeys();
+
+	int    FindInsertPos(int key);
+	int    LowerBound(int key);
+	Status InsertAt(int pos, const void *entry, LeafEntry *scratch = NULL);
+	Status DeleteAt(int pos);
+	Status SplitInsert(int pos, const void *entry, BTNodePage *right,
+	                   void *middle, Bool append = FALSE,
+	                   LeafEntry *scratch = NULL);
+};
+
+#endif
@@ -95,6 +95,10 @@ SOURCE=.\btindex.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\btnode.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\btleaf.cpp
 # End Source File
 # Begin Source File
@@ -131,10 +135,50 @@ SOURCE=.\main.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\globaldefs\latch.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\globaldefs\new_error.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\globaldefs\scheduler.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\globaldefs\threads.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\btbulk.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\btbuffer.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\btdelta.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\btlookup.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\btmem.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\btsnap.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\keysearch.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\spacemgr\page.cpp
 # End Source File
 # Begin Source File
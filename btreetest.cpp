@@ -1,18 +1,70 @@
 #include <math.h> 
 #include <iostream>
+#include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <string.h>
 #include <assert.h>
+#include <chrono>
+#include <atomic>
+#include <new>
 
 #include "bufmgr.h"
 #include "db.h"
 #include "btfile.h"
+#include "threads.h"
+#include "scheduler.h"
 
 #include "btreetest.h"
 
 #define MAX_COMMAND_SIZE 1000
+#define BUFFER_POOL_BYTES (8*1024*1024)
+#define BENCH_BATCH 256
+#define REOPEN_DB "btreopen"
+#define REOPEN_LOG "btreopenlog"
 
-Status BTreeTest::RunTests(std::istream &in) {
+// Every call of the global operator new (or new[]) is counted, so that the benchmark
+// can check that inserts and scans run without allocating memory.  Worker threads
+// allocate too, so the count is atomic.
+static std::atomic<unsigned long> numOfAllocs(0);
+
+void *operator new(size_t size)
+{
+	void *p;
+
+	numOfAllocs++;
+	if ((p = malloc(size ? size : 1)) == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	free(p);
+}
+
+Status BTreeTest::RunTests(std::istream &in, DBIOMode iomode, unsigned pagesize) {
 
 	char *dbname="btdb";
 	char *logname="btlog";
@@ -22,7 +74,8 @@ Status BTreeTest::RunTests(std::istream &in) {
 	remove(logname);
 
 	Status status;
-	minibase_globals = new SystemDefs(status, dbname, logname, 1000,500,200);
+	minibase_globals = new SystemDefs(status, dbname, logname, 1000,500,
+		BUFFER_POOL_BYTES, NULL, iomode, pagesize);
 	if (status != OK) {
 		minibase_errors.show_errors();
 		exit(1);
@@ -46,6 +99,11 @@ Status BTreeTest::RunTests(std::istream &in) {
 			in >> low >> high;
 			scanHighLow(btf,low,high);
 		}
+		else if(!strcmp(command, "rscan")) {
+			int high, low;
+			in >> low >> high;
+			scanHighLow(btf,low,high,Descending);
+		}
 		else if(!strcmp(command, "delete")) {
 			int high, low;
 			in >> low >> high;
@@ -56,6 +114,76 @@ Status BTreeTest::RunTests(std::istream &in) {
 			in >> low >> high;
 			deleteScanHighLow(btf,low,high);
 		}
+		else if(!strcmp(command, "bench")) {
+			int high, low;
+			in >> low >> high;
+			benchHighLow(btf,low,high);
+		}
+		else if(!strcmp(command, "counted")) {
+			int high, low;
+			in >> low >> high;
+			countedHighLow(low,high);
+		}
+		else if(!strcmp(command, "append")) {
+			int high, low;
+			in >> low >> high;
+			appendHighLow(low,high);
+		}
+		else if(!strcmp(command, "swizzle")) {
+			int high, low;
+			in >> low >> high;
+			swizzleHighLow(low,high);
+		}
+		else if(!strcmp(command, "memory")) {
+			int high, low;
+			in >> low >> high;
+			memoryHighLow(low,high);
+		}
+		else if(!strcmp(command, "snapshot")) {
+			int high, low;
+			in >> low >> high;
+			snapshotHighLow(low,high);
+		}
+		else if(!strcmp(command, "pscan")) {
+			int high, low;
+			in >> low >> high;
+			parallelScanHighLow(low,high);
+		}
+		else if(!strcmp(command, "bulk")) {
+			int high, low;
+			in >> low >> high;
+			bulkHighLow(low,high);
+		}
+		else if(!strcmp(command, "sched")) {
+			int high, low;
+			in >> low >> high;
+			schedulerHighLow(low,high);
+		}
+		else if(!strcmp(command, "lookup")) {
+			int high, low;
+			in >> low >> high;
+			lookupHighLow(low,high);
+		}
+		else if(!strcmp(command, "buffered")) {
+			int high, low;
+			in >> low >> high;
+			bufferedHighLow(low,high);
+		}
+		else if(!strcmp(command, "delta")) {
+			int high, low;
+			in >> low >> high;
+			deltaHighLow(low,high);
+		}
+		else if(!strcmp(command, "packed")) {
+			int high, low;
+			in >> low >> high;
+			packedHighLow(low,high);
+		}
+		else if(!strcmp(command, "reopen")) {
+			int high, low;
+			in >> low >> high;
+			reopenHighLow(low,high);
+		}
 		else if(!strcmp(command, "print")) {
 			btf->Print();
 		}
@@ -83,7 +211,7 @@ Status BTreeTest::RunTests(std::istream &in) {
 
 BTreeFile *BTreeTest::createIndex(char *name) {
     std::cout << "Create B+tree." << std::endl;
-    std::cout << "  Page size="<<MINIBASE_PAGESIZE<< " Max space="<<MAX_SPACE<<std::endl;
+    std::cout << "  Page size="<<MINIBASE_PAGESIZE<< " Max page size="<<MAX_SPACE<<std::endl;
 	
     Status status;
     BTreeFile *btf = new BTreeFile(status, name);
@@ -126,14 +254,17 @@ void BTreeTest::insertHighLow(BTreeFile *btf, int low, int high) {
 }
 
 
-void BTreeTest::scanHighLow(BTreeFile *btf, int low, int high) {
-	std::cout << "Scanning ("<<low<<" to "<<high<<"):"<< std::endl;
+void BTreeTest::scanHighLow(BTreeFile *btf, int low, int high, TupleOrder order) {
+	if (order == Descending)
+		std::cout << "Scanning ("<<high<<" down to "<<low<<"):"<< std::endl;
+	else
+		std::cout << "Scanning ("<<low<<" to "<<high<<"):"<< std::endl;
 
 	int *plow=&low, *phigh=&high;
 	if(low==-1) plow=NULL;
 	if(high==-1) phigh=NULL;
 
-	IndexFileScan *scan = btf->OpenScan(plow, phigh);
+	IndexFileScan *scan = btf->OpenScan(plow, phigh, order);
 	if(scan == NULL) {
 		std::cout << "  Error: cannot open a scan." << std::endl;
 		minibase_errors.show_errors();
@@ -247,3 +378,1583 @@ void BTreeTest::deleteScanHighLow(BTreeFile *btf, int low, int high) {
     }
 	std::cout << "  Success."<< std::endl;
 }
+
+
+//-------------------------------------------------------------------
+// BTreeTest::benchHighLow
+//
+// Input   : low, high - range of keys to insert.
+// Purpose : Insert the keys low..high in random order without printing
+//           each record, flush the buffer pool, then scan the whole
+//           index.  Reports elapsed wall-clock time for both phases so
+//           that runs with buffered and direct I/O can be compared, and
+//           the number of heap allocations in each, which must be 0.
+//           The index is then scanned once more with GetNextBatch().
+//-------------------------------------------------------------------
+
+void BTreeTest::benchHighLow(BTreeFile *btf, int low, int high) {
+	typedef std::chrono::steady_clock Clock;
+
+	int numkey=high-low+1;
+	std::cout << "Benchmark ("<<low<<" to "<<high<<"), "
+		<< (MINIBASE_DB->GetIOMode()==DB_DIRECT_IO ? "direct" : "buffered")
+		<< " I/O, page size="<<MINIBASE_DB->GetPageSize()<<std::endl;
+
+	int *keys = new int[numkey];
+	for (int i=0; i<numkey; i++)
+		keys[i] = low + i;
+	for (int i=numkey-1; i>0; i--) {
+		int j = rand() % (i+1);
+		int t = keys[i]; keys[i] = keys[j]; keys[j] = t;
+	}
+
+	unsigned long allocs = numOfAllocs;
+	Clock::time_point start = Clock::now();
+	for (int i=0; i<numkey; i++) {
+		RecordID rid;
+		rid.pageNo=keys[i]; rid.slotNo=keys[i]+1;
+		if (btf->Insert(keys[i], rid) != OK) {
+			std::cout << "  Insertion failed."<< std::endl;
+			minibase_errors.show_errors();
+			delete [] keys;
+			return;
+		}
+	}
+	unsigned long insertAllocs = numOfAllocs - allocs;
+	MINIBASE_BM->FlushAllPages();
+	Clock::time_point inserted = Clock::now();
+	delete [] keys;
+
+	allocs = numOfAllocs;
+	RecordID rid;
+	int ikey, count=0;
+	{
+		BTreeFileScan scan;
+		if (btf->OpenScan(NULL, NULL, scan) != OK) {
+			std::cout << "  Error: cannot open a scan." << std::endl;
+			minibase_errors.show_errors();
+			return;
+		}
+		while (scan.GetNext(rid, ikey) == OK)
+			count++;
+	}
+	Clock::time_point scanned = Clock::now();
+	unsigned long scanAllocs = numOfAllocs - allocs;
+
+	// The same scan again, BENCH_BATCH records per call
+	RecordID rids[BENCH_BATCH];
+	int keys2[BENCH_BATCH], n, batchCount=0;
+	{
+		BTreeFileScan scan;
+		if (btf->OpenScan(NULL, NULL, scan) == OK) {
+			while (scan.GetNextBatch(rids, keys2, BENCH_BATCH, n) == OK)
+				batchCount += n;
+		}
+	}
+	Clock::time_point batchScanned = Clock::now();
+
+	std::cout << "  Insert: " << numkey << " keys in "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(inserted-start).count()
+		<< " us" << std::endl;
+	std::cout << "  Scan:   " << count << " keys in "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(scanned-inserted).count()
+		<< " us" << std::endl;
+	std::cout << "  Batch scan: " << batchCount << " keys in "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(batchScanned-scanned).count()
+		<< " us" << std::endl;
+	std::cout << "  Allocations: " << insertAllocs << " in inserts, "
+		<< scanAllocs << " in the scan" << std::endl;
+	if (insertAllocs != 0 || scanAllocs != 0) {
+		std::cout << "  Error: inserts and scans allocated memory." << std::endl;
+		return;
+	}
+	std::cout << "  Success."<< std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// Checks of the kinds of trees against a plain one.  Each command
+// builds the trees it needs, in memory with small nodes so that a few
+// thousand keys make a tree of several levels, unless the check is of
+// the DB; gives them the same keys, drawn at random from low..high
+// with repeats; and compares what they return.
+//-------------------------------------------------------------------
+
+#define TEST_NODE_SIZE 256
+#define TEST_BATCH 7
+#define TEST_DELTA 64
+
+struct TestEntry {
+	int key;
+	RecordID rid;
+};
+
+static int CompareEntries(const void *a, const void *b)
+{
+	const TestEntry *x = (const TestEntry *)a;
+	const TestEntry *y = (const TestEntry *)b;
+
+	if (x->key != y->key)
+		return (x->key < y->key) ? -1 : 1;
+	if (x->rid.pageNo != y->rid.pageNo)
+		return (x->rid.pageNo < y->rid.pageNo) ? -1 : 1;
+	return (x->rid.slotNo < y->rid.slotNo) ? -1 : (x->rid.slotNo > y->rid.slotNo);
+}
+
+
+//-------------------------------------------------------------------
+// NewTestTree
+//
+// Input   : name - the index in the DB, NULL for a tree in memory
+//           counted, buffered, packed - the kind of tree
+// Purpose : Create a tree for a check.
+// Return  : The tree, NULL if it cannot be created.
+//-------------------------------------------------------------------
+
+static BTreeFile *NewTestTree(const char *name, Bool counted = FALSE,
+                              Bool buffered = FALSE, Bool packed = FALSE)
+{
+	Status status;
+	BTreeFile *btf;
+
+	if (name != NULL)
+		btf = new BTreeFile(status, name, counted, buffered, packed);
+	else
+		btf = new BTreeFile(status, TEST_NODE_SIZE, counted, buffered, packed);
+	if (status != OK) {
+		std::cout << "  Error: cannot create the tree." << std::endl;
+		minibase_errors.show_errors();
+		delete btf;
+		return NULL;
+	}
+	return btf;
+}
+
+
+//-------------------------------------------------------------------
+// RandomKeys / InsertKeys / InsertShuffled / DeleteKeys
+//
+// Purpose : Draw n keys from low..high; insert keys[from..to-1], key i
+//           with record id [key, i], in order or not; delete every
+//           step-th of those.  Shuffled, with far given, just every
+//           far-th is inserted again, with a page number far from its
+//           key.
+//-------------------------------------------------------------------
+
+static int *RandomKeys(int low, int high, int n)
+{
+	int *keys = new int[n];
+
+	for (int i = 0; i < n; i++)
+		keys[i] = low + rand() % (high - low + 1);
+	return keys;
+}
+
+static Status InsertKeys(BTreeFile *btf, const int *keys, int from, int to)
+{
+	RecordID rid;
+
+	for (int i = from; i < to; i++) {
+		rid.pageNo = keys[i]; rid.slotNo = i;
+		if (btf->Insert(keys[i], rid) != OK) {
+			std::cout << "  Error: insertion of " << keys[i] << " failed." << std::endl;
+			minibase_errors.show_errors();
+			return FAIL;
+		}
+	}
+	return OK;
+}
+
+// InsertKeys() in random order
+static Status InsertShuffled(BTreeFile *btf, const int *keys, int from, int to,
+                             int far = 0)
+{
+	int *order = new int[to - from];
+	RecordID rid;
+	Status s = OK;
+	int i, j, t;
+
+	for (i = 0; i < to - from; i++)
+		order[i] = from + i;
+	for (i = to - from - 1; i > 0; i--) {
+		j = rand() % (i+1);
+		t = order[i]; order[i] = order[j]; order[j] = t;
+	}
+	for (i = 0; i < to - from && s == OK; i++) {
+		rid.pageNo = keys[order[i]]; rid.slotNo = order[i];
+		if (far > 0) {
+			if (order[i] % far != 0)
+				continue;
+			rid.pageNo += 1 << 30;
+		}
+		s = btf->Insert(keys[order[i]], rid);
+	}
+	delete [] order;
+	if (s != OK) {
+		std::cout << "  Error: insertion failed." << std::endl;
+		minibase_errors.show_errors();
+	}
+	return s;
+}
+
+static Status DeleteKeys(BTreeFile *btf, const int *keys, int from, int to,
+                         int step)
+{
+	RecordID rid;
+
+	for (int i = from; i < to; i += step) {
+		rid.pageNo = keys[i]; rid.slotNo = i;
+		if (btf->Delete(keys[i], rid) != OK) {
+			std::cout << "  Error: deletion of " << keys[i] << " failed." << std::endl;
+			minibase_errors.show_errors();
+			return FAIL;
+		}
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// ReadScan
+//
+// Input   : scan - an open scan
+// Output  : entries, n - what it returns, in a new array
+// Purpose : Read a scan to the end, by GetNext() and GetNextBatch() in
+//           turn, and close it.
+//-------------------------------------------------------------------
+
+static void ReadScan(BTreeFileScan &scan, TestEntry *&entries, int &n)
+{
+	RecordID rids[TEST_BATCH];
+	int keys[TEST_BATCH], got, max = 64;
+	Bool batch = FALSE;
+
+	entries = new TestEntry[max];
+	n = 0;
+	for (;;) {
+		if (batch) {
+			if (scan.GetNextBatch(rids, keys, TEST_BATCH, got) != OK)
+				break;
+		}
+		else {
+			if (scan.GetNext(rids[0], keys[0]) != OK)
+				break;
+			got = 1;
+		}
+		batch = !batch;
+
+		if (n + got > max) {
+			TestEntry *larger = new TestEntry[2 * max];
+
+			memcpy(larger, entries, n * sizeof(TestEntry));
+			delete [] entries;
+			entries = larger;
+			max *= 2;
+		}
+		for (int i = 0; i < got; i++, n++) {
+			entries[n].key = keys[i];
+			entries[n].rid = rids[i];
+		}
+	}
+	scan.Close();
+}
+
+
+//-------------------------------------------------------------------
+// SameEntries
+//
+// Input   : what   - what is compared, for the report
+//           expect, ne - entries as the plain tree has them, sorted
+//           got, ng    - entries to check, as a scan returned them
+//           order      - the order of the scan
+// Purpose : Check that got is in key order and holds the same entries
+//           as expect.  Entries with the same key may come in any
+//           order.  got is sorted.
+// Return  : TRUE if they agree.
+//-------------------------------------------------------------------
+
+static Bool SameEntries(const char *what, TestEntry *expect, int ne,
+                        TestEntry *got, int ng, TupleOrder order = Ascending)
+{
+	int i;
+
+	for (i = 1; i < ng; i++) {
+		if (order == Descending ? got[i].key > got[i-1].key
+		                        : got[i].key < got[i-1].key) {
+			std::cout << "  Error: " << what << ": key " << got[i].key
+				<< " out of order." << std::endl;
+			return FALSE;
+		}
+	}
+	qsort(got, ng, sizeof(TestEntry), CompareEntries);
+	for (i = 0; i < ne && i < ng; i++)
+		if (CompareEntries(&expect[i], &got[i]) != 0)
+			break;
+	if (i < ne || i < ng) {
+		std::cout << "  Error: " << what << ": " << ng << " entries, "
+			<< ne << " in the plain tree, first difference at "
+			<< i << "." << std::endl;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+//-------------------------------------------------------------------
+// SameScan
+//
+// Input   : what   - what is compared, for the report
+//           expect - the plain tree
+//           btf    - the tree to check
+//           low, high - the range, NULL for no bound
+//           snap   - a snapshot of btf to scan, or NULL
+// Purpose : Compare a scan of btf over a range, in both directions,
+//           with one of the plain tree.
+// Return  : TRUE if they agree.
+//-------------------------------------------------------------------
+
+static Bool SameScan(const char *what, BTreeFile *expect, BTreeFile *btf,
+                     const int *low, const int *high,
+                     const BTSnapshot *snap = NULL)
+{
+	BTreeFileScan scan;
+	TestEntry *e, *g;
+	int ne, ng;
+	Bool same;
+
+	if (expect->OpenScan(low, high, scan) != OK)
+		return FALSE;
+	ReadScan(scan, e, ne);
+	qsort(e, ne, sizeof(TestEntry), CompareEntries);
+
+	same = (btf->OpenScan(low, high, scan, Ascending, snap) == OK);
+	if (same) {
+		ReadScan(scan, g, ng);
+		same = SameEntries(what, e, ne, g, ng);
+		delete [] g;
+	}
+	if (same && btf->OpenScan(low, high, scan, Descending, snap) == OK) {
+		ReadScan(scan, g, ng);
+		same = SameEntries(what, e, ne, g, ng, Descending);
+		delete [] g;
+	}
+	delete [] e;
+	return same;
+}
+
+
+//-------------------------------------------------------------------
+// SameScans
+//
+// Input   : as for SameScan(), with low..high the range of the keys
+// Purpose : SameScan() for the whole tree, its middle half, a range
+//           from below low and one key.  Reports the number of entries
+//           if they agree.
+// Return  : TRUE if they agree.
+//-------------------------------------------------------------------
+
+static Bool SameScans(const char *what, BTreeFile *expect, BTreeFile *btf,
+                      int low, int high, const BTSnapshot *snap = NULL)
+{
+	int quarter = (high - low) / 4;
+	int midLow = low + quarter, midHigh = high - quarter;
+	int below = low - 10, mid = low + 2 * quarter;
+	BTreeFileScan scan;
+	TestEntry *e;
+	int ne;
+
+	if (!SameScan(what, expect, btf, NULL, NULL, snap) ||
+	    !SameScan(what, expect, btf, &midLow, &midHigh, snap) ||
+	    !SameScan(what, expect, btf, &below, &midLow, snap) ||
+	    !SameScan(what, expect, btf, &mid, &mid, snap))
+		return FALSE;
+
+	expect->OpenScan(NULL, NULL, scan);
+	ReadScan(scan, e, ne);
+	delete [] e;
+	std::cout << "  " << what << ": " << ne << " entries, as in the plain tree."
+		<< std::endl;
+	return TRUE;
+}
+
+
+// Whether the sorted entries e hold one with key, and with rid unless
+// rid is NULL
+static Bool HasEntry(TestEntry *e, int ne, int key, const RecordID *rid)
+{
+	int lo = 0, hi = ne;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (e[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < ne && e[lo].key == key; lo++)
+		if (rid == NULL || (e[lo].rid.pageNo == rid->pageNo &&
+		                    e[lo].rid.slotNo == rid->slotNo))
+			return TRUE;
+	return FALSE;
+}
+
+
+//-------------------------------------------------------------------
+// SameLookups
+//
+// Input   : what   - what is compared, for the report
+//           expect - the plain tree
+//           btf    - the tree to check
+//           low, high - range of the keys
+// Purpose : Look up every key from below low to above high in btf, in
+//           random order, in batches of several sizes and one at a
+//           time, and check which are found against a scan of the
+//           plain tree.  A rid found must be that of an entry with the
+//           key.
+// Return  : TRUE if they agree.
+//-------------------------------------------------------------------
+
+static Bool SameLookups(const char *what, BTreeFile *expect, BTreeFile *btf,
+                        int low, int high)
+{
+	static const int batches[] = { 1, TEST_BATCH, 64, 0 };
+	const int numOfBatches = sizeof(batches) / sizeof(batches[0]);
+	int numkey = high - low + 11, i, j, t, n, b;
+	int *keys = new int[numkey];
+	RecordID *rids = new RecordID[numkey], rid;
+	Bool *found = new Bool[numkey];
+	BTreeFileScan scan;
+	TestEntry *e;
+	int ne;
+	Status s;
+	Bool same = TRUE;
+
+	expect->OpenScan(NULL, NULL, scan);
+	ReadScan(scan, e, ne);
+	qsort(e, ne, sizeof(TestEntry), CompareEntries);
+
+	for (i = 0; i < numkey; i++)
+		keys[i] = low - 5 + i;
+	for (i = numkey - 1; i > 0; i--) {
+		j = rand() % (i+1);
+		t = keys[i]; keys[i] = keys[j]; keys[j] = t;
+	}
+
+	// Batches of one, a few, many and all the keys at once
+	for (b = 0; b < numOfBatches && same; b++) {
+		n = batches[b] ? batches[b] : numkey;
+		for (i = 0; i < numkey && same; i += n) {
+			if (btf->Lookup(keys + i, (i + n < numkey ? n : numkey - i),
+			                rids + i, found + i) != OK) {
+				std::cout << "  Error: " << what << ": Lookup failed." << std::endl;
+				minibase_errors.show_errors();
+				same = FALSE;
+			}
+		}
+		for (i = 0; i < numkey && same; i++) {
+			if (found[i] != HasEntry(e, ne, keys[i], NULL) ||
+			    (found[i] && !HasEntry(e, ne, keys[i], &rids[i]))) {
+				std::cout << "  Error: " << what << ": lookup of " << keys[i]
+					<< " is wrong in batches of " << n << "." << std::endl;
+				same = FALSE;
+			}
+		}
+	}
+
+	// One at a time
+	for (i = 0; i < numkey && same; i++) {
+		s = btf->Lookup(keys[i], rid);
+		if (s != (found[i] ? OK : DONE) ||
+		    (s == OK && !HasEntry(e, ne, keys[i], &rid))) {
+			std::cout << "  Error: " << what << ": lookup of " << keys[i]
+				<< " on its own is wrong." << std::endl;
+			same = FALSE;
+		}
+	}
+
+	if (same)
+		std::cout << "  " << what << ": " << numkey << " lookups, as in the plain tree."
+			<< std::endl;
+	delete [] e;
+	delete [] found;
+	delete [] rids;
+	delete [] keys;
+	return same;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::countedHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Give a counted tree and a plain one the same random inserts
+//           and deletes, then compare their scans, and Rank(),
+//           Select() and CountRange() of the counted tree with what a
+//           scan of the plain tree counts.
+//-------------------------------------------------------------------
+
+void BTreeTest::countedHighLow(int low, int high) {
+	std::cout << "Counted tree ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	int numkey = 2 * (high-low+1);
+	BTreeFile *plain = NewTestTree(NULL);
+	BTreeFile *btf = NewTestTree(NULL, TRUE);
+	int *keys = RandomKeys(low, high, numkey);
+	Bool ok = (plain != NULL && btf != NULL &&
+	           InsertKeys(plain, keys, 0, numkey) == OK &&
+	           InsertKeys(btf, keys, 0, numkey) == OK &&
+	           DeleteKeys(plain, keys, 0, numkey, 3) == OK &&
+	           DeleteKeys(btf, keys, 0, numkey, 3) == OK &&
+	           SameScans("Scan", plain, btf, low, high));
+
+	if (ok) {
+		BTreeFileScan scan;
+		TestEntry *e;
+		int ne, i, n, rank, key, lo, hi;
+		RecordID rid;
+
+		plain->OpenScan(NULL, NULL, scan);
+		ReadScan(scan, e, ne);
+
+		// Every position and every key from below low to above high
+		for (i = 0; i < ne && ok; i++) {
+			if (btf->Select(i, key, rid) != OK || key != e[i].key) {
+				std::cout << "  Error: Select(" << i << ") is not "
+					<< e[i].key << "." << std::endl;
+				ok = FALSE;
+			}
+		}
+		if (ok && btf->Select(ne, key, rid) != DONE) {
+			std::cout << "  Error: Select(" << ne << ") found an entry." << std::endl;
+			ok = FALSE;
+		}
+		for (key = low - 1, i = 0; key <= high + 1 && ok; key++) {
+			while (i < ne && e[i].key < key)
+				i++;
+			if (btf->Rank(key, rank) != OK || rank != i) {
+				std::cout << "  Error: Rank(" << key << ") is " << rank
+					<< ", not " << i << "." << std::endl;
+				ok = FALSE;
+			}
+		}
+		for (lo = low - 1; lo <= high + 1 && ok; lo += 1 + (high-low) / 16) {
+			hi = lo + (high-low) / 4;
+			for (i = 0, n = 0; i < ne; i++)
+				if (e[i].key >= lo && e[i].key <= hi)
+					n++;
+			if (btf->CountRange(&lo, &hi, rank) != OK || rank != n) {
+				std::cout << "  Error: CountRange(" << lo << ", " << hi
+					<< ") is " << rank << ", not " << n << "." << std::endl;
+				ok = FALSE;
+			}
+		}
+		delete [] e;
+		if (ok)
+			std::cout << "  Select, Rank and CountRange agree with the scan." << std::endl;
+	}
+
+	delete [] keys;
+	delete btf;
+	delete plain;
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::appendHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Insert low..high, each key twice, in order into one tree,
+//           so that nearly all of them go in through the rightmost
+//           append path, and in random order into a plain one, and
+//           compare.  Then delete every third entry, which merges leaves
+//           on the right edge, append a quarter more keys above high
+//           and compare again.
+//-------------------------------------------------------------------
+
+void BTreeTest::appendHighLow(int low, int high) {
+	std::cout << "Rightmost append ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	int numkey = 2 * (high-low+1), more = numkey / 4;
+	BTreeFile *plain = NewTestTree(NULL);
+	BTreeFile *btf = NewTestTree(NULL);
+	int *keys = new int[numkey + more];
+
+	for (int i = 0; i < numkey + more; i++)
+		keys[i] = low + i / 2;
+
+	Bool ok = (plain != NULL && btf != NULL &&
+	           InsertShuffled(plain, keys, 0, numkey) == OK &&
+	           InsertKeys(btf, keys, 0, numkey) == OK &&
+	           SameScans("Appended", plain, btf, low, high) &&
+	           DeleteKeys(plain, keys, 0, numkey, 3) == OK &&
+	           DeleteKeys(btf, keys, 0, numkey, 3) == OK &&
+	           InsertShuffled(plain, keys, numkey, numkey + more) == OK &&
+	           InsertKeys(btf, keys, numkey, numkey + more) == OK &&
+	           SameScans("Appended after deletes", plain, btf, low,
+	                     keys[numkey + more - 1]));
+
+	delete [] keys;
+	delete btf;
+	delete plain;
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::swizzleHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Compare a tree in the DB, whose descents through the buffer
+//           pool swizzle the references to children, with a plain one
+//           in memory: after the inserts, twice, the second time through
+//           the swizzled references; after flushing the buffer pool,
+//           which unswizzles them; and after deletes, which merge nodes
+//           and so change swizzled nodes.  Every scan must leave as
+//           many frames pinned as there were before it.
+//-------------------------------------------------------------------
+
+void BTreeTest::swizzleHighLow(int low, int high) {
+	static int trees = 0;
+	char name[32];
+
+	std::cout << "Swizzling ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	sprintf(name, "SwizzleIndex%d", ++trees);
+	int numkey = 2 * (high-low+1);
+	BTreeFile *plain = NewTestTree(NULL);
+	BTreeFile *btf = NewTestTree(name);
+	int *keys = RandomKeys(low, high, numkey);
+	unsigned unpinned;
+
+	Bool ok = (plain != NULL && btf != NULL &&
+	           InsertKeys(plain, keys, 0, numkey) == OK &&
+	           InsertKeys(btf, keys, 0, numkey) == OK);
+	if (ok) {
+		unpinned = MINIBASE_BM->GetNumOfUnpinnedBuffers();
+		ok = SameScans("First scans", plain, btf, low, high) &&
+		     SameScans("Swizzled", plain, btf, low, high);
+		if (ok && MINIBASE_BM->GetNumOfUnpinnedBuffers() != unpinned) {
+			std::cout << "  Error: the scans left frames pinned." << std::endl;
+			ok = FALSE;
+		}
+		MINIBASE_BM->FlushAllPages();
+		ok = ok && SameScans("Flushed", plain, btf, low, high);
+		ok = ok && DeleteKeys(plain, keys, 0, numkey, 3) == OK &&
+		     DeleteKeys(btf, keys, 0, numkey, 3) == OK;
+		unpinned = MINIBASE_BM->GetNumOfUnpinnedBuffers();
+		ok = ok && SameScans("After deletes", plain, btf, low, high);
+		if (ok && MINIBASE_BM->GetNumOfUnpinnedBuffers() != unpinned) {
+			std::cout << "  Error: the scans left frames pinned." << std::endl;
+			ok = FALSE;
+		}
+	}
+
+	delete [] keys;
+	if (btf != NULL)
+		btf->DestroyFile();
+	delete btf;
+	delete plain;
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::memoryHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Compare trees in memory, with nodes of a few sizes from
+//           a few cache lines to several pages, with a plain tree in
+//           the DB, after the same random inserts and deletes.
+//-------------------------------------------------------------------
+
+void BTreeTest::memoryHighLow(int low, int high) {
+	static int trees = 0;
+	static const int sizes[] = { 100, TEST_NODE_SIZE, 4 * MINIBASE_DEFAULT_PAGESIZE };
+	const int numOfSizes = sizeof(sizes) / sizeof(sizes[0]);
+	char name[32];
+	int i;
+
+	std::cout << "Memory trees ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	sprintf(name, "MemoryCheckIndex%d", ++trees);
+	int numkey = 2 * (high-low+1);
+	BTreeFile *plain = NewTestTree(name);
+	BTreeFile *btf[numOfSizes];
+	int *keys = RandomKeys(low, high, numkey);
+	Bool ok = (plain != NULL &&
+	           InsertKeys(plain, keys, 0, numkey) == OK &&
+	           DeleteKeys(plain, keys, 0, numkey, 3) == OK);
+
+	for (i = 0; i < numOfSizes; i++) {
+		Status status;
+		char what[64];
+
+		btf[i] = new BTreeFile(status, sizes[i]);
+		if (status != OK) {
+			std::cout << "  Error: cannot create a tree with nodes of "
+				<< sizes[i] << " bytes." << std::endl;
+			minibase_errors.show_errors();
+			ok = FALSE;
+		}
+		sprintf(what, "Nodes of %d bytes", sizes[i]);
+		ok = ok && InsertKeys(btf[i], keys, 0, numkey) == OK &&
+		     DeleteKeys(btf[i], keys, 0, numkey, 3) == OK &&
+		     SameScans(what, plain, btf[i], low, high);
+	}
+
+	delete [] keys;
+	for (i = 0; i < numOfSizes; i++)
+		delete btf[i];
+	if (plain != NULL)
+		plain->DestroyFile();
+	delete plain;
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::snapshotHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Take a snapshot of a tree in the DB after half of the
+//           inserts, and open a scan of it.  Read part of the scan,
+//           then delete a third of the entries and make the other half
+//           of the inserts, and read the rest.  The scan, and new scans
+//           of the snapshot, must return what a plain tree holds that
+//           had only the first half of the inserts; the tree itself
+//           must agree with a plain tree that had them all.  Nothing
+//           may go wrong in the buffer manager on the way, which only
+//           says so on cerr.
+//-------------------------------------------------------------------
+
+void BTreeTest::snapshotHighLow(int low, int high) {
+	static int trees = 0;
+	char name[32];
+	std::ostringstream bufErrors;
+	std::streambuf *cerrBuf = std::cerr.rdbuf(bufErrors.rdbuf());
+
+	std::cout << "Snapshots ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	sprintf(name, "SnapshotIndex%d", ++trees);
+	int numkey = 2 * (high-low+1), half = numkey / 2;
+	BTreeFile *before = NewTestTree(NULL);
+	BTreeFile *after = NewTestTree(NULL);
+	BTreeFile *btf = NewTestTree(name);
+	int *keys = RandomKeys(low, high, numkey);
+	BTSnapshot *snap = NULL;
+	Bool ok = (before != NULL && after != NULL && btf != NULL &&
+	           InsertKeys(before, keys, 0, half) == OK &&
+	           InsertKeys(after, keys, 0, half) == OK &&
+	           InsertKeys(btf, keys, 0, half) == OK);
+
+	if (ok && (snap = btf->Snapshot()) == NULL) {
+		std::cout << "  Error: cannot take a snapshot." << std::endl;
+		minibase_errors.show_errors();
+		ok = FALSE;
+	}
+	if (ok) {
+		BTreeFileScan scan, longScan;
+		TestEntry *e, *g, *rest;
+		int ne, ng, nrest;
+
+		// Part of a scan of the snapshot, then the changes, then the rest
+		g = new TestEntry[half / 2 + 1];
+		ng = 0;
+		ok = (btf->OpenScan(NULL, NULL, longScan, Ascending, snap) == OK);
+		while (ok && ng < half / 2 &&
+		       longScan.GetNext(g[ng].rid, g[ng].key) == OK)
+			ng++;
+		ok = ok && DeleteKeys(after, keys, 0, half, 3) == OK &&
+		     DeleteKeys(btf, keys, 0, half, 3) == OK &&
+		     InsertKeys(after, keys, half, numkey) == OK &&
+		     InsertKeys(btf, keys, half, numkey) == OK;
+		if (ok) {
+			TestEntry *all;
+
+			ReadScan(longScan, rest, nrest);
+			all = new TestEntry[ng + nrest];
+			memcpy(all, g, ng * sizeof(TestEntry));
+			memcpy(all + ng, rest, nrest * sizeof(TestEntry));
+			ng += nrest;
+			delete [] rest;
+			delete [] g;
+			g = all;
+
+			before->OpenScan(NULL, NULL, scan);
+			ReadScan(scan, e, ne);
+			qsort(e, ne, sizeof(TestEntry), CompareEntries);
+			ok = SameEntries("Scan open across the changes", e, ne, g, ng);
+			delete [] e;
+			if (ok)
+				std::cout << "  Scan open across the changes: " << ng
+					<< " entries, as in the plain tree." << std::endl;
+		}
+		longScan.Close();
+		delete [] g;
+
+		ok = ok && SameScans("Snapshot", before, btf, low, high, snap) &&
+		     SameScans("Tree", after, btf, low, high);
+	}
+	if (snap != NULL && btf->ReleaseSnapshot(snap) != OK) {
+		std::cout << "  Error: cannot release the snapshot." << std::endl;
+		ok = FALSE;
+	}
+	ok = ok && SameScans("Tree after the release", after, btf, low, high);
+
+	delete [] keys;
+	if (btf != NULL)
+		btf->DestroyFile();
+	delete btf;
+	delete after;
+	delete before;
+	std::cerr.rdbuf(cerrBuf);
+	if (!bufErrors.str().empty()) {
+		std::cout << "  Error: the buffer manager reported:" << std::endl
+			<< bufErrors.str();
+		ok = FALSE;
+	}
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+// The partitions of a parallel scan and what each returned
+struct TestParts {
+	BTreeFileScan *scans;
+	TestEntry **entries;
+	int *n;
+};
+
+static void ReadPart(void *arg, int i)
+{
+	TestParts *parts = (TestParts *)arg;
+
+	ReadScan(parts->scans[i], parts->entries[i], parts->n[i]);
+}
+
+// One partition, as a task of the scheduler
+struct TestPart {
+	TestParts *parts;
+	int i;
+};
+
+static void ReadPartTask(void *arg)
+{
+	TestPart *part = (TestPart *)arg;
+
+	ReadPart(part->parts, part->i);
+}
+
+
+//-------------------------------------------------------------------
+// SameParallelScan
+//
+// Input   : what   - what is compared, for the report
+//           btf    - a tree
+//           low, high - the range, NULL for no bound
+//           nparts - the number of partitions to ask for
+//           asTasks - submit the partitions to MINIBASE_SCHEDULER one
+//                    by one, in a TaskGroup, rather than RunThreads()
+//           expect - a plain tree to compare with, NULL for btf itself
+// Purpose : Read the partitions of a parallel scan of btf, each on a
+//           thread of its own, and check that each is in order and
+//           below the next, and that together they hold what a plain
+//           scan of the range returns.
+// Return  : TRUE if they agree.
+//-------------------------------------------------------------------
+
+static Bool SameParallelScan(const char *what, BTreeFile *btf,
+                             const int *low, const int *high, int nparts,
+                             Bool asTasks = FALSE, BTreeFile *expect = NULL)
+{
+	BTreeFileScan scan, *scans = new BTreeFileScan[nparts];
+	TestEntry **entries = new TestEntry *[nparts], *e, *g;
+	int *n = new int[nparts];
+	int i, np, ne, ng;
+	TestParts parts;
+	Bool same = TRUE;
+
+	if (btf->OpenParallelScan(low, high, nparts, scans, np) != OK) {
+		std::cout << "  Error: cannot open a parallel scan." << std::endl;
+		minibase_errors.show_errors();
+		same = FALSE;
+		np = 0;
+	}
+	parts.scans = scans;
+	parts.entries = entries;
+	parts.n = n;
+	if (np > 0 && asTasks) {
+		TestPart *tasks = new TestPart[np];
+		TaskGroup group;
+
+		for (i = 0; i < np; i++) {
+			tasks[i].parts = &parts;
+			tasks[i].i = i;
+			if (MINIBASE_SCHEDULER->Submit(ReadPartTask, &tasks[i],
+			        i % 2 ? TASK_BACKGROUND : TASK_FOREGROUND, &group) != OK)
+				ReadPartTask(&tasks[i]);
+		}
+		MINIBASE_SCHEDULER->Wait(group);
+		delete [] tasks;
+	}
+	else if (np > 0)
+		RunThreads(np, ReadPart, &parts);
+
+	// One after the other, the partitions make one ascending scan
+	for (i = 0, ng = 0; i < np; i++)
+		ng += n[i];
+	g = new TestEntry[ng + 1];
+	for (i = 0, ng = 0; i < np; i++) {
+		memcpy(g + ng, entries[i], n[i] * sizeof(TestEntry));
+		ng += n[i];
+		delete [] entries[i];
+	}
+
+	if (expect == NULL)
+		expect = btf;
+	if (same && expect->OpenScan(low, high, scan) == OK) {
+		ReadScan(scan, e, ne);
+		qsort(e, ne, sizeof(TestEntry), CompareEntries);
+		same = SameEntries(what, e, ne, g, ng);
+		delete [] e;
+	}
+	if (same && np > nparts) {
+		std::cout << "  Error: " << what << ": " << np << " partitions." << std::endl;
+		same = FALSE;
+	}
+	if (same)
+		std::cout << "  " << what << ": " << ng << " entries in " << np
+			<< " partitions, as in a plain scan." << std::endl;
+
+	delete [] g;
+	delete [] n;
+	delete [] entries;
+	delete [] scans;
+	return same;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::parallelScanHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Compare parallel scans of a tree in the DB, into 1 to 8
+//           partitions, of the whole tree and of its middle half, with
+//           plain scans, after random inserts and again after deletes.
+//           Then do the same for a small tree in memory whose first
+//           separator is INT_MIN.
+//-------------------------------------------------------------------
+
+void BTreeTest::parallelScanHighLow(int low, int high) {
+	static int trees = 0;
+	char name[32], what[64];
+
+	std::cout << "Parallel scans ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	sprintf(name, "ParallelIndex%d", ++trees);
+	int numkey = 2 * (high-low+1);
+	int quarter = (high - low) / 4, midLow = low + quarter, midHigh = high - quarter;
+	BTreeFile *btf = NewTestTree(name);
+	int *keys = RandomKeys(low, high, numkey);
+	Bool ok = (btf != NULL && InsertKeys(btf, keys, 0, numkey) == OK);
+
+	for (int pass = 0; pass < 2 && ok; pass++) {
+		if (pass == 1)
+			ok = (DeleteKeys(btf, keys, 0, numkey, 3) == OK);
+		for (int nparts = 1; nparts <= 8 && ok; nparts *= 2) {
+			sprintf(what, "%s, %d wanted", pass ? "After deletes" : "Whole tree",
+			        nparts);
+			ok = SameParallelScan(what, btf, NULL, NULL, nparts);
+			sprintf(what, "Middle half, %d wanted", nparts);
+			ok = ok && SameParallelScan(what, btf, &midLow, &midHigh, nparts);
+		}
+	}
+
+	delete [] keys;
+	if (btf != NULL)
+		btf->DestroyFile();
+	delete btf;
+
+	// Duplicates of INT_MIN that fill more than a leaf, and a few more
+	// keys: the leaf split puts INT_MIN in the parent
+	const int numOfMins = 3 * TEST_NODE_SIZE / (int)sizeof(LeafEntry) / 2;
+	int mins[numOfMins + 4];
+	for (int i = 0; i < numOfMins + 4; i++)
+		mins[i] = (i < numOfMins) ? INT_MIN : i;
+	btf = ok ? NewTestTree(NULL) : NULL;
+	ok = (btf != NULL && InsertKeys(btf, mins, 0, numOfMins + 4) == OK);
+	for (int nparts = 2; nparts <= 8 && ok; nparts *= 2) {
+		sprintf(what, "Separator INT_MIN, %d wanted", nparts);
+		ok = SameParallelScan(what, btf, NULL, NULL, nparts);
+	}
+	delete btf;
+
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::bulkHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : BulkLoad() the same random entries, on one thread and on
+//           several, into a tree in the DB and one in memory, insert
+//           them one at a time into a plain tree, and compare.  Then
+//           delete every third entry and insert a quarter more, which
+//           splits and merges the full leaves, and compare again.
+//-------------------------------------------------------------------
+
+void BTreeTest::bulkHighLow(int low, int high) {
+	static int trees = 0;
+	static const int threads[] = { 1, 0 };
+	const int numOfTrees = 2 * sizeof(threads) / sizeof(threads[0]);
+	char name[32], what[64];
+	int i;
+
+	std::cout << "Bulk loaded trees ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	int numkey = 2 * (high-low+1), more = numkey / 4;
+	BTreeFile *plain = NewTestTree(NULL);
+	BTreeFile *btf[numOfTrees];
+	int *keys = RandomKeys(low, high, numkey + more);
+	RecordID *rids = new RecordID[numkey];
+	Bool ok = (plain != NULL && InsertKeys(plain, keys, 0, numkey) == OK);
+
+	for (i = 0; i < numkey; i++) {
+		rids[i].pageNo = keys[i]; rids[i].slotNo = i;
+	}
+	for (i = 0; i < numOfTrees; i++) {
+		if (i % 2 == 0)
+			sprintf(name, "BulkIndex%d", ++trees);
+		btf[i] = NewTestTree(i % 2 ? NULL : name);
+		sprintf(what, "%s, %s", i % 2 ? "In memory" : "In the DB",
+		        threads[i / 2] ? "one thread" : "all threads");
+		if (btf[i] == NULL)
+			ok = FALSE;
+		else if (ok && btf[i]->BulkLoad(keys, rids, numkey, threads[i / 2]) != OK) {
+			std::cout << "  Error: " << what << ": BulkLoad failed." << std::endl;
+			minibase_errors.show_errors();
+			ok = FALSE;
+		}
+		ok = ok && SameScans(what, plain, btf[i], low, high);
+	}
+
+	ok = ok && DeleteKeys(plain, keys, 0, numkey, 3) == OK &&
+	     InsertKeys(plain, keys, numkey, numkey + more) == OK;
+	for (i = 0; i < numOfTrees && ok; i++) {
+		sprintf(what, "Tree %d after deletes and inserts", i + 1);
+		ok = DeleteKeys(btf[i], keys, 0, numkey, 3) == OK &&
+		     InsertKeys(btf[i], keys, numkey, numkey + more) == OK &&
+		     SameScans(what, plain, btf[i], low, high);
+	}
+
+	delete [] rids;
+	delete [] keys;
+	for (i = 0; i < numOfTrees; i++) {
+		if (i % 2 == 0 && btf[i] != NULL)
+			btf[i]->DestroyFile();
+		delete btf[i];
+	}
+	delete plain;
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+// A bulk load run as a task, which itself runs RunThreads()
+struct TestLoad {
+	BTreeFile *btf;
+	const int *keys;
+	const RecordID *rids;
+	int n;
+	Status status;
+};
+
+static void LoadTask(void *arg)
+{
+	TestLoad *load = (TestLoad *)arg;
+
+	load->status = load->btf->BulkLoad(load->keys, load->rids, load->n);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::schedulerHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Read the partitions of parallel scans as tasks of
+//           MINIBASE_SCHEDULER, some in the foreground and some in the
+//           background, and compare them with plain scans.  Then bulk
+//           load trees in memory from tasks, so that the workers run
+//           RunAll() inside their own tasks, and compare those with a
+//           plain tree.
+//-------------------------------------------------------------------
+
+void BTreeTest::schedulerHighLow(int low, int high) {
+	static int trees = 0;
+	const int numOfLoads = 4;
+	char name[32], what[64];
+	int i;
+
+	std::cout << "Scheduler tasks ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	sprintf(name, "SchedulerIndex%d", ++trees);
+	int numkey = 2 * (high-low+1);
+	int quarter = (high - low) / 4, midLow = low + quarter, midHigh = high - quarter;
+	BTreeFile *plain = NewTestTree(name);
+	int *keys = RandomKeys(low, high, numkey);
+	RecordID *rids = new RecordID[numkey];
+	Bool ok = (plain != NULL && InsertKeys(plain, keys, 0, numkey) == OK &&
+	           DeleteKeys(plain, keys, 0, numkey, 3) == OK);
+
+	for (int nparts = 1; nparts <= 8 && ok; nparts *= 2) {
+		sprintf(what, "Whole tree, %d wanted", nparts);
+		ok = SameParallelScan(what, plain, NULL, NULL, nparts, TRUE);
+		sprintf(what, "Middle half, %d wanted", nparts);
+		ok = ok && SameParallelScan(what, plain, &midLow, &midHigh, nparts, TRUE);
+	}
+
+	// The entries the plain tree still has, to load
+	int n = 0;
+	for (i = 0; i < numkey; i++) {
+		if (i % 3 != 0) {
+			keys[n] = keys[i];
+			rids[n].pageNo = keys[i]; rids[n].slotNo = i;
+			n++;
+		}
+	}
+
+	BTreeFile *btf[numOfLoads];
+	TestLoad loads[numOfLoads];
+	TaskGroup group;
+
+	for (i = 0; i < numOfLoads; i++) {
+		btf[i] = NewTestTree(NULL);
+		loads[i].btf = btf[i];
+		loads[i].keys = keys;
+		loads[i].rids = rids;
+		loads[i].n = n;
+		loads[i].status = FAIL;
+		if (ok && btf[i] == NULL)
+			ok = FALSE;
+		if (ok && MINIBASE_SCHEDULER->Submit(LoadTask, &loads[i],
+		              TASK_FOREGROUND, &group) != OK)
+			LoadTask(&loads[i]);
+	}
+	MINIBASE_SCHEDULER->Wait(group);
+	for (i = 0; i < numOfLoads && ok; i++) {
+		sprintf(what, "Loaded by task %d", i + 1);
+		if (loads[i].status != OK) {
+			std::cout << "  Error: " << what << ": BulkLoad failed." << std::endl;
+			minibase_errors.show_errors();
+			ok = FALSE;
+		}
+		ok = ok && SameScans(what, plain, btf[i], low, high);
+	}
+
+	for (i = 0; i < numOfLoads; i++)
+		delete btf[i];
+	delete [] rids;
+	delete [] keys;
+	if (plain != NULL)
+		plain->DestroyFile();
+	delete plain;
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::lookupHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Check batch lookups in a tree in the DB and one in memory
+//           against a plain tree, after random inserts and again after
+//           deleting every third entry, which leaves some keys out.
+//-------------------------------------------------------------------
+
+void BTreeTest::lookupHighLow(int low, int high) {
+	static int trees = 0;
+	char name[32];
+
+	std::cout << "Batch lookups ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	sprintf(name, "LookupIndex%d", ++trees);
+	int numkey = high-low+1;
+	BTreeFile *plain = NewTestTree(NULL);
+	BTreeFile *db = NewTestTree(name);
+	BTreeFile *mem = NewTestTree(NULL);
+	int *keys = RandomKeys(low, high, numkey);
+	Bool ok = (plain != NULL && db != NULL && mem != NULL &&
+	           InsertKeys(plain, keys, 0, numkey) == OK &&
+	           InsertKeys(db, keys, 0, numkey) == OK &&
+	           InsertKeys(mem, keys, 0, numkey) == OK &&
+	           SameLookups("In the DB", plain, db, low, high) &&
+	           SameLookups("In memory", plain, mem, low, high) &&
+	           DeleteKeys(plain, keys, 0, numkey, 3) == OK &&
+	           DeleteKeys(db, keys, 0, numkey, 3) == OK &&
+	           DeleteKeys(mem, keys, 0, numkey, 3) == OK &&
+	           SameLookups("In the DB after deletes", plain, db, low, high) &&
+	           SameLookups("In memory after deletes", plain, mem, low, high));
+
+	delete [] keys;
+	if (db != NULL)
+		db->DestroyFile();
+	delete db;
+	delete mem;
+	delete plain;
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::bufferedHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Give buffered trees, one in the DB and one in memory, and a
+//           plain tree the same inserts, deletes and inserts again of
+//           deleted entries, and after each step compare scans,
+//           parallel scans and lookups, while messages are still in
+//           the buffers on their way down.
+//-------------------------------------------------------------------
+
+void BTreeTest::bufferedHighLow(int low, int high) {
+	static int trees = 0;
+	const int numOfTrees = 3;	// the plain one first
+	char name[32], what[64];
+	int i, j, step;
+
+	std::cout << "Buffered trees ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	sprintf(name, "BufferedIndex%d", ++trees);
+	int numkey = 2 * (high-low+1), half = numkey / 2;
+	BTreeFile *btf[numOfTrees];
+	int *keys = RandomKeys(low, high, numkey);
+	Bool ok = TRUE;
+
+	btf[0] = NewTestTree(NULL);
+	btf[1] = NewTestTree(name, FALSE, TRUE);
+	btf[2] = NewTestTree(NULL, FALSE, TRUE);
+	for (i = 0; i < numOfTrees; i++)
+		if (btf[i] == NULL)
+			ok = FALSE;
+
+	for (step = 0; step < 4 && ok; step++) {
+		for (i = 0; i < numOfTrees && ok; i++) {
+			switch (step) {
+			case 0:
+				ok = (InsertKeys(btf[i], keys, 0, half) == OK);
+				break;
+			case 1:
+				ok = (DeleteKeys(btf[i], keys, 0, half, 3) == OK);
+				break;
+			case 2:
+				// The second half, and every other entry deleted back
+				ok = (InsertKeys(btf[i], keys, half, numkey) == OK);
+				for (j = 0; j < half && ok; j += 6)
+					ok = (InsertKeys(btf[i], keys, j, j + 1) == OK);
+				break;
+			default:
+				ok = (DeleteKeys(btf[i], keys, 1, numkey, 3) == OK);
+				break;
+			}
+		}
+		for (i = 1; i < numOfTrees && ok; i++) {
+			sprintf(what, "%s, step %d", i == 1 ? "In the DB" : "In memory",
+			        step + 1);
+			ok = SameScans(what, btf[0], btf[i], low, high) &&
+			     SameParallelScan(what, btf[i], NULL, NULL, 4) &&
+			     SameLookups(what, btf[0], btf[i], low, high);
+		}
+	}
+
+	delete [] keys;
+	if (btf[1] != NULL)
+		btf[1]->DestroyFile();
+	for (i = 0; i < numOfTrees; i++)
+		delete btf[i];
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::deltaHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Put a delta buffer of TEST_DELTA entries in front of a tree
+//           in the DB and one in memory, give them and a plain tree the
+//           same inserts and deletes, and compare scans, parallel scans
+//           and lookups while some of them still wait in the buffer,
+//           again after MergeDelta() and again once the buffer is
+//           removed and the trees change without it.
+//-------------------------------------------------------------------
+
+void BTreeTest::deltaHighLow(int low, int high) {
+	static int trees = 0;
+	const int numOfTrees = 3;	// the plain one first
+	char name[32], what[64];
+	int i, step;
+
+	std::cout << "Delta buffers ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	sprintf(name, "DeltaIndex%d", ++trees);
+	int numkey = 2 * (high-low+1), half = numkey / 2;
+	int first = (half + TEST_DELTA / 3 < numkey) ? half + TEST_DELTA / 3 : numkey;
+	BTreeFile *btf[numOfTrees];
+	int *keys = RandomKeys(low, high, numkey);
+	Bool ok = TRUE;
+
+	btf[0] = NewTestTree(NULL);
+	btf[1] = NewTestTree(name);
+	btf[2] = NewTestTree(NULL);
+	for (i = 0; i < numOfTrees; i++)
+		if (btf[i] == NULL)
+			ok = FALSE;
+	for (i = 1; i < numOfTrees && ok; i++) {
+		if (btf[i]->SetDeltaBuffer(TEST_DELTA) != OK) {
+			std::cout << "  Error: cannot set a delta buffer." << std::endl;
+			minibase_errors.show_errors();
+			ok = FALSE;
+		}
+	}
+
+	for (step = 0; step < 5 && ok; step++) {
+		for (i = 0; i < numOfTrees && ok; i++) {
+			switch (step) {
+			case 0:
+				// Not a multiple of TEST_DELTA, so that some still wait
+				ok = (InsertKeys(btf[i], keys, 0, first) == OK);
+				break;
+			case 1:
+				ok = (DeleteKeys(btf[i], keys, 0, half, 3) == OK);
+				break;
+			case 2:
+				ok = (i == 0 || btf[i]->MergeDelta() == OK);
+				break;
+			case 3:
+				ok = (InsertKeys(btf[i], keys, first, numkey) == OK &&
+				      (i == 0 || btf[i]->SetDeltaBuffer(0) == OK));
+				break;
+			default:
+				ok = (DeleteKeys(btf[i], keys, 1, numkey, 3) == OK);
+				break;
+			}
+			if (!ok)
+				std::cout << "  Error: step " << step + 1 << " failed." << std::endl;
+		}
+		for (i = 1; i < numOfTrees && ok; i++) {
+			sprintf(what, "%s, step %d", i == 1 ? "In the DB" : "In memory",
+			        step + 1);
+			ok = SameScans(what, btf[0], btf[i], low, high) &&
+			     SameParallelScan(what, btf[i], NULL, NULL, 4) &&
+			     SameLookups(what, btf[0], btf[i], low, high);
+		}
+	}
+
+	delete [] keys;
+	if (btf[1] != NULL)
+		btf[1]->DestroyFile();
+	for (i = 0; i < numOfTrees; i++)
+		delete btf[i];
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::packedHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Insert low..high, each key twice and in random order, into
+//           packed trees in the DB and in memory and into a plain tree,
+//           delete the middle half and compare scans of every kind,
+//           parallel scans and lookups.  Then delete everything: the
+//           packed leaves, which are not merged, are left empty, and
+//           every kind of scan must skip them and return nothing.
+//           Last, insert them all again into the empty leaves, and then
+//           some with record ids far from the rest: a leaf may have no
+//           split that takes such an entry, which then goes down the
+//           tree a second time.
+//-------------------------------------------------------------------
+
+void BTreeTest::packedHighLow(int low, int high) {
+	static int trees = 0;
+	const int numOfTrees = 3;	// the plain one first
+	char name[32], what[64];
+	int i, step;
+
+	std::cout << "Packed trees ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	sprintf(name, "PackedIndex%d", ++trees);
+	int numkey = 2 * (high-low+1), quarter = numkey / 4;
+	int midLow = low + quarter / 2, midHigh = high - quarter / 2;
+	BTreeFile *btf[numOfTrees];
+	int *keys = new int[numkey];
+	Bool ok = TRUE;
+
+	for (i = 0; i < numkey; i++)
+		keys[i] = low + i / 2;
+	btf[0] = NewTestTree(NULL);
+	btf[1] = NewTestTree(name, FALSE, FALSE, TRUE);
+	btf[2] = NewTestTree(NULL, FALSE, FALSE, TRUE);
+	for (i = 0; i < numOfTrees; i++)
+		if (btf[i] == NULL)
+			ok = FALSE;
+
+	for (step = 0; step < 5 && ok; step++) {
+		for (i = 0; i < numOfTrees && ok; i++) {
+			switch (step) {
+			case 0:
+				ok = (InsertShuffled(btf[i], keys, 0, numkey) == OK);
+				break;
+			case 1:
+				ok = (DeleteKeys(btf[i], keys, quarter, numkey - quarter, 1) == OK);
+				break;
+			case 2:
+				ok = (DeleteKeys(btf[i], keys, 0, quarter, 1) == OK &&
+				      DeleteKeys(btf[i], keys, numkey - quarter, numkey, 1) == OK);
+				break;
+			case 3:
+				ok = (InsertShuffled(btf[i], keys, 0, numkey) == OK);
+				break;
+			default:
+				ok = (InsertShuffled(btf[i], keys, 0, numkey, 37) == OK);
+				break;
+			}
+		}
+		for (i = 1; i < numOfTrees && ok; i++) {
+			sprintf(what, "%s, %s", i == 1 ? "In the DB" : "In memory",
+			        step == 0 ? "full" : step == 1 ? "middle deleted" :
+			        step == 2 ? "empty" : step == 3 ? "refilled" :
+			        "far record ids");
+			ok = SameScans(what, btf[0], btf[i], low, high) &&
+			     SameParallelScan(what, btf[i], NULL, NULL, 4, FALSE, btf[0]) &&
+			     SameParallelScan(what, btf[i], &midLow, &midHigh, 4, FALSE, btf[0]) &&
+			     SameLookups(what, btf[0], btf[i], low, high);
+		}
+	}
+
+	delete [] keys;
+	if (btf[1] != NULL)
+		btf[1]->DestroyFile();
+	for (i = 0; i < numOfTrees; i++)
+		delete btf[i];
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+// OpenTestDB / CloseTestDB
+//
+// Purpose : Make minibase_globals a database of the reopen check,
+//           created with numOfPages pages or, with none, opened as it
+//           was left in iomode; and close it again, writing out what
+//           the buffer pool holds.
+//-------------------------------------------------------------------
+
+static Bool OpenTestDB(unsigned numOfPages, DBIOMode iomode, unsigned pagesize)
+{
+	Status status;
+
+	new SystemDefs(status, REOPEN_DB, REOPEN_LOG, numOfPages, 500,
+		BUFFER_POOL_BYTES, NULL, iomode, pagesize);
+	if (status != OK) {
+		std::cout << "  Error: cannot open the database." << std::endl;
+		minibase_errors.show_errors();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void CloseTestDB()
+{
+	if (!MINIBASE_DB->IsMapped())
+		MINIBASE_BM->FlushAllPages();
+	delete minibase_globals;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeTest::reopenHighLow
+//
+// Input   : low, high - range of the keys.
+// Purpose : Insert low..high in order into an index of a database of
+//           its own, so that the root splits a few times, close it and
+//           reopen it DB_MMAP_READONLY, and compare scans of every kind
+//           and lookups with a plain tree.  Then reopen it to delete
+//           all but the last few keys, so that the root collapses, and
+//           compare again read-only.  The index must open at the root
+//           it was left with each time.
+//-------------------------------------------------------------------
+
+void BTreeTest::reopenHighLow(int low, int high) {
+	SystemDefs *globals = minibase_globals;
+	unsigned pagesize = MINIBASE_PAGESIZE;
+	const char *name = "ReopenIndex";
+	int step;
+
+	std::cout << "Reopened index ("<<low<<" to "<<high<<"):"<< std::endl;
+
+	int numkey = high-low+1, keep = numkey / 64 + 1;
+	int *keys = new int[numkey];
+	BTreeFile *plain = NewTestTree(NULL);
+	BTreeFile *btf = NULL;
+	Bool ok = (plain != NULL);
+
+	for (int i = 0; i < numkey; i++)
+		keys[i] = low + i;
+	remove(REOPEN_DB);
+	remove(REOPEN_LOG);
+
+	for (step = 0; step < 2 && ok; step++) {
+		// Build the index, or shrink it, and close it
+		if (step == 0)
+			ok = OpenTestDB(1000 + numkey / 8, DB_BUFFERED_IO, pagesize);
+		else
+			ok = OpenTestDB(0, DB_BUFFERED_IO, pagesize);
+		if (ok) {
+			btf = NewTestTree(name);
+			if (step == 0)
+				ok = (btf != NULL && InsertKeys(btf, keys, 0, numkey) == OK &&
+				      InsertKeys(plain, keys, 0, numkey) == OK);
+			else
+				ok = (btf != NULL &&
+				      DeleteKeys(btf, keys, 0, numkey - keep, 1) == OK &&
+				      DeleteKeys(plain, keys, 0, numkey - keep, 1) == OK);
+			delete btf;
+			CloseTestDB();
+		}
+
+		// Read it where it was left
+		ok = ok && OpenTestDB(0, DB_MMAP_READONLY, pagesize);
+		if (ok) {
+			const char *what = step ? "Read-only after deletes" : "Read-only";
+
+			btf = NewTestTree(name);
+			ok = (btf != NULL &&
+			      SameScans(what, plain, btf, low, high) &&
+			      SameParallelScan(what, btf, NULL, NULL, 4, FALSE, plain) &&
+			      SameLookups(what, plain, btf, low, high));
+			delete btf;
+			CloseTestDB();
+		}
+	}
+
+	minibase_globals = globals;
+	remove(REOPEN_DB);
+	remove(REOPEN_LOG);
+	delete [] keys;
+	delete plain;
+	if (ok)
+		std::cout << "  Success." << std::endl;
+}
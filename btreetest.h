@@ -3,13 +3,29 @@
 
 class BTreeTest {
 public:
-	Status RunTests(std::istream &in);
+	Status RunTests(std::istream &in, DBIOMode iomode = DB_BUFFERED_IO,
+	                unsigned pagesize = 0);
 	BTreeFile *createIndex(char *name);
 	void destroyIndex(BTreeFile *btf, char *name);
 	void insertHighLow(BTreeFile *btf, int low, int high);
-	void scanHighLow(BTreeFile *btf, int low, int high);
+	void scanHighLow(BTreeFile *btf, int low, int high,
+	                 TupleOrder order = Ascending);
 	void deleteScanHighLow(BTreeFile *btf, int low, int high);
 	void deleteHighLow(BTreeFile *btf, int low, int high);
+	void benchHighLow(BTreeFile *btf, int low, int high);
+	void countedHighLow(int low, int high);
+	void appendHighLow(int low, int high);
+	void swizzleHighLow(int low, int high);
+	void memoryHighLow(int low, int high);
+	void snapshotHighLow(int low, int high);
+	void parallelScanHighLow(int low, int high);
+	void bulkHighLow(int low, int high);
+	void schedulerHighLow(int low, int high);
+	void lookupHighLow(int low, int high);
+	void bufferedHighLow(int low, int high);
+	void deltaHighLow(int low, int high);
+	void packedHighLow(int low, int high);
+	void reopenHighLow(int low, int high);
 };
 
 
@@ -0,0 +1,204 @@
+#include "btsnap.h"
+
+
+// Starting size of the table; it doubles as copies are added.
+const int COPY_BUCKETS = 64;
+
+
+//-------------------------------------------------------------------
+// BTCopyTable::BTCopyTable
+//
+// Input   : None
+// Output  : None
+// Purpose : Make an empty table.
+//-------------------------------------------------------------------
+
+BTCopyTable::BTCopyTable()
+{
+	buckets = NULL;
+	numOfBuckets = 0;
+	numOfCopies = 0;
+}
+
+
+//-------------------------------------------------------------------
+// BTCopyTable::~BTCopyTable
+//
+// Input   : None
+// Output  : None
+// Purpose : Forget all copies.  The nodes they are in are the tree's
+//           to free, see BTreeFile::ReleaseSnapshot().
+//-------------------------------------------------------------------
+
+BTCopyTable::~BTCopyTable()
+{
+	for (int i = 0; i < numOfBuckets; i++)
+	{
+		while (buckets[i] != NULL)
+		{
+			BTNodeCopy *c = buckets[i];
+			buckets[i] = c->next;
+			delete c;
+		}
+	}
+	delete [] buckets;
+}
+
+
+//-------------------------------------------------------------------
+// BTCopyTable::Find
+//
+// Input   : pid   - a node
+//           epoch - epoch of a snapshot
+// Output  : None
+// Purpose : Look for the copy of pid that holds what the snapshot saw.
+// Return  : The copy, or INVALID_PAGE if the snapshot reads pid itself.
+//-------------------------------------------------------------------
+
+PageID BTCopyTable::Find(PageID pid, int epoch)
+{
+	if (numOfCopies == 0)
+		return INVALID_PAGE;
+
+	for (BTNodeCopy *c = buckets[pid & (numOfBuckets - 1)]; c; c = c->next)
+		if (c->pid == pid && c->copy != pid &&
+		    c->from <= epoch && epoch <= c->to)
+			return c->copy;
+	return INVALID_PAGE;
+}
+
+
+//-------------------------------------------------------------------
+// BTCopyTable::LastEpoch
+//
+// Input   : pid - a node
+// Output  : None
+// Purpose : Find up to which epoch snapshots have a copy of pid.
+// Return  : The largest to of the copies of pid, -1 if it has none.
+//-------------------------------------------------------------------
+
+int BTCopyTable::LastEpoch(PageID pid)
+{
+	int last = -1;
+
+	if (numOfCopies == 0)
+		return last;
+
+	for (BTNodeCopy *c = buckets[pid & (numOfBuckets - 1)]; c; c = c->next)
+		if (c->pid == pid && c->copy != pid && c->to > last)
+			last = c->to;
+	return last;
+}
+
+
+//-------------------------------------------------------------------
+// BTCopyTable::Insert
+//
+// Input   : pid      - a node
+//           copy     - its copy, or INVALID_PAGE
+//           from, to - epochs of the snapshots the copy is for
+// Output  : None
+// Purpose : Record a copy, growing the table when it gets crowded.
+// Return  : OK if successful, FAIL if out of memory.
+//-------------------------------------------------------------------
+
+Status BTCopyTable::Insert(PageID pid, PageID copy, int from, int to)
+{
+	BTNodeCopy *c;
+
+	if (numOfCopies >= numOfBuckets && Grow() != OK)
+		return FAIL;
+
+	c = new BTNodeCopy;
+	if (c == NULL)
+		return FAIL;
+	c->pid = pid;
+	c->copy = copy;
+	c->from = from;
+	c->to = to;
+	c->next = buckets[pid & (numOfBuckets - 1)];
+	buckets[pid & (numOfBuckets - 1)] = c;
+	numOfCopies++;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTCopyTable::Prune
+//
+// Input   : snapshots - the snapshots still in use, newest first
+// Output  : None
+// Purpose : Take out the copies made for epochs none of the snapshots
+//           has.
+// Return  : The copies taken out, linked through next.  The caller
+//           frees their nodes and deletes them.
+//-------------------------------------------------------------------
+
+BTNodeCopy *BTCopyTable::Prune(const BTSnapshot *snapshots)
+{
+	BTNodeCopy *pruned = NULL;
+
+	for (int i = 0; i < numOfBuckets; i++)
+	{
+		BTNodeCopy **link = &buckets[i];
+
+		while (*link != NULL)
+		{
+			BTNodeCopy *c = *link;
+			const BTSnapshot *s = snapshots;
+
+			// Newest first: stop at the first one not after c->to
+			while (s != NULL && s->epoch > c->to)
+				s = s->next;
+			if (s != NULL && s->epoch >= c->from)
+			{
+				link = &c->next;
+				continue;
+			}
+
+			*link = c->next;
+			c->next = pruned;
+			pruned = c;
+			numOfCopies--;
+		}
+	}
+	return pruned;
+}
+
+
+//-------------------------------------------------------------------
+// BTCopyTable::Grow
+//
+// Input   : None
+// Output  : None
+// Purpose : Double the number of buckets and spread the copies over
+//           them.
+// Return  : OK if successful, FAIL if out of memory.
+//-------------------------------------------------------------------
+
+Status BTCopyTable::Grow()
+{
+	int n = (numOfBuckets == 0) ? COPY_BUCKETS : 2 * numOfBuckets;
+	BTNodeCopy **larger = new BTNodeCopy*[n];
+
+	if (larger == NULL)
+		return FAIL;
+	for (int i = 0; i < n; i++)
+		larger[i] = NULL;
+
+	for (int i = 0; i < numOfBuckets; i++)
+	{
+		while (buckets[i] != NULL)
+		{
+			BTNodeCopy *c = buckets[i];
+			buckets[i] = c->next;
+			c->next = larger[c->pid & (n - 1)];
+			larger[c->pid & (n - 1)] = c;
+		}
+	}
+
+	delete [] buckets;
+	buckets = larger;
+	numOfBuckets = n;
+	return OK;
+}
@@ -0,0 +1,84 @@
+#ifndef BTSNAP_H
+#define BTSNAP_H
+
+#include "minirel.h"
+#include "page.h"
+
+
+// Snapshots of a BTreeFile (see BTreeFile::Snapshot()).
+//
+// Nodes are still changed in place.  Each snapshot gets the tree's
+// current epoch, and the epoch goes up by one.  A writer about to change
+// a node that a live snapshot can still see first copies it to a new
+// node, and records the copy as the node's contents for the snapshots
+// of epochs from..to.  A snapshot reads a node through its copy if
+// there is one, and the node itself otherwise.  Page ids, leaf links
+// and swizzled references of the live tree stay as they are.  A node
+// the tree drops while snapshots are in use is held, not freed, until
+// the last of them is released, since they may still read it.
+
+class BTSnapshot {
+
+	friend class BTreeFile;
+	friend class BTreeFileScan;
+	friend class BTCopyTable;
+
+public:
+
+	PageID RootPid() { return rootPid; }
+
+private:
+
+	PageID      rootPid;	// the root when the snapshot was taken
+	int         epoch;
+	BTSnapshot *next;	// an older snapshot of the same tree
+};
+
+
+struct BTNodeCopy {
+	PageID      pid;	// the node
+	PageID      copy;	// its contents for snapshots from..to, or
+				// INVALID_PAGE if they never see the node, or
+				// pid itself if it is held for them
+	int         from;
+	int         to;
+	BTNodeCopy *next;
+};
+
+
+class BTCopyTable {
+
+public:
+
+	BTCopyTable();
+	~BTCopyTable();
+
+	// The copy of pid that snapshots of epoch see, INVALID_PAGE if they
+	// see the node itself.
+	PageID Find(PageID pid, int epoch);
+
+	// Last epoch the copies of pid are for, -1 if it has none.
+	int    LastEpoch(PageID pid);
+
+	Status Insert(PageID pid, PageID copy, int from, int to);
+
+	// Hold pid, which the tree no longer uses, for the snapshots up to
+	// epoch to.  It is pruned, and freed, with the copies.
+	Status Hold(PageID pid, int to) { return Insert(pid, pid, 0, to); }
+
+	// Take out the copies no snapshot in the list sees any more and
+	// return them, linked through next.
+	BTNodeCopy *Prune(const BTSnapshot *snapshots);
+
+	int    NumOfCopies() { return numOfCopies; }
+
+private:
+
+	BTNodeCopy **buckets;
+	int          numOfBuckets;	// a power of 2
+	int          numOfCopies;
+
+	Status Grow();
+};
+
+#endif
@@ -16,14 +16,21 @@ static int breakpoint()
 //                      this buffer manager to pick a victim to be
 //                      replaced.
 // Output  : None
+// Note    : The frames share one pool aligned to MINIBASE_IO_ALIGNMENT,
+//           so that pages can be transferred with direct I/O.
 //--------------------------------------------------------------------
 
 BufMgr::BufMgr( int bufSize )
 {
 	frames = new ClockFrame*[bufSize];//(ClockFrame **)malloc(sizeof(ClockFrame *)*bufSize);
+	pool = AlignedAlloc(bufSize * MINIBASE_PAGESIZE);
+	memset(pool, 0, bufSize * MINIBASE_PAGESIZE);
 	for (int i = 0; i < bufSize; i++)
+	{
 		frames[i] = new ClockFrame();
-	hashTable = new HashTable();
+		frames[i]->AttachBuffer((Page *)(pool + i * MINIBASE_PAGESIZE));
+	}
+	hashTable = new HashTable(bufSize);
 	replacer = new Clock( bufSize, frames, hashTable );
 	numOfBuf = bufSize;
 	totalHit = 0;
@@ -44,6 +51,7 @@ BufMgr::~BufMgr()
 	for (int i = 0; i < numOfBuf; i++)
 		delete frames[i];
 	delete [] frames;
+	AlignedFree(pool);
 	delete replacer;
 	delete hashTable;
 }
@@ -66,8 +74,15 @@ Status BufMgr::FlushAllPages()
 	Status s;
 	int goingToFail;
 
+	LatchGuard guard(latch);
+
 	goingToFail = FALSE;
 	s = OK;
+
+	// No page goes to disk with frame numbers in it
+	for (i = 0; i < numOfBuf; i++)
+		frames[i]->Unswizzle();
+
 	for (i = 0; s == OK && i < numOfBuf; i++)
 	{
 		if (frames[i]->IsValid())
@@ -104,6 +119,8 @@ Status BufMgr::FlushPage(PageID pid)
 {
 	int frameNo;
 
+	LatchGuard guard(latch);
+
 	frameNo = FindFrame(pid);
 	if (frameNo == INVALID_PAGE)
 	{
@@ -113,6 +130,8 @@ Status BufMgr::FlushPage(PageID pid)
 
 	if (frames[frameNo]->NotPinned())
 	{
+		frames[frameNo]->Unswizzle();
+		UnswizzleChildren(frameNo);
 		frames[frameNo]->Write();
 		return hashTable->Delete(pid);
 	}
@@ -138,15 +157,29 @@ Status BufMgr::FlushPage(PageID pid)
 //            is pinned. The number of pin on the page increase by
 //            one.
 // Return   : OK if operation is successful.  FAIL otherwise.
+// Note     : For a memory-mapped (read-only) database no frame is
+//            used: page points straight into the mapping.
 //--------------------------------------------------------------------
 
 Status BufMgr::PinPage(PageID pid, Page*& page, bool isEmpty)
 {
 	int frameNo;
 
+	LatchGuard guard(latch);
+
 	if (pid == 63)
 		breakpoint();
 
+	if (MINIBASE_DB != NULL && MINIBASE_DB->IsMapped())
+	{
+		if (isEmpty)
+			return FAIL;
+		totalCall++;
+		totalHit++;
+		page = MINIBASE_DB->GetMappedPage(pid);
+		return (page != NULL) ? OK : FAIL;
+	}
+
 
 	totalCall++;
 	frameNo = FindFrame(pid);
@@ -208,9 +241,16 @@ Status BufMgr::UnpinPage(PageID pid, Bool dirty)
 {
 	int frameNo;
 
+	LatchGuard guard(latch);
+
 	if (pid == 0) {
 	    breakpoint();
 	}
+
+	// Pages of a mapped database are never pinned in a frame.
+	if (MINIBASE_DB != NULL && MINIBASE_DB->IsMapped())
+		return dirty ? FAIL : OK;
+
 	frameNo = FindFrame(pid);
 
 	if (frameNo == INVALID_FRAME)
@@ -234,6 +274,139 @@ Status BufMgr::UnpinPage(PageID pid, Bool dirty)
 }
 
 
+//--------------------------------------------------------------------
+// BufMgr::UnpinPage
+//
+// Input    : page  - a page pinned in the buffer pool
+//            dirty - as above
+// Output   : None
+// Purpose  : Unpin a page found by its address rather than its page
+//            id, which saves the hash table lookup.
+// Return   : OK if operation is successful.  FAIL otherwise.
+//--------------------------------------------------------------------
+
+Status BufMgr::UnpinPage(Page *page, Bool dirty)
+{
+	int frameNo;
+
+	LatchGuard guard(latch);
+
+	if (MINIBASE_DB != NULL && MINIBASE_DB->IsMapped())
+		return dirty ? FAIL : OK;
+
+	frameNo = FrameOf(page);
+	if (frameNo == INVALID_FRAME || frames[frameNo]->NotPinned())
+	{
+		std::cerr << "   Trying to unpin a page which is not pinned.\n";
+		return FAIL;
+	}
+
+	if (dirty)
+		frames[frameNo]->DirtyIt();
+	frames[frameNo]->Unpin();
+	return OK;
+}
+
+
+//--------------------------------------------------------------------
+// BufMgr::PinChild
+//
+// Input    : ref    - a reference to a page held in the page parent,
+//                     a page id or a swizzled one
+//            parent - a pinned page
+// Output   : ref  - swizzled, if it was not and the page could be
+//            page - a pointer to the page in the buffer pool.
+// Purpose  : Pin a page reached from another one, such as the child of
+//            a B+ tree index node.  A swizzled reference gives the frame
+//            straight away, without a hash table lookup.  Otherwise the
+//            page is pinned as usual, and the reference in parent is
+//            swizzled so that the next pin through it is direct.
+// PreCond  : The content of parent is not moved around while it holds
+//            swizzled references: its owner calls PageOf() to read a
+//            reference and Unswizzle() on all of them before changing
+//            the page.
+// PostCond : The page is pinned, as by PinPage().
+// Return   : OK if operation is successful.  FAIL otherwise.
+// Note     : The reference is put back to the page id before the page
+//            leaves its frame.  Until its children have, the parent page
+//            is not picked for replacement, and its content does not go
+//            to disk with frame numbers in it: swizzling does not dirty
+//            the page, and flushing it unswizzles it first.
+//--------------------------------------------------------------------
+
+Status BufMgr::PinChild(PageID *ref, Page *parent, Page*& page)
+{
+	int frameNo, parentNo;
+	Status s;
+
+	LatchGuard guard(latch);
+
+	if (IsSwizzled(*ref))
+	{
+		frameNo = *ref & ~SWIZZLED_REF;
+		totalCall++;
+		totalHit++;
+		frames[frameNo]->Pin();
+		page = frames[frameNo]->GetPage();
+		return OK;
+	}
+
+	s = PinPage(*ref, page);
+	if (s != OK)
+		return s;
+
+	// Pages of a mapped database are not in frames
+	if (MINIBASE_DB->IsMapped())
+		return OK;
+
+	frameNo = FrameOf(page);
+	parentNo = FrameOf(parent);
+	if (parentNo != INVALID_FRAME && !frames[frameNo]->IsSwizzled())
+	{
+		frames[frameNo]->SetSwip(ref, frames[parentNo]);
+		*ref = SWIZZLED_REF | frameNo;
+	}
+	return OK;
+}
+
+
+//--------------------------------------------------------------------
+// BufMgr::PageOf
+//
+// Input    : ref - a page id or a swizzled reference
+// Output   : None
+// Purpose  : Read a reference that may be swizzled.
+// Return   : The page id.
+//--------------------------------------------------------------------
+
+PageID BufMgr::PageOf(PageID ref)
+{
+	if (!IsSwizzled(ref))
+		return ref;
+	return frames[ref & ~SWIZZLED_REF]->GetPageID();
+}
+
+
+//--------------------------------------------------------------------
+// BufMgr::Unswizzle
+//
+// Input    : ref - a swizzled reference
+// Output   : None
+// Purpose  : Turn a swizzled reference back into the page id, for a
+//            page that is about to move its references around.
+// Return   : The page id.
+//--------------------------------------------------------------------
+
+PageID BufMgr::Unswizzle(PageID ref)
+{
+	Frame *frame = frames[ref & ~SWIZZLED_REF];
+	LatchGuard guard(latch);
+
+	frame->Unswizzle();
+	return frame->GetPageID();
+}
+
+
 //--------------------------------------------------------------------
 // BufMgr::FreePage
 //
@@ -256,6 +429,8 @@ Status BufMgr::FreePage(PageID pid)
 	int frameNo;
 	Status s;
 
+	LatchGuard guard(latch);
+
 	pages--;
 	frameNo = FindFrame(pid);
 	if (frameNo == INVALID_FRAME)
@@ -264,6 +439,8 @@ Status BufMgr::FreePage(PageID pid)
 	}
 	else
 	{
+		frames[frameNo]->Unswizzle();
+		UnswizzleChildren(frameNo);
 		s = frames[frameNo]->Free();
 		if (s == OK)
 			hashTable->Delete(pid);
@@ -272,6 +449,56 @@ Status BufMgr::FreePage(PageID pid)
 }
 
 
+//--------------------------------------------------------------------
+// BufMgr::PrefetchPages
+//
+// Input    : pid     - page id of the first page to read ahead
+//            howMany - number of consecutive pages to read ahead
+// Output   : None
+// Purpose  : Read pages that are about to be pinned into the buffer
+//            pool without pinning them, so that a scan over pages
+//            laid out one after the other reads the file sequentially.
+// PreCond  : None
+// PostCond : Pages that were not in the buffer and for which a frame
+//            could be found are in the buffer, unpinned.
+// Return   : OK.  Read-ahead is only a hint: running out of frames or
+//            past the end of the database just stops it.
+// Note     : The frames are marked referenced so that the clock does
+//            not hand them out again before the scan gets to them.
+//--------------------------------------------------------------------
+
+Status BufMgr::PrefetchPages(PageID pid, int howMany)
+{
+	int frameNo;
+
+	LatchGuard guard(latch);
+
+	// The OS reads ahead in a mapped database.
+	if (MINIBASE_DB->IsMapped())
+		return OK;
+
+	for (int i = 0; i < howMany && pid < MINIBASE_DB->GetNumOfPages(); i++, pid++)
+	{
+		if (FindFrame(pid) != INVALID_FRAME)
+			continue;
+
+		frameNo = replacer->PickVictim();
+		if (frameNo == INVALID_FRAME)
+			break;
+
+		if (frames[frameNo]->Read(pid) != OK)
+		{
+			frames[frameNo]->EmptyIt();
+			break;
+		}
+		hashTable->Insert(pid, frameNo);
+		frames[frameNo]->SetReferenced();
+	}
+
+	return OK;
+}
+
+
 //--------------------------------------------------------------------
 // BufMgr::NewPage
 //
@@ -296,6 +523,8 @@ Status BufMgr::NewPage (int& pid, Page*& page, int howMany)
 {
 	Status s;
 
+	LatchGuard guard(latch);
+
  	s = MINIBASE_DB->AllocatePage(pid, howMany);
 	if (s != OK)
 	{
@@ -307,6 +536,28 @@ Status BufMgr::NewPage (int& pid, Page*& page, int howMany)
 }
 
 
+//--------------------------------------------------------------------
+// BufMgr::PinNewPage
+//
+// Input    : pid  - a page the caller has just allocated itself, with
+//                   DB::AllocatePageAt() or as part of a run.
+// Output   : page - a pointer to the page in memory.
+// Purpose  : Pin a newly allocated page as NewPage() pins the one it
+//            allocates: without reading it, and counted as a new page.
+// PreCond  : There is at least one free buffer space to hold a page.
+// PostCond : The page with page id = pid is pinned into the buffer.
+// Return   : OK if operation is successful.  FAIL otherwise.
+//--------------------------------------------------------------------
+
+Status BufMgr::PinNewPage (PageID pid, Page*& page)
+{
+	LatchGuard guard(latch);
+
+	pages++;
+	return PinPage(pid, page, TRUE);
+}
+
+
 //--------------------------------------------------------------------
 // BufMgr::GetNumOfUnpinnedBuffers
 //
@@ -324,6 +575,8 @@ unsigned int BufMgr::GetNumOfUnpinnedBuffers()
 	int i;
 	int count;
 
+	LatchGuard guard(latch);
+
 	count = 0;
 
 	for (i = 0; i < numOfBuf; i++)
@@ -357,3 +610,41 @@ int BufMgr::FindFrame( PageID pid )
 	return hashTable->LookUp(pid);	
 }
 
+
+//--------------------------------------------------------------------
+// BufMgr::FrameOf
+//
+// Input    : page - a pointer into the buffer pool
+// Output   : None
+// Purpose  : Find the frame of a page from its address.
+// Return   : The frame number, INVALID_FRAME if page is not in the
+//            pool.
+//--------------------------------------------------------------------
+
+int BufMgr::FrameOf(Page *page)
+{
+	long offset = (char *)page - pool;
+
+	if (offset < 0 || offset >= (long)numOfBuf * MINIBASE_PAGESIZE)
+		return INVALID_FRAME;
+	return offset / MINIBASE_PAGESIZE;
+}
+
+
+//--------------------------------------------------------------------
+// BufMgr::UnswizzleChildren
+//
+// Input    : frameNo - a frame about to be written or freed
+// Output   : None
+// Purpose  : Put back the page ids of all the references its page holds
+//            swizzled.
+//--------------------------------------------------------------------
+
+void BufMgr::UnswizzleChildren(int frameNo)
+{
+	for (int i = 0; i < numOfBuf && frames[frameNo]->HasSwizzledChildren(); i++)
+	{
+		if (frames[i]->IsChildOf(frames[frameNo]))
+			frames[i]->Unswizzle();
+	}
+}
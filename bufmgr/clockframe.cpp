@@ -20,7 +20,8 @@ void ClockFrame::Unpin()
 
 Bool ClockFrame::IsVictim()
 {
-	return (referenced == FALSE && NotPinned());
+	// A page with swizzled references stays until its children leave.
+	return (referenced == FALSE && NotPinned() && !HasSwizzledChildren());
 }
 
 Bool ClockFrame::IsReferenced()
@@ -40,4 +41,9 @@ Status ClockFrame::Free()
 void ClockFrame::UnsetReferenced()
 {
 	referenced = FALSE;
-}
\ No newline at end of file
+}
+
+void ClockFrame::SetReferenced()
+{
+	referenced = TRUE;
+}
@@ -5,15 +5,17 @@
 Frame::Frame()
 {
 	pid = INVALID_PAGE;
-	data = new Page();
-	memset(data, 0, sizeof(Page));
+	data = NULL;
 	pinCount = 0;
 	dirty = FALSE;
+	swip = NULL;
+	parent = NULL;
+	swizzled = 0;
 }
 
 Frame::~Frame()
 {
-	delete data;
+	// data belongs to the buffer pool of the BufMgr
 }
 
 void Frame::Pin()
@@ -126,3 +128,76 @@ Page *Frame::GetPage()
 {
 	return data;
 }
+
+
+//--------------------------------------------------------------------
+// Frame::AttachBuffer
+//
+// Input    : buf - one page worth of memory in the buffer pool
+// Output   : None
+// Purpose  : Give this frame its page buffer.  The buffer pool is
+//            allocated aligned so a frame can be the direct source
+//            or target of a DB read/write.
+//--------------------------------------------------------------------
+
+void Frame::AttachBuffer(Page *buf)
+{
+	data = buf;
+}
+
+
+//--------------------------------------------------------------------
+// Frame::SetSwip
+//
+// Input    : ref   - where owner's page refers to this page; it now
+//                    holds the frame number instead of the page id
+//            owner - the frame of that page
+// Output   : None
+// Purpose  : Remember the swizzled reference, so that it can be turned
+//            back into the page id before this page leaves the frame.
+//--------------------------------------------------------------------
+
+void Frame::SetSwip(PageID *ref, Frame *owner)
+{
+	swip = ref;
+	parent = owner;
+	owner->swizzled++;
+}
+
+
+Bool Frame::IsSwizzled()
+{
+	return swip != NULL;
+}
+
+
+Bool Frame::HasSwizzledChildren()
+{
+	return swizzled > 0;
+}
+
+
+Bool Frame::IsChildOf(Frame *owner)
+{
+	return swip != NULL && parent == owner;
+}
+
+
+//--------------------------------------------------------------------
+// Frame::Unswizzle
+//
+// Input    : None
+// Output   : None
+// Purpose  : Put the page id back into the reference the parent page
+//            holds to this page, if it holds a swizzled one.
+//--------------------------------------------------------------------
+
+void Frame::Unswizzle()
+{
+	if (swip == NULL)
+		return;
+	*swip = pid;
+	parent->swizzled--;
+	swip = NULL;
+	parent = NULL;
+}
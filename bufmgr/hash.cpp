@@ -98,24 +98,16 @@ Bucket::Bucket()
 
 Bucket::~Bucket()
 {
-	EmptyIt();
+	delete maps;
 }
 
 
-void Bucket::Insert(PageID pid, int frameNo)
+void Bucket::Insert(Map *m)
 {
-	Map *m = new Map(pid, frameNo);
-	if (maps)
-	{
-		maps->AddBehind(m);
-	}
-	else
-	{
-		maps = m;
-	}
+	maps->AddBehind(m);
 }
 
-Status Bucket::Delete(PageID pid)
+Map *Bucket::Delete(PageID pid)
 {
 	MapIterator next(maps);
 	Map *curr;
@@ -125,39 +117,37 @@ Status Bucket::Delete(PageID pid)
 		if (curr->HasPageID(pid))
 		{
 			curr->DeleteMe();
-			delete curr;
-			return OK;
+			return curr;
 		}
 	}
-	return FAIL;		
+	return NULL;		
 }
 
-int Bucket::Find(PageID pid)
+Map *Bucket::DeleteFirst()
 {
 	MapIterator next(maps);
 	Map *curr;
-	
-	while (curr = next())
+
+	if ((curr = next()) != NULL)
 	{
-		if (curr->HasPageID(pid))
-		{
-			return curr->FrameNo();
-		}
+		curr->DeleteMe();
 	}
-	return INVALID_FRAME;
+	return curr;
 }
 
-
-void Bucket::EmptyIt()
+int Bucket::Find(PageID pid)
 {
 	MapIterator next(maps);
 	Map *curr;
 	
 	while (curr = next())
 	{
-		curr->DeleteMe();
-		delete curr;
+		if (curr->HasPageID(pid))
+		{
+			return curr->FrameNo();
+		}
 	}
+	return INVALID_FRAME;
 }
 
 
@@ -168,15 +158,76 @@ void Bucket::EmptyIt()
 //--------------------------------------------
 
 
+HashTable::HashTable(int numOfFrames)
+{
+	int i;
+
+	poolSize = numOfFrames;
+	pool = new Map[poolSize];
+	freeMaps = NULL;
+	for (i = poolSize - 1; i >= 0; i--)
+	{
+		pool[i].next = freeMaps;
+		freeMaps = &pool[i];
+	}
+}
+
+
+HashTable::~HashTable()
+{
+	EmptyIt();
+	delete [] pool;
+}
+
+
+Map *HashTable::NewMap(PageID pid, int frameNo)
+{
+	Map *m = freeMaps;
+
+	// More maps than frames only if a page is entered twice
+	if (m == NULL)
+	{
+		return new Map(pid, frameNo);
+	}
+	freeMaps = m->next;
+	m->pid = pid;
+	m->frameNo = frameNo;
+	m->next = NULL;
+	m->prev = NULL;
+	return m;
+}
+
+
+void HashTable::FreeMap(Map *m)
+{
+	if (m >= pool && m < pool + poolSize)
+	{
+		m->next = freeMaps;
+		freeMaps = m;
+	}
+	else
+	{
+		delete m;
+	}
+}
+
+
 void HashTable::Insert(PageID pid, int frameNo)
 {
-	buckets[HASH(pid)].Insert(pid, frameNo);
+	buckets[HASH(pid)].Insert(NewMap(pid, frameNo));
 }
 
 
 Status HashTable::Delete(PageID pid)
 {
-	return buckets[HASH(pid)].Delete(pid);
+	Map *m = buckets[HASH(pid)].Delete(pid);
+
+	if (m == NULL)
+	{
+		return FAIL;
+	}
+	FreeMap(m);
+	return OK;
 }
 
 
@@ -188,9 +239,13 @@ int HashTable::LookUp(PageID pid)
 void HashTable::EmptyIt()
 {
 	int i;
+	Map *m;
 
 	for (i = 0; i < NUM_OF_BUCKETS; i++)
 	{
-		buckets[i].EmptyIt();
+		while ((m = buckets[i].DeleteFirst()) != NULL)
+		{
+			FreeMap(m);
+		}
 	}
-}
\ No newline at end of file
+}
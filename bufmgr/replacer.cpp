@@ -40,6 +40,7 @@ int Clock::PickVictim()
 		{
 			if (frames[current]->IsValid())
 			{
+				frames[current]->Unswizzle();
 				hashTable->Delete(frames[current]->GetPageID());
 				frames[current]->Write();
 			}
@@ -0,0 +1,80 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include "latch.h"
+
+
+//--------------------------------------------------------------------
+// Latch::Latch
+//
+// Input   : None
+// Output  : None
+// Purpose : Make a latch nobody holds.  It is recursive: a critical
+//           section on Windows, a recursive mutex elsewhere.
+//--------------------------------------------------------------------
+
+Latch::Latch()
+{
+#ifdef _WIN32
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection( cs );
+	lock = cs;
+#else
+	pthread_mutexattr_t attr;
+	pthread_mutex_t *mutex = new pthread_mutex_t;
+
+	pthread_mutexattr_init( &attr );
+	pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+	pthread_mutex_init( mutex, &attr );
+	pthread_mutexattr_destroy( &attr );
+	lock = mutex;
+#endif
+}
+
+
+//--------------------------------------------------------------------
+// Latch::~Latch
+//
+// Input   : None
+// Output  : None
+// Purpose : Destroy the latch, which nobody may hold.
+//--------------------------------------------------------------------
+
+Latch::~Latch()
+{
+#ifdef _WIN32
+	DeleteCriticalSection( (CRITICAL_SECTION *)lock );
+	delete (CRITICAL_SECTION *)lock;
+#else
+	pthread_mutex_destroy( (pthread_mutex_t *)lock );
+	delete (pthread_mutex_t *)lock;
+#endif
+}
+
+
+//--------------------------------------------------------------------
+// Latch::Acquire / Latch::Release
+//
+// Purpose : Wait until no other thread holds the latch and take it;
+//           give it back.
+//--------------------------------------------------------------------
+
+void Latch::Acquire()
+{
+#ifdef _WIN32
+	EnterCriticalSection( (CRITICAL_SECTION *)lock );
+#else
+	pthread_mutex_lock( (pthread_mutex_t *)lock );
+#endif
+}
+
+void Latch::Release()
+{
+#ifdef _WIN32
+	LeaveCriticalSection( (CRITICAL_SECTION *)lock );
+#else
+	pthread_mutex_unlock( (pthread_mutex_t *)lock );
+#endif
+}
@@ -0,0 +1,541 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "latch.h"
+#include "scheduler.h"
+
+#ifdef _WIN32
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+
+// Tasks a deque has room for at first; it doubles when full.
+const int TASK_DEQUE_SIZE = 64;
+
+struct Task
+{
+	TaskFunc   fn;
+	void      *arg;
+	TaskGroup *group;
+};
+
+
+// The tasks of one worker and priority, oldest first, in a ring buffer.
+
+struct TaskDeque
+{
+	Task *tasks;
+	int   size;
+	int   head;		// the oldest task
+	int   count;
+
+	TaskDeque() { tasks = NULL; size = head = count = 0; }
+	~TaskDeque() { delete [] tasks; }
+
+	Status PushBack( const Task &task );
+	Bool   PopBack( Task &task );
+	Bool   PopFront( Task &task );
+};
+
+
+struct Worker
+{
+	Latch     latch;	// held while the deques change
+	TaskDeque deques[NUM_TASK_PRIORITIES];
+	Bool      started;
+#ifdef _WIN32
+	HANDLE    thread;
+#else
+	pthread_t thread;
+#endif
+};
+
+
+// What the workers of a scheduler share.  queued counts the tasks in the
+// deques that no thread has claimed yet; a thread claims one (under
+// lock) before it looks for it, so that it is sure to find one.  Idle
+// workers, and threads waiting for a group, park on wakeup.
+
+struct SchedulerState
+{
+	Scheduler *scheduler;
+	Worker    *workers;
+	int        queued;
+	int        next;		// worker the next outside task goes to
+	Bool       stopping;
+#ifdef _WIN32
+	CRITICAL_SECTION   lock;
+	CONDITION_VARIABLE wakeup;
+#else
+	pthread_mutex_t    lock;
+	pthread_cond_t     wakeup;
+#endif
+
+	void Lock();
+	void Unlock();
+	void Park();
+	void WakeOne();
+	void WakeAll();
+
+	void RunClaimedTask( int self );
+	void Work( int self );
+};
+
+
+// The scheduler and worker the running thread is, if it is a worker.
+static THREAD_LOCAL SchedulerState *currentState = NULL;
+static THREAD_LOCAL int currentWorker = -1;
+
+// What a worker thread is started with.
+struct WorkerStart
+{
+	SchedulerState *state;
+	int             i;
+};
+
+
+//--------------------------------------------------------------------
+// TaskDeque::PushBack
+//
+// Input   : task - a task
+// Output  : None
+// Purpose : Add task as the newest, doubling the buffer if it is full.
+// Return  : OK if successful, FAIL if out of memory.
+//--------------------------------------------------------------------
+
+Status TaskDeque::PushBack( const Task &task )
+{
+	if (count == size)
+	{
+		int n = (size == 0) ? TASK_DEQUE_SIZE : 2 * size;
+		Task *larger = new Task[n];
+
+		if (larger == NULL)
+			return FAIL;
+		for (int i = 0; i < count; i++)
+			larger[i] = tasks[(head + i) % size];
+		delete [] tasks;
+		tasks = larger;
+		size = n;
+		head = 0;
+	}
+	tasks[(head + count) % size] = task;
+	count++;
+	return OK;
+}
+
+
+//--------------------------------------------------------------------
+// TaskDeque::PopBack / TaskDeque::PopFront
+//
+// Output  : task - the newest / the oldest task
+// Purpose : Take a task out: the owner takes its newest, whose data is
+//           most likely still in its cache, thieves the oldest.
+// Return  : FALSE if the deque is empty.
+//--------------------------------------------------------------------
+
+Bool TaskDeque::PopBack( Task &task )
+{
+	if (count == 0)
+		return FALSE;
+	count--;
+	task = tasks[(head + count) % size];
+	return TRUE;
+}
+
+Bool TaskDeque::PopFront( Task &task )
+{
+	if (count == 0)
+		return FALSE;
+	task = tasks[head];
+	head = (head + 1) % size;
+	count--;
+	return TRUE;
+}
+
+
+#ifdef _WIN32
+
+void SchedulerState::Lock()    { EnterCriticalSection( &lock ); }
+void SchedulerState::Unlock()  { LeaveCriticalSection( &lock ); }
+void SchedulerState::Park()    { SleepConditionVariableCS( &wakeup, &lock, INFINITE ); }
+void SchedulerState::WakeOne() { WakeConditionVariable( &wakeup ); }
+void SchedulerState::WakeAll() { WakeAllConditionVariable( &wakeup ); }
+
+static DWORD WINAPI StartWorker( LPVOID p )
+#else
+
+void SchedulerState::Lock()    { pthread_mutex_lock( &lock ); }
+void SchedulerState::Unlock()  { pthread_mutex_unlock( &lock ); }
+void SchedulerState::Park()    { pthread_cond_wait( &wakeup, &lock ); }
+void SchedulerState::WakeOne() { pthread_cond_signal( &wakeup ); }
+void SchedulerState::WakeAll() { pthread_cond_broadcast( &wakeup ); }
+
+static void *StartWorker( void *p )
+#endif
+{
+	WorkerStart *start = (WorkerStart *)p;
+	SchedulerState *state = start->state;
+	int i = start->i;
+
+	delete start;
+	state->Work( i );
+	return 0;
+}
+
+
+//--------------------------------------------------------------------
+// SchedulerState::RunClaimedTask
+//
+// Input   : self - the worker the calling thread is, or -1
+// Output  : None
+// Purpose : Find the task the caller has claimed and run it.  Every
+//           foreground task comes before any background one; within a
+//           priority the caller's own newest task comes first, then the
+//           oldest of the other workers in turn.  A task taken by some
+//           other thread along the way only means another round.
+//--------------------------------------------------------------------
+
+void SchedulerState::RunClaimedTask( int self )
+{
+	int n = scheduler->numOfWorkers;
+	Task task;
+	Bool found = FALSE;
+
+	while (!found)
+	{
+		for (int p = 0; p < NUM_TASK_PRIORITIES && !found; p++)
+		{
+			for (int k = 0; k < n && !found; k++)
+			{
+				int w = (self < 0) ? k : (self + k) % n;
+				Worker &worker = workers[w];
+
+				worker.latch.Acquire();
+				if (w == self)
+					found = worker.deques[p].PopBack( task );
+				else
+					found = worker.deques[p].PopFront( task );
+				worker.latch.Release();
+			}
+		}
+	}
+
+	task.fn( task.arg );
+
+	if (task.group != NULL)
+	{
+		Lock();
+		if (--task.group->pending == 0)
+			WakeAll();
+		Unlock();
+	}
+}
+
+
+//--------------------------------------------------------------------
+// SchedulerState::Work
+//
+// Input   : self - the worker
+// Output  : None
+// Purpose : What worker self does until the scheduler stops: claim a
+//           task and run it, or park while there is none.
+//--------------------------------------------------------------------
+
+void SchedulerState::Work( int self )
+{
+	currentState = this;
+	currentWorker = self;
+
+	Lock();
+	for (;;)
+	{
+		while (queued == 0 && !stopping)
+			Park();
+		if (queued == 0)
+			break;
+		queued--;
+		Unlock();
+		RunClaimedTask( self );
+		Lock();
+	}
+	Unlock();
+}
+
+
+//--------------------------------------------------------------------
+// Scheduler::Scheduler
+//
+// Input   : n - number of workers, 0 for one per processor
+// Output  : None
+// Purpose : Start the workers.  One that cannot be started leaves its
+//           deques to be emptied by the others.
+//--------------------------------------------------------------------
+
+Scheduler::Scheduler( int n )
+{
+	numOfWorkers = (n > 0) ? n : NumOfProcessors();
+
+	state = new SchedulerState;
+	state->scheduler = this;
+	state->workers = new Worker[numOfWorkers];
+	state->queued = 0;
+	state->next = 0;
+	state->stopping = FALSE;
+#ifdef _WIN32
+	InitializeCriticalSection( &state->lock );
+	InitializeConditionVariable( &state->wakeup );
+#else
+	pthread_mutex_init( &state->lock, NULL );
+	pthread_cond_init( &state->wakeup, NULL );
+#endif
+
+	for (int i = 0; i < numOfWorkers; i++)
+	{
+		Worker &worker = state->workers[i];
+		WorkerStart *start = new WorkerStart;
+
+		start->state = state;
+		start->i = i;
+#ifdef _WIN32
+		worker.thread = CreateThread( NULL, 0, StartWorker, start, 0, NULL );
+		worker.started = (worker.thread != NULL);
+#else
+		worker.started = (pthread_create( &worker.thread, NULL, StartWorker, start ) == 0);
+#endif
+		if (!worker.started)
+			delete start;
+	}
+}
+
+
+//--------------------------------------------------------------------
+// Scheduler::~Scheduler
+//
+// Input   : None
+// Output  : None
+// Purpose : Let the workers run what is queued, then wait for them to
+//           stop.
+//--------------------------------------------------------------------
+
+Scheduler::~Scheduler()
+{
+	state->Lock();
+	state->stopping = TRUE;
+	state->WakeAll();
+	state->Unlock();
+
+	for (int i = 0; i < numOfWorkers; i++)
+	{
+		Worker &worker = state->workers[i];
+
+		if (!worker.started)
+			continue;
+#ifdef _WIN32
+		WaitForSingleObject( worker.thread, INFINITE );
+		CloseHandle( worker.thread );
+#else
+		pthread_join( worker.thread, NULL );
+#endif
+	}
+
+#ifdef _WIN32
+	DeleteCriticalSection( &state->lock );
+#else
+	pthread_cond_destroy( &state->wakeup );
+	pthread_mutex_destroy( &state->lock );
+#endif
+	delete [] state->workers;
+	delete state;
+}
+
+
+//--------------------------------------------------------------------
+// Scheduler::Submit
+//
+// Input   : fn, arg  - the task: fn(arg)
+//           priority - TASK_FOREGROUND or TASK_BACKGROUND
+//           group    - a group to add the task to, or NULL
+// Output  : None
+// Purpose : Queue a task and wake a thread for it.  A worker queues its
+//           tasks on its own deques, other threads on the workers' in
+//           turn.
+// Return  : OK if successful, FAIL if out of memory.
+//--------------------------------------------------------------------
+
+Status Scheduler::Submit( TaskFunc fn, void *arg, TaskPriority priority,
+                          TaskGroup *group )
+{
+	Task task;
+	int w;
+	Status s;
+
+	task.fn = fn;
+	task.arg = arg;
+	task.group = group;
+
+	state->Lock();
+	w = CurrentWorker();
+	if (w < 0)
+		w = state->next++ % numOfWorkers;
+
+	Worker &worker = state->workers[w];
+	worker.latch.Acquire();
+	s = worker.deques[priority].PushBack( task );
+	worker.latch.Release();
+
+	if (s == OK)
+	{
+		if (group != NULL)
+			group->pending++;
+		state->queued++;
+		state->WakeOne();
+	}
+	state->Unlock();
+	return s;
+}
+
+
+//--------------------------------------------------------------------
+// Scheduler::Wait
+//
+// Input   : group - tasks submitted with it
+// Output  : None
+// Purpose : Run queued tasks, any of them, until the group is done, and
+//           park only when nothing is queued.
+//--------------------------------------------------------------------
+
+void Scheduler::Wait( TaskGroup &group )
+{
+	state->Lock();
+	while (group.pending > 0)
+	{
+		if (state->queued == 0)
+		{
+			state->Park();
+			continue;
+		}
+		state->queued--;
+		state->Unlock();
+		state->RunClaimedTask( CurrentWorker() );
+		state->Lock();
+	}
+
+	// Pass on a wakeup meant for a task this thread did not claim
+	if (state->queued > 0)
+		state->WakeOne();
+	state->Unlock();
+}
+
+
+// One of the n tasks of Scheduler::RunAll().
+struct RunAllTask
+{
+	ThreadFunc fn;
+	void      *arg;
+	int        i;
+};
+
+static void RunPart( void *p )
+{
+	RunAllTask *task = (RunAllTask *)p;
+
+	task->fn( task->arg, task->i );
+}
+
+
+//--------------------------------------------------------------------
+// Scheduler::RunAll
+//
+// Input   : n        - number of tasks
+//           fn, arg  - task i is fn(arg, i)
+//           priority - of all n
+// Output  : None
+// Purpose : Submit the n tasks and wait for them.  A task that cannot
+//           be queued runs on the caller.
+// Return  : OK if all were queued, FAIL otherwise.
+//--------------------------------------------------------------------
+
+Status Scheduler::RunAll( int n, ThreadFunc fn, void *arg,
+                          TaskPriority priority )
+{
+	RunAllTask *tasks = new RunAllTask[n];
+	TaskGroup group;
+	Status s = OK;
+
+	for (int i = 0; i < n; i++)
+	{
+		tasks[i].fn = fn;
+		tasks[i].arg = arg;
+		tasks[i].i = i;
+		if (Submit( RunPart, &tasks[i], priority, &group ) != OK)
+		{
+			RunPart( &tasks[i] );
+			s = FAIL;
+		}
+	}
+	Wait( group );
+
+	delete [] tasks;
+	return s;
+}
+
+
+//--------------------------------------------------------------------
+// Scheduler::SetAffinity
+//
+// Input   : worker - a worker
+//           cpu    - the processor to keep it on, -1 for any
+// Output  : None
+// Return  : OK if successful, FAIL if the worker is not running or the
+//           platform cannot pin threads.
+//--------------------------------------------------------------------
+
+Status Scheduler::SetAffinity( int worker, int cpu )
+{
+	if (worker < 0 || worker >= numOfWorkers || !state->workers[worker].started)
+		return FAIL;
+
+#if defined(_WIN32)
+	DWORD_PTR processMask, systemMask;
+
+	if (!GetProcessAffinityMask( GetCurrentProcess(), &processMask, &systemMask ))
+		return FAIL;
+	if (cpu >= 0)
+		processMask = (DWORD_PTR)1 << cpu;
+	if (!SetThreadAffinityMask( state->workers[worker].thread, processMask ))
+		return FAIL;
+	return OK;
+#elif defined(__linux__)
+	cpu_set_t set;
+
+	CPU_ZERO( &set );
+	for (int i = 0; i < CPU_SETSIZE; i++)
+		if (cpu < 0 || i == cpu)
+			CPU_SET( i, &set );
+	if (pthread_setaffinity_np( state->workers[worker].thread, sizeof(set), &set ) != 0)
+		return FAIL;
+	return OK;
+#else
+	return FAIL;
+#endif
+}
+
+
+//--------------------------------------------------------------------
+// Scheduler::CurrentWorker
+//
+// Input   : None
+// Output  : None
+// Return  : The worker of this scheduler the calling thread is, or -1.
+//--------------------------------------------------------------------
+
+int Scheduler::CurrentWorker()
+{
+	return (currentState == state) ? currentWorker : -1;
+}
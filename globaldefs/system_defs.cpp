@@ -5,9 +5,15 @@
 
 #include <new.h>
 #include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 #include "minirel.h"
 #include "db.h"
 #include "bufmgr.h"
+#include "scheduler.h"
+#include "latch.h"
 
 SystemDefs* minibase_globals;
 extern int MINIBASE_RESTART_FLAG;
@@ -18,11 +24,35 @@ std::ostream& operator<< (std::ostream& out, const struct RecordID rid)
     return(out);
 };
 
+// Aligned buffers for direct I/O.
+
+char* AlignedAlloc( unsigned size )
+{
+#ifdef _WIN32
+    return (char *)_aligned_malloc( size, MINIBASE_IO_ALIGNMENT );
+#else
+    void* ptr;
+    if ( posix_memalign( &ptr, MINIBASE_IO_ALIGNMENT, size ) != 0 )
+        return NULL;
+    return (char *)ptr;
+#endif
+}
+
+void AlignedFree( char* ptr )
+{
+#ifdef _WIN32
+    _aligned_free( ptr );
+#else
+    free( ptr );
+#endif
+}
+
 // constructor to start the system.
 
 SystemDefs::SystemDefs( Status& status, const char* dbname, const char* logname,
                         unsigned num_pgs, unsigned logsize,
-                        unsigned bufpoolsize, const char* replacement_policy )
+                        unsigned bufpoolsize, const char* replacement_policy,
+                        DBIOMode iomode, unsigned pagesize )
 {
     char *real_logname;
     char *real_dbname;
@@ -35,11 +65,13 @@ SystemDefs::SystemDefs( Status& status, const char* dbname, const char* logname,
 
 
     init( status, real_dbname,real_logname, num_pgs, logsize,
-          bufpoolsize? bufpoolsize : NUMBUF, replacement_policy? replacement_policy : "Clock" );
+          bufpoolsize, replacement_policy? replacement_policy : "Clock",
+          iomode, pagesize );
 }
 
 SystemDefs::SystemDefs( Status& status, const char* dbname, unsigned num_pgs,
-                        unsigned bufpoolsize, const char* replacement_policy )
+                        unsigned bufpoolsize, const char* replacement_policy,
+                        DBIOMode iomode, unsigned pagesize )
 {   
 	char *logname;
     char *real_dbname;
@@ -52,18 +84,22 @@ SystemDefs::SystemDefs( Status& status, const char* dbname, unsigned num_pgs,
 
 
     init( status, real_dbname, logname, num_pgs, num_pgs? 3*num_pgs : 500,
-          bufpoolsize? bufpoolsize : NUMBUF,
-          replacement_policy? replacement_policy : "Clock" );
+          bufpoolsize,
+          replacement_policy? replacement_policy : "Clock", iomode, pagesize );
 }
 
 void SystemDefs::init( Status& status, const char* dbname, const char* logname,
                        unsigned num_pgs, unsigned ,
-                       unsigned bufpoolsize, const char* )
+                       unsigned bufpoolsize, const char*, DBIOMode iomode,
+                       unsigned pagesize )
 {
     status = OK;
     char* BufMgrAddress;
 
     GlobalBufMgr = 0;
+    GlobalScheduler = 0;
+    SchedulerLatch = new Latch();
+    GlobalPageSize = MINIBASE_DEFAULT_PAGESIZE;
     GlobalDB = 0;
     GlobalCatalogPtr = 0;       // Kill any users---they must use ExtSysDefs.
     GlobalDBName = 0;
@@ -72,30 +108,55 @@ void SystemDefs::init( Status& status, const char* dbname, const char* logname,
 
     minibase_globals = this;
 
+      // The page size must be known before the buffer pool is allocated:
+      // a new database gets the requested size, with larger pages by
+      // default for direct I/O, an existing one the size it was created
+      // with.
+    if ((MINIBASE_RESTART_FLAG) || (num_pgs == 0)) {
+        unsigned dbpagesize;
+        status = DB::ReadPageSize(dbname, dbpagesize);
+        if (status != OK) {
+            std::cerr << "Error opening Database " << dbname << std::endl;
+            minibase_errors.show_errors();
+            return;
+        }
+        GlobalPageSize = dbpagesize;
+    } else if (pagesize != 0) {
+        GlobalPageSize = pagesize;
+    } else {
+        GlobalPageSize = (iomode == DB_DIRECT_IO) ? MINIBASE_IO_ALIGNMENT
+                                                  : MINIBASE_DEFAULT_PAGESIZE;
+    }
+
+      // The buffer pool is sized in bytes.
+    unsigned numbuf = bufpoolsize ? bufpoolsize / GlobalPageSize : NUMBUF;
+    if (numbuf < MINIBASE_MIN_BUFFERS)
+        numbuf = MINIBASE_MIN_BUFFERS;
+
 
-          // create the buffer manager in shared memory
-          // this needs to be changed later to merely the buffer pool.
+      // create the buffer manager in shared memory
+      // this needs to be changed later to merely the buffer pool.
 
-        BufMgrAddress = GlobalShMemMgr->malloc(sizeof(BufMgr));
-        GlobalBufMgr = new(BufMgrAddress) BufMgr(bufpoolsize);
+    BufMgrAddress = GlobalShMemMgr->malloc(sizeof(BufMgr));
+    GlobalBufMgr = new(BufMgrAddress) BufMgr(numbuf);
 
-        GlobalDBName = GlobalShMemMgr->malloc(strlen(dbname)+1);
-        strcpy(GlobalDBName,dbname);
+    GlobalDBName = GlobalShMemMgr->malloc(strlen(dbname)+1);
+    strcpy(GlobalDBName,dbname);
 
-        GlobalLogName = GlobalShMemMgr->malloc(strlen(logname)+1);
-        strcpy(GlobalLogName,logname);
+    GlobalLogName = GlobalShMemMgr->malloc(strlen(logname)+1);
+    strcpy(GlobalLogName,logname);
 
 
       // create or open the DB 
     if ((MINIBASE_RESTART_FLAG) || (num_pgs == 0)){// open an existing database
-        GlobalDB = new DB(dbname,status);
+        GlobalDB = new DB(dbname,status,iomode);
         if (status != OK) {
             std::cerr << "Error opening Database " << dbname << std::endl;
             minibase_errors.show_errors();
             return;
         }
     } else {
-        GlobalDB = new DB(dbname,num_pgs,status);
+        GlobalDB = new DB(dbname,num_pgs,status,iomode);
         if (status != OK) {
             std::cerr << "Error creating Database " << dbname << std::endl;
             minibase_errors.show_errors();
@@ -118,7 +179,10 @@ SystemDefs::~SystemDefs()
 {
   
       /* The buffer manager needs the GlobalDb to still exist when it is
-         deleted. */
+         deleted, and background tasks both of them. */
+
+    delete GlobalScheduler; GlobalScheduler = NULL;
+    delete SchedulerLatch; SchedulerLatch = NULL;
 
     delete GlobalBufMgr;   GlobalBufMgr = NULL;
     delete GlobalDBName; GlobalDBName = NULL;
@@ -129,3 +193,14 @@ SystemDefs::~SystemDefs()
  
 }
 
+
+  // The workers are started on first use, so that a system that never
+  // runs anything in parallel does not have a thread per processor.
+Scheduler* SystemDefs::GetScheduler()
+{
+    LatchGuard guard(*SchedulerLatch);
+
+    if (GlobalScheduler == NULL)
+        GlobalScheduler = new Scheduler();
+    return GlobalScheduler;
+}
@@ -0,0 +1,128 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "threads.h"
+#include "scheduler.h"
+
+
+// What a thread is started with.
+struct ThreadStart
+{
+	ThreadFunc fn;
+	void      *arg;
+	int        i;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI StartThread( LPVOID p )
+#else
+static void *StartThread( void *p )
+#endif
+{
+	ThreadStart *start = (ThreadStart *)p;
+
+	start->fn( start->arg, start->i );
+	return 0;
+}
+
+
+//--------------------------------------------------------------------
+// RunThreads
+//
+// Input   : n   - number of threads
+//           fn  - what each thread runs
+//           arg - passed on to fn
+// Output  : None
+// Purpose : Once minibase_globals exists, run the n as background tasks
+//           of MINIBASE_SCHEDULER, which is created on first use, so as
+//           not to take more cores than there are.  Before that, as for
+//           a tree in memory with no DB open, start threads 1..n-1, run
+//           thread 0 on the caller, then wait for the others.  A thread
+//           that cannot be started runs on the caller too, after
+//           thread 0.
+// Return  : OK if all n threads or tasks were started, FAIL otherwise.
+//--------------------------------------------------------------------
+
+Status RunThreads( int n, ThreadFunc fn, void *arg )
+{
+	if (minibase_globals != NULL)
+		return MINIBASE_SCHEDULER->RunAll( n, fn, arg, TASK_BACKGROUND );
+
+	ThreadStart *starts = new ThreadStart[n];
+	Bool *started = new Bool[n];
+#ifdef _WIN32
+	HANDLE *threads = new HANDLE[n];
+#else
+	pthread_t *threads = new pthread_t[n];
+#endif
+	Status s = OK;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		starts[i].fn = fn;
+		starts[i].arg = arg;
+		starts[i].i = i;
+		started[i] = FALSE;
+	}
+
+	for (i = 1; i < n; i++)
+	{
+#ifdef _WIN32
+		threads[i] = CreateThread( NULL, 0, StartThread, &starts[i], 0, NULL );
+		started[i] = (threads[i] != NULL);
+#else
+		started[i] = (pthread_create( &threads[i], NULL, StartThread, &starts[i] ) == 0);
+#endif
+	}
+
+	if (n > 0)
+		fn( arg, 0 );
+
+	for (i = 1; i < n; i++)
+	{
+		if (!started[i])
+		{
+			fn( arg, i );
+			s = FAIL;
+			continue;
+		}
+#ifdef _WIN32
+		WaitForSingleObject( threads[i], INFINITE );
+		CloseHandle( threads[i] );
+#else
+		pthread_join( threads[i], NULL );
+#endif
+	}
+
+	delete [] threads;
+	delete [] started;
+	delete [] starts;
+	return s;
+}
+
+
+//--------------------------------------------------------------------
+// NumOfProcessors
+//
+// Input   : None
+// Output  : None
+// Return  : The number of processors online, at least 1.
+//--------------------------------------------------------------------
+
+int NumOfProcessors()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo( &info );
+	return (int)info.dwNumberOfProcessors;
+#else
+	long n = sysconf( _SC_NPROCESSORS_ONLN );
+
+	return (n > 0) ? (int)n : 1;
+#endif
+}
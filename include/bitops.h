@@ -0,0 +1,45 @@
+// -*- C++ -*-
+//
+// bitops.h - word-at-a-time bit helpers used by the space map and the
+//            B+ tree node search.
+//
+
+#ifndef _BITOPS_H
+#define _BITOPS_H
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Number of trailing zero bits of x.  x must not be 0.
+inline int CountTrailingZeros64( unsigned long long x )
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll( x );
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if ( _BitScanForward( &index, (unsigned long)x ) )
+        return (int)index;
+    _BitScanForward( &index, (unsigned long)(x >> 32) );
+    return 32 + (int)index;
+#else
+    int n = 0;
+    while ( !(x & 1) ) { x >>= 1; ++n; }
+    return n;
+#endif
+}
+
+// Number of bits set in x.
+inline int PopCount64( unsigned long long x )
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll( x );
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+#endif // _BITOPS_H
@@ -7,6 +7,13 @@
 #include "frame.h"
 #include "replacer.h"
 #include "hash.h"
+#include "latch.h"
+
+// A swizzled page reference holds the number of the frame the page is in,
+// with the top bit set, instead of its page id (see BufMgr::PinChild()).
+const PageID SWIZZLED_REF = (PageID)0x80000000;
+
+inline Bool IsSwizzled(PageID ref) { return ref < INVALID_PAGE; }
 
 class BufMgr 
 {
@@ -14,22 +21,35 @@ class BufMgr
 
 		HashTable *hashTable;
 		ClockFrame **frames;
+		char *pool;		// aligned memory behind all frames
 		Replacer *replacer;
 		int   numOfBuf;
 
 		int FindFrame( PageID pid );
+		int FrameOf( Page *page );
+		void UnswizzleChildren( int frameNo );
 		int totalCall;
 		int totalHit;
 		int pages;
 
+		// Held while the frames and the hash table change, so that
+		// threads can pin and unpin pages at the same time.
+		Latch latch;
+
 	public:
 
 		BufMgr( int bufsize );
 		~BufMgr();      
 		Status PinPage( PageID pid, Page*& page, Bool emptyPage=FALSE );
 		Status UnpinPage( PageID pid, Bool dirty=FALSE );
+		Status UnpinPage( Page *page, Bool dirty=FALSE );
+		Status PinChild( PageID *ref, Page *parent, Page*& page );
+		PageID PageOf( PageID ref );
+		PageID Unswizzle( PageID ref );
 		Status NewPage( PageID& pid, Page*& firstpage,int howmany=1 ); 
+		Status PinNewPage( PageID pid, Page*& page );
 		Status FreePage( PageID pid ); 
+		Status PrefetchPages( PageID pid, int howMany );
 		Status FlushPage( PageID pid );
 		Status FlushAllPages();
 		int  GetStat() { return pages; }
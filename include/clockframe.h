@@ -17,6 +17,7 @@ class ClockFrame : public Frame
 		void Unpin();
 		Status Free();
 		void UnsetReferenced();
+		void SetReferenced();
 		Bool IsReferenced();
 		Bool IsVictim();
 };
@@ -19,6 +19,9 @@
 
   // This is the maximum length of the name of a "file" within a database.
 const int MAX_NAME = 50;
+
+  // Number of free runs of pages the DB remembers for multi-page allocations.
+const int MAX_CACHED_EXTENTS = 32;
   
 
 enum dbErrCodes {
@@ -30,6 +33,16 @@ enum dbErrCodes {
     FILE_NOT_FOUND,
     FILE_NAME_TOO_LONG,
     NEG_RUN_SIZE,
+    BAD_IO_ALIGNMENT,
+    READ_ONLY_DB,
+    BAD_PAGE_SIZE,
+};
+
+  // Expected access pattern, passed on to the OS for a mapped database.
+enum DBAccessPattern {
+    DB_ACCESS_NORMAL,
+    DB_ACCESS_SEQUENTIAL,
+    DB_ACCESS_RANDOM
 };
 
 // oooooooooooooooooooooooooooooooooooooo
@@ -40,14 +53,19 @@ class DB {
     // Constructors
     // Create a database with the specified number of pages where the page
     // size is the default page size.
-    DB( const char* name, unsigned num_pages, Status& status );
+    DB( const char* name, unsigned num_pages, Status& status,
+        DBIOMode iomode = DB_BUFFERED_IO );
 
     // Open the database with the given name.
-    DB( const char* name, Status& status );
+    DB( const char* name, Status& status, DBIOMode iomode = DB_BUFFERED_IO );
 
     // Destructor: closes the database
    ~DB();
 
+    // Read the page size recorded in an existing database file, so that
+    // the buffer pool can be set up before the database is opened.
+    static Status ReadPageSize( const char* name, unsigned& page_size );
+
     // Destroy the database, removing the file that stores it. 
     Status Destroy();
 
@@ -61,6 +79,10 @@ class DB {
     // Gives back the page number of the first page of the allocated run.
     Status AllocatePage(PageID& start_page_num, int run_size = 1);
 
+    // Allocate the given page if it is free; returns DONE if it is not.
+    // Used to place a new page physically next to a related one.
+    Status AllocatePageAt(PageID page_num);
+
     // Deallocate a set of pages starting at the specified page number and
     // a run size can be specified.
     Status DeallocatePage(PageID start_page_num, int run_size = 1);
@@ -74,6 +96,10 @@ class DB {
     // Delete the entry corresponding to a file from the header page(s).
     Status DeleteFileEntry(const char* fname);
 
+    // Change the first page recorded for a file, such as an index
+    // whose root moved.
+    Status UpdateFileEntry(const char* fname, PageID start_page_num);
+
     // Get the entry corresponding to the given file.
     Status GetFileEntry(const char* name, PageID& start_pg);
 
@@ -81,6 +107,14 @@ class DB {
     const char* GetName() const;
     int GetNumOfPages() const;
     int GetPageSize() const;
+    DBIOMode GetIOMode() const;
+
+    // A database opened DB_MMAP_READONLY is mapped into memory as a whole;
+    // the buffer manager hands out pointers into the mapping instead of
+    // copying pages into frames.
+    Bool  IsMapped() const { return map_base != NULL; }
+    Page* GetMappedPage(PageID pageno) const;
+    void  AdviseAccess(DBAccessPattern pattern, PageID first = 0, int n = -1);
 
     // Print out the space map of the database.
     // The space map is a bitmap showing which
@@ -90,7 +124,13 @@ class DB {
   private:
     int fd;
     unsigned num_pages;
+    unsigned bits_per_page;   // pages described by one space-map page
     char* name;
+    DBIOMode io_mode;
+    char* map_base;           // start of the mapping, NULL if not mapped
+    DBAccessPattern map_advice; // last advised for the whole mapping
+    unsigned map_pages;       // number of pages covered by the mapping
+    void* map_handle;         // file mapping object (Windows only)
 
     struct file_entry {
         PageID pagenum;         // INVALID_PAGE if no entry.
@@ -100,13 +140,13 @@ class DB {
     struct directory_page {
         PageID     next_page;
         unsigned   num_entries;
-        file_entry *entries;  // Variable-sized struct
-//      file_entry entries[0];  // Variable-sized struct
+        file_entry entries[1];  // Variable-sized struct
     };
 
       // A first_page structure appears on the first page of the database.
     struct first_page {
         unsigned int   num_db_pages; // How big the database is.
+        unsigned int   page_size;    // Its page size, in bytes.
         directory_page dir;          // The first directory page.
     };               
 
@@ -128,9 +168,84 @@ class DB {
      */
 
 
+      /* In-memory summary of the space map, built when the DB is opened
+         and kept up to date by set_bits():
+         - map_free[i] is the number of free pages described by space-map
+           page 1+i, so full map pages are skipped without pinning them;
+         - every page below alloc_cursor is allocated, single pages are
+           handed out from there (next fit, frees move it back);
+         - extents[] holds free runs of at least two pages seen while
+           searching the map, used first for multi-page requests. */
+    struct free_extent {
+        PageID   start;
+        unsigned length;
+    };
+
+    unsigned*   map_free;
+    PageID      alloc_cursor;
+    free_extent extents[MAX_CACHED_EXTENTS];
+    int         num_extents;
+
+      /* In-memory copy of the directory, loaded when the DB is opened and
+         written through to the directory pages by AddFileEntry(),
+         UpdateFileEntry() and DeleteFileEntry():
+         - catalog[] is a chained hash table of the files by name, each
+           entry remembering where on the directory pages it is stored;
+         - free_slots[] lists the unused directory slots, so adding a file
+           does not search the directory pages for one;
+         - last_dir_page is where a new directory page gets linked in. */
+    struct catalog_entry {
+        char           fname[MAX_NAME];
+        PageID         pagenum;
+        PageID         hpid;      // directory page holding the entry
+        unsigned       slot;      // entry number on that page
+        catalog_entry* next;      // hash chain
+    };
+
+    struct dir_slot {
+        PageID   hpid;
+        unsigned slot;
+    };
+
+    catalog_entry** catalog;
+    unsigned        catalog_size;     // number of buckets, a power of two
+    unsigned        catalog_count;
+    dir_slot*       free_slots;
+    unsigned        num_free_slots;
+    unsigned        free_slots_size;
+    PageID          last_dir_page;
+
+      // Build the catalog from the directory pages.
+    Status load_catalog();
+
+      // Catalog helpers.
+    catalog_entry* catalog_find( const char* fname ) const;
+    void catalog_insert( catalog_entry* ce );
+    void catalog_remove( catalog_entry* ce );
+    void push_free_slot( PageID hpid, unsigned slot );
+    void free_catalog();
+
       // Set runsize bits starting from start to value specified
     Status set_bits( PageID start, unsigned runsize, int bit );
 
+      // Build map_free and alloc_cursor from the space map pages.
+    Status init_space_map();
+
+      // Number of page bits that are meaningful on space-map page 1+i.
+    unsigned bits_on_map_page( unsigned i ) const;
+
+      // Allocation helpers for a single page and for a longer run.
+    Status allocate_single( PageID& page_num );
+    Status find_run( unsigned run_size, PageID& start_page_num );
+
+      // Maintain the extent cache.
+    void remember_extent( PageID start, unsigned length );
+    void clip_extents( PageID start, unsigned length );
+
+      // (Re)open the UNIX file for the current io_mode.
+    Status open_file();
+    void   unmap_file();
+
       // Initializes the given directory page to contain no entries.
     void init_dir_page( directory_page* dp, unsigned used_bytes );
 };
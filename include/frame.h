@@ -14,6 +14,11 @@ class Frame
 		int    pinCount;
 		int    dirty;
 
+		// Pointer swizzling (see BufMgr::PinChild()).
+		PageID *swip;		// reference to this page inside its parent
+		Frame  *parent;		// frame holding that parent page
+		int    swizzled;	// swizzled references inside this page
+
 	public :
 		
 		Frame();
@@ -32,6 +37,13 @@ class Frame
 		Bool HasPageID(PageID pid);
 		PageID GetPageID();
 		Page *GetPage();
+		void AttachBuffer(Page *buf);
+
+		void SetSwip(PageID *ref, Frame *owner);
+		Bool IsSwizzled();
+		Bool HasSwizzledChildren();
+		Bool IsChildOf(Frame *owner);
+		void Unswizzle();
 
 };
 
@@ -11,6 +11,7 @@
 class Map
 {
 	friend class MapIterator;
+	friend class HashTable;
 
 private :
 
@@ -21,7 +22,7 @@ private :
 
 public :
 	
-	Map(PageID p, int f);
+	Map(PageID p = INVALID_PAGE, int f = INVALID_FRAME);
 	~Map();
 	void AddBehind(Map *m);
 	void DeleteMe();
@@ -54,10 +55,10 @@ public :
 
 	Bucket();
 	~Bucket();
-	void Insert(PageID pid, int frameNo);
-	Status Delete(PageID pid);
+	void Insert(Map *m);
+	Map *Delete(PageID pid);
+	Map *DeleteFirst();
 	int Find(PageID pid);
-	void EmptyIt();
 };
 
 
@@ -67,8 +68,19 @@ private:
 
 	Bucket buckets[NUM_OF_BUCKETS];
 
+	// Maps come from a pool allocated up front, one per frame, so that
+	// pinning a page does not allocate memory.
+	Map *pool;
+	int poolSize;
+	Map *freeMaps;		// unused maps of the pool, linked by next
+
+	Map *NewMap(PageID pid, int frameNo);
+	void FreeMap(Map *m);
+
 public :
 
+	HashTable(int numOfFrames);
+	~HashTable();
 	void Insert(PageID pid, int frameNo);
 	Status Delete(PageID pid);
 	int LookUp(PageID pid);
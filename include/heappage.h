@@ -6,10 +6,17 @@
 
 const int INVALID_SLOT =  -1;
 
+// Length of an empty slot.  Offsets and lengths are unsigned 16 bits, so
+// a slot can address any byte of a 64 KB page.
+const ushort EMPTY_SLOT = 0xFFFF;
+
 //
 // CHANGE this constant whenever you update the structure of HeapPage class.
 //
-const int HEAPPAGE_DATA_SIZE=(MAX_SPACE - 3*sizeof(PageID) - 6*sizeof(short));
+const int HEAPPAGE_HEADER_SIZE = 3*sizeof(PageID) + 6*sizeof(ushort);
+
+// Size of the data area of a page of the current database.
+#define HEAPPAGE_DATA_SIZE (MINIBASE_PAGESIZE - HEAPPAGE_HEADER_SIZE)
 
 class HeapPage {
 
@@ -17,16 +24,16 @@ protected :
 
 	struct Slot 
 	{
-		short offset; // offset of record from the start of dataarea.
-		short length; // length of the record.
+		ushort offset; // offset of record from the start of dataarea.
+		ushort length; // length of the record.
 	};
 
 
-	short   numOfSlots;  // Number of slots available (maybe filled or
+	ushort  numOfSlots;  // Number of slots available (maybe filled or
 	                     // empty.
-	short   fillPtr;     // Offset from start of data area, where 
+	ushort  fillPtr;     // Offset from start of data area, where 
 	                     // the records resides.
-	short   freeSpace;   // Amount of free space in bytes in this page.
+	ushort  freeSpace;   // Amount of free space in bytes in this page.
 	
 	short   type;        // Not used for HeapFile assignment, but will 
 	                     // be used in B+-tree assignment.
@@ -39,11 +46,12 @@ protected :
 	                     // the end of a page.  (May overflow into
 			     // the data area.)
 
-	char data[HEAPPAGE_DATA_SIZE];
+	char data[MAX_SPACE - HEAPPAGE_HEADER_SIZE];
 
 	                     // Data area for this page.  Actual records
 			     // grows from the back towards to start of 
-			     // a page. 
+			     // a page.  Only HEAPPAGE_DATA_SIZE bytes
+			     // of it are in the page.
 
 	void CompactSlotDir();
 
@@ -68,9 +76,9 @@ public:
 	int    GetNumOfRecords();
 };
 
-#define SLOT_IS_EMPTY(s)  ((s).length == INVALID_SLOT)
+#define SLOT_IS_EMPTY(s)  ((s).length == EMPTY_SLOT)
 #define SLOT_FILL(s, o, l) do { (s).offset = (o); (s).length = (l);} while (0)
-#define SLOT_SET_EMPTY(s)  (s).length = INVALID_SLOT
+#define SLOT_SET_EMPTY(s)  (s).length = EMPTY_SLOT
 
 #define PIN(a, b)   if (MINIBASE_BM->PinPage((a), (Page *&)(b)) != OK) {\
 						std::cerr << "Unable to pin page " << a << std::endl; return FAIL;}
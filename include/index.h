@@ -27,6 +27,20 @@ public:
 	
 	virtual Status GetNext (RecordID &rid, int &key) = 0;
 	virtual Status DeleteCurrent () = 0;
+
+	// Return up to max records at once in rids[0..n) and keys[0..n).
+	// OK if n > 0, DONE once the scan has no more records.  Index
+	// files that can do better than one GetNext() per record override
+	// this.
+	virtual Status GetNextBatch (RecordID *rids, int *keys, int max, int &n)
+	{
+		for (n = 0; n < max; n++)
+		{
+			if (GetNext(rids[n], keys[n]) != OK)
+				break;
+		}
+		return n > 0 ? OK : DONE;
+	}
 	
 private:
 	
@@ -0,0 +1,43 @@
+#ifndef _LATCH_H
+#define _LATCH_H
+
+// A latch serializes threads on a shared in-memory structure, such as
+// the buffer pool.  The thread that holds it may acquire it again, as
+// long as it releases it as often.  The lock itself is the platform's
+// (see latch.cpp), since the standard thread headers cannot be included
+// after minirel.h.
+
+class Latch
+{
+	private:
+
+		void *lock;
+
+		Latch( const Latch & );
+		Latch &operator=( const Latch & );
+
+	public:
+
+		Latch();
+		~Latch();
+		void Acquire();
+		void Release();
+};
+
+
+// Holds a latch for as long as it is in scope.
+
+class LatchGuard
+{
+	private:
+
+		Latch &latch;
+
+	public:
+
+		LatchGuard( Latch &l ) : latch( l ) { latch.Acquire(); }
+		~LatchGuard() { latch.Release(); }
+};
+
+
+#endif // _LATCH_H
@@ -75,7 +75,14 @@ struct RecordID {
 
 // typedef struct RecordID RecordID;
 
-const int MINIBASE_PAGESIZE = 1024;           // in bytes
+const int MINIBASE_DEFAULT_PAGESIZE = 1024;   // in bytes, for a new database
+const int MINIBASE_MIN_PAGESIZE = 512;        // The page size is a power of
+const int MINIBASE_MAX_PAGESIZE = 65536;      // two in this range, chosen
+                                              // when the database is created
+                                              // (see MINIBASE_PAGESIZE).
+const int MINIBASE_SECTOR_SIZE = 512;         // direct I/O transfers must be
+                                              // a multiple of this
+const int MINIBASE_IO_ALIGNMENT = 4096;       // alignment of buffer pool frames
 const int MINIBASE_BUFFER_POOL_SIZE = 1024;   // in Frames
 const int MINIBASE_DB_SIZE = 10000;           // in Pages => the DBMS Manager 
                                               // tells the DB how much disk 
@@ -90,7 +97,8 @@ const int MAXFILENAME  = 15;          // also the name of a relation
 const int MAXINDEXNAME = 40;
 const int MAXATTRNAME  = 15;    
 
-const int NUMBUF = 50; // default buffer pool size
+const int NUMBUF = 50; // default buffer pool size, in frames
+const int MINIBASE_MIN_BUFFERS = 16; // fewest frames of a buffer pool
 
 #define bool int
 #define false 0
@@ -98,4 +106,9 @@ const int NUMBUF = 50; // default buffer pool size
 
 typedef int Bool;
 
+// Allocate/release memory aligned to MINIBASE_IO_ALIGNMENT, suitable as
+// the source or target of a direct I/O transfer.
+char* AlignedAlloc( unsigned size );
+void  AlignedFree( char* ptr );
+
 #endif
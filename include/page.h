@@ -5,7 +5,10 @@
 
 
 const PageID INVALID_PAGE = -1;
-const int MAX_SPACE = MINIBASE_PAGESIZE;
+// A Page is laid over a buffer of MINIBASE_PAGESIZE bytes, so it is
+// declared as large as the largest page; only MINIBASE_PAGESIZE bytes of
+// it may be used.
+const int MAX_SPACE = MINIBASE_MAX_PAGESIZE;
 
 
 class Page
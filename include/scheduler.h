@@ -0,0 +1,88 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include "minirel.h"
+#include "threads.h"
+
+// The engine's worker threads, one per processor by default, shared by
+// all background work (see SystemDefs::GlobalScheduler).  Each worker
+// has a deque of tasks per priority: it takes its own newest task first
+// and, when it has none, steals the oldest task of another worker.
+// Foreground tasks of any worker go ahead of background ones.
+
+typedef void (*TaskFunc)( void *arg );
+
+enum TaskPriority {
+	TASK_FOREGROUND,	// someone is waiting for it, such as a read
+	TASK_BACKGROUND,	// maintenance that can wait
+	NUM_TASK_PRIORITIES
+};
+
+struct SchedulerState;
+
+
+// Tasks submitted together, to wait for as a whole.
+
+class TaskGroup
+{
+	friend class Scheduler;
+	friend struct SchedulerState;
+
+	private:
+
+		int pending;	// submitted and not yet done
+
+	public:
+
+		TaskGroup() { pending = 0; }
+};
+
+
+class Scheduler
+{
+	private:
+
+		SchedulerState *state;
+		int             numOfWorkers;
+
+		Scheduler( const Scheduler & );
+		Scheduler &operator=( const Scheduler & );
+
+		friend struct SchedulerState;
+
+	public:
+
+		// numOfWorkers 0 for one per processor.
+		Scheduler( int numOfWorkers = 0 );
+
+		// Runs the tasks still queued, then stops the workers.
+		~Scheduler();
+
+		// Queue fn(arg) to run on some worker.  A task submitted by a
+		// worker goes to its own deque, others are dealt round robin.
+		Status Submit( TaskFunc fn, void *arg,
+		               TaskPriority priority = TASK_BACKGROUND,
+		               TaskGroup *group = NULL );
+
+		// Return once all tasks of group have run, running queued
+		// tasks meanwhile rather than blocking a core.
+		void   Wait( TaskGroup &group );
+
+		// Fork and join: run fn(arg, i) for i = 0..n-1 as tasks and
+		// wait for them all (as RunThreads() does with threads).
+		Status RunAll( int n, ThreadFunc fn, void *arg,
+		               TaskPriority priority = TASK_BACKGROUND );
+
+		// Keep worker i on processor cpu, or let it run on any with
+		// cpu -1.  FAIL where the platform cannot do it.
+		Status SetAffinity( int worker, int cpu );
+
+		int    NumOfWorkers() { return numOfWorkers; }
+
+		// The worker the calling thread is, -1 if none of this
+		// scheduler's.
+		int    CurrentWorker();
+};
+
+
+#endif // _SCHEDULER_H
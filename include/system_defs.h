@@ -15,24 +15,39 @@
 class BufMgr;
 class DB;
 class Catalog;
+class Scheduler;
+class Latch;
 
 #define MINIBASE_MAXARRSIZE 50
 
+  // How the DB moves pages between the buffer pool and its UNIX file.
+enum DBIOMode {
+    DB_BUFFERED_IO,     // plain read/write through the OS page cache
+    DB_DIRECT_IO,       // O_DIRECT: pages are cached in the buffer pool only
+    DB_MMAP_READONLY    // read-only: pages are served out of a file mapping
+};
+
 class SystemDefs
 {
 
 public:
     SystemDefs( Status& status, const char* dbname, unsigned dbpages =0,
-                unsigned bufpoolsize =0, const char* replacement_policy =0 );
+                unsigned bufpoolsize =0, const char* replacement_policy =0,
+                DBIOMode iomode =DB_BUFFERED_IO, unsigned pagesize =0 );
       /* This constructor uses a default log name and size, for multi-user
          Minibase.  For single-user Minibase, this is the designated
          constructor.  If "dbpages" is 0, the database is opened; if it is
-         greater than 0, the database is created with that number of pages. */
+         greater than 0, the database is created with that number of pages.
+         "bufpoolsize" is the size of the buffer pool in bytes (0 for NUMBUF
+         frames).  "iomode" selects buffered or direct I/O for the database
+         file.  "pagesize" is the page size of a new database (0 for the
+         default); an existing database keeps the size it was created with. */
 
 
     SystemDefs( Status& status, const char* dbname, const char* logname,
                 unsigned dbpages, unsigned maxlogsize,
-                unsigned bufpoolsize =0, const char* replacement_policy =0 );
+                unsigned bufpoolsize =0, const char* replacement_policy =0,
+                DBIOMode iomode =DB_BUFFERED_IO, unsigned pagesize =0 );
       /* This constructor lets you specify all aspects of the system. */
 
 
@@ -40,6 +55,14 @@ public:
 
 
     BufMgr*             GlobalBufMgr;
+    int                 GlobalPageSize;   // page size of the open database
+
+      /* The worker threads all background work of the engine runs on,
+         one per processor (see scheduler.h).  They are only started by
+         the first work that asks for them: use GetScheduler(). */
+    Scheduler*          GlobalScheduler;
+    Latch*              SchedulerLatch;
+    Scheduler*          GetScheduler();
 
       /* We fake shared memory in single-user Minibase to simplify the
          maintenance of the two versions. */
@@ -60,13 +83,16 @@ public:
 protected:
     void init( Status& status, const char* dbname, const char* logname,
                unsigned dbpages, unsigned maxlogsize,
-               unsigned bufpoolsize, const char* replacement_policy );
+               unsigned bufpoolsize, const char* replacement_policy,
+               DBIOMode iomode, unsigned pagesize );
 };
 
 extern SystemDefs* minibase_globals;
 
 #define  MINIBASE_DB                    (minibase_globals->GlobalDB)
 #define  MINIBASE_BM                    (minibase_globals->GlobalBufMgr)
+#define  MINIBASE_PAGESIZE              (minibase_globals->GlobalPageSize)
+#define  MINIBASE_SCHEDULER             (minibase_globals->GetScheduler())
 
 
 #define  MINIBASE_DBNAME                (minibase_globals->GlobalDBName)
@@ -0,0 +1,21 @@
+#ifndef _THREADS_H
+#define _THREADS_H
+
+#include "minirel.h"
+
+// Fork and join for the few places that spread work over the cores.  As
+// with Latch (latch.h), the threads are the platform's own.
+
+typedef void (*ThreadFunc)( void *arg, int i );
+
+// Run fn(arg, i) for i = 0..n-1, each on a thread of its own (i = 0 on
+// the calling thread), and wait until all have returned.  FAIL if a
+// thread could not be started; the others still run.  Once
+// minibase_globals exists, they are always tasks of MINIBASE_SCHEDULER
+// (scheduler.h) instead.
+Status RunThreads( int n, ThreadFunc fn, void *arg );
+
+// Number of processors the threads can run on.
+int NumOfProcessors();
+
+#endif // _THREADS_H
@@ -0,0 +1,219 @@
+#include "keysearch.h"
+#include "bitops.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define KEYSEARCH_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and clang only let a function use AVX2 instructions if it says so;
+// MSVC accepts the intrinsics anywhere.
+#if defined(KEYSEARCH_X86) && defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_AVX2
+#define TARGET_SSE2
+#endif
+
+
+typedef int (*count_fn)(const int *, int, int);
+
+static int count_less_dispatch(const int *keys, int n, int key);
+
+static count_fn count_less = count_less_dispatch;
+static const char *kernel_name = "scalar";
+
+
+//-------------------------------------------------------------------
+// count_less_scalar
+//
+// Input   : keys, n - the keys to look at
+//           key     - key to compare with
+// Output  : None
+// Purpose : Count the keys smaller than key, one at a time.  Used when
+//           the CPU has no vector unit we know of, and for the tail of
+//           the vector kernels.
+// Return  : The number of keys smaller than key.
+//-------------------------------------------------------------------
+
+static int count_less_scalar(const int *keys, int n, int key)
+{
+	int c = 0;
+
+	for (int i = 0; i < n; i++)
+		c += (keys[i] < key);
+	return c;
+}
+
+
+#if defined(KEYSEARCH_X86)
+
+//-------------------------------------------------------------------
+// count_less_sse2
+//
+// Input   : keys, n - the keys to look at
+//           key     - key to compare with
+// Output  : None
+// Purpose : Count the keys smaller than key, 4 at a time: one compare
+//           gives a mask per key, movemask packs the 4 masks into bits
+//           and popcount adds them up.
+// Return  : The number of keys smaller than key.
+//-------------------------------------------------------------------
+
+TARGET_SSE2
+static int count_less_sse2(const int *keys, int n, int key)
+{
+	__m128i k = _mm_set1_epi32(key);
+	int i = 0, c = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(keys + i));
+		__m128i lt = _mm_cmpgt_epi32(k, v);
+		c += PopCount64((unsigned)_mm_movemask_ps(_mm_castsi128_ps(lt)));
+	}
+	return c + count_less_scalar(keys + i, n - i, key);
+}
+
+
+//-------------------------------------------------------------------
+// count_less_avx2
+//
+// Input   : keys, n - the keys to look at
+//           key     - key to compare with
+// Output  : None
+// Purpose : Same as count_less_sse2(), 8 keys at a time.
+// Return  : The number of keys smaller than key.
+//-------------------------------------------------------------------
+
+TARGET_AVX2
+static int count_less_avx2(const int *keys, int n, int key)
+{
+	__m256i k = _mm256_set1_epi32(key);
+	int i = 0, c = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(keys + i));
+		__m256i lt = _mm256_cmpgt_epi32(k, v);
+		c += PopCount64((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(lt)));
+	}
+	return c + count_less_scalar(keys + i, n - i, key);
+}
+
+
+//-------------------------------------------------------------------
+// cpu_has_avx2 / cpu_has_sse2
+//
+// Purpose : Ask the CPU (and, for AVX2, the OS, which has to save the
+//           wide registers) whether the instructions can be used.
+//-------------------------------------------------------------------
+
+static bool cpu_has_avx2()
+{
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))	// OSXSAVE, AVX
+		return false;
+	if ((_xgetbv(0) & 6) != 6)	// XMM and YMM state saved by the OS
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return false;
+#endif
+}
+
+static bool cpu_has_sse2()
+{
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	return false;
+#endif
+}
+
+#endif // KEYSEARCH_X86
+
+
+//-------------------------------------------------------------------
+// count_less_dispatch
+//
+// Input   : keys, n, key - as for CountKeysLess()
+// Output  : None
+// Purpose : Pick the kernel for this CPU on the first call, then hand
+//           the call on to it.  Later calls go to the kernel directly.
+// Return  : The number of keys smaller than key.
+//-------------------------------------------------------------------
+
+static int count_less_dispatch(const int *keys, int n, int key)
+{
+	count_less = count_less_scalar;
+	kernel_name = "scalar";
+
+#if defined(KEYSEARCH_X86)
+	if (cpu_has_avx2())
+	{
+		count_less = count_less_avx2;
+		kernel_name = "avx2";
+	}
+	else if (cpu_has_sse2())
+	{
+		count_less = count_less_sse2;
+		kernel_name = "sse2";
+	}
+#endif
+
+	return count_less(keys, n, key);
+}
+
+
+//-------------------------------------------------------------------
+// CountKeysLess
+//
+// Input   : keys, n - the keys to look at, need not be sorted
+//           key     - key to compare with
+// Output  : None
+// Purpose : Count the keys smaller than key.  On a sorted run this is
+//           the position of the first key not smaller than key.
+// Return  : The number of keys smaller than key.
+//-------------------------------------------------------------------
+
+int CountKeysLess(const int *keys, int n, int key)
+{
+	return count_less(keys, n, key);
+}
+
+
+//-------------------------------------------------------------------
+// KeySearchKernel
+//
+// Input   : None
+// Output  : None
+// Purpose : Tell which kernel CountKeysLess() uses, choosing it first
+//           if that has not happened yet.
+// Return  : "avx2", "sse2" or "scalar".
+//-------------------------------------------------------------------
+
+const char *KeySearchKernel()
+{
+	if (count_less == count_less_dispatch)
+		count_less_dispatch(0, 0, 0);
+	return kernel_name;
+}
@@ -0,0 +1,18 @@
+#ifndef KEYSEARCH_H
+#define KEYSEARCH_H
+
+
+// Vector search of a sorted run of int keys, used by BTNodePage when the
+// keys of a node are stored apart from their record ids (see bt.h).
+//
+// The kernel is chosen once, on the first call, from what the CPU can
+// do: AVX2 compares 8 keys per instruction, SSE2 4, and a scalar loop
+// is used everywhere else.
+
+// Number of keys in keys[0..n) that are smaller than key.
+int CountKeysLess(const int *keys, int n, int key);
+
+// Name of the kernel CountKeysLess() uses: "avx2", "sse2" or "scalar".
+const char *KeySearchKernel();
+
+#endif
@@ -3,6 +3,7 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 
 #include "btreetest.h"
@@ -14,8 +15,23 @@ int main(int argc, char *argv[]) {
 	std::cout << "Execute 'btree ?' for info"<<std::endl<<std::endl;
 
 	BTreeTest btt;
+	DBIOMode iomode = DB_BUFFERED_IO;
+	unsigned pagesize = 0;
+	while (argc>1 && argv[1][0]=='-') {
+		if (!strcmp(argv[1], "-direct")) {
+			iomode = DB_DIRECT_IO;
+			argc--; argv++;
+		}
+		else if (argc>2 && !strcmp(argv[1], "-pagesize")) {
+			pagesize = atoi(argv[2]);
+			argc-=2; argv+=2;
+		}
+		else
+			break;
+	}
+
 	if (argc==1) {
-		btt.RunTests(std::cin);
+		btt.RunTests(std::cin, iomode, pagesize);
 	}
 	else if (argc==2 && argv[1][0]!='?') {
 		std::ifstream is=std::ifstream(argv[1], std::ios::in);
@@ -23,16 +39,33 @@ int main(int argc, char *argv[]) {
 			std::cout << "Error: Failed to open "<<argv[1]<<std::endl;
 			return 1;
 		}
-		btt.RunTests(is);
+		btt.RunTests(is, iomode, pagesize);
 	}
 	else {
-		std::cout << "Syntax: btree [command_file]"<<std::endl;
-		std::cout << "If no file, commands read from stdin"<<std::endl<<std::endl;
+		std::cout << "Syntax: btree [-direct] [-pagesize <bytes>] [command_file]"<<std::endl;
+		std::cout << "If no file, commands read from stdin"<<std::endl;
+		std::cout << "-direct opens the database with direct I/O"<<std::endl;
+		std::cout << "-pagesize creates the database with the given page size"<<std::endl<<std::endl;
 
 		std::cout << "Commands should be of the form:"<<std::endl;
 		std::cout << "insert <low> <high>"<<std::endl;
 		std::cout << "scan <low> <high>"<<std::endl;
+		std::cout << "rscan <low> <high> (scan from high down to low)"<<std::endl;
 		std::cout << "delete <low> <high>"<<std::endl;
+		std::cout << "bench <low> <high>"<<std::endl;
+		std::cout << "counted <low> <high> (check a counted tree against a plain one)"<<std::endl;
+		std::cout << "append <low> <high> (check keys inserted in order)"<<std::endl;
+		std::cout << "swizzle <low> <high> (check a tree in the buffer pool against one in memory)"<<std::endl;
+		std::cout << "memory <low> <high> (check trees in memory against one in the DB)"<<std::endl;
+		std::cout << "snapshot <low> <high> (check a snapshot against the tree as it was)"<<std::endl;
+		std::cout << "pscan <low> <high> (check parallel scans against plain ones)"<<std::endl;
+		std::cout << "bulk <low> <high> (check bulk loaded trees against a plain one)"<<std::endl;
+		std::cout << "sched <low> <high> (check scans and loads run as scheduler tasks)"<<std::endl;
+		std::cout << "lookup <low> <high> (check batch lookups against a plain scan)"<<std::endl;
+		std::cout << "buffered <low> <high> (check buffered trees against a plain one)"<<std::endl;
+		std::cout << "delta <low> <high> (check trees with a delta buffer against a plain one)"<<std::endl;
+		std::cout << "packed <low> <high> (check packed trees against a plain one)"<<std::endl;
+		std::cout << "reopen <low> <high> (check an index reopened read-only against a plain tree)"<<std::endl;
 		std::cout << "print"<<std::endl;
 		std::cout << "stats"<<std::endl;
 		std::cout << "quit (not required)"<<std::endl;
@@ -5,6 +5,8 @@
 * Wei Tsang Ooi Spring 97/Fall 98 CS432 Cornell University
 */
 
+#include <string.h>
+
 #include "sortedpage.h"
 #include "btindex.h"
 #include "btleaf.h"
@@ -26,54 +28,78 @@
 
 Status SortedPage::InsertRecord (char * recPtr, int recLen, RecordID& rid)
 {
-	Status status;
-	int i;
-	
-	// ASSERTIONS:
-	// - the slot directory is compressed -> inserts will occur at the end
-	// - slotCnt gives the number of slots used
-	
-	// general plan:
-	//    1. Insert the record into the page,
-	//       which is then not necessarily any more sorted
-	//    2. Sort the page by rearranging the slots (insertion sort)
-	
-	status = HeapPage::InsertRecord (recPtr, recLen, rid);
-	if (status != OK)
-		return FAIL;
-	
-	// performs a simple insertion sort
+	// The key is the first field of every record.
+	return InsertRecordAt(FindInsertPos(*(int *)recPtr), recPtr, recLen, rid);
+}
+
 
-	for (i = numOfSlots - 1; i > 0; i--) 
+//-------------------------------------------------------------------
+// SortedPage::FindInsertPos
+//
+// Input   : key - key of a record to be inserted
+// Output  : None
+// Precond : The records on this page are sorted and the slots
+//           directory is compact.
+// Purpose : Binary search for the slot a record with this key goes
+//           to: after all records with smaller or equal keys.
+// Return  : The slot number, between 0 and GetNumOfRecords().
+//-------------------------------------------------------------------
+
+int SortedPage::FindInsertPos (int key)
+{
+	int low = 0, high = numOfSlots;
+
+	while (low < high)
 	{
-		int *x = (int *)(data + slots[i].offset);
-		int *y = (int *)(data + slots[i-1].offset);
-		
-		if (*x < *y)
-		{
-			// switch slots
-
-			Slot tmpSlot;
-			tmpSlot   = slots[i];
-			slots[i]   = slots[i-1];
-			slots[i-1] = tmpSlot;
-			
-		} 
-		else 
-		{
-			
-			// end insertion sort
-
-			break;
-		}
+		int mid = (low + high) / 2;
+		if (*(int *)(data + slots[mid].offset) <= key)
+			low = mid + 1;
+		else
+			high = mid;
 	}
-	
-	// ASSERTIONS:
-	// - record keys increase with increasing slot number (starting at slot 0)
-	// - slot directory compacted
-	
-	rid.slotNo = i;
-		
+	return low;
+}
+
+
+//-------------------------------------------------------------------
+// SortedPage::InsertRecordAt
+//
+// Input   : slotNo  - slot the record goes to, as found by
+//                     FindInsertPos()
+//           recPtr  - pointer to the record to be inserted
+//           recLen  - length of the record
+// Output  : rid - record id of the inserted record
+// Precond : The slots directory is compact.
+// Postcond: The slots directory is compact, the record is in slot
+//           slotNo and the records after it have moved up one slot.
+// Purpose : Insert the record at a given position.  A sorted page
+//           has no empty slots, so there is no need to look for
+//           one: the slots from slotNo on are shifted with a single
+//           memmove.
+// Return  : OK if insertion is done, FAIL otherwise.
+//-------------------------------------------------------------------
+
+Status SortedPage::InsertRecordAt (int slotNo, char * recPtr, int recLen, RecordID& rid)
+{
+	if (slotNo < 0 || slotNo > numOfSlots)
+		return FAIL;
+
+	// check if there is enough space.
+
+	if (recLen + (int)sizeof(Slot) > freeSpace)
+		return FAIL;
+
+	fillPtr -= recLen;
+	freeSpace -= recLen + sizeof(Slot);
+	memcpy(&data[fillPtr], recPtr, recLen);
+
+	memmove(&slots[slotNo + 1], &slots[slotNo], (numOfSlots - slotNo) * sizeof(Slot));
+	SLOT_FILL(slots[slotNo], fillPtr, recLen);
+	numOfSlots++;
+
+	rid.pageNo = pid;
+	rid.slotNo = slotNo;
+
 	return OK;
 }
 
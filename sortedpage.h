@@ -17,7 +17,10 @@ private:
 public:
 		
 	Status InsertRecord(char * recPtr, int recLen, RecordID& rid);	
+	Status InsertRecordAt(int slotNo, char * recPtr, int recLen, RecordID& rid);
 	Status DeleteRecord(const RecordID& rid);
+
+	int   FindInsertPos(int key);
 	
 	void  SetType(short t)  { type = t; }
 	short GetType()         { return type; }
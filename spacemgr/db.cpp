@@ -8,11 +8,18 @@
 #include <fcntl.h>
 #include <io.h>
 #include <iomanip>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "db.h"
 #include "bufmgr.h"
-
-static const int bits_per_page = MAX_SPACE * 8;
+#include "bitops.h"
 
 static const char* dbErrMsgs[] = {
     "Database is full",         // DB_FULL
@@ -23,6 +30,9 @@ static const char* dbErrMsgs[] = {
     "File not found" ,          // FILE_NOT_FOUND
     "File name too long",       // FILE_NAME_TOO_LONG
     "Negative run size",        // NEG_RUN_SIZE
+    "Page size not aligned for direct I/O", // BAD_IO_ALIGNMENT
+    "Database is read-only",    // READ_ONLY_DB
+    "Unsupported page size",    // BAD_PAGE_SIZE
 };
 
 static error_string_table dbTable( DBMGR, dbErrMsgs );
@@ -35,8 +45,9 @@ static error_string_table dbTable( DBMGR, dbErrMsgs );
 // This function creates a database with the specified number of pages
 // where the pagesize is default.
 // It creates a UNIX file with the proper size. 
+// With DB_DIRECT_IO the file is reopened for direct I/O once it is sized.
 
-DB::DB( const char* fname, unsigned num_pgs, Status& status )
+DB::DB( const char* fname, unsigned num_pgs, Status& status, DBIOMode iomode )
 {
 
 #ifdef DEBUG 
@@ -46,6 +57,38 @@ DB::DB( const char* fname, unsigned num_pgs, Status& status )
 
     name = strcpy(new char[strlen(fname)+1],fname);
     num_pages = (num_pgs > 2) ? num_pgs : 2;
+    io_mode = iomode;
+    map_base = NULL;
+    map_pages = 0;
+    map_advice = DB_ACCESS_NORMAL;
+    map_handle = NULL;
+    map_free = NULL;
+    num_extents = 0;
+    catalog = NULL;
+    catalog_size = 0;
+    catalog_count = 0;
+    free_slots = NULL;
+    num_free_slots = 0;
+    free_slots_size = 0;
+    last_dir_page = 0;
+
+    bits_per_page = MINIBASE_PAGESIZE * 8;
+
+    if ( io_mode == DB_MMAP_READONLY ) {
+        fd = -1;
+        status = MINIBASE_FIRST_ERROR( DBMGR, READ_ONLY_DB );
+        return;
+    }
+
+      // The page size is a power of two, and slot offsets on a page are
+      // 16 bits wide.
+    if ( MINIBASE_PAGESIZE < MINIBASE_MIN_PAGESIZE
+         || MINIBASE_PAGESIZE > MINIBASE_MAX_PAGESIZE
+         || (MINIBASE_PAGESIZE & (MINIBASE_PAGESIZE - 1)) != 0 ) {
+        fd = -1;
+        status = MINIBASE_FIRST_ERROR( DBMGR, BAD_PAGE_SIZE );
+        return;
+    }
 
     // Create the file; fail if it's already there; open it in read/write
     // mode.
@@ -63,6 +106,12 @@ DB::DB( const char* fname, unsigned num_pgs, Status& status )
     ::lseek( fd, (num_pages*MINIBASE_PAGESIZE)-1, SEEK_SET );
     ::write( fd, &zero, 1 );
 
+    if ( io_mode == DB_DIRECT_IO ) {
+        ::close( fd );
+        status = open_file();
+        if ( status != OK )
+            return;
+    }
 
       // Initialize space map and directory pages.
 
@@ -83,6 +132,7 @@ DB::DB( const char* fname, unsigned num_pgs, Status& status )
     }
 
 	fp->num_db_pages = num_pages;
+	fp->page_size = MINIBASE_PAGESIZE;
 	init_dir_page( &fp->dir, sizeof *fp );
     
 	s = MINIBASE_BM->UnpinPage( 0 , TRUE );
@@ -92,10 +142,18 @@ DB::DB( const char* fname, unsigned num_pgs, Status& status )
     }
 	
 	
+    status = init_space_map();
+    if ( status != OK )
+        return;
+
     // Calculate how many pages are needed for the space map.  Reserve pages
     // 0 and 1 and as many additional pages for the space map as are needed.
     unsigned num_map_pages = (num_pages + bits_per_page - 1) / bits_per_page;
     status = set_bits( 0, 1 + num_map_pages, 1 );
+    if ( status != OK )
+        return;
+
+    status = load_catalog();
 }
 
 // ********************************************************
@@ -103,7 +161,7 @@ DB::DB( const char* fname, unsigned num_pgs, Status& status )
 // This function opens an existing database in both input and output
 // mode.
 
-DB::DB(const char* fname, Status& status)
+DB::DB(const char* fname, Status& status, DBIOMode iomode)
 {
 
 #ifdef DEBUG
@@ -111,14 +169,27 @@ DB::DB(const char* fname, Status& status)
 #endif
 
     name = strcpy(new char[strlen(fname)+1],fname);
+    io_mode = iomode;
+    map_base = NULL;
+    map_pages = 0;
+    map_advice = DB_ACCESS_NORMAL;
+    map_handle = NULL;
+    map_free = NULL;
+    num_extents = 0;
+    catalog = NULL;
+    catalog_size = 0;
+    catalog_count = 0;
+    free_slots = NULL;
+    num_free_slots = 0;
+    free_slots_size = 0;
+    last_dir_page = 0;
+
+    bits_per_page = MINIBASE_PAGESIZE * 8;
 
     // Open the file in both input and output mode.
-    fd = ::open( name, O_RDWR );
-
-    if ( fd < 0 ) {
-        status = MINIBASE_FIRST_ERROR( DBMGR, UNIX_ERROR );
+    status = open_file();
+    if ( status != OK )
         return;
-    }
 
     MINIBASE_DB = this; //set the global variable to be this.
 
@@ -141,6 +212,7 @@ DB::DB(const char* fname, Status& status)
     }
 
     num_pages = fp->num_db_pages;
+    unsigned page_size = fp->page_size;
 
     s = MINIBASE_BM->UnpinPage( 0 );
     if ( s != OK ) {
@@ -148,7 +220,17 @@ DB::DB(const char* fname, Status& status)
         return;
     }
 
-    status = OK;
+      // The buffer pool must have been set up for this page size.
+    if ( page_size != (unsigned) MINIBASE_PAGESIZE ) {
+        status = MINIBASE_FIRST_ERROR( DBMGR, BAD_PAGE_SIZE );
+        return;
+    }
+
+    status = init_space_map();
+    if ( status != OK )
+        return;
+
+    status = load_catalog();
 }
 
 // ****************************************************************
@@ -160,9 +242,38 @@ DB::~DB()
 #ifdef DEBUG
     cout<< "Closing database " << name << endl;
 #endif
+    unmap_file();
     ::close( fd );
     fd = -1;
     free( name );
+    delete [] map_free;
+    free_catalog();
+}
+
+// *****************************************************
+// Read the page size out of page 0 of a database file without opening
+// the database.
+
+Status DB::ReadPageSize( const char* fname, unsigned& page_size )
+{
+    unsigned header[2];     // first_page: num_db_pages, page_size
+
+    int fd = ::open( fname, O_RDONLY );
+    if ( fd < 0 )
+        return MINIBASE_FIRST_ERROR( DBMGR, UNIX_ERROR );
+
+    int n = ::read( fd, header, sizeof header );
+    ::close( fd );
+    if ( n != sizeof header )
+        return MINIBASE_FIRST_ERROR( DBMGR, FILE_IO_ERROR );
+
+    page_size = header[1];
+    if ( page_size < (unsigned) MINIBASE_MIN_PAGESIZE
+         || page_size > (unsigned) MINIBASE_MAX_PAGESIZE
+         || (page_size & (page_size - 1)) != 0 )
+        return MINIBASE_FIRST_ERROR( DBMGR, BAD_PAGE_SIZE );
+
+    return OK;
 }
 
 // *****************************************************
@@ -176,6 +287,7 @@ Status DB::Destroy()
     cout << "Destroying the database" << endl;
 #endif
 
+    unmap_file();
     ::close( fd );
     fd = -1;
     unlink( name );
@@ -204,8 +316,161 @@ int DB::GetPageSize() const
     return MINIBASE_PAGESIZE;
 }
 
+// ********************************************************
+
+DBIOMode DB::GetIOMode() const
+{
+    return io_mode;
+}
+
+// ********************************************************
+// This function opens the database file for reading and writing.  In
+// direct I/O mode the OS page cache is bypassed (O_DIRECT, or
+// FILE_FLAG_NO_BUFFERING on Windows), so every page is cached only once,
+// in the buffer pool.  Transfers then have to be sector aligned: the
+// page size must be a multiple of the sector size, and the buffer pool
+// frames are allocated aligned by the BufMgr.
+// In DB_MMAP_READONLY mode the file is opened read-only and mapped as a
+// whole; the mapping is shared by every process serving the same file.
+
+Status DB::open_file()
+{
+    if ( io_mode == DB_BUFFERED_IO ) {
+        fd = ::open( name, O_RDWR );
+    } else if ( io_mode == DB_MMAP_READONLY ) {
+        fd = ::open( name, O_RDONLY );
+        if ( fd < 0 )
+            return MINIBASE_FIRST_ERROR( DBMGR, UNIX_ERROR );
+
+        long size = ::lseek( fd, 0, SEEK_END );
+        map_pages = size / MINIBASE_PAGESIZE;
+        if ( map_pages == 0 ) {
+            ::close( fd );
+            fd = -1;
+            return MINIBASE_FIRST_ERROR( DBMGR, FILE_IO_ERROR );
+        }
+#ifdef _WIN32
+        map_handle = CreateFileMappingA( (HANDLE)_get_osfhandle( fd ), NULL,
+                                         PAGE_READONLY, 0, 0, NULL );
+        if ( map_handle != NULL )
+            map_base = (char *)MapViewOfFile( (HANDLE)map_handle,
+                                              FILE_MAP_READ, 0, 0, 0 );
+#else
+        void* base = ::mmap( NULL, (size_t)map_pages*MINIBASE_PAGESIZE,
+                             PROT_READ, MAP_SHARED, fd, 0 );
+        if ( base != MAP_FAILED )
+            map_base = (char *)base;
+#endif
+        if ( map_base == NULL ) {
+            unmap_file();
+            ::close( fd );
+            fd = -1;
+            return MINIBASE_FIRST_ERROR( DBMGR, UNIX_ERROR );
+        }
+    } else {
+        if ( MINIBASE_PAGESIZE % MINIBASE_SECTOR_SIZE != 0 ) {
+            fd = -1;
+            return MINIBASE_FIRST_ERROR( DBMGR, BAD_IO_ALIGNMENT );
+        }
+#if defined(_WIN32)
+        HANDLE h = CreateFileA( name, GENERIC_READ | GENERIC_WRITE,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL );
+        fd = -1;
+        if ( h != INVALID_HANDLE_VALUE ) {
+            fd = _open_osfhandle( (intptr_t)h, _O_RDWR | _O_BINARY );
+            if ( fd < 0 )
+                CloseHandle( h );
+        }
+#elif defined(O_DIRECT)
+        fd = ::open( name, O_RDWR | O_DIRECT );
+#else
+        fd = ::open( name, O_RDWR );
+#ifdef F_NOCACHE
+        if ( fd >= 0 )
+            ::fcntl( fd, F_NOCACHE, 1 );
+#endif
+#endif
+    }
+
+    if ( fd < 0 )
+        return MINIBASE_FIRST_ERROR( DBMGR, UNIX_ERROR );
+    return OK;
+}
+
+// ********************************************************
+// Release the mapping of a DB_MMAP_READONLY database.
+
+void DB::unmap_file()
+{
+#ifdef _WIN32
+    if ( map_base != NULL )
+        UnmapViewOfFile( map_base );
+    if ( map_handle != NULL )
+        CloseHandle( (HANDLE)map_handle );
+#else
+    if ( map_base != NULL )
+        ::munmap( map_base, (size_t)map_pages*MINIBASE_PAGESIZE );
+#endif
+    map_base = NULL;
+    map_handle = NULL;
+    map_pages = 0;
+    map_advice = DB_ACCESS_NORMAL;
+}
+
+// ********************************************************
+// Return a pointer to the given page inside the mapping, or NULL if the
+// database is not mapped or the page lies outside of it.
+
+Page* DB::GetMappedPage(PageID pageno) const
+{
+    if ( map_base == NULL || pageno < 0 || pageno >= (int) map_pages )
+        return NULL;
+    return (Page *)(map_base + (long)pageno*MINIBASE_PAGESIZE);
+}
+
+// ********************************************************
+// Pass the expected access pattern of n pages from first on to the OS,
+// so that it can read ahead aggressively for a scan and not at all for
+// point lookups.  n < 0 (the default) means the whole mapping; advice
+// for the whole mapping that it already has is not passed on again, so
+// callers may give it every time.  Only meaningful for a mapped
+// database; a no-op otherwise (and on Windows, which has no madvise()).
+
+void DB::AdviseAccess(DBAccessPattern pattern, PageID first, int n)
+{
+    if ( map_base == NULL || first < 0 || first >= (int) map_pages )
+        return;
+    if ( n < 0 || n > (int) map_pages - first )
+        n = map_pages - first;
+    if ( first == 0 && n == (int) map_pages ) {
+        if ( pattern == map_advice )
+            return;
+        map_advice = pattern;
+    }
+#ifndef _WIN32
+    int advice = MADV_NORMAL;
+    if ( pattern == DB_ACCESS_SEQUENTIAL )
+        advice = MADV_SEQUENTIAL;
+    else if ( pattern == DB_ACCESS_RANDOM )
+        advice = MADV_RANDOM;
+
+      // madvise() wants the start on a page of the OS, which may be
+      // larger than ours.
+    size_t os_page = (size_t) ::sysconf( _SC_PAGESIZE );
+    size_t start = (size_t)first*MINIBASE_PAGESIZE / os_page * os_page;
+    size_t end = (size_t)(first + n)*MINIBASE_PAGESIZE;
+    ::madvise( map_base + start, end - start, advice );
+#endif
+}
+
 // ********************************************************
 // This function allocates a run of pages.
+// The space map is searched a 64-bit word at a time.  A single page is
+// taken at the allocation cursor, skipping full map pages by their free
+// count, so allocation does not slow down as the database fills.  Longer
+// runs come from the extent cache if possible, and are otherwise looked
+// for in the map starting at the cursor.
 
 Status DB::AllocatePage(PageID& start_page_num, int run_size_int)
 {
@@ -213,68 +478,303 @@ Status DB::AllocatePage(PageID& start_page_num, int run_size_int)
     cout << "Allocating a run of "<< run_size << " pages." << endl;
 #endif
 
+    if ( map_base != NULL )
+        return MINIBASE_FIRST_ERROR( DBMGR, READ_ONLY_DB );
+
     if ( run_size_int < 0 ) { 
         std::cerr << "Allocating a negative run of pages.\n";
         return MINIBASE_FIRST_ERROR ( DBMGR, NEG_RUN_SIZE );
     }
 
     unsigned run_size = run_size_int;
-    unsigned num_map_pages = (num_pages + bits_per_page - 1) / bits_per_page;
-    unsigned current_run_start = 0, current_run_length = 0;
+    if ( run_size == 0 ) {
+        start_page_num = alloc_cursor;
+        return OK;
+    }
+    if ( run_size == 1 )
+        return allocate_single( start_page_num );
+
+      // A cached extent that is long enough saves searching the map.
+    for ( int e = 0; e < num_extents; ++e )
+        if ( extents[e].length >= run_size ) {
+            start_page_num = extents[e].start;
+            return set_bits( start_page_num, run_size, 1 );
+        }
+
+    Status status = find_run( run_size, start_page_num );
+    if ( status != OK )
+        return status;
+
+#ifdef DEBUG
+    cout<<"Page allocated in get_free_pages:: "<< start_page_num << endl;
+#endif
+    return set_bits( start_page_num, run_size, 1 );
+}
+
+// ********************************************************
+// Allocate one specific page.  Returns DONE, without logging an error, if
+// the page is already allocated: the caller then just picks another page.
+
+Status DB::AllocatePageAt( PageID page_num )
+{
+    if ( map_base != NULL )
+        return MINIBASE_FIRST_ERROR( DBMGR, READ_ONLY_DB );
+
+    if ( (page_num < 0) || (page_num >= (int) num_pages) )
+        return MINIBASE_FIRST_ERROR( DBMGR, BAD_PAGE_NO );
+
+    PageID pgid = 1 + page_num / bits_per_page;
+    unsigned bit = page_num % bits_per_page;
+    char* pg;
+    Status status = MINIBASE_BM->PinPage( pgid, (Page*&)pg );
+    if ( status != OK )
+        return MINIBASE_CHAIN_ERROR( DBMGR, status );
+
+    int in_use = pg[bit / 8] & (1 << (bit % 8));
+
+    status = MINIBASE_BM->UnpinPage( pgid );
+    if ( status != OK )
+        return MINIBASE_CHAIN_ERROR( DBMGR, status );
 
+    if ( in_use )
+        return DONE;
 
-    // This loop goes over each page in the space map.
+    return set_bits( page_num, 1, 1 );
+}
+
+// ********************************************************
+// Allocate the lowest free page.  All pages below alloc_cursor are in use,
+// so the search starts at the cursor's word; map pages without free pages
+// are skipped without being pinned.  The space map is read as
+// little-endian 64-bit words, bit n of the map describing page n.
+
+Status DB::allocate_single( PageID& page_num )
+{
+    unsigned num_map_pages = (num_pages + bits_per_page - 1) / bits_per_page;
     Status status;
-    for( unsigned i=0; i < num_map_pages; ++i ) {
+
+    for ( unsigned i = alloc_cursor / bits_per_page; i < num_map_pages; ++i ) {
+        if ( map_free[i] == 0 )
+            continue;
 
         PageID pgid = 1 + i;    // The space map starts at page #1.
-          // Pin the space-map page.
         char* pg;
         status = MINIBASE_BM->PinPage( pgid, (Page*&)pg );
         if ( status != OK )
             return MINIBASE_CHAIN_ERROR( DBMGR, status );
 
+        unsigned num_bits_this_page = bits_on_map_page( i );
+        unsigned base = i * bits_per_page;
+        unsigned first_bit = (unsigned)alloc_cursor > base ? alloc_cursor - base : 0;
+
+        for ( unsigned w = first_bit / 64; w*64 < num_bits_this_page; ++w ) {
+            unsigned long long word;
+            memcpy( &word, pg + w*8, sizeof word );
+            if ( w == first_bit / 64 )
+                word |= (1ULL << (first_bit % 64)) - 1;
+            if ( word == ~0ULL )
+                continue;
+
+            unsigned bit = w*64 + CountTrailingZeros64( ~word );
+            if ( bit >= num_bits_this_page )
+                break;
+
+            pg[bit / 8] |= 1 << (bit % 8);
+            --map_free[i];
+            page_num = base + bit;
+            alloc_cursor = page_num + 1;
+            clip_extents( page_num, 1 );
+
+            status = MINIBASE_BM->UnpinPage( pgid, TRUE );
+            if ( status != OK )
+                return MINIBASE_CHAIN_ERROR( DBMGR, status );
+            return OK;
+        }
 
-          // How many bits should we examine on this page?
-        unsigned num_bits_this_page = num_pages - i*bits_per_page;
-        if ( num_bits_this_page > bits_per_page )
-            num_bits_this_page = bits_per_page;
+        status = MINIBASE_BM->UnpinPage( pgid );
+        if ( status != OK )
+            return MINIBASE_CHAIN_ERROR( DBMGR, status );
+    }
 
+    return MINIBASE_FIRST_ERROR( DBMGR, DB_FULL );
+}
 
-          // Walk the page looking for a sequence of 0 bits of the appropriate
-          // length.  The outer loop steps through the page's bytes, the inner
-          // one steps through each byte's bits.
-        for ( ; num_bits_this_page > 0 && current_run_length < run_size; ++pg )
-            for ( unsigned mask=1;
-				(mask < 256) && (num_bits_this_page > 0) && (current_run_length < run_size);
-				mask <<= 1, --num_bits_this_page )
-			{
-				if ( *pg & mask ) 
-				{
-					current_run_start += current_run_length + 1;
-					current_run_length = 0;
-				} 
-				else
-					++current_run_length;
-			}
+// ********************************************************
+// Find a run of run_size free pages at or above the cursor.  Runs of used
+// and free bits inside a word are skipped with ctz rather than bit by bit;
+// entirely free map pages are counted without being pinned.  Shorter free
+// runs passed over on the way are added to the extent cache.
+
+Status DB::find_run( unsigned run_size, PageID& start_page_num )
+{
+    unsigned num_map_pages = (num_pages + bits_per_page - 1) / bits_per_page;
+    unsigned run_start = alloc_cursor, run_length = 0;
+    Status status;
+
+    for ( unsigned i = alloc_cursor / bits_per_page;
+          i < num_map_pages && run_length < run_size; ++i ) {
+
+        unsigned num_bits_this_page = bits_on_map_page( i );
+        unsigned base = i * bits_per_page;
+        unsigned first_bit = (unsigned)alloc_cursor > base ? alloc_cursor - base : 0;
+
+        if ( map_free[i] == 0 ) {
+            remember_extent( run_start, run_length );
+            run_length = 0;
+            continue;
+        }
+        if ( first_bit == 0 && map_free[i] == num_bits_this_page ) {
+            if ( run_length == 0 )
+                run_start = base;
+            run_length += num_bits_this_page;
+            continue;
+        }
+
+        PageID pgid = 1 + i;    // The space map starts at page #1.
+        char* pg;
+        status = MINIBASE_BM->PinPage( pgid, (Page*&)pg );
+        if ( status != OK )
+            return MINIBASE_CHAIN_ERROR( DBMGR, status );
+
+        for ( unsigned w = first_bit / 64;
+              w*64 < num_bits_this_page && run_length < run_size; ++w ) {
+            unsigned long long word;
+            memcpy( &word, pg + w*8, sizeof word );
+            if ( w == first_bit / 64 )
+                word |= (1ULL << (first_bit % 64)) - 1;
+            if ( num_bits_this_page - w*64 < 64 )
+                word |= ~0ULL << (num_bits_this_page - w*64);
+
+              // Step from one run of equal bits to the next.
+            unsigned b = 0;
+            while ( b < 64 && run_length < run_size ) {
+                unsigned long long rest = word >> b;
+                unsigned n;
+                if ( rest & 1 ) {
+                    remember_extent( run_start, run_length );
+                    run_length = 0;
+                    n = (~rest == 0) ? 64 - b : CountTrailingZeros64( ~rest );
+                } else {
+                    if ( run_length == 0 )
+                        run_start = base + w*64 + b;
+                    n = (rest == 0) ? 64 - b : CountTrailingZeros64( rest );
+                    if ( n > 64 - b )
+                        n = 64 - b;
+                    run_length += n;
+                }
+                b += n;
+            }
+        }
 
-          // Unpin the space-map page.
         status = MINIBASE_BM->UnpinPage( pgid );
         if ( status != OK )
             return MINIBASE_CHAIN_ERROR( DBMGR, status );
     }
 
+    if ( run_length < run_size )
+        return MINIBASE_FIRST_ERROR( DBMGR, DB_FULL );
 
-    if ( current_run_length >= run_size ) {
+    start_page_num = run_start;
+    return OK;
+}
 
-        start_page_num = current_run_start;
-#ifdef DEBUG
-        cout<<"Page allocated in get_free_pages:: "<< start_page_num << endl;
-#endif
-        return set_bits( start_page_num, run_size, 1 );
+// ********************************************************
+// Count the free pages described by each space-map page and place the
+// allocation cursor on the lowest free page.
+
+Status DB::init_space_map()
+{
+    unsigned num_map_pages = (num_pages + bits_per_page - 1) / bits_per_page;
+
+    delete [] map_free;
+    map_free = new unsigned[num_map_pages];
+    alloc_cursor = num_pages;
+    num_extents = 0;
+
+    for ( unsigned i = 0; i < num_map_pages; ++i ) {
+        PageID pgid = 1 + i;    // The space map starts at page #1.
+        char* pg;
+        Status status = MINIBASE_BM->PinPage( pgid, (Page*&)pg );
+        if ( status != OK )
+            return MINIBASE_CHAIN_ERROR( DBMGR, status );
+
+        unsigned num_bits_this_page = bits_on_map_page( i );
+        map_free[i] = 0;
+        for ( unsigned w = 0; w*64 < num_bits_this_page; ++w ) {
+            unsigned long long word;
+            memcpy( &word, pg + w*8, sizeof word );
+            unsigned long long free_bits = ~word;
+            if ( num_bits_this_page - w*64 < 64 )
+                free_bits &= (1ULL << (num_bits_this_page - w*64)) - 1;
+            if ( free_bits == 0 )
+                continue;
+
+            map_free[i] += PopCount64( free_bits );
+            if ( alloc_cursor == (PageID) num_pages )
+                alloc_cursor = i*bits_per_page + w*64
+                               + CountTrailingZeros64( free_bits );
+        }
+
+        status = MINIBASE_BM->UnpinPage( pgid );
+        if ( status != OK )
+            return MINIBASE_CHAIN_ERROR( DBMGR, status );
     }
 
-    return MINIBASE_FIRST_ERROR( DBMGR, DB_FULL );
+    return OK;
+}
+
+// ********************************************************
+
+unsigned DB::bits_on_map_page( unsigned i ) const
+{
+    unsigned num_bits_this_page = num_pages - i*bits_per_page;
+    if ( num_bits_this_page > bits_per_page )
+        num_bits_this_page = bits_per_page;
+    return num_bits_this_page;
+}
+
+// ********************************************************
+// Add a free run to the extent cache.  Runs of a single page are not worth
+// remembering: single pages are allocated at the cursor.
+
+void DB::remember_extent( PageID start, unsigned length )
+{
+    if ( length < 2 || num_extents == MAX_CACHED_EXTENTS )
+        return;
+    for ( int e = 0; e < num_extents; ++e )
+        if ( extents[e].start == start ) {
+            if ( extents[e].length < length )
+                extents[e].length = length;
+            return;
+        }
+    extents[num_extents].start = start;
+    extents[num_extents].length = length;
+    ++num_extents;
+}
+
+// ********************************************************
+// Pages start..start+length-1 have just been allocated: cut them out of
+// every cached extent, so that the cache only ever describes free pages.
+
+void DB::clip_extents( PageID start, unsigned length )
+{
+    PageID end = start + length;
+    int e = 0;
+    while ( e < num_extents ) {
+        PageID e_start = extents[e].start;
+        PageID e_end = e_start + extents[e].length;
+        if ( e_end <= start || end <= e_start ) {
+            ++e;
+            continue;
+        }
+
+          // Replace the extent by what is left of it on either side of
+          // the allocated pages.  The pieces no longer overlap them, so
+          // they are passed over when the loop reaches them.
+        extents[e] = extents[--num_extents];
+        remember_extent( e_start, start > e_start ? start - e_start : 0 );
+        remember_extent( end, e_end > end ? e_end - end : 0 );
+    }
 }
 
 // **********************************************************
@@ -299,7 +799,8 @@ Status DB::DeallocatePage(PageID start_page_num, int run_size)
 // ***********************************************************
 // This function adds a record containing the file name and the first page
 // of the file to the directory maintained in the header pages of the 
-// database.
+// database.  The entry goes into a free slot known to the catalog, and a
+// new directory page is linked in only when there is none.
 
 Status DB::AddFileEntry(const char* fname, PageID start_page_num)
 {
@@ -308,6 +809,9 @@ Status DB::AddFileEntry(const char* fname, PageID start_page_num)
          << " : " << start_page_num << endl;
 #endif
 
+    if ( map_base != NULL )
+        return MINIBASE_FIRST_ERROR( DBMGR, READ_ONLY_DB );
+
       // Is the info kosher?
     if ( strlen(fname) >= MAX_NAME )
         return MINIBASE_FIRST_ERROR( DBMGR, FILE_NAME_TOO_LONG );
@@ -316,86 +820,73 @@ Status DB::AddFileEntry(const char* fname, PageID start_page_num)
 
 
       // Does the file already exist?
-    PageID tmp;
-    if ( GetFileEntry(fname,tmp) == OK )
+    if ( catalog_find(fname) != NULL )
         return MINIBASE_FIRST_ERROR( DBMGR, DUPLICATE_ENTRY );
 
     char    *pg = 0;
     Status   status;
     directory_page* dp = 0;
-    bool found = false;
-    unsigned free_slot = 0;
-    PageID hpid, nexthpid = 0;
+    PageID hpid;
 
-    do {
-        hpid = nexthpid;
-          // Pin the header page.
-        status = MINIBASE_BM->PinPage( hpid, (Page*&)pg );
-        if ( status != OK )
-            return MINIBASE_CHAIN_ERROR( DBMGR, status );
-
-          // This complication is because the first page has a different
-          // structure from that of subsequent pages.
-        dp = (hpid == 0)? &((first_page*)pg)->dir : (directory_page*)pg;
-        nexthpid = dp->next_page;
-
-        unsigned entry = 0;
-        while ( (entry < dp->num_entries)
-              && (dp->entries[entry].pagenum != INVALID_PAGE))
-            ++entry;
-
-        if ( entry < dp->num_entries ) {
-            free_slot = entry;
-            found = true;
-          } else if ( nexthpid != INVALID_PAGE ) {
-
-              // We only unpin if we're going to continue looping.
-            status = MINIBASE_BM->UnpinPage( hpid );
-            if ( status != OK )
-                return MINIBASE_CHAIN_ERROR( DBMGR, status );
-          }
-    } while ( nexthpid != INVALID_PAGE && !found );
-
-    
          // Have to add a new header page if possible.
-    if ( !found ) {
-        status = AllocatePage( nexthpid );
-        if ( status != OK ) {
-            MINIBASE_BM->UnpinPage( hpid );
+    if ( num_free_slots == 0 ) {
+        status = AllocatePage( hpid );
+        if ( status != OK )
             return status;
-        }
 
-          // Set the next-page pointer on the previous directory page.
-        dp->next_page = nexthpid;
-        status = MINIBASE_BM->UnpinPage( hpid , TRUE );
+          // Set the next-page pointer on the last directory page.
+        status = MINIBASE_BM->PinPage( last_dir_page, (Page*&)pg );
         if ( status != OK )
             return MINIBASE_CHAIN_ERROR( DBMGR, status );
 
+        dp = (last_dir_page == 0)? &((first_page*)pg)->dir : (directory_page*)pg;
+        dp->next_page = hpid;
+        status = MINIBASE_BM->UnpinPage( last_dir_page , TRUE );
+        if ( status != OK )
+            return MINIBASE_CHAIN_ERROR( DBMGR, status );
 
-          // Pin the newly-allocated directory page.
-        hpid = nexthpid;
+
+          // Format the newly-allocated directory page.
         status = MINIBASE_BM->PinPage( hpid, (Page*&)pg, true /*empty*/ );
         if ( status != OK )
             return MINIBASE_CHAIN_ERROR( DBMGR, status );
 
         dp = (directory_page*)pg;
         init_dir_page( dp, sizeof(directory_page) );
-        free_slot = 0;
+        for ( unsigned entry = dp->num_entries; entry > 0; --entry )
+            push_free_slot( hpid, entry - 1 );
+        last_dir_page = hpid;
+
+        status = MINIBASE_BM->UnpinPage( hpid , TRUE );
+        if ( status != OK )
+            return MINIBASE_CHAIN_ERROR( DBMGR, status );
     }
 
+    dir_slot free_slot = free_slots[--num_free_slots];
+    hpid = free_slot.hpid;
 
-      // At this point, "hpid" has the page id of the header page with the free
-      // slot; "pg" points to the pinned page; "dp" has the directory_page
-      // pointer; "free_slot" is the entry number in the directory where we're
-      // going to put the new file entry.
+      // Write the entry through to its directory page.
+    status = MINIBASE_BM->PinPage( hpid, (Page*&)pg );
+    if ( status != OK ) {
+        ++num_free_slots;
+        return MINIBASE_CHAIN_ERROR( DBMGR, status );
+    }
 
-    dp->entries[free_slot].pagenum = start_page_num;
-    strcpy( dp->entries[free_slot].fname, fname );
+    dp = (hpid == 0)? &((first_page*)pg)->dir : (directory_page*)pg;
+    dp->entries[free_slot.slot].pagenum = start_page_num;
+    strcpy( dp->entries[free_slot.slot].fname, fname );
 
     status = MINIBASE_BM->UnpinPage( hpid , TRUE );
     if ( status != OK )
         status = MINIBASE_CHAIN_ERROR( DBMGR, status );
 
+    catalog_entry* ce = new catalog_entry;
+    strcpy( ce->fname, fname );
+    ce->pagenum = start_page_num;
+    ce->hpid = hpid;
+    ce->slot = free_slot.slot;
+    catalog_insert( ce );
+
     return status;
 }
 
@@ -410,59 +901,79 @@ Status DB::DeleteFileEntry(const char* fname)
     cout << "Deleting the file entry for " << fname << endl;
 #endif
 
+    if ( map_base != NULL )
+        return MINIBASE_FIRST_ERROR( DBMGR, READ_ONLY_DB );
+
+    catalog_entry* ce = catalog_find( fname );
+    if ( ce == NULL )   // Entry not found - nothing deleted
+        return MINIBASE_FIRST_ERROR( DBMGR, FILE_NOT_FOUND );
+
     char* pg = 0;
     Status status;
     directory_page* dp = 0;
-    bool found = false;
-    unsigned slot = 0;
-    PageID hpid, nexthpid = 0;
 
-    do {
-        hpid = nexthpid;
-          // Pin the header page.
-        status = MINIBASE_BM->PinPage( hpid, (Page*&)pg );
-        if ( status != OK )
-            return MINIBASE_CHAIN_ERROR( DBMGR, status );
+    status = MINIBASE_BM->PinPage( ce->hpid, (Page*&)pg );
+    if ( status != OK )
+        return MINIBASE_CHAIN_ERROR( DBMGR, status );
 
-          // This complication is because the first page has a different
-          // structure from that of subsequent pages.
-        dp = (hpid == 0)? &((first_page*)pg)->dir : (directory_page*)pg;
-        nexthpid = dp->next_page;
+      // Have to delete record at hpnum:slot
+    dp = (ce->hpid == 0)? &((first_page*)pg)->dir : (directory_page*)pg;
+    dp->entries[ce->slot].pagenum = INVALID_PAGE;
 
-        unsigned entry = 0;
-        while ((entry < dp->num_entries)
-               && ((dp->entries[entry].pagenum == INVALID_PAGE)
-                  || (strcmp(fname,dp->entries[entry].fname) != 0)) )
-            ++entry;
-
-        if ( entry < dp->num_entries ) {
-            slot = entry;
-            found = true;
-          } else {
-            status = MINIBASE_BM->UnpinPage( hpid );
-            if ( status != OK )
-                return MINIBASE_CHAIN_ERROR( DBMGR, status );
-          }
-    } while ( nexthpid != INVALID_PAGE && !found );
+    status = MINIBASE_BM->UnpinPage( ce->hpid , TRUE );
+    if ( status != OK )
+        status = MINIBASE_CHAIN_ERROR( DBMGR, status );
+
+    push_free_slot( ce->hpid, ce->slot );
+    catalog_remove( ce );
+    delete ce;
+
+    return OK;
+}
+
+// ***************************************************************
+// This function changes the start page number recorded for the
+// specified file, in its directory slot and in the catalog.
+
+Status DB::UpdateFileEntry(const char* fname, PageID start_page_num)
+{
+#ifdef DEBUG
+    cout << "Updating the file entry for " << fname
+         << " : " << start_page_num << endl;
+#endif
 
+    if ( map_base != NULL )
+        return MINIBASE_FIRST_ERROR( DBMGR, READ_ONLY_DB );
+    if ((start_page_num < 0) || (start_page_num >= (int) num_pages) )
+        return MINIBASE_FIRST_ERROR( DBMGR, BAD_PAGE_NO );
 
-    if ( !found )   // Entry not found - nothing deleted
+    catalog_entry* ce = catalog_find( fname );
+    if ( ce == NULL )
         return MINIBASE_FIRST_ERROR( DBMGR, FILE_NOT_FOUND );
 
+    char* pg = 0;
+    Status status;
+    directory_page* dp = 0;
 
-      // Have to delete record at hpnum:slot
-    dp->entries[slot].pagenum = INVALID_PAGE;
+    status = MINIBASE_BM->PinPage( ce->hpid, (Page*&)pg );
+    if ( status != OK )
+        return MINIBASE_CHAIN_ERROR( DBMGR, status );
 
-    status = MINIBASE_BM->UnpinPage( hpid , TRUE );
+    dp = (ce->hpid == 0)? &((first_page*)pg)->dir : (directory_page*)pg;
+    dp->entries[ce->slot].pagenum = start_page_num;
+
+    status = MINIBASE_BM->UnpinPage( ce->hpid , TRUE );
     if ( status != OK )
-        status = MINIBASE_CHAIN_ERROR( DBMGR, status );
+        return MINIBASE_CHAIN_ERROR( DBMGR, status );
 
+    ce->pagenum = start_page_num;
     return OK;
 }
 
 // ***************************************************************
 // This function gets the start page number for the specified file.
-// This is done by looking up the directory stored in the header pages.
+// This is done by looking up the catalog, without touching the header
+// pages.
 
 Status DB::GetFileEntry(const char* fname, PageID& start_page)
 {
@@ -470,13 +981,30 @@ Status DB::GetFileEntry(const char* fname, PageID& start_page)
     cout << "Getting the file entry for " << fname << endl;
 #endif
 
+    catalog_entry* ce = catalog_find( fname );
+    if ( ce == NULL )   // Entry not found - don't post error, just fail.
+        return FAIL;
+
+    start_page = ce->pagenum;
+    return OK;
+}
+
+// ***************************************************************
+// Read the whole directory into the catalog.  This is the only time the
+// chain of directory pages is walked.
+
+Status DB::load_catalog()
+{
     char* pg = 0;
     Status status;
     directory_page* dp = 0;
-    bool found = false;
-    unsigned slot = 0;
     PageID hpid, nexthpid = 0;
 
+    free_catalog();
+    catalog_size = 64;
+    catalog = new catalog_entry*[catalog_size];
+    memset( catalog, 0, catalog_size * sizeof(catalog_entry*) );
+
     do {
         hpid = nexthpid;
           // Pin the header page.
@@ -489,31 +1017,146 @@ Status DB::GetFileEntry(const char* fname, PageID& start_page)
         dp = (hpid == 0)? &((first_page*)pg)->dir : (directory_page*)pg;
         nexthpid = dp->next_page;
 
-        unsigned entry = 0;
-        while ((entry < dp->num_entries)
-              && ((dp->entries[entry].pagenum == INVALID_PAGE)
-                 || (strcmp(fname,dp->entries[entry].fname) != 0)) )
-            ++entry;
+        for ( unsigned entry = 0; entry < dp->num_entries; ++entry ) {
+            file_entry* fe = &dp->entries[entry];
+            if ( fe->pagenum == INVALID_PAGE ) {
+                push_free_slot( hpid, entry );
+                continue;
+            }
 
-        if ( entry < dp->num_entries ) {
-            slot = entry;
-            found = true;
+            catalog_entry* ce = new catalog_entry;
+            strcpy( ce->fname, fe->fname );
+            ce->pagenum = fe->pagenum;
+            ce->hpid = hpid;
+            ce->slot = entry;
+            catalog_insert( ce );
         }
 
         status = MINIBASE_BM->UnpinPage( hpid );
         if ( status != OK )
             return MINIBASE_CHAIN_ERROR( DBMGR, status );
 
-    } while ((nexthpid != INVALID_PAGE) && !found );
+    } while ( nexthpid != INVALID_PAGE );
 
+    last_dir_page = hpid;
 
-    if ( !found )   // Entry not found - don't post error, just fail.
-        return FAIL;
-
-    start_page = dp->entries[slot].pagenum;
+      // Reverse the stack of free slots, so that the first free slot in
+      // the directory is the one used first.
+    for ( unsigned i = 0, j = num_free_slots; i + 1 < j; ++i, --j ) {
+        dir_slot tmp = free_slots[i];
+        free_slots[i] = free_slots[j - 1];
+        free_slots[j - 1] = tmp;
+    }
     return OK;
 }
 
+// ***************************************************************
+// FNV-1a hash of a file name.
+
+static unsigned hash_name( const char* fname )
+{
+    unsigned h = 2166136261u;
+    for ( ; *fname; ++fname )
+        h = (h ^ (unsigned char)*fname) * 16777619u;
+    return h;
+}
+
+// ***************************************************************
+
+DB::catalog_entry* DB::catalog_find( const char* fname ) const
+{
+    if ( catalog == NULL )
+        return NULL;
+
+    catalog_entry* ce = catalog[hash_name(fname) & (catalog_size - 1)];
+    while ( ce != NULL && strcmp(ce->fname, fname) != 0 )
+        ce = ce->next;
+    return ce;
+}
+
+// ***************************************************************
+// Add an entry to the catalog, doubling the number of buckets when the
+// chains get longer than one entry on average.
+
+void DB::catalog_insert( catalog_entry* ce )
+{
+    if ( catalog_count >= catalog_size ) {
+        unsigned new_size = catalog_size * 2;
+        catalog_entry** new_catalog = new catalog_entry*[new_size];
+        memset( new_catalog, 0, new_size * sizeof(catalog_entry*) );
+
+        for ( unsigned b = 0; b < catalog_size; ++b )
+            while ( catalog[b] != NULL ) {
+                catalog_entry* moved = catalog[b];
+                catalog[b] = moved->next;
+                unsigned nb = hash_name(moved->fname) & (new_size - 1);
+                moved->next = new_catalog[nb];
+                new_catalog[nb] = moved;
+            }
+
+        delete [] catalog;
+        catalog = new_catalog;
+        catalog_size = new_size;
+    }
+
+    unsigned b = hash_name(ce->fname) & (catalog_size - 1);
+    ce->next = catalog[b];
+    catalog[b] = ce;
+    ++catalog_count;
+}
+
+// ***************************************************************
+
+void DB::catalog_remove( catalog_entry* ce )
+{
+    catalog_entry** link = &catalog[hash_name(ce->fname) & (catalog_size - 1)];
+    while ( *link != ce )
+        link = &(*link)->next;
+    *link = ce->next;
+    --catalog_count;
+}
+
+// ***************************************************************
+
+void DB::push_free_slot( PageID hpid, unsigned slot )
+{
+    if ( num_free_slots == free_slots_size ) {
+        unsigned new_size = free_slots_size ? 2 * free_slots_size : 64;
+        dir_slot* new_slots = new dir_slot[new_size];
+        if ( num_free_slots > 0 )
+            memcpy( new_slots, free_slots, num_free_slots * sizeof(dir_slot) );
+        delete [] free_slots;
+        free_slots = new_slots;
+        free_slots_size = new_size;
+    }
+    free_slots[num_free_slots].hpid = hpid;
+    free_slots[num_free_slots].slot = slot;
+    ++num_free_slots;
+}
+
+// ***************************************************************
+
+void DB::free_catalog()
+{
+    if ( catalog != NULL ) {
+        for ( unsigned b = 0; b < catalog_size; ++b )
+            while ( catalog[b] != NULL ) {
+                catalog_entry* ce = catalog[b];
+                catalog[b] = ce->next;
+                delete ce;
+            }
+        delete [] catalog;
+    }
+    catalog = NULL;
+    catalog_size = 0;
+    catalog_count = 0;
+
+    delete [] free_slots;
+    free_slots = NULL;
+    num_free_slots = 0;
+    free_slots_size = 0;
+}
+
 // **************************************************************
 // This function reads the contents of the page into the specified
 // memory area.
@@ -530,6 +1173,15 @@ Status DB::ReadPage(PageID pageno, Page* pageptr)
     if ((pageno < 0) || (pageno >= (int) num_pages))
         return FAIL;
 
+    // A mapped database is read straight out of the mapping.
+    if ( map_base != NULL ) {
+        Page* mapped = GetMappedPage( pageno );
+        if ( mapped == NULL )
+            return FAIL;
+        memcpy( (char *)pageptr, (char *)mapped, MINIBASE_PAGESIZE );
+        return OK;
+    }
+
     // Seek to the correct page
     if (::lseek( fd, (long)pageno*MINIBASE_PAGESIZE, SEEK_SET ) < 0 )
         return FAIL;
@@ -556,6 +1208,9 @@ Status DB::WritePage(PageID pageno, Page* pageptr)
         return MINIBASE_FIRST_ERROR( DBMGR, BAD_PAGE_NO );
     }
 
+    if ( map_base != NULL )
+        return MINIBASE_FIRST_ERROR( DBMGR, READ_ONLY_DB );
+
       // Seek to the correct page
     if (::lseek( fd, (long)pageno*MINIBASE_PAGESIZE, SEEK_SET ) < 0 )
         return MINIBASE_FIRST_ERROR( DBMGR, UNIX_ERROR );
@@ -577,11 +1232,16 @@ Status DB::set_bits( PageID start_page, unsigned run_size, int bit )
     if ((start_page < 0) || (start_page+run_size > num_pages))
         return MINIBASE_FIRST_ERROR( DBMGR, BAD_PAGE_NO );
 
+    if ( map_base != NULL )
+        return MINIBASE_FIRST_ERROR( DBMGR, READ_ONLY_DB );
+
 #ifdef DEBUG
     printf("set_bits:: space_map_before \n");
     dump_space_map();
 #endif
 
+    unsigned total_run = run_size;
+
       // Locate the run within the space map.
     int first_map_page = start_page / bits_per_page + 1;
     int last_map_page = (start_page+run_size-1) / bits_per_page + 1;
@@ -614,19 +1274,27 @@ Status DB::set_bits( PageID start_page, unsigned run_size, int bit )
         char* p   = pg + first_byte_no;
         char* end = pg + last_byte_no;
 
-          // This loop actually flips the bits on the current page.
+          // This loop actually flips the bits on the current page,
+          // counting the ones that change for the page's free count.
+        unsigned flipped = 0;
         for ( ; p <= end; ++p, first_bit_offset=0 ) {
 
             unsigned max_bits_this_byte = 8 - first_bit_offset;
             unsigned num_bits_this_byte = (run_size > max_bits_this_byte?
                                            max_bits_this_byte : run_size);
             unsigned mask = ((1 << num_bits_this_byte) - 1) << first_bit_offset;
+            unsigned char before = *p;
             if ( bit ) 
                 *p |= mask;
             else
                 *p &= ~mask;
+            flipped += PopCount64( (unsigned char)(before ^ *p) );
             run_size -= num_bits_this_byte;
         }
+        if ( bit )
+            map_free[pgid-1] -= flipped;
+        else
+            map_free[pgid-1] += flipped;
 
           // Unpin the space-map page.
         status = MINIBASE_BM->UnpinPage(pgid, TRUE);
@@ -640,6 +1308,14 @@ Status DB::set_bits( PageID start_page, unsigned run_size, int bit )
     dump_space_map();
 #endif
 
+    if ( bit )
+        clip_extents( start_page, total_run );
+    else {
+        if ( start_page < alloc_cursor )
+            alloc_cursor = start_page;
+        remember_extent( start_page, total_run );
+    }
+
     return OK;
 }
 
@@ -649,8 +1325,8 @@ Status DB::set_bits( PageID start_page, unsigned run_size, int bit )
 void DB::init_dir_page( directory_page* dp, unsigned used_bytes )
 {
     dp->next_page = INVALID_PAGE;
-    dp->num_entries = (MAX_SPACE - used_bytes) / sizeof(file_entry);
-	dp->entries = (file_entry *)malloc(sizeof(file_entry)*dp->num_entries);
+      // used_bytes already counts the first entry.
+    dp->num_entries = (MINIBASE_PAGESIZE - used_bytes) / sizeof(file_entry) + 1;
 
     for ( unsigned index=0; index < dp->num_entries; ++index )
         dp->entries[index].pagenum = INVALID_PAGE;
@@ -19,8 +19,8 @@ void HeapPage::Init(PageID pageNo)
 	prevPage = INVALID_PAGE;
 	nextPage = INVALID_PAGE;
 	this->pid = pageNo;
-	fillPtr = sizeof(data);
-	freeSpace = sizeof(data);
+	fillPtr = HEAPPAGE_DATA_SIZE;
+	freeSpace = HEAPPAGE_DATA_SIZE;
 	numOfSlots = 0;
 	SLOT_SET_EMPTY(slots[0]);
 }
@@ -60,7 +60,7 @@ Status HeapPage::InsertRecord(char *recPtr, int length, RecordID& rid)
 {
 	// check if there is enough space.
 
-	short spaceNeeded;
+	int spaceNeeded;
 	spaceNeeded = length + sizeof(Slot);
 
    	if (spaceNeeded > freeSpace)
@@ -120,7 +120,7 @@ Status HeapPage::InsertRecord(char *recPtr, int length, RecordID& rid)
 
 Status HeapPage::DeleteRecord(const RecordID& rid)
 {
-	short offset, len;
+	int offset, len;
 
 	// Check validity of rid
 